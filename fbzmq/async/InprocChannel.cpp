@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/InprocChannel.h>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace fbzmq {
+namespace detail {
+
+InprocChannelSignal::InprocChannelSignal() {
+  if ((fd_ = eventfd(0 /* init-value */, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+    LOG(FATAL) << "InprocChannel: Failed to create an eventfd.";
+  }
+}
+
+InprocChannelSignal::~InprocChannelSignal() {
+  close(fd_);
+}
+
+void
+InprocChannelSignal::signal() noexcept {
+  if (signaled_.exchange(true)) {
+    return;
+  }
+  uint64_t buf{1};
+  auto bytesWritten = write(fd_, static_cast<void*>(&buf), sizeof(buf));
+  CHECK_EQ(sizeof(buf), bytesWritten);
+}
+
+void
+InprocChannelSignal::clear() noexcept {
+  uint64_t buf;
+  auto bytesRead = read(fd_, static_cast<void*>(&buf), sizeof(buf));
+  // nothing to read is fine, wakeup may have been consumed already
+  if (bytesRead < 0) {
+    CHECK_EQ(EAGAIN, errno) << "InprocChannel: Failed to read eventfd.";
+  }
+  // writes made from now on signal again, ones made before are drained next
+  signaled_.store(false);
+}
+
+} // namespace detail
+} // namespace fbzmq
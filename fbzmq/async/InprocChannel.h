@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <boost/noncopyable.hpp>
+#include <folly/Function.h>
+#include <folly/ProducerConsumerQueue.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+
+namespace fbzmq {
+
+namespace detail {
+
+/**
+ * Wakeup of InprocChannel's reader, not expected to be used directly. Writer
+ * signals eventfd only when reader isn't signaled already, so bursts of
+ * writes cost a single syscall.
+ */
+class InprocChannelSignal : public boost::noncopyable {
+ public:
+  InprocChannelSignal();
+  ~InprocChannelSignal();
+
+  // wake up reader unless it is already
+  void signal() noexcept;
+
+  // consume wakeup, must be called before draining the channel
+  void clear() noexcept;
+
+  int
+  getFd() const {
+    return fd_;
+  }
+
+ private:
+  int fd_{-1};
+  std::atomic<bool> signaled_{false};
+};
+
+} // namespace detail
+
+/**
+ * Single producer single consumer channel moving ownership of objects from
+ * any thread (usually another event loop) to a ZmqEventLoop, without
+ * serializing them as with Message::fromThriftObj over inproc sockets.
+ * Objects are passed through a lock-free ring of `capacity` pointers, and
+ * reader's loop is woken up via an eventfd registered with the loop, so
+ * reader keeps the poll-driven programming model of sockets, e.g.
+ *
+ *  InprocChannel<thrift::Request> channel(1024);
+ *  channel.attachReader(&evl, [](std::unique_ptr<thrift::Request> req) {
+ *    ...
+ *  });
+ *
+ *  // in writer's thread
+ *  auto req = std::make_unique<thrift::Request>();
+ *  if (not channel.write(std::move(req))) {
+ *    // channel is full, req is still owned by writer
+ *  }
+ *
+ * Exactly one thread may write and one loop may read at a time.
+ */
+template <typename T>
+class InprocChannel : public boost::noncopyable {
+ public:
+  using ReadCallback = folly::Function<void(std::unique_ptr<T>) noexcept>;
+
+  explicit InprocChannel(size_t capacity)
+      // one slot of ProducerConsumerQueue is always kept empty
+      : queue_(capacity + 1) {}
+
+  ~InprocChannel() {
+    detachReader();
+  }
+
+  /**
+   * Move object into channel. False if channel is full, object is left with
+   * the caller then.
+   */
+  bool
+  write(std::unique_ptr<T>&& obj) {
+    if (not queue_.write(std::move(obj))) {
+      return false;
+    }
+    signal_.signal();
+    return true;
+  }
+
+  /**
+   * Take next object, null if channel is empty. For readers polling the
+   * channel themselves instead of being attached to a loop.
+   */
+  std::unique_ptr<T>
+  read() {
+    std::unique_ptr<T> obj;
+    queue_.read(obj);
+    return obj;
+  }
+
+  /**
+   * Invoke `callback` in loop's thread with every object written, up to
+   * `maxReadsPerWakeup` at a time to not starve other events of the loop.
+   * Must be called from loop's thread (or before loop runs), and so must
+   * `detachReader`.
+   */
+  void
+  attachReader(
+      ZmqEventLoop* evl, ReadCallback callback, size_t maxReadsPerWakeup = 64) {
+    CHECK(!evl_) << "InprocChannel already has a reader";
+    CHECK_LT(0, maxReadsPerWakeup);
+    evl_ = evl;
+    callback_ = std::move(callback);
+    evl_->addSocketFd(
+        signal_.getFd(), ZMQ_POLLIN, [this, maxReadsPerWakeup](int) noexcept {
+          signal_.clear();
+          std::unique_ptr<T> obj;
+          for (size_t i = 0; i < maxReadsPerWakeup; ++i) {
+            if (not queue_.read(obj)) {
+              return;
+            }
+            callback_(std::move(obj));
+            if (not evl_) {
+              // detached by callback
+              return;
+            }
+          }
+          // more to read, come back after other events of the loop
+          if (not queue_.isEmpty()) {
+            signal_.signal();
+          }
+        });
+  }
+
+  void
+  detachReader() {
+    if (not evl_) {
+      return;
+    }
+    evl_->removeSocketFd(signal_.getFd());
+    evl_ = nullptr;
+  }
+
+  /**
+   * Approximate number of objects in channel, can be called from any thread
+   */
+  size_t
+  size() const {
+    return queue_.sizeGuess();
+  }
+
+ private:
+  folly::ProducerConsumerQueue<std::unique_ptr<T>> queue_;
+
+  detail::InprocChannelSignal signal_;
+
+  // reader's loop and callback, if attached
+  ZmqEventLoop* evl_{nullptr};
+  ReadCallback callback_;
+};
+
+} // namespace fbzmq
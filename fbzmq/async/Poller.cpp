@@ -0,0 +1,352 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/Poller.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Upper bound on number of epoll events we read in a single wait
+const size_t kMaxEpollEvents = 1024;
+
+uint32_t
+toEpollEvents(short events) {
+  uint32_t epollEvents = 0;
+  if (events & ZMQ_POLLIN) {
+    epollEvents |= EPOLLIN;
+  }
+  if (events & ZMQ_POLLOUT) {
+    epollEvents |= EPOLLOUT;
+  }
+  return epollEvents;
+}
+
+short
+fromEpollEvents(uint32_t epollEvents) {
+  short events = 0;
+  if (epollEvents & (EPOLLIN | EPOLLPRI)) {
+    events |= ZMQ_POLLIN;
+  }
+  if (epollEvents & EPOLLOUT) {
+    events |= ZMQ_POLLOUT;
+  }
+  // Same as zmq_poll, report anything else as an error
+  if (epollEvents & ~(EPOLLIN | EPOLLPRI | EPOLLOUT)) {
+    events |= ZMQ_POLLERR;
+  }
+  return events;
+}
+
+} // namespace
+
+std::unique_ptr<Poller>
+Poller::create(PollerType type) {
+  switch (type) {
+  case PollerType::ZMQ_POLL:
+    return std::make_unique<ZmqPollPoller>();
+  case PollerType::EPOLL:
+    return std::make_unique<EpollPoller>();
+  default:
+    LOG(FATAL) << "Unknown poller type " << static_cast<int>(type);
+  }
+  return nullptr;
+}
+
+//
+// ZmqPollPoller
+//
+
+void
+ZmqPollPoller::add(std::shared_ptr<PollSubscription> subscription) {
+  CHECK(!indices_.count(subscription.get()));
+  indices_.emplace(subscription.get(), pollItems_.size());
+  pollItems_.push_back(
+      {subscription->socket, subscription->fd, subscription->events, 0});
+  pollSubscriptions_.push_back(std::move(subscription));
+}
+
+void
+ZmqPollPoller::remove(std::shared_ptr<PollSubscription> const& subscription) {
+  auto it = indices_.find(subscription.get());
+  if (it == indices_.end()) {
+    return;
+  }
+
+  // Swap with the last item and pop
+  const auto index = it->second;
+  indices_.erase(it);
+  if (index != pollItems_.size() - 1) {
+    pollItems_[index] = pollItems_.back();
+    pollSubscriptions_[index] = std::move(pollSubscriptions_.back());
+    indices_[pollSubscriptions_[index].get()] = index;
+  }
+  pollItems_.pop_back();
+  pollSubscriptions_.pop_back();
+}
+
+void
+ZmqPollPoller::update(
+    std::shared_ptr<PollSubscription> const& subscription, short events) {
+  auto it = indices_.find(subscription.get());
+  if (it == indices_.end()) {
+    return;
+  }
+  subscription->events = events;
+  pollItems_[it->second].events = events;
+}
+
+folly::Expected<int, Error>
+ZmqPollPoller::wait(
+    std::chrono::milliseconds timeout, std::vector<PollEvent>& events) {
+  folly::Optional<std::chrono::milliseconds> pollTimeout;
+  if (timeout.count() >= 0) {
+    pollTimeout = timeout;
+  }
+  auto ret = fbzmq::poll(pollItems_, pollTimeout);
+  if (ret.hasError()) {
+    return ret;
+  }
+
+  int count = ret.value();
+  int numEvents = 0;
+  for (size_t i = 0; i < pollItems_.size() && count > 0; ++i) {
+    auto& item = pollItems_[i];
+    auto& subscription = pollSubscriptions_[i];
+    if (item.revents) {
+      --count;
+    }
+    if (item.revents & subscription->events) {
+      events.emplace_back(subscription, item.revents & subscription->events);
+      ++numEvents;
+    }
+  }
+  return numEvents;
+}
+
+//
+// EpollPoller
+//
+
+EpollPoller::EpollPoller() {
+  if ((epollFd_ = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    LOG(FATAL) << "EpollPoller: Failed to create an epoll fd. "
+               << folly::errnoStr(errno);
+  }
+}
+
+EpollPoller::~EpollPoller() {
+  close(epollFd_);
+}
+
+void
+EpollPoller::add(std::shared_ptr<PollSubscription> subscription) {
+  CHECK(!fds_.count(subscription.get()));
+
+  // Figure out fd and epoll events to register
+  int fd = subscription->fd;
+  uint32_t epollEvents = toEpollEvents(subscription->events);
+  if (subscription->socket) {
+    size_t fdLen = sizeof(fd);
+    if (zmq_getsockopt(subscription->socket, ZMQ_FD, &fd, &fdLen) != 0) {
+      throw std::runtime_error(folly::sformat(
+          "Failed to get ZMQ_FD of socket. {}", Error(zmq_errno()).errString));
+    }
+    // ZMQ_FD only signals readability when socket state changes
+    epollEvents = EPOLLIN | EPOLLET;
+  }
+
+  if (registrations_.count(fd)) {
+    throw std::runtime_error(
+        folly::sformat("fd {} is already registered with poller.", fd));
+  }
+
+  struct epoll_event event;
+  event.events = epollEvents;
+  event.data.fd = fd;
+  if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+    throw std::runtime_error(folly::sformat(
+        "Failed to add fd {} to epoll. {}", fd, folly::errnoStr(errno)));
+  }
+
+  const bool isSocket = subscription->socket != nullptr;
+  fds_.emplace(subscription.get(), fd);
+  auto& registration = registrations_[fd];
+  registration.subscription = std::move(subscription);
+
+  // Socket may already be readable/writable, in which case no edge will ever
+  // be delivered on ZMQ_FD. Evaluate it on next wait.
+  if (isSocket) {
+    markPending(fd, registration);
+  }
+}
+
+void
+EpollPoller::remove(std::shared_ptr<PollSubscription> const& subscription) {
+  auto it = fds_.find(subscription.get());
+  if (it == fds_.end()) {
+    return;
+  }
+
+  // Drop pending list entry as well, a new registration of the same fd
+  // would otherwise be evaluated (and reported) twice on next wait
+  const int fd = it->second;
+  fds_.erase(it);
+  auto regIt = registrations_.find(fd);
+  if (regIt != registrations_.end()) {
+    if (regIt->second.pending) {
+      pending_.erase(std::find(pending_.begin(), pending_.end(), fd));
+    }
+    registrations_.erase(regIt);
+  }
+
+  // Underlying fd could have been closed already (e.g. socket closed before
+  // removal), in which case kernel has already dropped it from epoll set.
+  epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void
+EpollPoller::update(
+    std::shared_ptr<PollSubscription> const& subscription, short events) {
+  auto it = fds_.find(subscription.get());
+  if (it == fds_.end()) {
+    return;
+  }
+  const int fd = it->second;
+
+  if (subscription->socket) {
+    // ZMQ_FD registration stays as is, newly subscribed events could be
+    // pending already without any further edge on ZMQ_FD
+    subscription->events = events;
+    markPending(fd, registrations_.at(fd));
+    return;
+  }
+
+  struct epoll_event event;
+  event.events = toEpollEvents(events);
+  event.data.fd = fd;
+  if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &event) != 0) {
+    throw std::runtime_error(folly::sformat(
+        "Failed to modify fd {} in epoll. {}", fd, folly::errnoStr(errno)));
+  }
+  subscription->events = events;
+}
+
+void
+EpollPoller::recheck(std::shared_ptr<PollSubscription> const& subscription) {
+  if (!subscription->socket) {
+    // raw fds are level triggered
+    return;
+  }
+
+  auto it = fds_.find(subscription.get());
+  if (it == fds_.end()) {
+    return;
+  }
+  markPending(it->second, registrations_.at(it->second));
+}
+
+void
+EpollPoller::markPending(int fd, Registration& registration) {
+  if (registration.pending) {
+    return;
+  }
+  registration.pending = true;
+  pending_.push_back(fd);
+}
+
+folly::Expected<int, Error>
+EpollPoller::wait(
+    std::chrono::milliseconds timeout, std::vector<PollEvent>& events) {
+  // Do not block if some sockets are waiting for evaluation
+  const int timeoutMs = pending_.empty() ? timeout.count() : 0;
+  epollEvents_.resize(
+      std::max<size_t>(1, std::min(kMaxEpollEvents, registrations_.size())));
+
+  int count;
+  while (true) {
+    count = epoll_wait(
+        epollFd_, epollEvents_.data(), epollEvents_.size(), timeoutMs);
+    if (count >= 0) {
+      break;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    return folly::makeUnexpected(Error(errno));
+  }
+
+  int numEvents = 0;
+  for (int i = 0; i < count; ++i) {
+    const int fd = epollEvents_[i].data.fd;
+    auto it = registrations_.find(fd);
+    if (it == registrations_.end()) {
+      continue;
+    }
+
+    auto& registration = it->second;
+    auto& subscription = registration.subscription;
+    if (subscription->socket) {
+      markPending(fd, registration);
+      continue;
+    }
+
+    auto revents =
+        fromEpollEvents(epollEvents_[i].events) & subscription->events;
+    if (revents) {
+      events.emplace_back(subscription, revents);
+      ++numEvents;
+    }
+  }
+
+  // Evaluate readiness of zmq sockets. Ready sockets stay pending so that
+  // they are re-evaluated after their callbacks have been invoked.
+  nextPending_.clear();
+  std::swap(pending_, nextPending_);
+  for (auto fd : nextPending_) {
+    auto it = registrations_.find(fd);
+    if (it == registrations_.end()) {
+      continue;
+    }
+
+    auto& registration = it->second;
+    auto& subscription = registration.subscription;
+    registration.pending = false;
+
+    int zmqEvents = 0;
+    size_t zmqEventsLen = sizeof(zmqEvents);
+    if (zmq_getsockopt(
+            subscription->socket, ZMQ_EVENTS, &zmqEvents, &zmqEventsLen) != 0) {
+      // Socket is most likely closed. Let it be until it is removed.
+      VLOG(2) << "EpollPoller: Failed to get ZMQ_EVENTS. "
+              << Error(zmq_errno()).errString;
+      continue;
+    }
+
+    auto revents = static_cast<short>(zmqEvents & subscription->events);
+    if (revents) {
+      events.emplace_back(subscription, revents);
+      markPending(fd, registration);
+      ++numEvents;
+    }
+  }
+  nextPending_.clear();
+
+  return numEvents;
+}
+
+} // namespace fbzmq
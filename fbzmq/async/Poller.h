@@ -0,0 +1,243 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Expected.h>
+#include <folly/Function.h>
+#include <sys/epoll.h>
+#include <zmq.h>
+
+#include <fbzmq/zmq/Common.h>
+
+namespace fbzmq {
+
+namespace detail {
+// Callback latency stat of instrumented ZmqEventLoop
+class LatencyStat;
+} // namespace detail
+
+using SocketCallback = folly::Function<void(int revents) noexcept>;
+
+/**
+ * Polling backends supported by ZmqEventLoop.
+ *
+ * ZMQ_POLL - Uses `zmq_poll` over an array of all subscriptions. Each wakeup
+ *            costs O(N) in number of registered sockets/fds.
+ * EPOLL    - Registers raw fds and `ZMQ_FD` of zmq sockets with epoll. Only
+ *            ready subscriptions are reported. Cost of wakeup is proportional
+ *            to number of active sockets.
+ */
+enum class PollerType {
+  ZMQ_POLL = 1,
+  EPOLL = 2,
+};
+
+/**
+ * Dispatch order of subscriptions within a loop iteration, look at
+ * `ZmqEventLoop::setSocketPriority`
+ */
+enum class SocketPriority {
+  HIGH = 0,
+  NORMAL = 1,
+  LOW = 2,
+};
+
+/**
+ * Utility struct to store information about poll-item and its callback for
+ * all added sockets/fds
+ */
+struct PollSubscription {
+  PollSubscription(
+      void* socket, int fd, short events, SocketCallback&& callback)
+      : socket(socket), fd(fd), events(events), callback(std::move(callback)) {}
+
+  // zmq socket pointer. nullptr if subscription is for raw fd
+  void* socket{nullptr};
+
+  // raw fd. only valid if socket is nullptr
+  int fd{-1};
+
+  // bitmap of subscribed events
+  short events{0};
+
+  // callback which needs to be invoked on event.
+  SocketCallback callback{nullptr};
+
+  // Set to false once subscription is removed. Helps in avoiding callbacks
+  // for subscriptions removed while processing events of the same iteration
+  bool active{true};
+
+  // Name of subscription in stats of instrumented loop, unnamed ones share
+  // a single stat
+  std::string name{};
+
+  // Stat recording callback durations, resolved once while loop is
+  // instrumented and owned by loop's instrumentation
+  detail::LatencyStat* callbackStat{nullptr};
+
+  // Dispatch order within an iteration and number of times callback is
+  // invoked per iteration while zmq socket stays ready
+  SocketPriority priority{SocketPriority::NORMAL};
+  size_t maxDispatches{1};
+};
+
+/**
+ * Event reported by Poller
+ */
+struct PollEvent {
+  PollEvent(std::shared_ptr<PollSubscription> subscription, short revents)
+      : subscription(std::move(subscription)), revents(revents) {}
+
+  std::shared_ptr<PollSubscription> subscription{nullptr};
+
+  // bitmap of received events (always subset of subscribed events)
+  short revents{0};
+};
+
+/**
+ * Interface for polling backends used by ZmqEventLoop. Registrations are
+ * updated incrementally. Not thread safe, must be accessed from within the
+ * event loop thread only.
+ */
+class Poller {
+ public:
+  virtual ~Poller() = default;
+
+  /**
+   * Create poller of specified type
+   */
+  static std::unique_ptr<Poller> create(PollerType type);
+
+  /**
+   * Add/Remove subscription. Throws std::runtime_error if subscription can't
+   * be registered with underlying polling mechanism.
+   */
+  virtual void add(std::shared_ptr<PollSubscription> subscription) = 0;
+  virtual void remove(
+      std::shared_ptr<PollSubscription> const& subscription) = 0;
+
+  /**
+   * Change subscribed events of a registered subscription in place, keeping
+   * its callback. Throws std::runtime_error if change can't be applied to
+   * underlying polling mechanism.
+   */
+  virtual void update(
+      std::shared_ptr<PollSubscription> const& subscription, short events) = 0;
+
+  /**
+   * Re-evaluate readiness of a zmq socket subscription on next wait. Only
+   * meaningful for edge triggered backends.
+   */
+  virtual void
+  recheck(std::shared_ptr<PollSubscription> const& /* subscription */) {}
+
+  /**
+   * Wait for events on registered subscriptions for at most `timeout`
+   * duration (negative value means infinite). Ready subscriptions are
+   * appended to `events` vector.
+   *
+   * @returns: number of ready subscriptions
+   */
+  virtual folly::Expected<int, Error> wait(
+      std::chrono::milliseconds timeout, std::vector<PollEvent>& events) = 0;
+};
+
+/**
+ * zmq_poll based backend. Maintains the poll-items array incrementally, an
+ * add is O(1) append and removal is O(1) swap with last item.
+ */
+class ZmqPollPoller final : public Poller {
+ public:
+  void add(std::shared_ptr<PollSubscription> subscription) override;
+  void remove(std::shared_ptr<PollSubscription> const& subscription) override;
+  void update(
+      std::shared_ptr<PollSubscription> const& subscription,
+      short events) override;
+  folly::Expected<int, Error> wait(
+      std::chrono::milliseconds timeout,
+      std::vector<PollEvent>& events) override;
+
+ private:
+  std::vector<zmq_pollitem_t> pollItems_{};
+  std::vector<std::shared_ptr<PollSubscription>> pollSubscriptions_{};
+
+  // Index of subscription in pollItems_ & pollSubscriptions_
+  std::unordered_map<PollSubscription const*, size_t> indices_{};
+};
+
+/**
+ * epoll based backend.
+ *
+ * Raw fds are registered in level triggered mode. For zmq sockets, `ZMQ_FD`
+ * is registered which is edge triggered and only signals that socket state
+ * might have changed. Actual readiness is read via `ZMQ_EVENTS`. A zmq socket
+ * stays in pending list (and next wait will not block) as long as it is
+ * reported ready, this makes sure that callbacks which do not drain the
+ * socket completely will be invoked again.
+ *
+ * NOTE: Any send/recv on a zmq socket can consume the edge on `ZMQ_FD`. If
+ * you operate on a registered socket outside of its own callback, you must
+ * call `recheck` for it.
+ */
+class EpollPoller final : public Poller {
+ public:
+  EpollPoller();
+  ~EpollPoller() override;
+
+  EpollPoller(EpollPoller const&) = delete;
+  EpollPoller& operator=(EpollPoller const&) = delete;
+
+  void add(std::shared_ptr<PollSubscription> subscription) override;
+  void remove(std::shared_ptr<PollSubscription> const& subscription) override;
+  void update(
+      std::shared_ptr<PollSubscription> const& subscription,
+      short events) override;
+  void recheck(std::shared_ptr<PollSubscription> const& subscription) override;
+  folly::Expected<int, Error> wait(
+      std::chrono::milliseconds timeout,
+      std::vector<PollEvent>& events) override;
+
+ private:
+  struct Registration {
+    std::shared_ptr<PollSubscription> subscription{nullptr};
+
+    // Is this in pending list for ZMQ_EVENTS check
+    bool pending{false};
+  };
+
+  /**
+   * Add registered fd of zmq socket into pending list
+   */
+  void markPending(int fd, Registration& registration);
+
+  // epoll file descriptor
+  int epollFd_{-1};
+
+  // registered fd (raw fd or ZMQ_FD) => registration
+  std::unordered_map<int, Registration> registrations_{};
+
+  // subscription => registered fd
+  std::unordered_map<PollSubscription const*, int> fds_{};
+
+  // fds of zmq sockets which needs ZMQ_EVENTS evaluation on next wait
+  std::vector<int> pending_{};
+  std::vector<int> nextPending_{};
+
+  // buffer for receiving epoll events
+  std::vector<struct epoll_event> epollEvents_{};
+};
+
+} // namespace fbzmq
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/TimeoutHeap.h>
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Generation is kept within 30 bits so that ids are always non-negative and
+// leave room for flags used by ZmqEventLoop
+const uint32_t kGenerationMask = 0x3fffffff;
+
+int64_t
+makeTimeoutId(uint32_t slot, uint32_t generation) {
+  return (static_cast<int64_t>(generation) << 32) | slot;
+}
+
+} // namespace
+
+constexpr size_t TimeoutHeap::kArity;
+
+int64_t
+TimeoutHeap::push(
+    std::chrono::steady_clock::time_point scheduledTime,
+    TimeoutCallback callback) {
+  uint32_t slot;
+  if (!freeSlots_.empty()) {
+    slot = freeSlots_.back();
+    freeSlots_.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(slots_.size());
+    slots_.emplace_back();
+  }
+
+  auto& entry = slots_[slot];
+  entry.callback = std::move(callback);
+  entry.inUse = true;
+
+  heap_.emplace_back();
+  place(heap_.size() - 1, Node{scheduledTime, nextSeq_++, slot});
+  siftUp(heap_.size() - 1);
+
+  return makeTimeoutId(slot, entry.generation);
+}
+
+bool
+TimeoutHeap::erase(int64_t timeoutId) {
+  auto slot = findSlot(timeoutId);
+  if (slot < 0) {
+    return false;
+  }
+
+  // Destroy callback right away
+  removeAt(slots_[slot].position);
+  ++numCancelled_;
+  return true;
+}
+
+TimeoutCallback
+TimeoutHeap::pop() {
+  CHECK(!heap_.empty());
+  return removeAt(0);
+}
+
+int64_t
+TimeoutHeap::findSlot(int64_t timeoutId) const {
+  if (timeoutId < 0) {
+    return -1;
+  }
+
+  const auto slot = static_cast<uint32_t>(timeoutId & 0xffffffff);
+  const auto generation = static_cast<uint32_t>(timeoutId >> 32);
+  if (slot >= slots_.size()) {
+    return -1;
+  }
+
+  auto const& entry = slots_[slot];
+  if (!entry.inUse || entry.generation != generation) {
+    return -1;
+  }
+  return slot;
+}
+
+TimeoutCallback
+TimeoutHeap::removeAt(size_t pos) {
+  const auto slot = heap_[pos].slot;
+
+  // Fill the hole with last node and restore heap property
+  const auto last = heap_.back();
+  heap_.pop_back();
+  if (pos < heap_.size()) {
+    place(pos, last);
+    if (pos > 0 && less(heap_[pos], heap_[(pos - 1) / kArity])) {
+      siftUp(pos);
+    } else {
+      siftDown(pos);
+    }
+  }
+
+  // Free the slot
+  auto& entry = slots_[slot];
+  auto callback = std::move(entry.callback);
+  entry.callback = nullptr;
+  entry.inUse = false;
+  entry.generation = (entry.generation + 1) & kGenerationMask;
+  freeSlots_.push_back(slot);
+
+  return callback;
+}
+
+void
+TimeoutHeap::siftUp(size_t pos) {
+  const auto node = heap_[pos];
+  while (pos > 0) {
+    const auto parent = (pos - 1) / kArity;
+    if (!less(node, heap_[parent])) {
+      break;
+    }
+    place(pos, heap_[parent]);
+    pos = parent;
+  }
+  place(pos, node);
+}
+
+void
+TimeoutHeap::siftDown(size_t pos) {
+  const auto node = heap_[pos];
+  const auto size = heap_.size();
+  while (true) {
+    const auto firstChild = pos * kArity + 1;
+    if (firstChild >= size) {
+      break;
+    }
+
+    // Find smallest child
+    auto minChild = firstChild;
+    const auto lastChild = std::min(firstChild + kArity, size);
+    for (auto child = firstChild + 1; child < lastChild; ++child) {
+      if (less(heap_[child], heap_[minChild])) {
+        minChild = child;
+      }
+    }
+
+    if (!less(heap_[minChild], node)) {
+      break;
+    }
+    place(pos, heap_[minChild]);
+    pos = minChild;
+  }
+  place(pos, node);
+}
+
+} // namespace fbzmq
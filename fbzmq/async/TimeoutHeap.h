@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <folly/Function.h>
+
+namespace fbzmq {
+
+using TimeoutCallback = folly::Function<void(void) noexcept>;
+
+/**
+ * Min-heap of timeouts ordered by their scheduled time, used by ZmqEventLoop.
+ *
+ * Implemented as a 4-ary heap with position handles. Every timeout gets a
+ * unique id which encodes the slot it occupies and the generation of that
+ * slot, hence cancellation is O(log n) and reclaims memory immediately
+ * and stale ids (of fired or cancelled timeouts) are detected safely.
+ *
+ * Heap nodes are small (time, sequence, slot) tuples, callbacks are stored
+ * in the slot table and never move during sift operations. Timeouts with the
+ * same scheduled time are expired in the order of their insertion.
+ *
+ * Not thread safe.
+ */
+class TimeoutHeap {
+ public:
+  /**
+   * Add new timeout.
+   *
+   * @returns: unique non-negative id associated with the timeout
+   */
+  int64_t push(
+      std::chrono::steady_clock::time_point scheduledTime,
+      TimeoutCallback callback);
+
+  /**
+   * Remove timeout with given id from heap.
+   *
+   * @returns: true if timeout was pending, false otherwise
+   */
+  bool erase(int64_t timeoutId);
+
+  /**
+   * Remove earliest timeout from heap and return its callback. Slot is freed
+   * before returning, so callback can schedule/cancel timeouts freely.
+   * Heap must not be empty.
+   */
+  TimeoutCallback pop();
+
+  /**
+   * Scheduled time of earliest timeout. Heap must not be empty.
+   */
+  std::chrono::steady_clock::time_point
+  topTime() const {
+    return heap_.front().scheduledTime;
+  }
+
+  bool
+  empty() const {
+    return heap_.empty();
+  }
+
+  size_t
+  size() const {
+    return heap_.size();
+  }
+
+  /**
+   * Total number of timeouts cancelled via `erase` so far
+   */
+  uint64_t
+  getNumCancelled() const {
+    return numCancelled_;
+  }
+
+ private:
+  // arity of heap. 4 children per node keeps sift-down cache friendly and
+  // halves the height of tree compared to binary heap.
+  static constexpr size_t kArity = 4;
+
+  struct Node {
+    std::chrono::steady_clock::time_point scheduledTime;
+
+    // insertion sequence number to keep ordering stable
+    uint64_t seq{0};
+
+    // index into slots_
+    uint32_t slot{0};
+  };
+
+  struct Slot {
+    TimeoutCallback callback{nullptr};
+
+    // position of timeout in heap_. only valid when slot is in use
+    uint32_t position{0};
+
+    // bumped everytime slot is freed to invalidate stale ids
+    uint32_t generation{0};
+
+    bool inUse{false};
+  };
+
+  static bool
+  less(Node const& lhs, Node const& rhs) {
+    return lhs.scheduledTime < rhs.scheduledTime ||
+        (lhs.scheduledTime == rhs.scheduledTime && lhs.seq < rhs.seq);
+  }
+
+  /**
+   * Resolve id to slot index. Returns -1 if id is not valid anymore.
+   */
+  int64_t findSlot(int64_t timeoutId) const;
+
+  /**
+   * Remove node at position `pos` from heap and free its slot
+   */
+  TimeoutCallback removeAt(size_t pos);
+
+  void siftUp(size_t pos);
+  void siftDown(size_t pos);
+
+  // place node at given position and update its handle
+  void
+  place(size_t pos, Node const& node) {
+    heap_[pos] = node;
+    slots_[node.slot].position = static_cast<uint32_t>(pos);
+  }
+
+  std::vector<Node> heap_;
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> freeSlots_;
+
+  uint64_t nextSeq_{0};
+  uint64_t numCancelled_{0};
+};
+
+} // namespace fbzmq
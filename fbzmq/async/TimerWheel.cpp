@@ -0,0 +1,309 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/TimerWheel.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Generation is kept within 30 bits so that ids are always non-negative and
+// leave room for flags used by ZmqEventLoop
+const uint32_t kGenerationMask = 0x3fffffff;
+
+uint64_t
+rotl(uint64_t value, uint32_t shift) {
+  shift &= 63;
+  return shift ? (value << shift) | (value >> (64 - shift)) : value;
+}
+
+uint64_t
+rotr(uint64_t value, uint32_t shift) {
+  shift &= 63;
+  return shift ? (value >> shift) | (value << (64 - shift)) : value;
+}
+
+} // namespace
+
+constexpr uint32_t TimerWheel::kBitsPerLevel;
+constexpr uint32_t TimerWheel::kNumSlots;
+constexpr uint32_t TimerWheel::kNumLevels;
+constexpr uint32_t TimerWheel::kNil;
+
+TimerWheel::TimerWheel(std::chrono::steady_clock::time_point start)
+    : start_(start) {
+  static_assert(
+      kNumSlots == 64, "occupancy bitmap must have one bit per slot");
+  for (auto& level : slots_) {
+    level.fill(kNil);
+  }
+  occupied_.fill(0);
+}
+
+int64_t
+TimerWheel::schedule(
+    std::chrono::steady_clock::time_point deadline, TimeoutCallback callback) {
+  uint32_t index;
+  if (!freeTimers_.empty()) {
+    index = freeTimers_.back();
+    freeTimers_.pop_back();
+  } else {
+    index = static_cast<uint32_t>(timers_.size());
+    timers_.emplace_back();
+  }
+
+  auto& timer = timers_[index];
+  timer.callback = std::move(callback);
+  // Timers which are already due are expired on next advance. This keeps
+  // timers scheduled from expired callbacks from being handed out by the
+  // same round of `popExpired`.
+  timer.deadline = std::max(toTicks(deadline, true /* roundUp */), now_ + 1);
+  timer.seq = nextSeq_++;
+  ++numTimers_;
+  insert(index);
+
+  return (static_cast<int64_t>(timer.generation) << 32) | index;
+}
+
+bool
+TimerWheel::cancel(int64_t timerId) {
+  auto index = findTimer(timerId);
+  if (index < 0) {
+    return false;
+  }
+
+  if (timers_[index].state == TimerState::IN_WHEEL) {
+    unlink(index);
+  }
+  // Entry in expired list (if any) will be skipped lazily
+  release(index);
+  return true;
+}
+
+void
+TimerWheel::advance(std::chrono::steady_clock::time_point now) {
+  const auto newTick = toTicks(now, false /* roundUp */);
+  if (newTick <= now_) {
+    return;
+  }
+
+  // Collect timers from all slots crossed at each level. A level's slots are
+  // crossed only if its higher granularity clock has ticked.
+  cascade_.clear();
+  for (uint32_t level = 0; level < kNumLevels; ++level) {
+    const auto shift = level * kBitsPerLevel;
+    const auto oldPos = now_ >> shift;
+    const auto newPos = newTick >> shift;
+    if (oldPos == newPos) {
+      break;
+    }
+
+    uint64_t pending = std::numeric_limits<uint64_t>::max();
+    if (newPos - oldPos < kNumSlots) {
+      // slots (oldPos, newPos]
+      pending = rotl(
+          (uint64_t(1) << (newPos - oldPos)) - 1,
+          static_cast<uint32_t>(oldPos + 1));
+    }
+    pending &= occupied_[level];
+
+    while (pending) {
+      const auto slot = __builtin_ctzll(pending);
+      pending &= pending - 1;
+      for (auto index = slots_[level][slot]; index != kNil;) {
+        cascade_.push_back(index);
+        index = timers_[index].next;
+      }
+      slots_[level][slot] = kNil;
+      occupied_[level] &= ~(uint64_t(1) << slot);
+    }
+  }
+  now_ = newTick;
+
+  // Expire due timers and re-insert rest of them into lower levels
+  expiredBatch_.clear();
+  for (auto index : cascade_) {
+    auto& timer = timers_[index];
+    if (timer.deadline <= now_) {
+      timer.state = TimerState::EXPIRED;
+      expiredBatch_.push_back(index);
+    } else {
+      insert(index);
+    }
+  }
+  std::sort(
+      expiredBatch_.begin(),
+      expiredBatch_.end(),
+      [this](uint32_t lhs, uint32_t rhs) {
+        auto const& l = timers_[lhs];
+        auto const& r = timers_[rhs];
+        return l.deadline < r.deadline ||
+            (l.deadline == r.deadline && l.seq < r.seq);
+      });
+
+  // Compact already consumed part of expired list
+  if (expiredPos_ == expired_.size()) {
+    expired_.clear();
+    expiredPos_ = 0;
+  }
+  for (auto index : expiredBatch_) {
+    expired_.emplace_back(index, timers_[index].generation);
+  }
+}
+
+TimeoutCallback
+TimerWheel::popExpired() {
+  while (expiredPos_ < expired_.size()) {
+    const auto entry = expired_[expiredPos_++];
+    auto const& timer = timers_[entry.first];
+    if (timer.state == TimerState::EXPIRED &&
+        timer.generation == entry.second) {
+      return release(entry.first);
+    }
+  }
+
+  expired_.clear();
+  expiredPos_ = 0;
+  return nullptr;
+}
+
+folly::Optional<std::chrono::steady_clock::time_point>
+TimerWheel::nextWakeup() const {
+  if (numTimers_ == 0) {
+    return folly::none;
+  }
+
+  // Expired timers are waiting to be popped
+  if (expiredPos_ < expired_.size()) {
+    return start_ + std::chrono::microseconds(now_);
+  }
+
+  // First occupied slot after current position at each level. For level 0
+  // this is the exact deadline, for others it is the time at which slot's
+  // timers are cascaded down.
+  uint64_t wakeupTick = std::numeric_limits<uint64_t>::max();
+  for (uint32_t level = 0; level < kNumLevels; ++level) {
+    if (!occupied_[level]) {
+      continue;
+    }
+    const auto shift = level * kBitsPerLevel;
+    const auto pos = now_ >> shift;
+    const uint64_t distance = __builtin_ctzll(
+        rotr(occupied_[level], static_cast<uint32_t>(pos + 1)));
+    wakeupTick = std::min(wakeupTick, (pos + distance + 1) << shift);
+  }
+
+  // There must be some timer in wheel
+  CHECK_NE(std::numeric_limits<uint64_t>::max(), wakeupTick);
+  return start_ + std::chrono::microseconds(wakeupTick);
+}
+
+uint64_t
+TimerWheel::toTicks(
+    std::chrono::steady_clock::time_point time, bool roundUp) const {
+  if (time <= start_) {
+    return 0;
+  }
+
+  const auto nanos =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(time - start_)
+          .count();
+  return nanos / 1000 + ((roundUp && nanos % 1000) ? 1 : 0);
+}
+
+int64_t
+TimerWheel::findTimer(int64_t timerId) const {
+  if (timerId < 0) {
+    return -1;
+  }
+
+  const auto index = static_cast<uint32_t>(timerId & 0xffffffff);
+  const auto generation = static_cast<uint32_t>(timerId >> 32);
+  if (index >= timers_.size()) {
+    return -1;
+  }
+
+  auto const& timer = timers_[index];
+  if (timer.state == TimerState::FREE || timer.generation != generation) {
+    return -1;
+  }
+  return index;
+}
+
+void
+TimerWheel::insert(uint32_t index) {
+  auto& timer = timers_[index];
+  DCHECK_LT(now_, timer.deadline);
+
+  // Find lowest level whose window can hold the deadline. If deadline is
+  // beyond range of wheel, park it in the farthest slot of top level and it
+  // will be re-inserted when that slot is reached.
+  uint32_t level = kNumLevels - 1;
+  auto slot = ((now_ >> (level * kBitsPerLevel)) + kNumSlots - 1);
+  for (uint32_t l = 0; l < kNumLevels; ++l) {
+    const auto shift = l * kBitsPerLevel;
+    const auto deadlinePos = timer.deadline >> shift;
+    if (deadlinePos - (now_ >> shift) < kNumSlots) {
+      level = l;
+      slot = deadlinePos;
+      break;
+    }
+  }
+  slot &= (kNumSlots - 1);
+
+  auto& head = slots_[level][slot];
+  timer.prev = kNil;
+  timer.next = head;
+  if (head != kNil) {
+    timers_[head].prev = index;
+  }
+  head = index;
+  occupied_[level] |= uint64_t(1) << slot;
+
+  timer.level = static_cast<uint8_t>(level);
+  timer.slot = static_cast<uint8_t>(slot);
+  timer.state = TimerState::IN_WHEEL;
+}
+
+void
+TimerWheel::unlink(uint32_t index) {
+  auto& timer = timers_[index];
+  if (timer.prev != kNil) {
+    timers_[timer.prev].next = timer.next;
+  } else {
+    slots_[timer.level][timer.slot] = timer.next;
+  }
+  if (timer.next != kNil) {
+    timers_[timer.next].prev = timer.prev;
+  }
+  if (slots_[timer.level][timer.slot] == kNil) {
+    occupied_[timer.level] &= ~(uint64_t(1) << timer.slot);
+  }
+  timer.prev = kNil;
+  timer.next = kNil;
+}
+
+TimeoutCallback
+TimerWheel::release(uint32_t index) {
+  auto& timer = timers_[index];
+  auto callback = std::move(timer.callback);
+  timer.callback = nullptr;
+  timer.state = TimerState::FREE;
+  timer.generation = (timer.generation + 1) & kGenerationMask;
+  freeTimers_.push_back(index);
+  --numTimers_;
+  return callback;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <folly/Optional.h>
+
+#include <fbzmq/async/TimeoutHeap.h>
+
+namespace fbzmq {
+
+/**
+ * Hierarchical timing wheel with microsecond resolution, used by ZmqEventLoop
+ * for high resolution timeouts.
+ *
+ * Wheel has `kNumLevels` levels of `kNumSlots` slots each. A slot at level L
+ * spans 64^L microseconds. Timers are put in the lowest level which can hold
+ * their deadline and are cascaded down to lower levels as time advances.
+ * Per level occupancy bitmaps allow skipping empty slots, so advancing the
+ * wheel is independent of amount of elapsed time.
+ *
+ * Schedule and cancel are O(1). Timers are never expired before their
+ * deadline. Timers expired by a single `advance` are handed out in order of
+ * their deadline (and insertion for same deadline).
+ *
+ * Not thread safe.
+ */
+class TimerWheel {
+ public:
+  explicit TimerWheel(
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now());
+
+  /**
+   * Schedule a new timer.
+   *
+   * @returns: unique non-negative id associated with the timer
+   */
+  int64_t schedule(
+      std::chrono::steady_clock::time_point deadline, TimeoutCallback callback);
+
+  /**
+   * Cancel a scheduled timer (it can be in expired list as well). Callback is
+   * destroyed immediately.
+   *
+   * @returns: true if timer was pending, false otherwise
+   */
+  bool cancel(int64_t timerId);
+
+  /**
+   * Advance wheel to `now`. All timers with deadline <= now are moved to the
+   * expired list.
+   */
+  void advance(std::chrono::steady_clock::time_point now);
+
+  /**
+   * Pop next callback from expired list. Returns nullptr if there are no
+   * more expired timers.
+   */
+  TimeoutCallback popExpired();
+
+  /**
+   * Earliest time at which wheel should be advanced. It is a lower bound on
+   * next deadline, advancing earlier than that is a no-op. Returns none if
+   * there are no timers.
+   */
+  folly::Optional<std::chrono::steady_clock::time_point> nextWakeup() const;
+
+  /**
+   * Number of pending timers (including expired ones not yet popped)
+   */
+  size_t
+  size() const {
+    return numTimers_;
+  }
+
+  bool
+  empty() const {
+    return numTimers_ == 0;
+  }
+
+ private:
+  static constexpr uint32_t kBitsPerLevel = 6;
+  static constexpr uint32_t kNumSlots = 1 << kBitsPerLevel;
+  static constexpr uint32_t kNumLevels = 6;
+  static constexpr uint32_t kNil = 0xffffffff;
+
+  enum class TimerState : uint8_t {
+    FREE = 0,
+    IN_WHEEL = 1,
+    EXPIRED = 2,
+  };
+
+  struct Timer {
+    TimeoutCallback callback{nullptr};
+
+    // deadline in ticks (microseconds since start_)
+    uint64_t deadline{0};
+
+    // insertion sequence number to keep ordering stable
+    uint64_t seq{0};
+
+    // intrusive doubly linked list of slot
+    uint32_t prev{kNil};
+    uint32_t next{kNil};
+
+    // bumped everytime timer is freed to invalidate stale ids
+    uint32_t generation{0};
+
+    uint8_t level{0};
+    uint8_t slot{0};
+    TimerState state{TimerState::FREE};
+  };
+
+  uint64_t toTicks(std::chrono::steady_clock::time_point time, bool roundUp)
+      const;
+
+  int64_t findTimer(int64_t timerId) const;
+
+  // Insert timer in wheel based on its deadline and current tick
+  void insert(uint32_t index);
+
+  // Unlink timer from its slot
+  void unlink(uint32_t index);
+
+  // Release timer and return its callback
+  TimeoutCallback release(uint32_t index);
+
+  const std::chrono::steady_clock::time_point start_;
+
+  // Current tick of wheel
+  uint64_t now_{0};
+
+  std::array<std::array<uint32_t, kNumSlots>, kNumLevels> slots_;
+  std::array<uint64_t, kNumLevels> occupied_;
+
+  std::vector<Timer> timers_;
+  std::vector<uint32_t> freeTimers_;
+
+  // Expired timers, sorted by deadline. Cancelled ones are skipped lazily.
+  std::vector<std::pair<uint32_t /* index */, uint32_t /* generation */>>
+      expired_;
+  size_t expiredPos_{0};
+
+  // Scratch space used while cascading timers in `advance`
+  std::vector<uint32_t> cascade_;
+  std::vector<uint32_t> expiredBatch_;
+
+  size_t numTimers_{0};
+  uint64_t nextSeq_{0};
+};
+
+} // namespace fbzmq
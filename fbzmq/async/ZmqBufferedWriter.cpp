@@ -0,0 +1,167 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/ZmqBufferedWriter.h>
+
+namespace fbzmq {
+
+ZmqBufferedWriter::ZmqBufferedWriter(
+    ZmqEventLoop* evl,
+    detail::SocketImpl* socket,
+    size_t highWatermark,
+    size_t lowWatermark,
+    WatermarkCallback onHighWatermark,
+    WatermarkCallback onLowWatermark,
+    SocketCallback readCallback,
+    size_t maxSendsPerFlush)
+    : evl_(evl),
+      socket_(socket),
+      socketPtr_{**socket},
+      highWatermark_(highWatermark),
+      lowWatermark_(lowWatermark),
+      onHighWatermark_(std::move(onHighWatermark)),
+      onLowWatermark_(std::move(onLowWatermark)),
+      readCallback_(std::move(readCallback)),
+      maxSendsPerFlush_(maxSendsPerFlush) {
+  CHECK(socket_->isNonBlocking()) << "ZmqBufferedWriter needs non-blocking "
+                                  << "socket";
+  CHECK_LT(0, highWatermark_);
+  CHECK_LE(lowWatermark_, highWatermark_);
+  CHECK_LT(0, maxSendsPerFlush_);
+
+  // reading is always subscribed to, writing only while there is a backlog
+  if (readCallback_) {
+    registerSocket(ZMQ_POLLIN);
+  }
+
+  // graceful stop of the loop waits for queued messages to be sent
+  drainCheckId_ = evl_->addDrainCheck([this]() { return getNumQueued(); });
+}
+
+ZmqBufferedWriter::~ZmqBufferedWriter() {
+  evl_->removeDrainCheck(drainCheckId_);
+  if (registered_) {
+    evl_->removeSocket(socketPtr_);
+  }
+}
+
+void
+ZmqBufferedWriter::write(Message msg) {
+  if (queue_.empty() || queue_.back().size() >= maxSendsPerFlush_) {
+    queue_.emplace_back();
+  }
+  queue_.back().add(std::move(msg));
+  onQueued();
+}
+
+void
+ZmqBufferedWriter::write(std::vector<Message> frames) {
+  if (frames.empty()) {
+    return;
+  }
+  if (queue_.empty() || queue_.back().size() >= maxSendsPerFlush_) {
+    queue_.emplace_back();
+  }
+  queue_.back().add(std::move(frames));
+  onQueued();
+}
+
+void
+ZmqBufferedWriter::onQueued() {
+  ++numQueued_;
+
+  // Send right away unless earlier messages are still waiting for POLLOUT,
+  // which keeps messages in order
+  if (!waitingWritable_) {
+    flush();
+    // our sends may have consumed edge of ZMQ_FD with epoll backend
+    if (registered_) {
+      evl_->recheckSocket(socketPtr_);
+    }
+  }
+
+  if (!aboveHighWatermark_ && numQueued_ >= highWatermark_) {
+    aboveHighWatermark_ = true;
+    if (onHighWatermark_) {
+      onHighWatermark_();
+    }
+  }
+}
+
+void
+ZmqBufferedWriter::flush() noexcept {
+  // one chunk (i.e. at most maxSendsPerFlush_ messages) per call, to not
+  // starve other events of the loop
+  if (!queue_.empty()) {
+    auto& batch = queue_.front();
+    const auto numBefore = batch.size();
+    const auto ret = socket_->sendBatch(batch);
+    const size_t numSent = ret.hasValue() ? ret.value() : 0;
+    if (ret.hasError() && ret.error().errNum != EAGAIN) {
+      LOG(ERROR) << "ZmqBufferedWriter: error sending message " << ret.error();
+      // drop the message, it would fail again on every retry. Partially sent
+      // one has been dropped by sendBatch already.
+      if (batch.size() == numBefore) {
+        batch.erasePrefix(1);
+      }
+    }
+    numQueued_ -= numBefore - batch.size();
+    numErrors_ += numBefore - batch.size() - numSent;
+    if (batch.empty()) {
+      queue_.pop_front();
+    }
+  }
+
+  updatePollOut();
+
+  if (aboveHighWatermark_ && numQueued_ <= lowWatermark_) {
+    aboveHighWatermark_ = false;
+    if (onLowWatermark_) {
+      onLowWatermark_();
+    }
+  }
+}
+
+void
+ZmqBufferedWriter::updatePollOut() {
+  const bool needed = numQueued_ > 0;
+  if (needed == waitingWritable_) {
+    return;
+  }
+  waitingWritable_ = needed;
+
+  const int events =
+      (readCallback_ ? ZMQ_POLLIN : 0) | (needed ? ZMQ_POLLOUT : 0);
+  if (registered_) {
+    if (events) {
+      evl_->updateSocketEvents(socketPtr_, events);
+    } else {
+      evl_->removeSocket(socketPtr_);
+      registered_ = false;
+    }
+    return;
+  }
+
+  registerSocket(events);
+}
+
+void
+ZmqBufferedWriter::registerSocket(int events) {
+  evl_->addSocket(socketPtr_, events, [this](int revents) noexcept {
+    if (revents & ZMQ_POLLOUT) {
+      flush();
+    }
+    if (readCallback_ && (revents & ~ZMQ_POLLOUT)) {
+      readCallback_(revents & ~ZMQ_POLLOUT);
+    }
+  });
+  registered_ = true;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <folly/Function.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+/**
+ * Write queue for a non-blocking socket driven by ZmqEventLoop. Messages are
+ * sent right away while socket can take them. Once send would block (EAGAIN,
+ * e.g. ZMQ_SNDHWM is reached or peer is not connected yet) they are queued in
+ * order and flushed in batches as socket becomes writable again. ZMQ_POLLOUT
+ * is subscribed only while queue is non-empty, so an idle writer costs no
+ * wakeups.
+ *
+ * Flow control: `onHighWatermark` is invoked once queue grows to
+ * `highWatermark` messages, and `onLowWatermark` once it has been drained
+ * down to `lowWatermark` afterwards. Producers are expected to pause in
+ * between, instead of busy looping on EAGAIN or dropping messages. Writes
+ * are never refused though, queue is unbounded.
+ *
+ * Writer takes over registration of the socket with the loop. If socket is
+ * also read from, pass `readCallback` which is invoked on ZMQ_POLLIN, rather
+ * than adding socket to the loop separately.
+ *
+ * Loop's `drainAndStop` waits for queue to be flushed before stopping.
+ *
+ * Must be used from within loop's thread only. Socket must outlive writer.
+ */
+class ZmqBufferedWriter : public boost::noncopyable {
+ public:
+  using WatermarkCallback = folly::Function<void() noexcept>;
+
+  ZmqBufferedWriter(
+      ZmqEventLoop* evl,
+      detail::SocketImpl* socket,
+      size_t highWatermark,
+      size_t lowWatermark,
+      WatermarkCallback onHighWatermark = nullptr,
+      WatermarkCallback onLowWatermark = nullptr,
+      SocketCallback readCallback = nullptr,
+      size_t maxSendsPerFlush = 256);
+
+  ~ZmqBufferedWriter();
+
+  /**
+   * Send (or queue) single frame or multipart message
+   */
+  void write(Message msg);
+  void write(std::vector<Message> frames);
+
+  /**
+   * Messages waiting for socket to become writable
+   */
+  size_t
+  getNumQueued() const {
+    return numQueued_;
+  }
+
+  /**
+   * Whether high watermark has been hit and queue hasn't been drained down to
+   * low watermark since
+   */
+  bool
+  isAboveHighWatermark() const {
+    return aboveHighWatermark_;
+  }
+
+  /**
+   * Messages dropped because of send errors other than EAGAIN
+   */
+  size_t
+  getNumErrors() const {
+    return numErrors_;
+  }
+
+ private:
+  // account newly queued message and flush if not waiting for POLLOUT
+  void onQueued();
+
+  // send queued messages until socket would block or budget is exhausted
+  void flush() noexcept;
+
+  // subscribe to POLLOUT (or not) according to queue state
+  void updatePollOut();
+
+  void registerSocket(int events);
+
+  ZmqEventLoop* const evl_{nullptr};
+  detail::SocketImpl* const socket_{nullptr};
+  const RawZmqSocketPtr socketPtr_;
+
+  const size_t highWatermark_{0};
+  const size_t lowWatermark_{0};
+  WatermarkCallback onHighWatermark_;
+  WatermarkCallback onLowWatermark_;
+  SocketCallback readCallback_;
+  const size_t maxSendsPerFlush_{0};
+
+  // queued messages, in chunks of up to maxSendsPerFlush_ messages so that
+  // sent ones are dropped off the front cheaply
+  std::deque<MessageBatch> queue_;
+  size_t numQueued_{0};
+
+  // is socket registered with the loop, and with POLLOUT
+  bool registered_{false};
+  bool waitingWritable_{false};
+
+  bool aboveHighWatermark_{false};
+  size_t numErrors_{0};
+
+  // registration with loop's drain checks
+  int64_t drainCheckId_{0};
+};
+
+} // namespace fbzmq
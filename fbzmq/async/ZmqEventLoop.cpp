@@ -9,19 +9,195 @@
 
 #include <fbzmq/async/ZmqEventLoop.h>
 
+#include <pthread.h>
+#include <sched.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <array>
+#include <system_error>
+#include <tuple>
+
 #include <folly/Format.h>
 #include <folly/Memory.h>
 #include <folly/ScopeGuard.h>
 
+#include <fbzmq/service/stats/ThreadData.h>
 #include <fbzmq/zmq/Common.h>
 
 namespace fbzmq {
 
-ZmqEventLoop::ZmqEventLoop(uint64_t queueCapacity)
-    : callbackQueue_(queueCapacity) {
+namespace {
+
+// Flag set on ids of high resolution timeouts. Ids of TimeoutHeap and
+// TimerWheel are always below it.
+const int64_t kHighResTimeoutFlag = int64_t(1) << 62;
+
+// Lower bound of adaptive busy poll budget, as a fraction of configured one
+const int64_t kMinBusyPollBudgetDivisor = 64;
+
+// Values written to signal fd by `stop` and `drainAndStop`. Eventfd adds up
+// values written, lower half counts stop requests and upper half drains.
+const uint64_t kStopSignal{1};
+const uint64_t kDrainSignal{uint64_t(1) << 32};
+
+// Max poll timeout while draining, work reported by drain checks doesn't
+// necessarily wake the loop up
+const std::chrono::milliseconds kDrainPollInterval{10};
+
+void
+increment(std::atomic<uint64_t>& counter) {
+  // single writer, no need for atomic read-modify-write
+  counter.store(
+      counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Upper bounds (in microseconds) of latency histogram buckets. Values above
+// the last bound fall into an extra unbounded bucket.
+const std::array<int64_t, 5> kLatencyBucketBounds = {
+    {10, 100, 1000, 10000, 100000}};
+
+// Interval over which busy percentage is computed
+const std::chrono::seconds kBusyPctInterval{1};
+
+int64_t
+toMicros(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+} // namespace
+
+namespace detail {
+
+/**
+ * Latency stat with pre-registered counters, so that recording a value
+ * doesn't involve any string formatting or hashing
+ */
+class LatencyStat {
+ public:
+  LatencyStat(ThreadData& threadData, std::string const& key)
+      : stat_(threadData.registerStat(key)),
+        max_(threadData.registerCounter(key + ".max")) {
+    threadData.addStatExportType(stat_, AVG);
+    threadData.addStatExportType(stat_, COUNT);
+    for (size_t i = 0; i < kLatencyBucketBounds.size(); ++i) {
+      buckets_[i] = threadData.registerCounter(
+          folly::sformat("{}.hist.le_{}", key, kLatencyBucketBounds[i]));
+    }
+    buckets_.back() =
+        threadData.registerCounter(folly::sformat("{}.hist.inf", key));
+  }
+
+  void
+  add(ThreadData& threadData, int64_t value) {
+    threadData.addStatValue(stat_, value);
+    size_t bucket = 0;
+    while (bucket < kLatencyBucketBounds.size() and
+           value > kLatencyBucketBounds[bucket]) {
+      ++bucket;
+    }
+    threadData.incrementCounter(buckets_[bucket]);
+    if (value > maxValue_) {
+      maxValue_ = value;
+      threadData.setCounter(max_, value);
+    }
+  }
+
+ private:
+  StatHandle stat_;
+  CounterHandle max_;
+  std::array<CounterHandle, kLatencyBucketBounds.size() + 1> buckets_;
+  int64_t maxValue_{-1};
+};
+
+} // namespace detail
+
+struct ZmqEventLoop::Instrumentation {
+  Instrumentation(ThreadData& threadData, std::string const& prefix)
+      : threadData(threadData),
+        prefix(prefix),
+        iteration(threadData, prefix + ".iteration_us"),
+        timerSlip(threadData, prefix + ".timer_slip_us"),
+        timeoutCallback(threadData, prefix + ".timeout_callback_us"),
+        queueWait(threadData, prefix + ".queue_wait_us"),
+        queuedCallback(threadData, prefix + ".queued_callback_us"),
+        unnamedCallback(threadData, prefix + ".callback_us.unnamed"),
+        queueDepth(threadData.registerStat(prefix + ".queue_depth")),
+        busy(threadData.registerStat(prefix + ".busy_us")),
+        idle(threadData.registerStat(prefix + ".idle_us")),
+        busyPct(threadData.registerCounter(prefix + ".busy_pct")),
+        windowStart(std::chrono::steady_clock::now()) {
+    threadData.addStatExportType(queueDepth, AVG);
+    threadData.addStatExportType(busy, SUM);
+    threadData.addStatExportType(idle, SUM);
+  }
+
+  detail::LatencyStat*
+  getCallbackStat(std::string const& name) {
+    if (name.empty()) {
+      return &unnamedCallback;
+    }
+    auto it = callbacks.find(name);
+    if (it == callbacks.end()) {
+      std::tie(it, std::ignore) = callbacks.emplace(
+          std::piecewise_construct,
+          std::forward_as_tuple(name),
+          std::forward_as_tuple(
+              threadData, folly::sformat("{}.callback_us.{}", prefix, name)));
+    }
+    return &it->second;
+  }
+
+  void
+  recordIteration(
+      std::chrono::steady_clock::time_point idleStart,
+      std::chrono::steady_clock::time_point busyStart,
+      std::chrono::steady_clock::time_point end) {
+    const auto idleTime = busyStart - idleStart;
+    const auto busyTime = end - busyStart;
+    iteration.add(threadData, toMicros(busyTime));
+    threadData.addStatValue(busy, toMicros(busyTime));
+    threadData.addStatValue(idle, toMicros(idleTime));
+
+    windowBusy += busyTime;
+    windowIdle += idleTime;
+    if (end - windowStart >= kBusyPctInterval) {
+      const auto total = (windowBusy + windowIdle).count();
+      threadData.setCounter(
+          busyPct, total ? 100 * windowBusy.count() / total : 0);
+      windowStart = end;
+      windowBusy = windowIdle = std::chrono::steady_clock::duration(0);
+    }
+  }
+
+  ThreadData& threadData;
+  const std::string prefix;
+
+  detail::LatencyStat iteration;
+  detail::LatencyStat timerSlip;
+  detail::LatencyStat timeoutCallback;
+  detail::LatencyStat queueWait;
+  detail::LatencyStat queuedCallback;
+  detail::LatencyStat unnamedCallback;
+  const StatHandle queueDepth;
+  const StatHandle busy;
+  const StatHandle idle;
+  const CounterHandle busyPct;
+
+  // Callback stats of named subscriptions keyed by name
+  std::unordered_map<std::string, detail::LatencyStat> callbacks;
+
+  // Busy and idle time accumulated since `windowStart`
+  std::chrono::steady_clock::time_point windowStart;
+  std::chrono::steady_clock::duration windowBusy{0};
+  std::chrono::steady_clock::duration windowIdle{0};
+};
+
+ZmqEventLoop::ZmqEventLoop(uint64_t queueCapacity, PollerType pollerType)
+    : callbackQueue_(queueCapacity), poller_(Poller::create(pollerType)) {
   // Create signal-fd for start/stop events
   if ((signalFd_ = eventfd(0 /* init-value */, 0 /* flags */)) < 0) {
     LOG(FATAL) << "ZmqEventLoop: Failed to create an eventfd.";
@@ -41,9 +217,16 @@ ZmqEventLoop::ZmqEventLoop(uint64_t queueCapacity)
     auto bytesRead = read(signalFd_, static_cast<void*>(&buf), sizeof(buf));
     CHECK_EQ(sizeof(buf), bytesRead);
 
-    VLOG(4) << "ZmqEventLoop: Received stop signal. Stopping thread.";
-    stop_ = true;
+    if (buf & (kDrainSignal - 1)) {
+      VLOG(4) << "ZmqEventLoop: Received stop signal. Stopping thread.";
+      stop_ = true;
+    } else if (buf >= kDrainSignal) {
+      VLOG(4) << "ZmqEventLoop: Received drain signal. Draining thread.";
+      startDrain(std::chrono::milliseconds(
+          drainTimeoutMs_.load(std::memory_order_relaxed)));
+    }
   });
+  setSocketFdName(signalFd_, "stop_signal");
 
   // Attach callback on callback event fd
   addSocketFd(callbackFd_, ZMQ_POLLIN, [this](int revents) noexcept {
@@ -54,21 +237,54 @@ ZmqEventLoop::ZmqEventLoop(uint64_t queueCapacity)
     auto bytesRead = read(callbackFd_, static_cast<void*>(&buf), sizeof(buf));
     CHECK_EQ(sizeof(buf), bytesRead);
 
-    // Process events
+    // Producers enqueuing from now on must signal again. Anything enqueued
+    // before this point will be drained below.
+    callbackSignalPending_.store(false, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // Process events. Bound the processing to what is in queue right now so
+    // that producers can't starve the loop. Write of an item can still be in
+    // progress, in which case its producer will signal us again.
     VLOG(4) << "ZmqEventLoop: Received callback events in queue. #" << buf;
-    TimeoutCallback callback;
+    QueuedCallback item;
     auto items = callbackQueue_.size();
     VLOG(4) << "ZmqEventLoop: Processing " << items << " callback from queue.";
-    while (items-- > 0) {
-      callbackQueue_.blockingRead(callback);
-      callback();
+    if (instrumentation_) {
+      instrumentation_->threadData.addStatValue(
+          instrumentation_->queueDepth, items);
+    }
+    while (items-- > 0 && callbackQueue_.read(item)) {
+      if (draining_) {
+        ++drainStats_.numCallbacksRun;
+      }
+      // Callbacks enqueued before instrumentation got enabled have no time
+      if (not instrumentation_ or
+          item.enqueueTime == std::chrono::steady_clock::time_point{}) {
+        item.callback();
+        continue;
+      }
+
+      const auto start = std::chrono::steady_clock::now();
+      instrumentation_->queueWait.add(
+          instrumentation_->threadData, toMicros(start - item.enqueueTime));
+      item.callback();
+      // Callback can disable instrumentation
+      if (instrumentation_) {
+        instrumentation_->queuedCallback.add(
+            instrumentation_->threadData,
+            toMicros(std::chrono::steady_clock::now() - start));
+      }
     }
   });
+  setSocketFdName(callbackFd_, "callback_queue");
 }
 
 ZmqEventLoop::~ZmqEventLoop() {
   close(signalFd_);
   close(callbackFd_);
+  if (timerFd_ >= 0) {
+    close(timerFd_);
+  }
 }
 
 void
@@ -82,6 +298,10 @@ ZmqEventLoop::run() {
     threadId_.store({}, std::memory_order_relaxed);
   };
 
+  if (not threadCpus_.empty()) {
+    applyThreadAffinity();
+  }
+
   // Start the magic
   loopForever();
 }
@@ -91,11 +311,138 @@ ZmqEventLoop::stop() {
   CHECK(isRunning()) << "Attempt to stop a non-running thread";
 
   // Send signal on the signalFd_ (eventfd)
-  uint64_t buf{1};
+  uint64_t buf{kStopSignal};
+  auto bytesWritten = write(signalFd_, static_cast<void*>(&buf), sizeof(buf));
+  CHECK_EQ(sizeof(buf), bytesWritten);
+}
+
+void
+ZmqEventLoop::drainAndStop(std::chrono::milliseconds timeout) {
+  CHECK(isRunning()) << "Attempt to drain a non-running thread";
+
+  drainTimeoutMs_.store(timeout.count(), std::memory_order_relaxed);
+  uint64_t buf{kDrainSignal};
   auto bytesWritten = write(signalFd_, static_cast<void*>(&buf), sizeof(buf));
   CHECK_EQ(sizeof(buf), bytesWritten);
 }
 
+int64_t
+ZmqEventLoop::addDrainCheck(DrainCheck check) {
+  CHECK(isInEventLoop());
+  const auto checkId = nextDrainCheckId_++;
+  drainChecks_.emplace(checkId, std::move(check));
+  return checkId;
+}
+
+void
+ZmqEventLoop::removeDrainCheck(int64_t checkId) {
+  CHECK(isInEventLoop());
+  drainChecks_.erase(checkId);
+}
+
+size_t
+ZmqEventLoop::getNumPendingDrainWork() const {
+  size_t numPending = 0;
+  for (auto const& kv : drainChecks_) {
+    numPending += kv.second();
+  }
+  return numPending;
+}
+
+void
+ZmqEventLoop::startDrain(std::chrono::milliseconds timeout) {
+  if (draining_) {
+    return;
+  }
+  draining_ = true;
+  drainDeadline_ = std::chrono::steady_clock::now() + timeout;
+  drainStats_ = DrainStats{};
+
+  // Stop reading, internal fds keep driving callbacks and timers
+  for (auto const& kv : socketMap_) {
+    setQuiescedEvents(kv.second, kv.second->events);
+  }
+  for (auto const& kv : socketFdMap_) {
+    if (kv.first != signalFd_ and kv.first != callbackFd_ and
+        kv.first != timerFd_) {
+      setQuiescedEvents(kv.second, kv.second->events);
+    }
+  }
+}
+
+void
+ZmqEventLoop::setQuiescedEvents(
+    std::shared_ptr<PollSubscription> const& subscription, short events) {
+  // Subscription is registered with poller as long as it has events left
+  // without ZMQ_POLLIN, and with full events before it got quiesced
+  auto& entry = quiesced_[subscription.get()];
+  const bool registered =
+      entry.first == nullptr or (entry.second & ~ZMQ_POLLIN) != 0;
+  entry.first = subscription;
+  entry.second = events;
+
+  const short quiescedEvents = events & ~ZMQ_POLLIN;
+  if (registered and quiescedEvents) {
+    poller_->update(subscription, quiescedEvents);
+  } else if (registered) {
+    poller_->remove(subscription);
+  } else if (quiescedEvents) {
+    subscription->events = quiescedEvents;
+    poller_->add(subscription);
+  }
+}
+
+bool
+ZmqEventLoop::isDrained() {
+  const auto now = std::chrono::steady_clock::now();
+  // same conditions as processTimeouts and processHighResTimers
+  const bool timeoutsDue =
+      not timeoutHeap_.empty() and timeoutHeap_.topTime() < now;
+  const auto wheelWakeup =
+      timerWheel_ ? timerWheel_->nextWakeup() : folly::none;
+  const bool highResTimeoutsDue = wheelWakeup and *wheelWakeup <= now;
+  if (not timeoutsDue and not highResTimeoutsDue and
+      callbackQueue_.size() <= 0 and getNumPendingDrainWork() == 0) {
+    return true;
+  }
+  if (now >= drainDeadline_) {
+    drainStats_.timedOut = true;
+    return true;
+  }
+  return false;
+}
+
+void
+ZmqEventLoop::finishDrain() {
+  // Hard stop cuts drain short as well
+  if (not isDrained()) {
+    drainStats_.timedOut = true;
+  }
+  drainStats_.numCallbacksDropped = std::max<ssize_t>(0, callbackQueue_.size());
+  drainStats_.numTimeoutsDropped = getNumPendingTimeouts();
+  drainStats_.numPendingDropped = getNumPendingDrainWork();
+  VLOG(2) << "ZmqEventLoop: Drained " << drainStats_.numCallbacksRun
+          << " callbacks and " << drainStats_.numTimeoutsRun
+          << " timeouts, left behind " << drainStats_.numCallbacksDropped
+          << " callbacks, " << drainStats_.numTimeoutsDropped
+          << " timeouts and " << drainStats_.numPendingDropped
+          << " pending items";
+
+  // Subscribe to requested events again
+  for (auto& kv : quiesced_) {
+    auto& subscription = kv.second.first;
+    const short events = kv.second.second;
+    if (events & ~ZMQ_POLLIN) {
+      poller_->update(subscription, events);
+    } else {
+      subscription->events = events;
+      poller_->add(subscription);
+    }
+  }
+  quiesced_.clear();
+  draining_ = false;
+}
+
 void
 ZmqEventLoop::addSocket(
     RawZmqSocketPtr socketPtr, int events, SocketCallback callback) {
@@ -105,10 +452,17 @@ ZmqEventLoop::addSocket(
     throw std::runtime_error("Socket callback already registered.");
   }
 
-  auto subscription =
-      std::make_shared<PollSubscription>(events, std::move(callback));
+  auto subscription = std::make_shared<PollSubscription>(
+      reinterpret_cast<void*>(static_cast<uintptr_t>(socketPtr)),
+      -1 /* fd */,
+      events,
+      std::move(callback));
+  resolveCallbackStat(*subscription);
+  poller_->add(subscription);
+  if (draining_) {
+    setQuiescedEvents(subscription, events);
+  }
   socketMap_.emplace(socketPtr, std::move(subscription));
-  needsRebuild_ = true;
 }
 
 void
@@ -119,25 +473,86 @@ ZmqEventLoop::addSocketFd(int socketFd, int events, SocketCallback callback) {
     throw std::runtime_error("Socket callback already registered.");
   }
 
-  auto subscription =
-      std::make_shared<PollSubscription>(events, std::move(callback));
+  auto subscription = std::make_shared<PollSubscription>(
+      nullptr /* socket */, socketFd, events, std::move(callback));
+  resolveCallbackStat(*subscription);
+  poller_->add(subscription);
+  if (draining_ and socketFd != timerFd_) {
+    setQuiescedEvents(subscription, events);
+  }
   socketFdMap_.emplace(socketFd, std::move(subscription));
-  needsRebuild_ = true;
 }
 
 void
 ZmqEventLoop::removeSocket(RawZmqSocketPtr socketPtr) {
   CHECK(isInEventLoop());
-  if (socketMap_.erase(socketPtr)) {
-    needsRebuild_ = true;
+  auto it = socketMap_.find(socketPtr);
+  if (it == socketMap_.end()) {
+    return;
   }
+
+  // Subscription might still be referred by pending events of current poll
+  it->second->active = false;
+  it->second->callbackStat = nullptr;
+  setPriority(*it->second, SocketPriority::NORMAL, 1);
+  quiesced_.erase(it->second.get());
+  poller_->remove(it->second);
+  socketMap_.erase(it);
 }
 
 void
 ZmqEventLoop::removeSocketFd(int socketFd) {
   CHECK(isInEventLoop());
-  if (socketFdMap_.erase(socketFd)) {
-    needsRebuild_ = true;
+  auto it = socketFdMap_.find(socketFd);
+  if (it == socketFdMap_.end()) {
+    return;
+  }
+
+  // Subscription might still be referred by pending events of current poll
+  it->second->active = false;
+  it->second->callbackStat = nullptr;
+  setPriority(*it->second, SocketPriority::NORMAL, 1);
+  quiesced_.erase(it->second.get());
+  poller_->remove(it->second);
+  socketFdMap_.erase(it);
+}
+
+void
+ZmqEventLoop::updateSocketEvents(RawZmqSocketPtr socketPtr, int events) {
+  CHECK(isInEventLoop());
+  CHECK_NE(0, events) << "Subscription events can't be empty.";
+  auto it = socketMap_.find(socketPtr);
+  if (it == socketMap_.end()) {
+    throw std::runtime_error("Socket callback not registered.");
+  }
+  if (quiesced_.count(it->second.get())) {
+    setQuiescedEvents(it->second, events);
+    return;
+  }
+  poller_->update(it->second, events);
+}
+
+void
+ZmqEventLoop::updateSocketFdEvents(int socketFd, int events) {
+  CHECK(isInEventLoop());
+  CHECK_NE(0, events) << "Subscription events can't be empty.";
+  auto it = socketFdMap_.find(socketFd);
+  if (it == socketFdMap_.end()) {
+    throw std::runtime_error("Socket callback not registered.");
+  }
+  if (quiesced_.count(it->second.get())) {
+    setQuiescedEvents(it->second, events);
+    return;
+  }
+  poller_->update(it->second, events);
+}
+
+void
+ZmqEventLoop::recheckSocket(RawZmqSocketPtr socketPtr) {
+  CHECK(isInEventLoop());
+  auto it = socketMap_.find(socketPtr);
+  if (it != socketMap_.end()) {
+    poller_->recheck(it->second);
   }
 }
 
@@ -154,16 +569,201 @@ ZmqEventLoop::scheduleTimeoutAt(
     std::chrono::steady_clock::time_point scheduleTime,
     TimeoutCallback callback) {
   CHECK(isInEventLoop());
-  auto timeoutId = timeoutId_++;
-  timeoutHeap_.emplace(scheduleTime, std::move(callback), timeoutId);
-  activeTimeouts_.insert(timeoutId);
-  return timeoutId;
+  return timeoutHeap_.push(scheduleTime, std::move(callback));
+}
+
+int64_t
+ZmqEventLoop::scheduleHighResTimeout(
+    std::chrono::microseconds timeout, TimeoutCallback callback) {
+  CHECK(isInEventLoop());
+  if (!timerWheel_) {
+    initHighResTimers();
+  }
+
+  auto timeoutId = timerWheel_->schedule(
+      std::chrono::steady_clock::now() + timeout, std::move(callback));
+  armHighResTimer();
+  return timeoutId | kHighResTimeoutFlag;
 }
 
 bool
 ZmqEventLoop::cancelTimeout(int64_t timeoutId) {
   CHECK(isInEventLoop());
-  return activeTimeouts_.erase(timeoutId) > 0;
+  if (timeoutId & kHighResTimeoutFlag) {
+    // timerfd is left armed, spurious wakeup will be handled gracefully
+    return timerWheel_ && timerWheel_->cancel(timeoutId & ~kHighResTimeoutFlag);
+  }
+  return timeoutHeap_.erase(timeoutId);
+}
+
+void
+ZmqEventLoop::initHighResTimers() {
+  if ((timerFd_ = timerfd_create(
+           CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+    LOG(FATAL) << "ZmqEventLoop: Failed to create a timerfd.";
+  }
+  timerWheel_ = std::make_unique<TimerWheel>();
+
+  addSocketFd(timerFd_, ZMQ_POLLIN, [this](int revents) noexcept {
+    CHECK(revents & ZMQ_POLLIN);
+
+    // Receive expiration count. Can fail with EAGAIN if timer got re-armed
+    // after it was reported readable, which is fine.
+    uint64_t buf;
+    auto bytesRead = read(timerFd_, static_cast<void*>(&buf), sizeof(buf));
+    (void)bytesRead;
+
+    if (instrumentation_ && timerFdArmedAt_) {
+      instrumentation_->timerSlip.add(
+          instrumentation_->threadData,
+          toMicros(std::chrono::steady_clock::now() - *timerFdArmedAt_));
+    }
+    timerFdArmedAt_.clear();
+    processHighResTimers();
+  });
+  setSocketFdName(timerFd_, "high_res_timers");
+}
+
+void
+ZmqEventLoop::armHighResTimer() {
+  auto wakeup = timerWheel_->nextWakeup();
+  if (!wakeup) {
+    return;
+  }
+  if (timerFdArmedAt_ && *timerFdArmedAt_ <= *wakeup) {
+    return;
+  }
+
+  // steady_clock is CLOCK_MONOTONIC, hence absolute time can be used as is.
+  // Zero value disarms the timer so use at least 1ns.
+  auto nanos = std::max<int64_t>(
+      1,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          wakeup->time_since_epoch())
+          .count());
+  struct itimerspec spec {};
+  spec.it_value.tv_sec = nanos / 1000000000;
+  spec.it_value.tv_nsec = nanos % 1000000000;
+  if (timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+    LOG(FATAL) << "ZmqEventLoop: Failed to arm timerfd.";
+  }
+  timerFdArmedAt_ = *wakeup;
+}
+
+void
+ZmqEventLoop::processHighResTimers() {
+  timerWheel_->advance(std::chrono::steady_clock::now());
+  while (auto callback = timerWheel_->popExpired()) {
+    // Callback can in turn schedule or cancel more timeouts
+    if (draining_) {
+      ++drainStats_.numTimeoutsRun;
+    }
+    callback();
+  }
+  armHighResTimer();
+}
+
+folly::Future<int>
+ZmqEventLoop::readable(
+    RawZmqSocketPtr socketPtr,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  return waitForEvents(socketPtr, ZMQ_POLLIN, timeout);
+}
+
+folly::Future<int>
+ZmqEventLoop::writable(
+    RawZmqSocketPtr socketPtr,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  return waitForEvents(socketPtr, ZMQ_POLLOUT, timeout);
+}
+
+folly::Future<int>
+ZmqEventLoop::waitForEvents(
+    RawZmqSocketPtr socketPtr,
+    int events,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  CHECK(isInEventLoop());
+
+  // Shared by socket and timeout callbacks, whichever fires first wins
+  struct Waiter {
+    folly::Promise<int> promise;
+    folly::Optional<int64_t> timeoutId;
+  };
+  auto waiter = std::make_shared<Waiter>();
+  auto future = waiter->promise.getFuture();
+
+  try {
+    addSocket(
+        socketPtr, events, [this, socketPtr, waiter](int revents) noexcept {
+          // Keep waiter alive, removing socket destroys this callback
+          auto self = waiter;
+          if (self->timeoutId) {
+            cancelTimeout(*self->timeoutId);
+          }
+          removeSocket(socketPtr);
+          self->promise.setValue(revents);
+        });
+  } catch (std::exception const& e) {
+    return folly::makeFuture<int>(std::runtime_error(e.what()));
+  }
+
+  if (timeout) {
+    waiter->timeoutId =
+        scheduleTimeout(*timeout, [this, socketPtr, waiter]() noexcept {
+          removeSocket(socketPtr);
+          waiter->promise.setException(std::system_error(
+              EAGAIN, std::generic_category(), "Timed out waiting on socket"));
+        });
+  }
+  return future;
+}
+
+folly::Future<Message>
+ZmqEventLoop::recvAsync(
+    detail::SocketImpl& socket,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  CHECK(isInEventLoop());
+
+  auto maybeMsg = socket.recvOne(std::chrono::milliseconds(0));
+  if (maybeMsg.hasValue()) {
+    return folly::makeFuture(std::move(maybeMsg).value());
+  }
+  if (maybeMsg.error().errNum != EAGAIN) {
+    return folly::makeFuture<Message>(std::system_error(
+        maybeMsg.error().errNum,
+        std::generic_category(),
+        maybeMsg.error().errString));
+  }
+
+  // Retry once readable, with what is left of timeout. Readiness can be
+  // spurious e.g. when other party disconnects.
+  folly::Optional<std::chrono::steady_clock::time_point> deadline;
+  if (timeout) {
+    deadline = std::chrono::steady_clock::now() + *timeout;
+  }
+  return readable(RawZmqSocketPtr{*socket}, timeout)
+      .then([this, &socket, deadline](int) {
+        folly::Optional<std::chrono::milliseconds> remaining;
+        if (deadline) {
+          remaining = std::max(
+              std::chrono::milliseconds(0),
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  *deadline - std::chrono::steady_clock::now()));
+        }
+        return recvAsync(socket, remaining);
+      });
+}
+
+folly::Future<folly::Unit>
+ZmqEventLoop::sleep(std::chrono::milliseconds duration) {
+  CHECK(isInEventLoop());
+  folly::Promise<folly::Unit> promise;
+  auto future = promise.getFuture();
+  scheduleTimeout(
+      duration, [promise = std::move(promise)]() mutable noexcept {
+        promise.setValue(folly::Unit{});
+      });
+  return future;
 }
 
 void
@@ -175,7 +775,51 @@ ZmqEventLoop::runInEventLoop(TimeoutCallback callback) {
   CHECK(!isRunning() || !isInEventLoop());
 
   // Enqueue the callback
-  callbackQueue_.blockingWrite(std::move(callback));
+  callbackQueue_.blockingWrite(makeQueuedCallback(std::move(callback)));
+  signalCallbacks();
+}
+
+void
+ZmqEventLoop::runInEventLoop(std::vector<TimeoutCallback> callbacks) {
+  CHECK(!isRunning() || !isInEventLoop());
+
+  for (auto& callback : callbacks) {
+    // Let loop start on what we have enqueued so far if queue is full, else
+    // we may block forever
+    auto item = makeQueuedCallback(std::move(callback));
+    if (!callbackQueue_.write(std::move(item))) {
+      signalCallbacks();
+      callbackQueue_.blockingWrite(std::move(item));
+    }
+  }
+  signalCallbacks();
+}
+
+bool
+ZmqEventLoop::tryRunInEventLoop(TimeoutCallback callback) {
+  if (!callbackQueue_.write(makeQueuedCallback(std::move(callback)))) {
+    return false;
+  }
+  signalCallbacks();
+  return true;
+}
+
+ZmqEventLoop::QueuedCallback
+ZmqEventLoop::makeQueuedCallback(TimeoutCallback callback) const {
+  QueuedCallback item;
+  item.callback = std::move(callback);
+  if (instrumented_.load(std::memory_order_relaxed)) {
+    item.enqueueTime = std::chrono::steady_clock::now();
+  }
+  return item;
+}
+
+void
+ZmqEventLoop::signalCallbacks() {
+  // Loop is already signalled and hasn't started draining yet
+  if (callbackSignalPending_.exchange(true, std::memory_order_seq_cst)) {
+    return;
+  }
 
   // Send signal on the callbackFd_ (eventfd)
   uint64_t buf{1};
@@ -193,15 +837,261 @@ ZmqEventLoop::runImmediatelyOrInEventLoop(TimeoutCallback callback) {
   runInEventLoop(std::move(callback));
 }
 
+void
+ZmqEventLoop::setBusyPollBudget(
+    std::chrono::microseconds budget, bool adaptive) {
+  CHECK(isInEventLoop());
+  CHECK_LE(0, budget.count()) << "Busy poll budget can't be negative";
+  busyPollMaxBudget_ = budget;
+  busyPollBudget_ = budget;
+  busyPollAdaptive_ = adaptive;
+  currentBudgetUs_.store(budget.count(), std::memory_order_relaxed);
+}
+
+void
+ZmqEventLoop::setThreadAffinity(std::vector<int> cpus) {
+  CHECK(isInEventLoop());
+  threadCpus_ = std::move(cpus);
+  if (isRunning() and not threadCpus_.empty()) {
+    applyThreadAffinity();
+  }
+}
+
+void
+ZmqEventLoop::applyThreadAffinity() const {
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (const auto cpu : threadCpus_) {
+    CHECK(cpu >= 0 and cpu < CPU_SETSIZE) << "Invalid CPU " << cpu;
+    CPU_SET(cpu, &cpuSet);
+  }
+  const int rc =
+      pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+  if (rc != 0) {
+    throw std::system_error(rc, std::system_category(), "set thread affinity");
+  }
+}
+
+ZmqEventLoop::BusyPollStats
+ZmqEventLoop::getBusyPollStats() const {
+  BusyPollStats stats;
+  stats.numSpinHits = numSpinHits_.load(std::memory_order_relaxed);
+  stats.numSpinMisses = numSpinMisses_.load(std::memory_order_relaxed);
+  stats.numSpinPolls = numSpinPolls_.load(std::memory_order_relaxed);
+  stats.currentBudget = std::chrono::microseconds(
+      currentBudgetUs_.load(std::memory_order_relaxed));
+  return stats;
+}
+
+void
+ZmqEventLoop::enableInstrumentation(
+    ThreadData& threadData, std::string const& prefix) {
+  CHECK(isInEventLoop());
+  instrumentation_ = std::make_unique<Instrumentation>(threadData, prefix);
+  instrumented_.store(true, std::memory_order_relaxed);
+  resolveCallbackStats();
+}
+
+void
+ZmqEventLoop::disableInstrumentation() {
+  CHECK(isInEventLoop());
+  instrumented_.store(false, std::memory_order_relaxed);
+  instrumentation_.reset();
+  resolveCallbackStats();
+}
+
+void
+ZmqEventLoop::resolveCallbackStat(PollSubscription& subscription) {
+  subscription.callbackStat = instrumentation_
+      ? instrumentation_->getCallbackStat(subscription.name)
+      : nullptr;
+}
+
+void
+ZmqEventLoop::resolveCallbackStats() {
+  for (auto& kv : socketMap_) {
+    resolveCallbackStat(*kv.second);
+  }
+  for (auto& kv : socketFdMap_) {
+    resolveCallbackStat(*kv.second);
+  }
+}
+
+void
+ZmqEventLoop::setSocketName(RawZmqSocketPtr socketPtr, std::string name) {
+  CHECK(isInEventLoop());
+  auto it = socketMap_.find(socketPtr);
+  if (it != socketMap_.end()) {
+    it->second->name = std::move(name);
+    resolveCallbackStat(*it->second);
+  }
+}
+
+void
+ZmqEventLoop::setSocketFdName(int socketFd, std::string name) {
+  CHECK(isInEventLoop());
+  auto it = socketFdMap_.find(socketFd);
+  if (it != socketFdMap_.end()) {
+    it->second->name = std::move(name);
+    resolveCallbackStat(*it->second);
+  }
+}
+
+void
+ZmqEventLoop::setSocketPriority(
+    RawZmqSocketPtr socketPtr,
+    SocketPriority priority,
+    size_t maxDispatchesPerIteration) {
+  CHECK(isInEventLoop());
+  CHECK_LT(0, maxDispatchesPerIteration);
+  auto it = socketMap_.find(socketPtr);
+  if (it == socketMap_.end()) {
+    throw std::runtime_error("Socket callback not registered.");
+  }
+  setPriority(*it->second, priority, maxDispatchesPerIteration);
+}
+
+void
+ZmqEventLoop::setSocketFdPriority(int socketFd, SocketPriority priority) {
+  CHECK(isInEventLoop());
+  auto it = socketFdMap_.find(socketFd);
+  if (it == socketFdMap_.end()) {
+    throw std::runtime_error("Socket fd callback not registered.");
+  }
+  setPriority(*it->second, priority, 1);
+}
+
+void
+ZmqEventLoop::setPriority(
+    PollSubscription& subscription,
+    SocketPriority priority,
+    size_t maxDispatches) {
+  const auto isPrioritized = [](PollSubscription const& sub) {
+    return sub.priority != SocketPriority::NORMAL or sub.maxDispatches != 1;
+  };
+  const bool wasPrioritized = isPrioritized(subscription);
+  subscription.priority = priority;
+  subscription.maxDispatches = maxDispatches;
+  const bool prioritized = isPrioritized(subscription);
+  if (prioritized and not wasPrioritized) {
+    ++numPrioritized_;
+  } else if (wasPrioritized and not prioritized) {
+    --numPrioritized_;
+  }
+}
+
+void
+ZmqEventLoop::dispatch(PollSubscription& subscription, int revents) {
+  for (size_t numDispatches = 0;;) {
+    if (instrumentation_) {
+      invokeInstrumented(subscription, revents);
+    } else {
+      subscription.callback(revents);
+    }
+
+    // Stop once budget is used up, subscription got removed by callback or
+    // socket has nothing more for it. Readiness of fds isn't known.
+    if (++numDispatches >= subscription.maxDispatches or
+        not subscription.active or subscription.socket == nullptr) {
+      return;
+    }
+    int zmqEvents{0};
+    size_t zmqEventsLen = sizeof(zmqEvents);
+    if (zmq_getsockopt(
+            subscription.socket, ZMQ_EVENTS, &zmqEvents, &zmqEventsLen) != 0) {
+      return;
+    }
+    revents = zmqEvents & subscription.events;
+    if (revents == 0) {
+      return;
+    }
+  }
+}
+
+void
+ZmqEventLoop::processTimeouts() {
+  auto now = std::chrono::steady_clock::now();
+  while (!timeoutHeap_.empty() && (timeoutHeap_.topTime() < now)) {
+    const auto expiry = timeoutHeap_.topTime();
+    // Callback must be issued after popping up the timeout as it can in turn
+    // schedule or cancel more timeouts.
+    auto callback = timeoutHeap_.pop();
+    if (draining_) {
+      ++drainStats_.numTimeoutsRun;
+    }
+    if (not instrumentation_) {
+      callback();
+      continue;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    instrumentation_->timerSlip.add(
+        instrumentation_->threadData, toMicros(start - expiry));
+    callback();
+    if (instrumentation_) {
+      instrumentation_->timeoutCallback.add(
+          instrumentation_->threadData,
+          toMicros(std::chrono::steady_clock::now() - start));
+    }
+  }
+}
+
+void
+ZmqEventLoop::invokeInstrumented(PollSubscription& subscription, int revents) {
+  const auto start = std::chrono::steady_clock::now();
+  subscription.callback(revents);
+  // Callback can disable instrumentation or remove subscription
+  if (instrumentation_ and subscription.callbackStat) {
+    subscription.callbackStat->add(
+        instrumentation_->threadData,
+        toMicros(std::chrono::steady_clock::now() - start));
+  }
+}
+
+bool
+ZmqEventLoop::busyPoll(std::chrono::milliseconds pollTimeout) {
+  const auto start = std::chrono::steady_clock::now();
+  auto deadline = start + busyPollBudget_;
+  if (pollTimeout.count() >= 0) {
+    deadline = std::min(deadline, start + pollTimeout);
+  }
+
+  bool hit = false;
+  do {
+    poller_->wait(std::chrono::milliseconds(0), pollEvents_).value();
+    increment(numSpinPolls_);
+    if (not pollEvents_.empty()) {
+      hit = true;
+      break;
+    }
+  } while (std::chrono::steady_clock::now() < deadline);
+
+  if (hit) {
+    increment(numSpinHits_);
+  } else {
+    increment(numSpinMisses_);
+  }
+
+  if (busyPollAdaptive_) {
+    const auto minBudget = std::max(
+        std::chrono::microseconds(1),
+        busyPollMaxBudget_ / kMinBusyPollBudgetDivisor);
+    busyPollBudget_ = hit ? std::min(busyPollMaxBudget_, busyPollBudget_ * 2)
+                          : std::max(minBudget, busyPollBudget_ / 2);
+    currentBudgetUs_.store(busyPollBudget_.count(), std::memory_order_relaxed);
+  }
+  return hit;
+}
+
 void
 ZmqEventLoop::loopForever() {
   std::chrono::milliseconds pollTimeout;
   stop_ = false;
   while (not stop_) {
-    // Rebuild poll-items if needed
-    if (needsRebuild_) {
-      rebuildPollItems();
-      needsRebuild_ = false;
+    // Stop once drain has completed or timed out
+    if (draining_ and isDrained()) {
+      stop_ = true;
+      break;
     }
 
     // Calculate poll-timeout. If there is a pending timeout then poll-timeout
@@ -211,7 +1101,7 @@ ZmqEventLoop::loopForever() {
     if (not timeoutHeap_.empty()) {
       // Calculate waitTime for next scheduled event
       auto waitTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-          timeoutHeap_.top().scheduledTime - std::chrono::steady_clock::now());
+          timeoutHeap_.topTime() - std::chrono::steady_clock::now());
 
       // wait time can be negative if scheduled-timeout is already active
       pollTimeout = std::max(std::chrono::milliseconds(1), waitTime);
@@ -220,55 +1110,90 @@ ZmqEventLoop::loopForever() {
       pollTimeout = std::chrono::milliseconds(-1);
     }
 
+    // Wake up regularly while draining to check for completion
+    if (draining_ and
+        (pollTimeout.count() < 0 or pollTimeout > kDrainPollInterval)) {
+      pollTimeout = kDrainPollInterval;
+    }
+
     // Perform polling on sockets
     VLOG(5) << "ZmqEventLoop: Polling with poll timeout of "
             << pollTimeout.count() << "ms.";
+    const bool instrumented = instrumentation_ != nullptr;
+    const auto idleStart = instrumented
+        ? std::chrono::steady_clock::now()
+        : std::chrono::steady_clock::time_point{};
+
+    // Spin for a while before going to sleep if configured so
+    bool hasEvents = false;
+    if (busyPollBudget_.count() > 0) {
+      const auto spinStart = std::chrono::steady_clock::now();
+      hasEvents = busyPoll(pollTimeout);
+      if (not hasEvents and pollTimeout.count() > 0) {
+        // Account for time spent spinning
+        pollTimeout = std::max(
+            std::chrono::milliseconds(0),
+            pollTimeout -
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - spinStart));
+      }
+    }
+
     // this will throw on error
-    int count = fbzmq::poll(pollItems_, pollTimeout).value();
-    for (size_t i = 0; i < pollItems_.size() && count > 0; ++i) {
-      auto& item = pollItems_[i];
-      auto& subscription = pollSubscriptions_[i];
-      if (item.revents & subscription->events) {
-        subscription->callback(item.revents & subscription->events);
-        --count;
+    if (not hasEvents) {
+      poller_->wait(pollTimeout, pollEvents_).value();
+    }
+    const auto busyStart = instrumented
+        ? std::chrono::steady_clock::now()
+        : std::chrono::steady_clock::time_point{};
+    // Dispatch by priority if any subscription asked for it. Due timeouts
+    // are processed once HIGH priority events have been dispatched.
+    const bool prioritized = numPrioritized_ > 0;
+    if (prioritized) {
+      std::stable_sort(
+          pollEvents_.begin(),
+          pollEvents_.end(),
+          [](PollEvent const& lhs, PollEvent const& rhs) {
+            return lhs.subscription->priority < rhs.subscription->priority;
+          });
+    }
+    bool timeoutsProcessed = false;
+    for (auto& event : pollEvents_) {
+      if (prioritized and not timeoutsProcessed and
+          event.subscription->priority != SocketPriority::HIGH) {
+        processTimeouts();
+        timeoutsProcessed = true;
+      }
+      // Skip subscriptions removed by callbacks processed before
+      if (not event.subscription->active) {
+        continue;
       }
+      // Read events reported before drain started are left unhandled
+      int revents = event.revents;
+      if (draining_ and quiesced_.count(event.subscription.get())) {
+        revents &= ~ZMQ_POLLIN;
+        if (revents == 0) {
+          continue;
+        }
+      }
+      dispatch(*event.subscription, revents);
     } // end for
+    pollEvents_.clear();
 
     // Process timeout heap
-    auto now = std::chrono::steady_clock::now();
-    while (!timeoutHeap_.empty() && (timeoutHeap_.top().scheduledTime < now)) {
-      // Skip processing if timeout is not active
-      if (not activeTimeouts_.erase(timeoutHeap_.top().timeoutId)) {
-        timeoutHeap_.pop();
-        continue;
-      }
+    if (not timeoutsProcessed) {
+      processTimeouts();
+    }
 
-      // Callback must be issued after popping up the timeout as it can in turn
-      // push some more callbacks which can potentially make the callback
-      // to be destroyed.
-      auto callbackPtr = std::move(timeoutHeap_.top().callbackPtr); // Move ptr
-      timeoutHeap_.pop();
-      (*callbackPtr)();
+    // Skip iterations during which instrumentation got enabled or disabled
+    if (instrumented and instrumentation_) {
+      instrumentation_->recordIteration(
+          idleStart, busyStart, std::chrono::steady_clock::now());
     }
   } // end while
-}
-
-void
-ZmqEventLoop::rebuildPollItems() {
-  pollItems_.clear();
-  pollSubscriptions_.clear();
-  pollItems_.reserve(socketMap_.size() + socketFdMap_.size());
-  pollSubscriptions_.reserve(socketMap_.size() + socketFdMap_.size());
 
-  for (auto& kv : socketMap_) {
-    pollItems_.push_back(
-        {reinterpret_cast<void*>(kv.first), 0, kv.second->events, 0});
-    pollSubscriptions_.push_back(kv.second);
-  }
-
-  for (auto& kv : socketFdMap_) {
-    pollItems_.push_back({nullptr, kv.first, kv.second->events, 0});
-    pollSubscriptions_.push_back(kv.second);
+  if (draining_) {
+    finishDrain();
   }
 }
 
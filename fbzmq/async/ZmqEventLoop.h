@@ -11,28 +11,35 @@
 
 #include <atomic>
 #include <chrono>
+#include <functional>
+#include <map>
 #include <memory>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
-#include <boost/heap/priority_queue.hpp>
 #include <boost/serialization/strong_typedef.hpp>
 #include <folly/Function.h>
 #include <folly/MPMCQueue.h>
+#include <folly/Optional.h>
+#include <folly/futures/Future.h>
 #include <glog/logging.h>
 #include <zmq.h>
 
+#include <fbzmq/async/Poller.h>
 #include <fbzmq/async/Runnable.h>
+#include <fbzmq/async/TimeoutHeap.h>
+#include <fbzmq/async/TimerWheel.h>
+#include <fbzmq/zmq/Socket.h>
 
 namespace fbzmq {
 
-using SocketCallback = folly::Function<void(int revents) noexcept>;
-using TimeoutCallback = folly::Function<void(void) noexcept>;
-
 BOOST_STRONG_TYPEDEF(uintptr_t, RawZmqSocketPtr)
 
+class ThreadData;
+
 /**
  * In ZMQ world thread is all about multiplexing read/write of messages on
  * multiple sockets into a single loop. This class wraps up many basic
@@ -61,10 +68,57 @@ BOOST_STRONG_TYPEDEF(uintptr_t, RawZmqSocketPtr)
  * Usage: You can either inherit this class or create an object and use it as
  * a looper (just like folly::EventBase). Look into `examples` to get started.
  *
+ * Polling backend can be chosen via `pollerType`. `PollerType::EPOLL` scales
+ * with number of active sockets instead of number of registered sockets and
+ * is recommended for loops with large number of subscriptions (look into
+ * `Poller.h` for caveats).
+ *
  */
 class ZmqEventLoop : public Runnable {
  public:
-  explicit ZmqEventLoop(uint64_t queueCapacity = 1e4);
+  /**
+   * Counters of busy polling, look at `setBusyPollBudget`
+   */
+  struct BusyPollStats {
+    // Spins which found events within the budget
+    uint64_t numSpinHits{0};
+
+    // Spins which exhausted the budget and fell back to blocking poll
+    uint64_t numSpinMisses{0};
+
+    // Zero timeout polls issued while spinning
+    uint64_t numSpinPolls{0};
+
+    // Budget currently in effect (varies in adaptive mode)
+    std::chrono::microseconds currentBudget{0};
+  };
+
+  /**
+   * Outcome of last drain, look at `drainAndStop`
+   */
+  struct DrainStats {
+    // Queued callbacks and timeouts invoked while draining
+    uint64_t numCallbacksRun{0};
+    uint64_t numTimeoutsRun{0};
+
+    // Left behind once loop stopped: queued callbacks, pending timeouts
+    // (which are kept for next run) and work reported by drain checks
+    uint64_t numCallbacksDropped{0};
+    uint64_t numTimeoutsDropped{0};
+    uint64_t numPendingDropped{0};
+
+    // Whether drain has been cut short by its deadline (or by `stop`)
+    bool timedOut{false};
+  };
+
+  /**
+   * Amount of outstanding work of a component, look at `addDrainCheck`
+   */
+  using DrainCheck = std::function<size_t()>;
+
+  explicit ZmqEventLoop(
+      uint64_t queueCapacity = 1e4,
+      PollerType pollerType = PollerType::ZMQ_POLL);
 
   ~ZmqEventLoop() override;
 
@@ -98,6 +152,39 @@ class ZmqEventLoop : public Runnable {
    */
   void stop() override;
 
+  /**
+   * Graceful variant of `stop`, for restarts which shouldn't lose in-flight
+   * work. Loop stops dispatching read events (subscriptions keep getting
+   * other events, e.g. ZMQ_POLLOUT of buffered writers), and keeps running
+   * queued callbacks and due timeouts and waiting for work reported by drain
+   * checks. It stops once nothing is left or `timeout` has passed, whichever
+   * comes first, and reports what has been drained vs dropped via
+   * `getDrainStats`. Timeouts which aren't due yet don't hold loop back.
+   *
+   * Can be invoked from any thread, like `stop`, which aborts ongoing drain.
+   * Read events are subscribed to again once loop stops, so it can be run
+   * again.
+   */
+  void drainAndStop(std::chrono::milliseconds timeout);
+
+  /**
+   * Outcome of last drain. Must be called from within the loop or once it
+   * has stopped.
+   */
+  DrainStats
+  getDrainStats() const {
+    return drainStats_;
+  }
+
+  /**
+   * Register check reporting amount of work a component still has to
+   * complete (e.g. messages waiting to be sent). Drain doesn't stop the loop
+   * before all checks report zero, unless it times out. Returns id for
+   * `removeDrainCheck`.
+   */
+  int64_t addDrainCheck(DrainCheck check);
+  void removeDrainCheck(int64_t checkId);
+
   bool
   isRunning() const override {
     return threadId_.load(std::memory_order_relaxed) != 0;
@@ -139,6 +226,9 @@ class ZmqEventLoop : public Runnable {
    * `events` bitmap for specifying polling events you are interested in.
    *
    * Callback will be invoked with the appropriate revents bitmap.
+   *
+   * Throws std::runtime_error if socket/fd is already registered or can't be
+   * registered with the polling backend.
    */
   void addSocketFd(int socketFd, int events, SocketCallback callback);
   void addSocket(
@@ -151,6 +241,24 @@ class ZmqEventLoop : public Runnable {
   void removeSocket(RawZmqSocketPtr socketPtr);
   void removeSocketFd(int socketFd);
 
+  /**
+   * Change polling events of an already registered socket/fd in place, e.g.
+   * to subscribe to ZMQ_POLLOUT only while there is something to write. The
+   * callback stays as is. Can be called from within the socket's callback.
+   *
+   * Throws std::runtime_error if socket/fd isn't registered.
+   */
+  void updateSocketEvents(RawZmqSocketPtr socketPtr, int events);
+  void updateSocketFdEvents(int socketFd, int events);
+
+  /**
+   * With edge triggered polling backend (`PollerType::EPOLL`), a send/recv on
+   * a registered socket outside of its own callback can consume the
+   * notification of pending events. Call this after such operations to get
+   * socket re-evaluated on next poll. No-op for other backends.
+   */
+  void recheckSocket(RawZmqSocketPtr socketPtr);
+
   /**
    * You can use this function to schedule an async-callback with specified
    * timeout. Callback will be invoked at least after specified duration but
@@ -162,6 +270,32 @@ class ZmqEventLoop : public Runnable {
   int64_t scheduleTimeout(
       std::chrono::milliseconds timeout, TimeoutCallback callback);
 
+  /**
+   * High resolution variant of above, selected when timeout is expressed in
+   * `std::chrono::microseconds`. Look at `scheduleHighResTimeout`.
+   */
+  template <
+      typename Duration,
+      std::enable_if_t<
+          std::is_same<Duration, std::chrono::microseconds>::value,
+          int> = 0>
+  int64_t
+  scheduleTimeout(Duration timeout, TimeoutCallback callback) {
+    return scheduleHighResTimeout(timeout, std::move(callback));
+  }
+
+  /**
+   * Schedule timeout with microsecond resolution. Regular timeouts are
+   * driven by poll timeout and hence have millisecond granularity (at least
+   * 1ms). High resolution timeouts are kept in a hierarchical timing wheel
+   * (O(1) schedule & cancel) which is driven by a timerfd registered with
+   * the loop, created on first use.
+   *
+   * Returned token can be used with `cancelTimeout` just like regular ones.
+   */
+  int64_t scheduleHighResTimeout(
+      std::chrono::microseconds timeout, TimeoutCallback callback);
+
   /**
    * Same as above method but takes a time-point after which to call this
    * callback. If two callbacks are inserted with same timestamp then their
@@ -175,17 +309,53 @@ class ZmqEventLoop : public Runnable {
       TimeoutCallback callback);
 
   /**
-   * Cancel previously scheduled timeout if it exists.
-   *
-   * NOTE: As of current implementation the scheduled timeout will incur the
-   *       memory overhead until its timeout is expired. We keep it in heap
-   *       and discard when it is processed.
+   * Cancel previously scheduled timeout if it exists. Timeout is removed
+   * from the timeout heap and its callback is destroyed immediately. This is
+   * O(log n) in number of pending timeouts.
    *
    * @returns: true if timeout is pending and has been cancelled else returns
    *           false if timeout already got executed.
    */
   bool cancelTimeout(int64_t timeoutId);
 
+  /**
+   * Future based API for writing multi-step protocols without blocking the
+   * loop. Futures are fulfilled within the loop's thread and continuations
+   * attached via `then` run inline there, so a single loop can drive many
+   * outstanding requests, e.g.
+   *
+   *   evl.recvAsync(sock, timeout).then([&](Message&& msg) {
+   *     ... process response and send next request ...
+   *     return evl.recvAsync(sock, timeout);
+   *   });
+   *
+   * `readable`/`writable` register socket for a single event and unregister
+   * it before fulfilling the future. Socket must not be registered otherwise
+   * (future fails with std::runtime_error). On timeout future fails with
+   * std::system_error(EAGAIN).
+   *
+   * `recvAsync` receives a message right away if one is available, else
+   * waits for socket to become readable. Socket must outlive the future.
+   *
+   * `sleep` completes after given duration, backed by the timeout heap.
+   *
+   * Must be called from within the loop (or before it runs). Futures of
+   * pending operations fail with folly::BrokenPromise if loop is destroyed.
+   *
+   * NOTE: Coroutines require C++20, these can be wrapped into awaitables once
+   * we move past C++14.
+   */
+  folly::Future<int> readable(
+      RawZmqSocketPtr socketPtr,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+  folly::Future<int> writable(
+      RawZmqSocketPtr socketPtr,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+  folly::Future<Message> recvAsync(
+      detail::SocketImpl& socket,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+  folly::Future<folly::Unit> sleep(std::chrono::milliseconds duration);
+
   /**
    * Special method to enqueue function calls into ZmqEventLoop's thread.
    * Function will return immediately and callback will be executed later on.
@@ -193,6 +363,10 @@ class ZmqEventLoop : public Runnable {
    * All callbaks enqueued from a single threads are guaranteed to be executed
    * in the same order.
    *
+   * Wakeups are coalesced, loop is signalled only if it hasn't been signalled
+   * already since it last started draining the queue. Under load most of the
+   * calls avoid the eventfd syscall.
+   *
    * NOTE: It can block if underlying queue capacity is full. You can configure
    * it to a bigger number via constructor.
    *
@@ -201,6 +375,19 @@ class ZmqEventLoop : public Runnable {
    */
   void runInEventLoop(TimeoutCallback callback);
 
+  /**
+   * Bulk variant of above. All callbacks are enqueued (in order) with single
+   * wakeup of the loop.
+   */
+  void runInEventLoop(std::vector<TimeoutCallback> callbacks);
+
+  /**
+   * Non-blocking variant of `runInEventLoop`. Returns false without enqueuing
+   * the callback if underlying queue is full. Unlike `runInEventLoop` this
+   * can be called from within the event loop as well.
+   */
+  bool tryRunInEventLoop(TimeoutCallback callback);
+
   /**
    * Same as above but can be called from within the loop as well. It will be
    * executed immediately if called from within the same thread otherwise
@@ -208,70 +395,237 @@ class ZmqEventLoop : public Runnable {
    */
   void runImmediatelyOrInEventLoop(TimeoutCallback callback);
 
+  /**
+   * Busy polling for latency critical loops, disabled by default. Before
+   * blocking in poll the loop spins with zero timeout polls for up to
+   * `budget`, so events arriving in the meantime are picked up without the
+   * sleep/wakeup cost of a blocking poll. Spinning never delays due
+   * timeouts. Zero budget disables it.
+   *
+   * In adaptive mode the effective budget is halved on every miss (down to
+   * 1/64 of `budget`) and doubled on every hit (up to `budget`), which keeps
+   * CPU usage of idle periods down while staying responsive under load.
+   *
+   * Intended for loops running on dedicated cores. Must be called from
+   * within the loop (or before it runs).
+   */
+  void setBusyPollBudget(
+      std::chrono::microseconds budget, bool adaptive = false);
+
+  /**
+   * Busy polling counters, can be read from any thread
+   */
+  BusyPollStats getBusyPollStats() const;
+
+  /**
+   * Pin loop's thread to given CPUs, e.g. to keep it off the cores of zmq IO
+   * threads (look at ContextOptions). Applied right away if called within
+   * the running loop, otherwise by `run` once loop's thread starts it. Empty
+   * set of CPUs leaves affinity alone. Throws std::system_error if affinity
+   * can't be set.
+   */
+  void setThreadAffinity(std::vector<int> cpus);
+
+  /**
+   * Latency and utilization instrumentation, disabled by default. Once
+   * enabled the loop records following stats into `threadData`, all prefixed
+   * with `prefix`. Durations are in microseconds.
+   *
+   * - iteration_us: time spent processing events of a loop iteration
+   * - busy_us/idle_us (SUM): time spent processing vs waiting for events,
+   *   busy_pct is their ratio over last second or so
+   * - callback_us.<name>: duration of callbacks of subscriptions named via
+   *   `setSocketName`/`setSocketFdName`. Unnamed ones all go to
+   *   callback_us.unnamed.
+   * - timer_slip_us: delay between expiry and invocation of timeouts
+   * - timeout_callback_us: duration of timeout callbacks
+   * - queue_depth: number of callbacks found in queue on each drain
+   * - queue_wait_us/queued_callback_us: time callbacks enqueued from other
+   *   threads spend in queue and their durations
+   *
+   * Latency stats are exported as AVG & COUNT, along with `.max` (all time)
+   * and histogram counters `.hist.le_<bound>` for bounds 10us to 100ms.
+   *
+   * Stats are plain `ThreadData` entries and can be published to `ZmqMonitor`
+   * along with other counters of the module. `threadData` must outlive
+   * instrumentation and must only be accessed from within the loop. Must be
+   * called from within the loop (or before it runs).
+   */
+  void enableInstrumentation(
+      ThreadData& threadData, std::string const& prefix = "zmq_event_loop");
+  void disableInstrumentation();
+
+  bool
+  isInstrumentationEnabled() const {
+    return instrumentation_ != nullptr;
+  }
+
+  /**
+   * Name subscription for stats of its callback, look at
+   * `enableInstrumentation`. No-op for unknown sockets/fds.
+   */
+  void setSocketName(RawZmqSocketPtr socketPtr, std::string name);
+  void setSocketFdName(int socketFd, std::string name);
+
+  /**
+   * Dispatch priority of subscription. Events reported by a poll are
+   * dispatched from HIGH to LOW priority, and due timeouts are processed right
+   * after HIGH priority ones, so control sockets and heartbeat timers aren't
+   * held back by a flood on data sockets. Subscriptions of same priority are
+   * dispatched in no particular order. All subscriptions are NORMAL by
+   * default, and events are dispatched before timeouts then.
+   *
+   * `maxDispatchesPerIteration` is the fairness budget of zmq sockets: once
+   * woken up callback is re-invoked, as long as socket stays ready for one of
+   * subscribed events, up to that many times before loop yields to other
+   * subscriptions. Callbacks are thus expected to handle a single message per
+   * invocation. Fds are always dispatched once per iteration as their
+   * readiness can't be checked without a syscall.
+   *
+   * Throws std::runtime_error for unknown sockets/fds.
+   */
+  void setSocketPriority(
+      RawZmqSocketPtr socketPtr,
+      SocketPriority priority,
+      size_t maxDispatchesPerIteration = 1);
+  void setSocketFdPriority(int socketFd, SocketPriority priority);
+
   /**
    * Returns the count of currently active timeouts which will get executed
    * eventually.
    */
   size_t
   getNumPendingTimeouts() const {
-    return activeTimeouts_.size();
+    return timeoutHeap_.size() + (timerWheel_ ? timerWheel_->size() : 0);
+  }
+
+  /**
+   * Number of entries held in timeout heap (excludes high resolution
+   * timeouts). Cancelled timeouts are reclaimed right away and are never
+   * accounted here.
+   */
+  size_t
+  getTimeoutHeapSize() const {
+    return timeoutHeap_.size();
   }
 
- private:
   /**
-   * Utility struct to store information about poll-item and its callback
-   * for all added sockets/fds
+   * Total number of timeouts cancelled before their expiry
    */
-  struct PollSubscription {
-    PollSubscription(int events, SocketCallback&& callback)
-        : events(events), callback(std::move(callback)) {}
+  uint64_t
+  getNumCancelledTimeouts() const {
+    return timeoutHeap_.getNumCancelled();
+  }
 
-    // bitmap of subscribed events
-    short events{0};
+ private:
+  // Loop stats, defined in ZmqEventLoop.cpp
+  struct Instrumentation;
 
-    // callback which needs to be invoked on event.
-    SocketCallback callback{nullptr};
+  // Entry of `callbackQueue_`
+  struct QueuedCallback {
+    TimeoutCallback callback{nullptr};
+
+    // Set only while instrumentation is enabled
+    std::chrono::steady_clock::time_point enqueueTime{};
   };
 
   /**
-   * Struct to maintain the timeout-state which includes its scheduleTime and
-   * associated callback.
+   * All logic for socket polling/timeout invoking happens here.
    */
-  struct TimeoutEvent {
-    TimeoutEvent(
-        std::chrono::steady_clock::time_point scheduledTime,
-        TimeoutCallback&& callback,
-        int64_t timeoutId)
-        : scheduledTime(scheduledTime), timeoutId(timeoutId) {
-      callbackPtr = std::make_shared<TimeoutCallback>(std::move(callback));
-    }
+  void loopForever();
 
-    // Define '>' operator for building min-heap
-    bool
-    operator>(TimeoutEvent const& rhs) const {
-      return scheduledTime > rhs.scheduledTime;
-    }
+  /**
+   * Create timer wheel and timerfd for high resolution timeouts
+   */
+  void initHighResTimers();
 
-    // Time point when this timeout should be executed
-    std::chrono::steady_clock::time_point scheduledTime;
+  /**
+   * Arm timerfd for the next wakeup of timer wheel, if it is earlier than
+   * currently armed time
+   */
+  void armHighResTimer();
 
-    // So that copy will not involve copy of callback
-    std::shared_ptr<TimeoutCallback> callbackPtr{nullptr};
+  /**
+   * Expire and invoke due high resolution timeouts and re-arm timerfd
+   */
+  void processHighResTimers();
 
-    // Unique-ID associated with this timeout
-    int64_t timeoutId{0};
-  };
+  /**
+   * Wakeup the loop for processing enqueued callbacks unless it has been
+   * signalled already
+   */
+  void signalCallbacks();
 
   /**
-   * All logic for socket polling/timeout invoking happens here.
+   * Spin with zero timeout polls for busy poll budget (bounded by
+   * `pollTimeout`). Returns true if any events have been collected.
    */
-  void loopForever();
+  bool busyPoll(std::chrono::milliseconds pollTimeout);
 
   /**
-   * Helper function to rebuild the pollItems_ and pollSubscriptions_ list. This
-   * is invoked only after processing of poll items is finished.
+   * Wrap externally enqueued callback, with timestamp if instrumented
    */
-  void rebuildPollItems();
+  QueuedCallback makeQueuedCallback(TimeoutCallback callback) const;
+
+  /**
+   * Register socket for a single occurrence of `events`, look at `readable`
+   */
+  folly::Future<int> waitForEvents(
+      RawZmqSocketPtr socketPtr,
+      int events,
+      folly::Optional<std::chrono::milliseconds> timeout);
+
+  /**
+   * Invoke callback of subscription and record its duration
+   */
+  void invokeInstrumented(PollSubscription& subscription, int revents);
+
+  /**
+   * Point subscription(s) to their callback stat of current instrumentation
+   * (if any), so that dispatch doesn't have to look stats up
+   */
+  void resolveCallbackStat(PollSubscription& subscription);
+  void resolveCallbackStats();
+
+  /**
+   * Invoke callback of subscription for reported event, re-invoking it within
+   * its dispatch budget while zmq socket stays ready
+   */
+  void dispatch(PollSubscription& subscription, int revents);
+
+  /**
+   * Invoke callbacks of expired timeouts of timeout heap
+   */
+  void processTimeouts();
+
+  /**
+   * Drain state, look at `drainAndStop`. Subscriptions are quiesced when
+   * draining starts and restored once it finishes.
+   */
+  void startDrain(std::chrono::milliseconds timeout);
+  bool isDrained();
+  void finishDrain();
+  size_t getNumPendingDrainWork() const;
+
+  /**
+   * Set events requested for subscription while draining, subscribing to
+   * them without ZMQ_POLLIN
+   */
+  void setQuiescedEvents(
+      std::shared_ptr<PollSubscription> const& subscription, short events);
+
+  /**
+   * Update priority of subscription and count of prioritized ones
+   */
+  void setPriority(
+      PollSubscription& subscription,
+      SocketPriority priority,
+      size_t maxDispatches);
+
+  /**
+   * Apply `threadCpus_` to calling thread
+   */
+  void applyThreadAffinity() const;
 
   // Local eventfd for capturing stop signal
   int signalFd_{-1};
@@ -281,7 +635,24 @@ class ZmqEventLoop : public Runnable {
   int callbackFd_{-1};
 
   // Queue to hold externally enqueued events.
-  folly::MPMCQueue<TimeoutCallback> callbackQueue_;
+  folly::MPMCQueue<QueuedCallback> callbackQueue_;
+
+  // Set by producers when they signal `callbackFd_` and reset by the loop
+  // before it drains `callbackQueue_`. Used to coalesce wakeups.
+  std::atomic<bool> callbackSignalPending_{false};
+
+  // CPUs loop's thread is pinned to, if any
+  std::vector<int> threadCpus_{};
+
+  // Polling backend. Subscriptions are updated incrementally.
+  std::unique_ptr<Poller> poller_;
+
+  // Events reported by the last poll. Reused across iterations.
+  std::vector<PollEvent> pollEvents_{};
+
+  // Number of subscriptions with non default priority or budget. Events are
+  // only sorted by priority when there is any.
+  size_t numPrioritized_{0};
 
   // thread-id associated with `run` loop (default value is 0). `threadId_` is
   // also being used to indicate whether a main loop is running or not
@@ -290,6 +661,19 @@ class ZmqEventLoop : public Runnable {
   // Flag to break the main loop
   bool stop_{false};
 
+  // Drain requested via `drainAndStop` and its state. Quiesced subscriptions
+  // map to the events requested for them.
+  std::atomic<int64_t> drainTimeoutMs_{0};
+  bool draining_{false};
+  std::chrono::steady_clock::time_point drainDeadline_{};
+  DrainStats drainStats_{};
+  std::unordered_map<
+      PollSubscription*,
+      std::pair<std::shared_ptr<PollSubscription>, short>>
+      quiesced_{};
+  std::map<int64_t, DrainCheck> drainChecks_{};
+  int64_t nextDrainCheckId_{0};
+
   // Data structure to store socket/fd subscriptions along with their callbacks
   std::unordered_map<
       std::uintptr_t /* socket-ptr */,
@@ -298,24 +682,30 @@ class ZmqEventLoop : public Runnable {
   std::unordered_map<int /* socket-fd */, std::shared_ptr<PollSubscription>>
       socketFdMap_{};
 
-  // Polling item. Updated dynamically.
-  bool needsRebuild_{false};
-  std::vector<zmq_pollitem_t> pollItems_{};
-  std::vector<std::shared_ptr<PollSubscription>> pollSubscriptions_{};
-
-  // Priority queue DS for maintaining timeout-heap and callbacks
-  boost::heap::priority_queue<
-      TimeoutEvent,
-      boost::heap::compare<std::greater<TimeoutEvent>>,
-      boost::heap::stable<true>>
-      timeoutHeap_;
-
-  // Maintains set of active timeouts.
-  std::unordered_set<int64_t> activeTimeouts_;
-
-  // Monotonically increasing integer used to assign IDs to newly scheduled
-  // timeouts
-  int64_t timeoutId_{0};
+  // Heap of pending timeouts along with their callbacks
+  TimeoutHeap timeoutHeap_;
+
+  // High resolution timeouts and timerfd driving them. Created lazily.
+  std::unique_ptr<TimerWheel> timerWheel_{nullptr};
+  int timerFd_{-1};
+
+  // Time for which timerfd is armed currently, if any
+  folly::Optional<std::chrono::steady_clock::time_point> timerFdArmedAt_;
+
+  // Busy polling configuration and counters. Counters are only written by
+  // the loop, atomics allow reading them from other threads.
+  std::chrono::microseconds busyPollMaxBudget_{0};
+  std::chrono::microseconds busyPollBudget_{0};
+  bool busyPollAdaptive_{false};
+  std::atomic<uint64_t> numSpinHits_{0};
+  std::atomic<uint64_t> numSpinMisses_{0};
+  std::atomic<uint64_t> numSpinPolls_{0};
+  std::atomic<int64_t> currentBudgetUs_{0};
+
+  // Loop stats if instrumentation is enabled. `instrumented_` mirrors it for
+  // producers of `callbackQueue_`.
+  std::unique_ptr<Instrumentation> instrumentation_{nullptr};
+  std::atomic<bool> instrumented_{false};
 };
 
 } // namespace fbzmq
@@ -0,0 +1,298 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/ZmqEventLoopPool.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace fbzmq {
+
+namespace {
+
+// Max number of shared callbacks processed by a loop in one go, before it
+// gets back to its own sockets & timeouts
+const size_t kDrainBatchSize = 64;
+
+} // namespace
+
+ZmqEventLoopPool::ZmqEventLoopPool(
+    size_t numLoops, uint64_t queueCapacity, PollerType pollerType)
+    : numSockets_(numLoops, 0),
+      sharedQueue_(queueCapacity),
+      drainPending_(new std::atomic<bool>[numLoops]) {
+  CHECK_LT(0, numLoops) << "Pool must have at least one loop";
+  for (size_t i = 0; i < numLoops; ++i) {
+    loops_.emplace_back(
+        std::make_unique<ZmqEventLoop>(queueCapacity, pollerType));
+    drainPending_[i].store(false);
+  }
+}
+
+ZmqEventLoopPool::~ZmqEventLoopPool() {
+  stop();
+}
+
+void
+ZmqEventLoopPool::start() {
+  CHECK(threads_.empty()) << "Pool is already running";
+  for (auto& loop : loops_) {
+    auto ptr = loop.get();
+    threads_.emplace_back([ptr]() { ptr->run(); });
+  }
+  for (auto& loop : loops_) {
+    loop->waitUntilRunning();
+  }
+}
+
+void
+ZmqEventLoopPool::stop() {
+  if (threads_.empty()) {
+    return;
+  }
+  for (auto& loop : loops_) {
+    loop->stop();
+  }
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+}
+
+ZmqEventLoop&
+ZmqEventLoopPool::getLoopForKey(uint64_t key) {
+  return *loops_[key % loops_.size()];
+}
+
+size_t
+ZmqEventLoopPool::addSocket(
+    RawZmqSocketPtr socketPtr,
+    int events,
+    SocketCallback callback,
+    folly::Optional<size_t> loopIndex) {
+  uint64_t epoch;
+  size_t index;
+  {
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    if (registry_.count(socketPtr)) {
+      throw std::runtime_error("Socket already registered with pool.");
+    }
+    if (loopIndex) {
+      CHECK_LT(*loopIndex, loops_.size());
+      index = *loopIndex;
+    } else {
+      index = std::min_element(numSockets_.begin(), numSockets_.end()) -
+          numSockets_.begin();
+    }
+    epoch = nextEpoch_++;
+
+    Registration registration;
+    registration.loopIndex = index;
+    registration.events = events;
+    registration.callback =
+        std::make_shared<SocketCallback>(std::move(callback));
+    registration.epoch = epoch;
+    registry_.emplace(socketPtr, std::move(registration));
+    ++numSockets_[index];
+  }
+
+  loops_[index]->runImmediatelyOrInEventLoop(
+      [this, socketPtr, epoch]() noexcept {
+        registerSocket(socketPtr, epoch);
+      });
+  return index;
+}
+
+void
+ZmqEventLoopPool::removeSocket(RawZmqSocketPtr socketPtr) {
+  size_t index;
+  {
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    auto it = registry_.find(socketPtr);
+    if (it == registry_.end()) {
+      return;
+    }
+    const bool inFlight = it->second.inFlight;
+    index = it->second.loopIndex;
+    --numSockets_[index];
+    registry_.erase(it);
+
+    // Pending registration will find out that socket is gone
+    if (inFlight) {
+      return;
+    }
+  }
+
+  loops_[index]->runImmediatelyOrInEventLoop(
+      [this, socketPtr, index]() noexcept {
+        loops_[index]->removeSocket(socketPtr);
+      });
+}
+
+bool
+ZmqEventLoopPool::moveSocket(RawZmqSocketPtr socketPtr, size_t loopIndex) {
+  CHECK_LT(loopIndex, loops_.size());
+
+  size_t fromIndex;
+  uint64_t epoch;
+  {
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    auto it = registry_.find(socketPtr);
+    if (it == registry_.end() or it->second.inFlight) {
+      return false;
+    }
+    auto& registration = it->second;
+    if (registration.loopIndex == loopIndex) {
+      return true;
+    }
+
+    fromIndex = registration.loopIndex;
+    epoch = nextEpoch_++;
+    --numSockets_[fromIndex];
+    ++numSockets_[loopIndex];
+    registration.loopIndex = loopIndex;
+    registration.epoch = epoch;
+    registration.inFlight = true;
+  }
+
+  // Remove from within current loop so that none of socket's callbacks are
+  // running, then hand over to new loop
+  loops_[fromIndex]->runImmediatelyOrInEventLoop(
+      [this, socketPtr, fromIndex, loopIndex, epoch]() noexcept {
+        loops_[fromIndex]->removeSocket(socketPtr);
+        loops_[loopIndex]->runImmediatelyOrInEventLoop(
+            [this, socketPtr, epoch]() noexcept {
+              registerSocket(socketPtr, epoch);
+            });
+      });
+  return true;
+}
+
+folly::Optional<size_t>
+ZmqEventLoopPool::getSocketLoop(RawZmqSocketPtr socketPtr) const {
+  std::lock_guard<std::mutex> lock(registryMutex_);
+  auto it = registry_.find(socketPtr);
+  if (it == registry_.end()) {
+    return folly::none;
+  }
+  return it->second.loopIndex;
+}
+
+size_t
+ZmqEventLoopPool::getNumSockets(size_t loopIndex) const {
+  std::lock_guard<std::mutex> lock(registryMutex_);
+  return numSockets_.at(loopIndex);
+}
+
+void
+ZmqEventLoopPool::registerSocket(RawZmqSocketPtr socketPtr, uint64_t epoch) {
+  size_t index;
+  int events;
+  std::shared_ptr<SocketCallback> callback;
+  {
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    auto it = registry_.find(socketPtr);
+    if (it == registry_.end() or it->second.epoch != epoch) {
+      // Socket has been removed meanwhile
+      return;
+    }
+    it->second.inFlight = false;
+    index = it->second.loopIndex;
+    events = it->second.events;
+    callback = it->second.callback;
+  }
+
+  try {
+    loops_[index]->addSocket(
+        socketPtr, events, [callback](int revents) noexcept {
+          (*callback)(revents);
+        });
+  } catch (std::exception const& e) {
+    LOG(FATAL) << "Failed to register socket with loop " << index << ": "
+               << e.what();
+  }
+}
+
+void
+ZmqEventLoopPool::runInAnyLoop(TimeoutCallback callback) {
+  const auto index =
+      nextLoop_.fetch_add(1, std::memory_order_relaxed) % loops_.size();
+  const auto callerIndex = getCallerLoopIndex();
+  if (not callerIndex) {
+    sharedQueue_.blockingWrite(std::move(callback));
+    signalDrain(index, true /* blocking */);
+    return;
+  }
+
+  // Called from within one of the loops, which must not block on any queue
+  // of the pool (two loops doing so to each other would deadlock). Drain
+  // right here whenever shared queue or picked loop's queue is full.
+  while (not sharedQueue_.write(std::move(callback))) {
+    drainSharedQueue(*callerIndex);
+  }
+  if (not signalDrain(index, false /* blocking */)) {
+    drainSharedQueue(*callerIndex);
+  }
+}
+
+folly::Optional<size_t>
+ZmqEventLoopPool::getCallerLoopIndex() const {
+  for (size_t i = 0; i < loops_.size(); ++i) {
+    if (loops_[i]->isRunning() and loops_[i]->isInEventLoop()) {
+      return i;
+    }
+  }
+  return folly::none;
+}
+
+bool
+ZmqEventLoopPool::signalDrain(size_t loopIndex, bool blocking) {
+  // Drain is already enqueued and will pick up new callbacks
+  if (drainPending_[loopIndex].exchange(true, std::memory_order_seq_cst)) {
+    return true;
+  }
+
+  auto& loop = *loops_[loopIndex];
+  auto drain = [this, loopIndex]() noexcept { drainSharedQueue(loopIndex); };
+  if (blocking) {
+    loop.runInEventLoop(std::move(drain));
+    return true;
+  }
+  if (loop.tryRunInEventLoop(std::move(drain))) {
+    return true;
+  }
+  drainPending_[loopIndex].store(false, std::memory_order_seq_cst);
+  return false;
+}
+
+void
+ZmqEventLoopPool::drainSharedQueue(size_t loopIndex) {
+  // Reset before draining, callbacks enqueued from here on will signal again
+  drainPending_[loopIndex].store(false, std::memory_order_seq_cst);
+
+  TimeoutCallback callback;
+  while (true) {
+    for (size_t i = 0; i < kDrainBatchSize; ++i) {
+      if (not sharedQueue_.read(callback)) {
+        return;
+      }
+      callback();
+      callback = nullptr;
+    }
+
+    // Work remains, let next loop help out while this one gets back to its
+    // own sockets (re-signals itself if it is the only loop). Loops never
+    // block on each other's queues, keep draining here if next one's is full.
+    if (signalDrain((loopIndex + 1) % loops_.size(), false /* blocking */)) {
+      return;
+    }
+  }
+}
+
+} // namespace fbzmq
@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/MPMCQueue.h>
+#include <folly/Optional.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+
+namespace fbzmq {
+
+/**
+ * Pool of `ZmqEventLoop`s, each running in its own thread, for spreading
+ * sockets and CPU bound work across cores.
+ *
+ * 1. Socket affinity: `addSocket` assigns a socket to a loop (least loaded
+ *    one unless specified) and all of its callbacks are invoked in that
+ *    loop's thread. Like with a single loop, socket must be accessed only from
+ *    its callbacks (or send/recv calls made from the same loop).
+ *
+ * 2. Quiescent handoff: `moveSocket` migrates a socket to another loop. Socket
+ *    is first removed from its current loop from within that loop (so none of
+ *    its callbacks can be running) and only then registered with the new one
+ *    through the loop's queue, which also acts as the memory barrier zmq
+ *    requires for migrating a socket across threads.
+ *
+ * 3. Shared work: `runInAnyLoop` enqueues callback in a queue shared by all
+ *    loops. A loop is woken up to drain it in batches, and when work remains
+ *    after a batch it hands over draining to the next loop. Work queued behind
+ *    a busy loop is thereby picked up by the idle ones. Order of execution is
+ *    not guaranteed.
+ *
+ * For state sharded by key (e.g. per client), `getLoopForKey` maps key to a
+ * loop consistently.
+ *
+ * All methods are thread safe.
+ */
+class ZmqEventLoopPool {
+ public:
+  explicit ZmqEventLoopPool(
+      size_t numLoops,
+      uint64_t queueCapacity = 1e4,
+      PollerType pollerType = PollerType::ZMQ_POLL);
+
+  ~ZmqEventLoopPool();
+
+  /**
+   * Make this non-copyable and non-movable
+   */
+  ZmqEventLoopPool(ZmqEventLoopPool const&) = delete;
+  ZmqEventLoopPool& operator=(ZmqEventLoopPool const&) = delete;
+
+  /**
+   * Spawn a thread per loop and wait until all of them are running
+   */
+  void start();
+
+  /**
+   * Stop all loops and join their threads. Pool can be started again.
+   */
+  void stop();
+
+  size_t
+  getNumLoops() const {
+    return loops_.size();
+  }
+
+  ZmqEventLoop&
+  getLoop(size_t index) {
+    return *loops_.at(index);
+  }
+
+  /**
+   * Loop for specified key. Same key always maps to same loop.
+   */
+  ZmqEventLoop& getLoopForKey(uint64_t key);
+
+  /**
+   * Register socket for polling with one of the loops and return index of
+   * the loop. Least loaded loop (by number of sockets) is picked unless
+   * `loopIndex` is specified. Registration happens asynchronously in the
+   * loop's thread (or immediately if called from it).
+   *
+   * Throws std::runtime_error if socket is already registered with the pool.
+   */
+  size_t addSocket(
+      RawZmqSocketPtr socketPtr,
+      int events,
+      SocketCallback callback,
+      folly::Optional<size_t> loopIndex = folly::none);
+
+  /**
+   * Unregister socket asynchronously. No callbacks are invoked once loop has
+   * processed the removal.
+   */
+  void removeSocket(RawZmqSocketPtr socketPtr);
+
+  /**
+   * Migrate socket to specified loop with a quiescent handoff, look above.
+   *
+   * @returns: false if socket is unknown or it is still being registered or
+   *           migrated, true otherwise
+   */
+  bool moveSocket(RawZmqSocketPtr socketPtr, size_t loopIndex);
+
+  /**
+   * Index of loop socket is assigned to, if socket is known
+   */
+  folly::Optional<size_t> getSocketLoop(RawZmqSocketPtr socketPtr) const;
+
+  /**
+   * Number of sockets assigned to given loop
+   */
+  size_t getNumSockets(size_t loopIndex) const;
+
+  /**
+   * Enqueue callback to be executed in whichever loop gets to it first.
+   * Intended for CPU bound work posted by external threads.
+   *
+   * NOTE: It can block if shared queue is full. You can configure it to a
+   * bigger number via constructor. Loops of the pool never block, they run
+   * queued callbacks themselves instead.
+   */
+  void runInAnyLoop(TimeoutCallback callback);
+
+ private:
+  struct Registration {
+    size_t loopIndex{0};
+    int events{0};
+
+    // Shared so that callback can be re-registered with another loop
+    std::shared_ptr<SocketCallback> callback;
+
+    // Bumped on every migration, pending registrations of stale epochs are
+    // dropped
+    uint64_t epoch{0};
+
+    // Set while registration with `loopIndex` is pending
+    bool inFlight{true};
+  };
+
+  /**
+   * Register socket within loop's thread if registration is still current
+   */
+  void registerSocket(RawZmqSocketPtr socketPtr, uint64_t epoch);
+
+  /**
+   * Signal loop to drain shared queue unless it has been signalled already.
+   * Returns false if loop's queue is full in non-blocking mode.
+   */
+  bool signalDrain(size_t loopIndex, bool blocking);
+
+  /**
+   * Invoked within loop's thread to process a batch of shared callbacks
+   */
+  void drainSharedQueue(size_t loopIndex);
+
+  /**
+   * Index of loop whose thread is calling, if any
+   */
+  folly::Optional<size_t> getCallerLoopIndex() const;
+
+  std::vector<std::unique_ptr<ZmqEventLoop>> loops_;
+  std::vector<std::thread> threads_;
+
+  // Socket registrations and number of sockets per loop
+  mutable std::mutex registryMutex_;
+  std::unordered_map<uintptr_t, Registration> registry_;
+  std::vector<size_t> numSockets_;
+  uint64_t nextEpoch_{0};
+
+  // Callbacks enqueued via `runInAnyLoop`
+  folly::MPMCQueue<TimeoutCallback> sharedQueue_;
+
+  // Per loop flag indicating that drain has been enqueued and hasn't started
+  std::unique_ptr<std::atomic<bool>[]> drainPending_;
+
+  // Round robin cursor for picking loop to wake up
+  std::atomic<size_t> nextLoop_{0};
+};
+
+} // namespace fbzmq
@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/ZmqHedgedClient.h>
+
+#include <algorithm>
+
+namespace fbzmq {
+
+namespace {
+
+// latencies needed in window before hedge delay is derived off them
+const uint64_t kMinLatencies{20};
+
+// how often hedge delay is recomputed off latencies
+const std::chrono::seconds kHedgeDelayUpdateInterval{1};
+
+std::chrono::seconds
+toSeconds(std::chrono::steady_clock::time_point tp) {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+      tp.time_since_epoch());
+}
+
+} // namespace
+
+constexpr size_t RequestHeader::kNumFrames;
+
+folly::Expected<RequestHeader, Error>
+RequestHeader::decode(std::vector<Message> const& frames, size_t offset) {
+  if (frames.size() < offset + kNumFrames) {
+    return folly::makeUnexpected(Error(EPROTO));
+  }
+  const auto requestId = frames[offset].read<uint64_t>();
+  const auto remainingMs = frames[offset + 1].read<uint32_t>();
+  if (requestId.hasError() || remainingMs.hasError()) {
+    return folly::makeUnexpected(Error(EPROTO));
+  }
+
+  RequestHeader header;
+  header.requestId = requestId.value();
+  header.deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(remainingMs.value());
+  return header;
+}
+
+ZmqHedgedClient::ZmqHedgedClient(
+    ZmqEventLoop* evl,
+    Context& zmqContext,
+    std::vector<SocketUrl> const& replicaUrls,
+    double hedgePercentile,
+    std::chrono::milliseconds initialHedgeDelay,
+    std::chrono::seconds latencyWindow)
+    : evl_(evl),
+      hedgePercentile_(hedgePercentile),
+      initialHedgeDelay_(initialHedgeDelay),
+      latencies_({latencyWindow}),
+      hedgeDelay_(initialHedgeDelay) {
+  CHECK(!replicaUrls.empty()) << "ZmqHedgedClient needs replicas";
+  CHECK_LT(0, hedgePercentile_);
+  CHECK_GE(100, hedgePercentile_);
+
+  for (size_t i = 0; i < replicaUrls.size(); ++i) {
+    auto sock = std::make_unique<Socket<ZMQ_DEALER, ZMQ_CLIENT>>(
+        zmqContext, folly::none, folly::none, NonblockingFlag{true});
+    const auto ret = sock->connect(replicaUrls[i]);
+    if (ret.hasError()) {
+      LOG(FATAL) << "ZmqHedgedClient: Error connecting to '"
+                 << static_cast<std::string>(replicaUrls[i]) << "' "
+                 << ret.error();
+    }
+    evl_->addSocket(
+        RawZmqSocketPtr{**sock}, ZMQ_POLLIN, [this, i](int) noexcept {
+          processReply(i);
+        });
+    sockets_.push_back(std::move(sock));
+  }
+}
+
+ZmqHedgedClient::~ZmqHedgedClient() {
+  for (auto const& kv : pending_) {
+    if (kv.second.hedgeTimeout) {
+      evl_->cancelTimeout(*kv.second.hedgeTimeout);
+    }
+    if (kv.second.deadlineTimeout) {
+      evl_->cancelTimeout(*kv.second.deadlineTimeout);
+    }
+  }
+  for (auto& sock : sockets_) {
+    evl_->removeSocket(RawZmqSocketPtr{**sock});
+  }
+}
+
+void
+ZmqHedgedClient::request(
+    std::vector<Message> frames,
+    std::chrono::milliseconds timeout,
+    ReplyCallback callback) {
+  CHECK(evl_->isInEventLoop());
+  CHECK(callback);
+  ++stats_.numRequests;
+
+  const auto requestId = nextRequestId_++;
+  const auto now = std::chrono::steady_clock::now();
+  const size_t first = nextReplica_++ % sockets_.size();
+  auto& pending = pending_[requestId];
+  pending.frames = std::move(frames);
+  pending.deadline = now + timeout;
+  pending.callback = std::move(callback);
+  pending.sentAt = now;
+
+  // first replica taking the request (without blocking) gets it
+  bool sent = false;
+  for (size_t i = 0; i < sockets_.size() && !sent; ++i) {
+    pending.replica = (first + i) % sockets_.size();
+    sent = send(requestId, pending, pending.replica);
+  }
+  if (!sent) {
+    complete(requestId, folly::makeUnexpected(Error(EAGAIN)));
+    return;
+  }
+
+  pending.deadlineTimeout =
+      evl_->scheduleTimeout(timeout, [this, requestId]() noexcept {
+        ++stats_.numTimeouts;
+        complete(requestId, folly::makeUnexpected(Error(ETIMEDOUT)));
+      });
+
+  // hedge only if there is another replica and time left for its reply
+  const auto hedgeDelay = getHedgeDelay();
+  if (sockets_.size() > 1 && now + hedgeDelay < pending.deadline) {
+    pending.hedgeTimeout = evl_->scheduleTimeout(
+        hedgeDelay, [this, requestId]() noexcept { hedge(requestId); });
+  }
+}
+
+bool
+ZmqHedgedClient::send(
+    uint64_t requestId, Pending const& pending, size_t replica) {
+  const auto remaining =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          pending.deadline - std::chrono::steady_clock::now());
+  const auto remainingMs =
+      static_cast<uint32_t>(std::max<int64_t>(0, remaining.count()));
+
+  // frames are refcounted by zmq, copies don't copy their content
+  std::vector<Message> msgs;
+  msgs.reserve(RequestHeader::kNumFrames + pending.frames.size());
+  msgs.push_back(Message::from(requestId).value());
+  msgs.push_back(Message::from(remainingMs).value());
+  msgs.insert(msgs.end(), pending.frames.begin(), pending.frames.end());
+
+  const auto ret = sockets_[replica]->sendMultiple(msgs);
+  if (ret.hasError()) {
+    VLOG(2) << "ZmqHedgedClient: Error sending request to replica " << replica
+            << " " << ret.error();
+    return false;
+  }
+  return true;
+}
+
+void
+ZmqHedgedClient::hedge(uint64_t requestId) noexcept {
+  auto it = pending_.find(requestId);
+  if (it == pending_.end()) {
+    return;
+  }
+  auto& pending = it->second;
+  pending.hedgeTimeout.clear();
+
+  for (size_t i = 1; i < sockets_.size(); ++i) {
+    const size_t replica = (pending.replica + i) % sockets_.size();
+    if (send(requestId, pending, replica)) {
+      pending.hedgeReplica = replica;
+      pending.hedgedAt = std::chrono::steady_clock::now();
+      ++stats_.numHedged;
+      return;
+    }
+  }
+}
+
+void
+ZmqHedgedClient::processReply(size_t replica) noexcept {
+  auto frames = sockets_[replica]->recvMultiple();
+  if (frames.hasError()) {
+    if (frames.error().errNum != EAGAIN) {
+      LOG(ERROR) << "ZmqHedgedClient: Error receiving reply " << frames.error();
+    }
+    return;
+  }
+  auto& msgs = frames.value();
+  if (msgs.empty() || msgs[0].read<uint64_t>().hasError()) {
+    LOG(ERROR) << "ZmqHedgedClient: Dropping reply without request id";
+    return;
+  }
+
+  const auto requestId = msgs[0].read<uint64_t>().value();
+  auto it = pending_.find(requestId);
+  if (it == pending_.end()) {
+    // answered by other replica or timed out already
+    ++stats_.numLateReplies;
+    return;
+  }
+
+  // latency of the attempt which got answered
+  auto const& pending = it->second;
+  const auto now = std::chrono::steady_clock::now();
+  const bool fromHedge =
+      pending.hedgeReplica && *pending.hedgeReplica == replica;
+  const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - (fromHedge ? pending.hedgedAt : pending.sentAt));
+  latencies_.addValue(toSeconds(now), latency.count());
+  if (fromHedge) {
+    ++stats_.numHedgeWins;
+  }
+
+  msgs.erase(msgs.begin());
+  complete(requestId, std::move(msgs));
+}
+
+void
+ZmqHedgedClient::complete(
+    uint64_t requestId, folly::Expected<std::vector<Message>, Error> result) {
+  auto it = pending_.find(requestId);
+  if (it == pending_.end()) {
+    return;
+  }
+
+  auto callback = std::move(it->second.callback);
+  if (it->second.hedgeTimeout) {
+    evl_->cancelTimeout(*it->second.hedgeTimeout);
+  }
+  if (it->second.deadlineTimeout) {
+    evl_->cancelTimeout(*it->second.deadlineTimeout);
+  }
+  pending_.erase(it);
+
+  // callback may issue next request
+  callback(std::move(result));
+}
+
+std::chrono::microseconds
+ZmqHedgedClient::getHedgeDelay() {
+  const auto now = std::chrono::steady_clock::now();
+  if (now - hedgeDelayUpdatedAt_ < kHedgeDelayUpdateInterval) {
+    return hedgeDelay_;
+  }
+
+  const auto level = latencies_.getLevel(0, toSeconds(now));
+  if (level.getCount() < kMinLatencies) {
+    hedgeDelay_ = initialHedgeDelay_;
+  } else {
+    hedgeDelay_ = std::chrono::microseconds(
+        level.getPercentile(hedgePercentile_));
+  }
+  hedgeDelayUpdatedAt_ = now;
+  return hedgeDelay_;
+}
+
+} // namespace fbzmq
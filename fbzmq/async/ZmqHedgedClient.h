@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <folly/Expected.h>
+#include <folly/Function.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/service/stats/Histogram.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+/**
+ * Header frames ZmqHedgedClient puts in front of every request,
+ * `[uint64_t request id][uint32_t remaining time in milliseconds]`. Remaining
+ * time rather than absolute deadline is sent to not depend on clocks of
+ * client and server being in sync, time in flight is not accounted for.
+ *
+ * Servers (usually ROUTER) reply with the request id frame followed by the
+ * reply frames, and can decode the header to drop requests their client has
+ * given up on already without processing them, e.g.
+ *
+ *  auto frames = routerSock.recvMultiple().value();
+ *  auto header = RequestHeader::decode(frames, 1); // after identity frame
+ *  if (header.hasError() or header->isExpired()) {
+ *    return;
+ *  }
+ *  ...
+ *  routerSock.sendMultiple(frames[0], frames[1], reply);
+ */
+struct RequestHeader {
+  static constexpr size_t kNumFrames = 2;
+
+  uint64_t requestId{0};
+
+  // local deadline, computed on decode from remaining time
+  std::chrono::steady_clock::time_point deadline;
+
+  /**
+   * Decode header starting at frame `offset`, EPROTO if frames don't hold
+   * one. Payload of request follows at `offset + kNumFrames`.
+   */
+  static folly::Expected<RequestHeader, Error> decode(
+      std::vector<Message> const& frames, size_t offset = 0);
+
+  bool
+  isExpired(
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now()) const {
+    return now >= deadline;
+  }
+};
+
+/**
+ * Asynchronous request/reply client over DEALER sockets connected to a set of
+ * replicas, with request hedging and deadline propagation, for cutting tail
+ * latency against overloaded servers.
+ *
+ * Every request goes to the next replica in round-robin order along with its
+ * deadline (look at RequestHeader). If no reply came within the
+ * `hedgePercentile` percentile of recent reply latencies, a duplicate is sent
+ * to another replica. First reply wins, late ones are discarded. Callback is
+ * invoked exactly once, with the reply or with ETIMEDOUT once deadline is
+ * reached. Until enough latencies are known `initialHedgeDelay` is used.
+ *
+ * Must be used from within loop's thread only.
+ */
+class ZmqHedgedClient : public boost::noncopyable {
+ public:
+  using ReplyCallback = folly::Function<void(
+      folly::Expected<std::vector<Message>, Error> reply) noexcept>;
+
+  struct Stats {
+    uint64_t numRequests{0};
+    // requests for which a duplicate was sent
+    uint64_t numHedged{0};
+    // hedged requests which got answered by the duplicate first
+    uint64_t numHedgeWins{0};
+    uint64_t numTimeouts{0};
+    // replies to requests answered or timed out already
+    uint64_t numLateReplies{0};
+  };
+
+  ZmqHedgedClient(
+      ZmqEventLoop* evl,
+      Context& zmqContext,
+      std::vector<SocketUrl> const& replicaUrls,
+      double hedgePercentile = 95,
+      std::chrono::milliseconds initialHedgeDelay =
+          std::chrono::milliseconds(10),
+      std::chrono::seconds latencyWindow = std::chrono::seconds(60));
+
+  ~ZmqHedgedClient();
+
+  /**
+   * Send request frames, reply frames (without request id) or error are
+   * passed to `callback` from within the loop
+   */
+  void request(
+      std::vector<Message> frames,
+      std::chrono::milliseconds timeout,
+      ReplyCallback callback);
+
+  /**
+   * Delay after which requests are currently hedged
+   */
+  std::chrono::microseconds getHedgeDelay();
+
+  Stats
+  getStats() const {
+    return stats_;
+  }
+
+  size_t
+  getNumPending() const {
+    return pending_.size();
+  }
+
+ private:
+  struct Pending {
+    std::vector<Message> frames;
+    std::chrono::steady_clock::time_point deadline;
+    ReplyCallback callback;
+    // replica of first attempt, and of duplicate if hedged
+    size_t replica{0};
+    folly::Optional<size_t> hedgeReplica;
+    // send times of attempts, for latency of the winning one
+    std::chrono::steady_clock::time_point sentAt;
+    std::chrono::steady_clock::time_point hedgedAt;
+    folly::Optional<int64_t> hedgeTimeout;
+    folly::Optional<int64_t> deadlineTimeout;
+  };
+
+  // send attempt of request to replica with remaining time until deadline
+  bool send(uint64_t requestId, Pending const& pending, size_t replica);
+
+  void hedge(uint64_t requestId) noexcept;
+
+  void processReply(size_t replica) noexcept;
+
+  // remove request and pass result to its callback
+  void complete(
+      uint64_t requestId, folly::Expected<std::vector<Message>, Error> result);
+
+  ZmqEventLoop* const evl_{nullptr};
+  const double hedgePercentile_{0};
+  const std::chrono::milliseconds initialHedgeDelay_{0};
+
+  std::vector<std::unique_ptr<Socket<ZMQ_DEALER, ZMQ_CLIENT>>> sockets_;
+  size_t nextReplica_{0};
+
+  uint64_t nextRequestId_{1};
+  std::unordered_map<uint64_t, Pending> pending_;
+
+  // reply latencies in microseconds, and hedge delay computed off them
+  MultiLevelHistogram latencies_;
+  std::chrono::microseconds hedgeDelay_{0};
+  std::chrono::steady_clock::time_point hedgeDelayUpdatedAt_;
+
+  Stats stats_;
+};
+
+} // namespace fbzmq
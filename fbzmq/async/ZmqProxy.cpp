@@ -0,0 +1,262 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/ZmqProxy.h>
+
+namespace fbzmq {
+
+namespace {
+
+// directions as they appear in exported counters
+const char* const kDirectionNames[] = {
+    "frontend_to_backend",
+    "backend_to_frontend",
+};
+
+} // namespace
+
+ZmqProxy::ZmqProxy(
+    ZmqEventLoop* evl,
+    detail::SocketImpl* frontend,
+    detail::SocketImpl* backend,
+    detail::SocketImpl* capture,
+    detail::SocketImpl* control,
+    CaptureOptions const& captureOptions,
+    size_t maxMsgsPerWakeup)
+    : evl_(evl),
+      frontend_(frontend),
+      backend_(backend),
+      capture_(capture),
+      control_(control),
+      maxMsgsPerWakeup_(maxMsgsPerWakeup) {
+  CHECK(frontend_ && backend_);
+  CHECK_LT(0, maxMsgsPerWakeup_);
+  setCaptureOptions(captureOptions);
+
+  addSockets();
+  if (control_) {
+    evl_->addSocket(
+        RawZmqSocketPtr{**control_}, ZMQ_POLLIN, [this](int) noexcept {
+          processControl();
+        });
+  }
+}
+
+ZmqProxy::~ZmqProxy() {
+  if (!terminated_) {
+    removeSockets();
+    if (control_) {
+      evl_->removeSocket(RawZmqSocketPtr{**control_});
+    }
+  }
+}
+
+void
+ZmqProxy::addSockets() {
+  evl_->addSocket(
+      RawZmqSocketPtr{**frontend_}, ZMQ_POLLIN, [this](int) noexcept {
+        forward(Direction::FRONTEND_TO_BACKEND);
+      });
+  evl_->addSocket(
+      RawZmqSocketPtr{**backend_}, ZMQ_POLLIN, [this](int) noexcept {
+        forward(Direction::BACKEND_TO_FRONTEND);
+      });
+}
+
+void
+ZmqProxy::removeSockets() {
+  evl_->removeSocket(RawZmqSocketPtr{**frontend_});
+  evl_->removeSocket(RawZmqSocketPtr{**backend_});
+}
+
+void
+ZmqProxy::pause() {
+  CHECK(evl_->isInEventLoop());
+  if (paused_ || terminated_) {
+    return;
+  }
+  paused_ = true;
+  removeSockets();
+}
+
+void
+ZmqProxy::resume() {
+  CHECK(evl_->isInEventLoop());
+  if (!paused_ || terminated_) {
+    return;
+  }
+  paused_ = false;
+  addSockets();
+}
+
+void
+ZmqProxy::terminate() {
+  CHECK(evl_->isInEventLoop());
+  if (terminated_) {
+    return;
+  }
+  if (!paused_) {
+    removeSockets();
+  }
+  if (control_) {
+    evl_->removeSocket(RawZmqSocketPtr{**control_});
+  }
+  terminated_ = true;
+  if (terminateCallback_) {
+    terminateCallback_();
+  }
+}
+
+void
+ZmqProxy::setTerminateCallback(folly::Function<void() noexcept> callback) {
+  terminateCallback_ = std::move(callback);
+}
+
+void
+ZmqProxy::setCaptureOptions(CaptureOptions const& captureOptions) {
+  captureOptions_ = captureOptions;
+  captureBudget_.reset();
+  if (captureOptions_.maxBytesPerSec > 0) {
+    // allow for a second worth of budget in a burst
+    captureBudget_ = std::make_unique<TokenBucket>(
+        captureOptions_.maxBytesPerSec, captureOptions_.maxBytesPerSec);
+  }
+}
+
+bool
+ZmqProxy::sampleCapture(Counters& counters, uint64_t bytes) {
+  if (!capture_ || captureOptions_.sampleEvery == 0) {
+    return false;
+  }
+  if (counters.numSampled++ % captureOptions_.sampleEvery != 0) {
+    return false;
+  }
+  return !captureBudget_ ||
+      captureBudget_->consume(bytes, TokenBucket::Clock::now());
+}
+
+void
+ZmqProxy::forward(Direction direction) noexcept {
+  const bool fromFrontend = direction == Direction::FRONTEND_TO_BACKEND;
+  auto const& src = fromFrontend ? *frontend_ : *backend_;
+  auto const& dst = fromFrontend ? *backend_ : *frontend_;
+  auto& counters = counters_[static_cast<size_t>(direction)];
+
+  batch_.clear();
+  const auto recvRet = src.recvBatch(
+      batch_, maxMsgsPerWakeup_, std::chrono::milliseconds(0));
+  if (recvRet.hasError()) {
+    if (recvRet.error().errNum != EAGAIN) {
+      LOG(ERROR) << "ZmqProxy: Error receiving messages " << recvRet.error();
+    }
+    return;
+  }
+
+  // size (and capture) before sending, zmq takes over frames on send
+  sizes_.clear();
+  for (size_t i = 0; i < batch_.size(); ++i) {
+    auto frames = batch_[i];
+    uint64_t bytes = 0;
+    for (auto const& frame : frames) {
+      bytes += frame.size();
+    }
+    sizes_.emplace_back(frames.size(), bytes);
+
+    if (sampleCapture(counters, bytes)) {
+      const auto captureRet = capture_->sendMultiple(
+          std::vector<Message>(frames.begin(), frames.end()));
+      if (captureRet.hasValue()) {
+        ++counters.numCapturedMsgs;
+        counters.numCapturedBytes += bytes;
+      }
+    }
+  }
+
+  const size_t numMsgs = batch_.size();
+  const auto sendRet = dst.sendBatch(batch_);
+  if (sendRet.hasError() && sendRet.error().errNum != EAGAIN) {
+    LOG(ERROR) << "ZmqProxy: Error sending messages " << sendRet.error();
+  }
+  // Messages not taken by destination are dropped, as well as one which
+  // failed midway. Sent ones are a prefix.
+  const size_t numSent = sendRet.hasValue() ? sendRet.value() : 0;
+  for (size_t i = 0; i < numSent; ++i) {
+    counters.numFrames += sizes_[i].first;
+    counters.numBytes += sizes_[i].second;
+  }
+  counters.numMsgs += numSent;
+  counters.numDroppedMsgs += numMsgs - numSent;
+  batch_.clear();
+}
+
+void
+ZmqProxy::processControl() noexcept {
+  auto cmd = control_->recvOne();
+  if (cmd.hasError()) {
+    LOG(ERROR) << "ZmqProxy: Error receiving command " << cmd.error();
+    return;
+  }
+  const auto cmdStr = cmd->read<std::string>().value();
+
+  if (cmdStr == "PAUSE") {
+    pause();
+  } else if (cmdStr == "RESUME") {
+    resume();
+  } else if (cmdStr == "TERMINATE") {
+    terminate();
+  } else if (cmdStr == "STATISTICS") {
+    // same layout as zmq_proxy_steerable, messages and bytes received and
+    // sent on frontend, followed by the ones of backend
+    const auto fwd = getStats(Direction::FRONTEND_TO_BACKEND);
+    const auto bwd = getStats(Direction::BACKEND_TO_FRONTEND);
+    const auto ret = control_->sendMultiple(
+        Message::from(fwd.numMsgs).value(),
+        Message::from(fwd.numBytes).value(),
+        Message::from(bwd.numMsgs).value(),
+        Message::from(bwd.numBytes).value(),
+        Message::from(bwd.numMsgs).value(),
+        Message::from(bwd.numBytes).value(),
+        Message::from(fwd.numMsgs).value(),
+        Message::from(fwd.numBytes).value());
+    if (ret.hasError()) {
+      LOG(ERROR) << "ZmqProxy: Error sending statistics " << ret.error();
+    }
+  } else {
+    LOG(ERROR) << "ZmqProxy: Unknown command '" << cmdStr << "'";
+  }
+}
+
+ZmqProxy::Stats
+ZmqProxy::getStats(Direction direction) const {
+  auto const& counters = counters_[static_cast<size_t>(direction)];
+  Stats stats;
+  stats.numMsgs = counters.numMsgs;
+  stats.numFrames = counters.numFrames;
+  stats.numBytes = counters.numBytes;
+  stats.numDroppedMsgs = counters.numDroppedMsgs;
+  stats.numCapturedMsgs = counters.numCapturedMsgs;
+  stats.numCapturedBytes = counters.numCapturedBytes;
+  return stats;
+}
+
+void
+ZmqProxy::exportStats(ThreadData& tData, std::string const& prefix) const {
+  for (size_t i = 0; i < counters_.size(); ++i) {
+    const auto stats = getStats(static_cast<Direction>(i));
+    const auto key = prefix + "." + kDirectionNames[i];
+    tData.setCounter(key + ".msgs", stats.numMsgs);
+    tData.setCounter(key + ".frames", stats.numFrames);
+    tData.setCounter(key + ".bytes", stats.numBytes);
+    tData.setCounter(key + ".dropped_msgs", stats.numDroppedMsgs);
+    tData.setCounter(key + ".captured_msgs", stats.numCapturedMsgs);
+    tData.setCounter(key + ".captured_bytes", stats.numCapturedBytes);
+  }
+}
+
+} // namespace fbzmq
@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <folly/Function.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqRateLimiter.h>
+#include <fbzmq/service/stats/ThreadData.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+/**
+ * Proxy between frontend and backend sockets running in a ZmqEventLoop, as
+ * alternative to `proxy()` which blocks its thread forever. Like
+ * `zmq_proxy_steerable` it can be paused, resumed and terminated, either
+ * directly from within the loop or by sending "PAUSE", "RESUME", "TERMINATE"
+ * or "STATISTICS" to the optional `control` socket. STATISTICS is answered
+ * on control socket with the same eight uint64_t frames as zmq does.
+ *
+ * Messages, frames and bytes are counted per direction. Unlike `proxy()`,
+ * capture is sampled: only every `sampleEvery`-th message is copied to
+ * `capture` socket, and at most `maxBytesPerSec` bytes per second of them,
+ * so capture can be left on for live traffic. Captured frames share content
+ * with forwarded ones (refcounted by zmq) rather than being copied.
+ *
+ * Up to `maxMsgsPerWakeup` messages are forwarded per wakeup via batched
+ * recv/send. Sends follow the destination socket's mode, messages not taken
+ * by a non-blocking destination are dropped and counted.
+ *
+ * Must be used from within loop's thread only, sockets must outlive proxy.
+ */
+class ZmqProxy : public boost::noncopyable {
+ public:
+  enum class Direction {
+    FRONTEND_TO_BACKEND = 0,
+    BACKEND_TO_FRONTEND = 1,
+  };
+
+  struct CaptureOptions {
+    // capture 1 in `sampleEvery` messages, 0 disables capture
+    uint32_t sampleEvery{1};
+    // capture budget, 0 means unlimited
+    uint64_t maxBytesPerSec{0};
+  };
+
+  struct Stats {
+    // messages forwarded, with their frames and bytes
+    uint64_t numMsgs{0};
+    uint64_t numFrames{0};
+    uint64_t numBytes{0};
+    // messages destination socket didn't take
+    uint64_t numDroppedMsgs{0};
+    // messages copied to capture socket
+    uint64_t numCapturedMsgs{0};
+    uint64_t numCapturedBytes{0};
+  };
+
+  ZmqProxy(
+      ZmqEventLoop* evl,
+      detail::SocketImpl* frontend,
+      detail::SocketImpl* backend,
+      detail::SocketImpl* capture = nullptr,
+      detail::SocketImpl* control = nullptr,
+      CaptureOptions const& captureOptions = CaptureOptions(),
+      size_t maxMsgsPerWakeup = 256);
+
+  ~ZmqProxy();
+
+  /**
+   * Stop and resume forwarding. Messages are held in sockets while paused.
+   */
+  void pause();
+  void resume();
+
+  /**
+   * Stop forwarding for good and detach all sockets from the loop. Invokes
+   * callback set with `setTerminateCallback`, if any.
+   */
+  void terminate();
+
+  bool
+  isPaused() const {
+    return paused_;
+  }
+
+  bool
+  isTerminated() const {
+    return terminated_;
+  }
+
+  void setTerminateCallback(folly::Function<void() noexcept> callback);
+
+  void setCaptureOptions(CaptureOptions const& captureOptions);
+
+  /**
+   * Counters of a direction, can be read from any thread
+   */
+  Stats getStats(Direction direction) const;
+
+  /**
+   * Export stats as counters `<prefix>.frontend_to_backend.msgs` etc. into
+   * thread data of calling thread
+   */
+  void exportStats(ThreadData& tData, std::string const& prefix) const;
+
+ private:
+  struct Counters {
+    std::atomic<uint64_t> numMsgs{0};
+    std::atomic<uint64_t> numFrames{0};
+    std::atomic<uint64_t> numBytes{0};
+    std::atomic<uint64_t> numDroppedMsgs{0};
+    std::atomic<uint64_t> numCapturedMsgs{0};
+    std::atomic<uint64_t> numCapturedBytes{0};
+    // messages seen, for 1-in-N sampling
+    uint64_t numSampled{0};
+  };
+
+  // forward pending messages of one direction
+  void forward(Direction direction) noexcept;
+
+  // whether message of `bytes` is to be captured
+  bool sampleCapture(Counters& counters, uint64_t bytes);
+
+  void processControl() noexcept;
+
+  void addSockets();
+  void removeSockets();
+
+  ZmqEventLoop* const evl_{nullptr};
+  detail::SocketImpl* const frontend_{nullptr};
+  detail::SocketImpl* const backend_{nullptr};
+  detail::SocketImpl* const capture_{nullptr};
+  detail::SocketImpl* const control_{nullptr};
+  const size_t maxMsgsPerWakeup_{0};
+
+  CaptureOptions captureOptions_;
+  std::unique_ptr<TokenBucket> captureBudget_;
+
+  bool paused_{false};
+  bool terminated_{false};
+  folly::Function<void() noexcept> terminateCallback_;
+
+  // reused for every wakeup, frames and bytes of every message of batch
+  MessageBatch batch_;
+  std::vector<std::pair<uint64_t, uint64_t>> sizes_;
+
+  std::array<Counters, 2> counters_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,323 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/ZmqPubBatcher.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <folly/Bits.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Batch frame is a header followed by records, each prefixed by its length.
+// Integers are little endian.
+const uint32_t kBatchMagic{0x42425a46}; // "FZBB"
+
+struct BatchHeader {
+  uint32_t magic;
+  uint32_t numRecords;
+};
+
+// Oversized publications are sent in fragment frames, each a header followed
+// by `totalLength - offset` bytes of publication at most
+const uint32_t kFragmentMagic{0x46425a46}; // "FZBF"
+
+struct FragmentHeader {
+  uint32_t magic;
+  uint32_t offset;
+  uint32_t totalLength;
+};
+
+using RecordLength = uint32_t;
+
+// batches start small and grow up to max batch size, so that topics with
+// sparse publications don't hold full sized buffers
+const size_t kInitialBatchBytes{4096};
+
+} // namespace
+
+ZmqPubBatcher::ZmqPubBatcher(
+    ZmqEventLoop* evl,
+    detail::SocketImpl* socket,
+    size_t maxBatchBytes,
+    size_t maxQueuedBytes,
+    std::chrono::milliseconds maxBatchDelay)
+    : evl_(evl),
+      socket_(socket),
+      maxBatchBytes_(maxBatchBytes),
+      maxBatchDelay_(maxBatchDelay) {
+  CHECK_LT(sizeof(BatchHeader) + sizeof(RecordLength), maxBatchBytes_);
+  CHECK_LT(sizeof(FragmentHeader), maxBatchBytes_);
+  CHECK_LE(maxBatchBytes_, maxQueuedBytes);
+
+  // every queued message is a batch of at most maxBatchBytes (oversized
+  // publications aside), hence HWM in batches bounds queued bytes
+  const int hwm = static_cast<int>(std::min<size_t>(
+      maxQueuedBytes / maxBatchBytes_, std::numeric_limits<int>::max()));
+  const auto hwmRet = socket_->setSockOpt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+  if (hwmRet.hasError()) {
+    LOG(FATAL) << "ZmqPubBatcher: Could not set ZMQ_SNDHWM "
+               << hwmRet.error();
+  }
+
+  flushTimer_ = ZmqTimeout::make(evl_, [this]() noexcept { flush(); });
+}
+
+ZmqPubBatcher::~ZmqPubBatcher() {
+  flush();
+}
+
+void
+ZmqPubBatcher::publish(Message msg) {
+  publish("", std::move(msg));
+}
+
+void
+ZmqPubBatcher::publish(std::string const& topic, Message msg) {
+  ++stats_.numMessages;
+  const size_t recordBytes = sizeof(RecordLength) + msg.size();
+  const size_t neededBytes = sizeof(BatchHeader) + recordBytes;
+
+  if (neededBytes > maxBatchBytes_) {
+    ++stats_.numOversized;
+    // keep order with pending publications of topic
+    auto it = batches_.find(topic);
+    if (it != batches_.end()) {
+      send(topic, it->second);
+      batches_.erase(it);
+    }
+    sendFragments(topic, msg);
+    return;
+  }
+
+  // send pending batch first if publication doesn't fit in it
+  auto& batch = batches_[topic];
+  if (batch.buf && batch.buf->length() + recordBytes > maxBatchBytes_) {
+    send(topic, batch);
+  }
+
+  if (not batch.buf) {
+    batch.buf = folly::IOBuf::create(std::max(
+        neededBytes, std::min(kInitialBatchBytes, maxBatchBytes_)));
+    // header is filled in once batch is sent
+    batch.buf->append(sizeof(BatchHeader));
+  } else if (batch.buf->tailroom() < recordBytes) {
+    const auto capacity = std::max(
+        batch.buf->length() + recordBytes,
+        std::min(batch.buf->capacity() * 2, maxBatchBytes_));
+    batch.buf->reserve(0, capacity - batch.buf->length());
+  }
+
+  const RecordLength length = folly::Endian::little<RecordLength>(msg.size());
+  auto tail = batch.buf->writableTail();
+  std::memcpy(tail, &length, sizeof(length));
+  std::memcpy(tail + sizeof(length), msg.data().data(), msg.size());
+  batch.buf->append(recordBytes);
+  batch.numRecords += 1;
+  numPendingBytes_ += recordBytes;
+
+  if (batch.buf->length() >= maxBatchBytes_) {
+    send(topic, batch);
+    batches_.erase(topic);
+  } else if (not flushTimer_->isScheduled()) {
+    // zero delay fires once events of current loop iteration are processed
+    flushTimer_->scheduleTimeout(maxBatchDelay_);
+  }
+}
+
+void
+ZmqPubBatcher::flush() {
+  for (auto& kv : batches_) {
+    if (kv.second.buf) {
+      send(kv.first, kv.second);
+    }
+  }
+  // drop sent batches, topics which went idle don't linger in the map
+  batches_.clear();
+  if (flushTimer_->isScheduled()) {
+    flushTimer_->cancelTimeout();
+  }
+}
+
+void
+ZmqPubBatcher::send(std::string const& topic, Batch& batch) {
+  BatchHeader header;
+  header.magic = folly::Endian::little(kBatchMagic);
+  header.numRecords = folly::Endian::little(batch.numRecords);
+  std::memcpy(batch.buf->writableData(), &header, sizeof(header));
+  numPendingBytes_ -= batch.buf->length() - sizeof(BatchHeader);
+  batch.numRecords = 0;
+
+  if (sendFrame(topic, std::move(batch.buf))) {
+    ++stats_.numBatches;
+  }
+}
+
+void
+ZmqPubBatcher::sendFragments(std::string const& topic, Message const& msg) {
+  const auto data = msg.data();
+  const size_t maxChunkBytes = maxBatchBytes_ - sizeof(FragmentHeader);
+  FragmentHeader header;
+  header.magic = folly::Endian::little(kFragmentMagic);
+  header.totalLength = folly::Endian::little<uint32_t>(data.size());
+
+  for (size_t offset = 0; offset < data.size(); offset += maxChunkBytes) {
+    const size_t chunkBytes = std::min(maxChunkBytes, data.size() - offset);
+    header.offset = folly::Endian::little<uint32_t>(offset);
+    auto buf = folly::IOBuf::create(sizeof(header) + chunkBytes);
+    std::memcpy(buf->writableData(), &header, sizeof(header));
+    std::memcpy(
+        buf->writableData() + sizeof(header), data.data() + offset, chunkBytes);
+    buf->append(sizeof(header) + chunkBytes);
+    // rest of publication would be dropped by subscriber anyway
+    if (not sendFrame(topic, std::move(buf))) {
+      return;
+    }
+    ++stats_.numFragments;
+  }
+}
+
+bool
+ZmqPubBatcher::sendFrame(
+    std::string const& topic, std::unique_ptr<folly::IOBuf> buf) {
+  auto msg = Message::wrapBuffer(std::move(buf)).value();
+  const auto ret = topic.empty()
+      ? socket_->sendOne(std::move(msg))
+      : socket_->sendMultiple(Message::from(topic).value(), std::move(msg));
+  if (ret.hasError()) {
+    LOG(ERROR) << "ZmqPubBatcher: error sending batch " << ret.error();
+    ++stats_.numErrors;
+    return false;
+  }
+  return true;
+}
+
+folly::Expected<std::vector<Message>, Error>
+ZmqPubBatcher::unbatch(Message const& batch) {
+  auto data = batch.data();
+  BatchHeader header;
+  if (data.size() < sizeof(header)) {
+    return folly::makeUnexpected(Error(EPROTO, "Batch frame too short"));
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  data.advance(sizeof(header));
+  if (folly::Endian::little(header.magic) != kBatchMagic) {
+    return folly::makeUnexpected(Error(EPROTO, "Not a batch frame"));
+  }
+
+  const auto numRecords = folly::Endian::little(header.numRecords);
+  std::vector<Message> msgs;
+  msgs.reserve(
+      std::min<size_t>(numRecords, data.size() / sizeof(RecordLength)));
+  for (uint32_t i = 0; i < numRecords; ++i) {
+    RecordLength length;
+    if (data.size() < sizeof(length)) {
+      return folly::makeUnexpected(Error(EPROTO, "Truncated batch frame"));
+    }
+    std::memcpy(&length, data.data(), sizeof(length));
+    data.advance(sizeof(length));
+    length = folly::Endian::little(length);
+    if (data.size() < length) {
+      return folly::makeUnexpected(Error(EPROTO, "Truncated batch frame"));
+    }
+
+    auto msg = Message::allocate(length);
+    if (msg.hasError()) {
+      return folly::makeUnexpected(msg.error());
+    }
+    std::memcpy(msg->writeableData().data(), data.data(), length);
+    data.advance(length);
+    msgs.emplace_back(std::move(msg.value()));
+  }
+  if (not data.empty()) {
+    return folly::makeUnexpected(Error(EPROTO, "Trailing bytes in batch"));
+  }
+  return msgs;
+}
+
+folly::Expected<std::vector<Message>, Error>
+ZmqPubBatcher::recvUnbatched(
+    detail::SocketImpl* socket,
+    folly::Optional<std::chrono::milliseconds> timeout,
+    std::string* topic) {
+  // oversized publication being reassembled, if any
+  folly::Optional<Message> publication;
+  std::string publicationTopic;
+  size_t numReceivedBytes{0};
+
+  while (true) {
+    auto frames = socket->recvMultiple(timeout);
+    if (frames.hasError()) {
+      return folly::makeUnexpected(frames.error());
+    }
+    if (frames->size() > 2) {
+      return folly::makeUnexpected(Error(EPROTO, "Unexpected batch frames"));
+    }
+    auto frameTopic = frames->size() == 2
+        ? frames->front().read<std::string>().value()
+        : std::string();
+
+    auto data = frames->back().data();
+    FragmentHeader header;
+    if (data.size() >= sizeof(header)) {
+      std::memcpy(&header, data.data(), sizeof(header));
+    }
+    if (data.size() < sizeof(header) or
+        folly::Endian::little(header.magic) != kFragmentMagic) {
+      // publication being reassembled (if any) lost its tail
+      if (topic) {
+        *topic = std::move(frameTopic);
+      }
+      return unbatch(frames->back());
+    }
+
+    data.advance(sizeof(header));
+    const auto offset = folly::Endian::little(header.offset);
+    const auto totalLength = folly::Endian::little(header.totalLength);
+    if (offset == 0) {
+      auto msg = Message::allocate(totalLength);
+      if (msg.hasError()) {
+        return folly::makeUnexpected(msg.error());
+      }
+      publication = std::move(msg.value());
+      publicationTopic = std::move(frameTopic);
+      numReceivedBytes = 0;
+    } else if (
+        not publication or offset != numReceivedBytes or
+        totalLength != publication->size() or frameTopic != publicationTopic) {
+      // fragment of publication whose earlier fragments got dropped
+      publication.clear();
+      continue;
+    }
+    if (data.empty() or data.size() > totalLength - numReceivedBytes) {
+      return folly::makeUnexpected(Error(EPROTO, "Malformed fragment frame"));
+    }
+
+    std::memcpy(
+        publication->writeableData().data() + numReceivedBytes,
+        data.data(),
+        data.size());
+    numReceivedBytes += data.size();
+    if (numReceivedBytes == totalLength) {
+      if (topic) {
+        *topic = std::move(publicationTopic);
+      }
+      std::vector<Message> msgs;
+      msgs.emplace_back(std::move(publication.value()));
+      return msgs;
+    }
+  }
+}
+
+} // namespace fbzmq
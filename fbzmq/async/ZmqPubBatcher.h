@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <folly/Expected.h>
+#include <folly/Optional.h>
+#include <folly/io/IOBuf.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+/**
+ * Byte budgeted publisher for a ZMQ_PUB socket driven by ZmqEventLoop.
+ *
+ * ZMQ_SNDHWM counts messages regardless of their size, so memory held for a
+ * slow subscriber depends on what is being published. Batcher packs
+ * publications into batch frames of up to `maxBatchBytes` instead, and sets
+ * ZMQ_SNDHWM to `maxQueuedBytes / maxBatchBytes` batches, which bounds bytes
+ * queued per subscriber to `maxQueuedBytes`. Publications bigger than a batch
+ * are split into fragment frames of up to `maxBatchBytes` each, so that they
+ * are accounted by their real size as well, and are reassembled by
+ * `recvUnbatched`. As with plain PUB, frames are dropped for subscribers
+ * which have hit the HWM. Publication which lost any of its fragments that
+ * way is dropped as a whole by the subscriber.
+ *
+ * Batching adapts to load: publications are sent once their batch is full,
+ * otherwise at the end of current loop iteration, or after `maxBatchDelay`
+ * if non-zero. Bursts are thereby packed into few frames while sparse
+ * publications don't wait for a batch to fill up.
+ *
+ * Publications may carry a topic, which is sent as first frame of their
+ * batch, so that subscribers can keep filtering via ZMQ_SUBSCRIBE. Order is
+ * kept among publications of the same topic.
+ *
+ * Subscribers must unpack batches with `recvUnbatched` (or `unbatch`),
+ * publications of a batcher aren't readable as plain messages.
+ *
+ * Must be constructed before socket is bound or connected, for HWM to apply,
+ * and used from within loop's thread only. Socket must outlive batcher.
+ */
+class ZmqPubBatcher : public boost::noncopyable {
+ public:
+  struct Stats {
+    // publications passed to `publish`
+    uint64_t numMessages{0};
+    // batch frames sent
+    uint64_t numBatches{0};
+    // publications bigger than `maxBatchBytes`, and fragment frames they
+    // were sent in
+    uint64_t numOversized{0};
+    uint64_t numFragments{0};
+    // batches dropped because of send errors
+    uint64_t numErrors{0};
+  };
+
+  ZmqPubBatcher(
+      ZmqEventLoop* evl,
+      detail::SocketImpl* socket,
+      size_t maxBatchBytes = 64 * 1024,
+      size_t maxQueuedBytes = 16 * 1024 * 1024,
+      std::chrono::milliseconds maxBatchDelay = std::chrono::milliseconds(0));
+
+  /**
+   * Send pending batches
+   */
+  ~ZmqPubBatcher();
+
+  /**
+   * Queue publication for sending, with topic frame unless topic is empty
+   */
+  void publish(Message msg);
+  void publish(std::string const& topic, Message msg);
+
+  /**
+   * Send pending batches right away
+   */
+  void flush();
+
+  /**
+   * Bytes of publications waiting in pending batches
+   */
+  size_t
+  getNumPendingBytes() const {
+    return numPendingBytes_;
+  }
+
+  Stats
+  getStats() const {
+    return stats_;
+  }
+
+  /**
+   * Unpack publications of a batch frame. Fails with EPROTO if frame isn't
+   * a well formed batch (fragments of oversized publications included).
+   */
+  static folly::Expected<std::vector<Message>, Error> unbatch(
+      Message const& batch);
+
+  /**
+   * Receive batch on a ZMQ_SUB socket and unpack its publications, like
+   * `recvMultiple`. Topic frame, if any, is returned in `topic`. Fragments of
+   * oversized publication are received until it is complete (timeout applies
+   * to each of them), and fragments of incomplete ones skipped.
+   */
+  static folly::Expected<std::vector<Message>, Error> recvUnbatched(
+      detail::SocketImpl* socket,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none,
+      std::string* topic = nullptr);
+
+ private:
+  struct Batch {
+    std::unique_ptr<folly::IOBuf> buf;
+    uint32_t numRecords{0};
+  };
+
+  // send batch of topic and reset it
+  void send(std::string const& topic, Batch& batch);
+
+  // send publication bigger than a batch in fragments
+  void sendFragments(std::string const& topic, Message const& msg);
+
+  // send frame with topic frame (if any) in front of it
+  bool sendFrame(std::string const& topic, std::unique_ptr<folly::IOBuf> buf);
+
+  ZmqEventLoop* const evl_{nullptr};
+  detail::SocketImpl* const socket_{nullptr};
+  const size_t maxBatchBytes_{0};
+  const std::chrono::milliseconds maxBatchDelay_{0};
+
+  // pending batch of every topic, empty topic for publications without one.
+  // Topics only have an entry while their batch is pending.
+  std::unordered_map<std::string, Batch> batches_;
+  size_t numPendingBytes_{0};
+
+  std::unique_ptr<ZmqTimeout> flushTimer_;
+
+  Stats stats_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,243 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/async/ZmqRateLimiter.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace fbzmq {
+
+namespace {
+
+std::chrono::microseconds
+toMicroseconds(double seconds) {
+  return std::chrono::microseconds(
+      static_cast<int64_t>(std::ceil(std::max(seconds, 0.0) * 1e6)));
+}
+
+} // namespace
+
+//
+// TokenBucket
+//
+
+TokenBucket::TokenBucket(double rate, double burst, Clock::time_point now)
+    : rate_(rate), burst_(burst), tokens_(burst), lastRefill_(now) {
+  CHECK_LT(0, rate_);
+  CHECK_LT(0, burst_);
+}
+
+double
+TokenBucket::getAvailable(Clock::time_point now) const {
+  if (now <= lastRefill_) {
+    return tokens_;
+  }
+  const std::chrono::duration<double> elapsed = now - lastRefill_;
+  return std::min(burst_, tokens_ + elapsed.count() * rate_);
+}
+
+bool
+TokenBucket::consume(double tokens, Clock::time_point now) {
+  tokens_ = getAvailable(now);
+  lastRefill_ = std::max(lastRefill_, now);
+  if (tokens_ < tokens) {
+    return false;
+  }
+  tokens_ -= tokens;
+  return true;
+}
+
+std::chrono::microseconds
+TokenBucket::getRetryAfter(double tokens, Clock::time_point now) const {
+  CHECK_LE(tokens, burst_) << "Bucket can never hold " << tokens << " tokens";
+  const double missing = tokens - getAvailable(now);
+  if (missing <= 0) {
+    return std::chrono::microseconds(0);
+  }
+  return toMicroseconds(missing / rate_);
+}
+
+//
+// ZmqRateLimiter
+//
+
+ZmqRateLimiter::ZmqRateLimiter(ZmqEventLoop* evl, double rate, double burst)
+    : ZmqTimeout(evl), evl_(evl), bucket_(rate, burst) {}
+
+bool
+ZmqRateLimiter::tryAcquire(double tokens) {
+  CHECK(evl_->isInEventLoop());
+  if (!pending_.empty()) {
+    return false;
+  }
+  return bucket_.consume(tokens, TokenBucket::Clock::now());
+}
+
+std::chrono::microseconds
+ZmqRateLimiter::getRetryAfter(double tokens) const {
+  return bucket_.getRetryAfter(tokens, TokenBucket::Clock::now());
+}
+
+void
+ZmqRateLimiter::runWhenAllowed(double tokens, TimeoutCallback callback) {
+  CHECK(evl_->isInEventLoop());
+  CHECK(callback);
+  CHECK_LE(tokens, bucket_.getBurst()) << "Callback would never be run";
+
+  pending_.push_back(Pending{tokens, std::move(callback)});
+  // Callbacks added from within runPending (e.g. by a callback scheduling
+  // next send) are picked up by it, rather than recursing
+  if (!running_ && !isScheduled()) {
+    runPending();
+  }
+}
+
+void
+ZmqRateLimiter::timeoutExpired() noexcept {
+  CHECK(evl_->isInEventLoop());
+  runPending();
+}
+
+void
+ZmqRateLimiter::runPending() noexcept {
+  running_ = true;
+  while (!pending_.empty()) {
+    auto& next = pending_.front();
+    const auto now = TokenBucket::Clock::now();
+    if (!bucket_.consume(next.tokens, now)) {
+      scheduleTimeout(bucket_.getRetryAfter(next.tokens, now));
+      break;
+    }
+    auto callback = std::move(next.callback);
+    pending_.pop_front();
+    callback();
+  }
+  running_ = false;
+}
+
+//
+// ZmqKeyedRateLimiter
+//
+
+ZmqKeyedRateLimiter::ZmqKeyedRateLimiter(
+    ZmqEventLoop* evl, uint64_t limit, std::chrono::milliseconds window)
+    : ZmqTimeout(evl),
+      evl_(evl),
+      limit_(limit),
+      window_(window),
+      start_(TokenBucket::Clock::now()) {
+  CHECK_LT(0, limit_);
+  CHECK_LT(0, window_.count());
+
+  // expire idle keys
+  scheduleTimeout(window, true /* isPeriodic */);
+}
+
+std::pair<int64_t, std::chrono::microseconds>
+ZmqKeyedRateLimiter::getWindow(TokenBucket::Clock::time_point now) const {
+  const auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - start_);
+  const int64_t index = elapsed / window_;
+  return std::make_pair(index, elapsed - index * window_);
+}
+
+double
+ZmqKeyedRateLimiter::getEstimate(
+    Window const& window,
+    int64_t index,
+    std::chrono::microseconds elapsed) const {
+  uint64_t count = 0;
+  uint64_t prevCount = 0;
+  if (window.index == index) {
+    count = window.count;
+    prevCount = window.prevCount;
+  } else if (window.index == index - 1) {
+    prevCount = window.count;
+  }
+  // part of previous fixed window still covered by the sliding one
+  const double weight =
+      1.0 - static_cast<double>(elapsed.count()) / window_.count();
+  return prevCount * weight + count;
+}
+
+bool
+ZmqKeyedRateLimiter::tryAcquire(std::string const& key) {
+  CHECK(evl_->isInEventLoop());
+  const auto current = getWindow(TokenBucket::Clock::now());
+  const auto index = current.first;
+
+  auto& window = windows_[key];
+  if (window.index != index) {
+    window.prevCount = window.index == index - 1 ? window.count : 0;
+    window.count = 0;
+    window.index = index;
+  }
+
+  if (getEstimate(window, index, current.second) + 1 > limit_) {
+    return false;
+  }
+  ++window.count;
+  return true;
+}
+
+std::chrono::microseconds
+ZmqKeyedRateLimiter::getRetryAfter(std::string const& key) const {
+  CHECK(evl_->isInEventLoop());
+  auto it = windows_.find(key);
+  if (it == windows_.end()) {
+    return std::chrono::microseconds(0);
+  }
+
+  const auto current = getWindow(TokenBucket::Clock::now());
+  const auto index = current.first;
+  const auto elapsed = current.second;
+  auto const& window = it->second;
+  if (getEstimate(window, index, elapsed) + 1 <= limit_) {
+    return std::chrono::microseconds(0);
+  }
+
+  const double windowSecs = std::chrono::duration<double>(window_).count();
+  const double elapsedSecs = std::chrono::duration<double>(elapsed).count();
+  const uint64_t count = window.index == index ? window.count : 0;
+  const uint64_t prevCount = window.index == index
+      ? window.prevCount
+      : (window.index == index - 1 ? window.count : 0);
+
+  if (count + 1 > limit_) {
+    // Current fixed window alone is over the limit. Wait for the next one, in
+    // which this one's weight has to decay far enough.
+    return toMicroseconds(
+        windowSecs - elapsedSecs +
+        windowSecs * (1.0 - static_cast<double>(limit_ - 1) / count));
+  }
+  // weight of previous fixed window has to decay far enough
+  return toMicroseconds(
+      windowSecs *
+          (1.0 - static_cast<double>(limit_ - 1 - count) / prevCount) -
+      elapsedSecs);
+}
+
+void
+ZmqKeyedRateLimiter::timeoutExpired() noexcept {
+  CHECK(evl_->isInEventLoop());
+  const auto index = getWindow(TokenBucket::Clock::now()).first;
+  // keys without requests in current and previous fixed window
+  for (auto it = windows_.begin(); it != windows_.end();) {
+    auto const& window = it->second;
+    if (window.index < index - 1 ||
+        (window.index == index - 1 && window.count == 0)) {
+      it = windows_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+} // namespace fbzmq
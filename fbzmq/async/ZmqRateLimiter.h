@@ -0,0 +1,201 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqTimeout.h>
+
+namespace fbzmq {
+
+/**
+ * Token bucket refilled at `rate` tokens per second and holding at most
+ * `burst` tokens, i.e. sustains `rate` on average and admits bursts of up to
+ * `burst` at once. Bucket starts full. Time is passed in by the caller, all
+ * operations are O(1).
+ */
+class TokenBucket {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  TokenBucket(double rate, double burst, Clock::time_point now = Clock::now());
+
+  /**
+   * Take `tokens` out of the bucket if there are enough of them
+   */
+  bool consume(double tokens, Clock::time_point now);
+
+  /**
+   * Time until `tokens` can be consumed, zero if right now. `tokens` must not
+   * exceed burst size.
+   */
+  std::chrono::microseconds getRetryAfter(
+      double tokens, Clock::time_point now) const;
+
+  /**
+   * Tokens in the bucket at `now`
+   */
+  double getAvailable(Clock::time_point now) const;
+
+  double
+  getBurst() const {
+    return burst_;
+  }
+
+ private:
+  const double rate_{0};
+  const double burst_{0};
+
+  // tokens as of lastRefill_
+  double tokens_{0};
+  Clock::time_point lastRefill_;
+};
+
+/**
+ * TokenBucket driven by ZmqEventLoop, for pacing outbound sends (or any other
+ * work) from within the loop rather than sleeping, e.g.
+ *
+ *  ZmqRateLimiter limiter(evl, 1000 (per second), 100 (burst));
+ *
+ *  // send whenever allowed, in order, without blocking the loop
+ *  limiter.runWhenAllowed(1, [this]() noexcept { sendNext(); });
+ *
+ *  // or admit requests, telling rejected ones when to come back
+ *  if (not limiter.tryAcquire()) {
+ *    auto retryAfter = limiter.getRetryAfter();
+ *    ...
+ *  }
+ *
+ * Must be used from within loop's thread only.
+ */
+class ZmqRateLimiter final : private ZmqTimeout {
+ public:
+  ZmqRateLimiter(ZmqEventLoop* evl, double rate, double burst);
+
+  ~ZmqRateLimiter() override = default;
+
+  /**
+   * Take `tokens` if available right away. Always fails while callbacks are
+   * waiting in `runWhenAllowed`, to keep them in order.
+   */
+  bool tryAcquire(double tokens = 1);
+
+  /**
+   * Time until `tryAcquire(tokens)` would succeed, not accounting for waiting
+   * callbacks
+   */
+  std::chrono::microseconds getRetryAfter(double tokens = 1) const;
+
+  /**
+   * Invoke `callback` from within the loop once `tokens` are available, right
+   * away if they are. Callbacks are run in order they were added.
+   */
+  void runWhenAllowed(double tokens, TimeoutCallback callback);
+
+  /**
+   * Callbacks waiting for tokens
+   */
+  size_t
+  getNumPending() const {
+    return pending_.size();
+  }
+
+ private:
+  /**
+   * Overrides ZmqTimeout's timeout callback
+   */
+  void timeoutExpired() noexcept override;
+
+  // run waiting callbacks which are allowed and schedule timeout for the rest
+  void runPending() noexcept;
+
+  const ZmqEventLoop* evl_{nullptr};
+  TokenBucket bucket_;
+
+  struct Pending {
+    double tokens{0};
+    TimeoutCallback callback{nullptr};
+  };
+  std::deque<Pending> pending_;
+
+  // whether runPending is on the stack
+  bool running_{false};
+};
+
+/**
+ * Per key (e.g. ROUTER identity of a peer) limit of `limit` requests per
+ * `window`, for admitting inbound requests. Rate is computed over a sliding
+ * window approximated from counts of current and previous fixed windows,
+ * weighted by their overlap with the sliding one. This needs two counters per
+ * key and O(1) per check, unlike keeping timestamps of every request.
+ *
+ * State of keys idle for a whole window is dropped periodically by the loop.
+ * Must be used from within loop's thread only.
+ */
+class ZmqKeyedRateLimiter final : private ZmqTimeout {
+ public:
+  ZmqKeyedRateLimiter(
+      ZmqEventLoop* evl, uint64_t limit, std::chrono::milliseconds window);
+
+  ~ZmqKeyedRateLimiter() override = default;
+
+  /**
+   * Count request of `key` if it is within its limit
+   */
+  bool tryAcquire(std::string const& key);
+
+  /**
+   * Time until request of `key` would be admitted, zero if right now
+   */
+  std::chrono::microseconds getRetryAfter(std::string const& key) const;
+
+  /**
+   * Number of keys currently tracked
+   */
+  size_t
+  getNumKeys() const {
+    return windows_.size();
+  }
+
+ private:
+  struct Window {
+    int64_t index{0};
+    uint64_t count{0};
+    uint64_t prevCount{0};
+  };
+
+  /**
+   * Overrides ZmqTimeout's timeout callback
+   */
+  void timeoutExpired() noexcept override;
+
+  // index of fixed window `now` falls in and time elapsed in it
+  std::pair<int64_t, std::chrono::microseconds> getWindow(
+      TokenBucket::Clock::time_point now) const;
+
+  // estimated requests of key over sliding window ending at `now`
+  double getEstimate(
+      Window const& window,
+      int64_t index,
+      std::chrono::microseconds elapsed) const;
+
+  const ZmqEventLoop* evl_{nullptr};
+  const uint64_t limit_{0};
+  const std::chrono::microseconds window_{0};
+  const TokenBucket::Clock::time_point start_;
+
+  std::unordered_map<std::string, Window> windows_;
+};
+
+} // namespace fbzmq
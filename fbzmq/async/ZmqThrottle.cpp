@@ -15,9 +15,17 @@ ZmqThrottle::ZmqThrottle(
     ZmqEventLoop* evl,
     std::chrono::milliseconds timeout,
     TimeoutCallback callback)
+    : ZmqThrottle(evl, timeout, false /* isHighRes */, std::move(callback)) {}
+
+ZmqThrottle::ZmqThrottle(
+    ZmqEventLoop* evl,
+    std::chrono::microseconds timeout,
+    bool isHighRes,
+    TimeoutCallback callback)
     : ZmqTimeout(evl),
       evl_(evl),
       timeout_(timeout),
+      isHighRes_(isHighRes),
       callback_(std::move(callback)) {
   CHECK(callback_);
 }
@@ -33,12 +41,17 @@ ZmqThrottle::operator()() noexcept {
   }
 
   // Special case to handle immediate timeouts
-  if (timeout_ <= std::chrono::milliseconds(0)) {
+  if (timeout_ <= std::chrono::microseconds(0)) {
     callback_();
     return;
   }
 
-  scheduleTimeout(timeout_);
+  if (isHighRes_) {
+    scheduleTimeout(timeout_);
+  } else {
+    scheduleTimeout(
+        std::chrono::duration_cast<std::chrono::milliseconds>(timeout_));
+  }
 }
 
 void
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <chrono>
+#include <type_traits>
 
 #include <fbzmq/async/ZmqEventLoop.h>
 #include <fbzmq/async/ZmqTimeout.h>
@@ -37,6 +38,18 @@ class ZmqThrottle final : private ZmqTimeout {
       std::chrono::milliseconds timeout,
       TimeoutCallback callback);
 
+  /**
+   * Throttle with microsecond resolution. Underlying timeout is scheduled as
+   * high resolution timeout in event loop.
+   */
+  template <
+      typename Duration,
+      std::enable_if_t<
+          std::is_same<Duration, std::chrono::microseconds>::value,
+          int> = 0>
+  ZmqThrottle(ZmqEventLoop* evl, Duration timeout, TimeoutCallback callback)
+      : ZmqThrottle(evl, timeout, true /* isHighRes */, std::move(callback)) {}
+
   ~ZmqThrottle() override = default;
 
   /**
@@ -55,13 +68,20 @@ class ZmqThrottle final : private ZmqTimeout {
   }
 
  private:
+  ZmqThrottle(
+      ZmqEventLoop* evl,
+      std::chrono::microseconds timeout,
+      bool isHighRes,
+      TimeoutCallback callback);
+
   /**
    * Overrides ZmqTimeout's timeout callback
    */
   void timeoutExpired() noexcept override;
 
   const ZmqEventLoop* evl_{nullptr};
-  const std::chrono::milliseconds timeout_{0};
+  const std::chrono::microseconds timeout_{0};
+  const bool isHighRes_{false};
   TimeoutCallback callback_{nullptr};
 };
 
@@ -51,6 +51,12 @@ ZmqTimeout::~ZmqTimeout() {
 void
 ZmqTimeout::scheduleTimeout(
     std::chrono::milliseconds timeoutPeriod, bool isPeriodic) {
+  scheduleTimeoutImpl(timeoutPeriod, false /* isHighRes */, isPeriodic);
+}
+
+void
+ZmqTimeout::scheduleTimeoutImpl(
+    std::chrono::microseconds timeoutPeriod, bool isHighRes, bool isPeriodic) {
   // Cancel already scheduled timeout if any
   if (isScheduled()) {
     cancelTimeout();
@@ -58,8 +64,20 @@ ZmqTimeout::scheduleTimeout(
 
   state_ = isPeriodic ? TimeoutState::PERIODIC : TimeoutState::SCHEDULED;
   timeoutPeriod_ = timeoutPeriod;
-  token_ = eventLoop_->scheduleTimeout(
-      timeoutPeriod_, [this]() noexcept { timeoutExpiredHelper(); });
+  isHighRes_ = isHighRes;
+  scheduleNext();
+}
+
+void
+ZmqTimeout::scheduleNext() {
+  if (isHighRes_) {
+    token_ = eventLoop_->scheduleHighResTimeout(
+        timeoutPeriod_, [this]() noexcept { timeoutExpiredHelper(); });
+  } else {
+    token_ = eventLoop_->scheduleTimeout(
+        std::chrono::duration_cast<std::chrono::milliseconds>(timeoutPeriod_),
+        [this]() noexcept { timeoutExpiredHelper(); });
+  }
 }
 
 void
@@ -76,8 +94,7 @@ ZmqTimeout::cancelTimeout() {
 void
 ZmqTimeout::timeoutExpiredHelper() noexcept {
   if (state_ == TimeoutState::PERIODIC) {
-    token_ = eventLoop_->scheduleTimeout(
-        timeoutPeriod_, [this]() noexcept { timeoutExpiredHelper(); });
+    scheduleNext();
   } else {
     state_ = TimeoutState::NONE;
   }
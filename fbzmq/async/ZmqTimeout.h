@@ -9,6 +9,9 @@
 
 #pragma once
 
+#include <chrono>
+#include <type_traits>
+
 #include <fbzmq/async/ZmqEventLoop.h>
 
 namespace fbzmq {
@@ -75,6 +78,20 @@ class ZmqTimeout {
   void scheduleTimeout(
       std::chrono::milliseconds timeoutPeriod, bool isPeriodic = false);
 
+  /**
+   * Same as above but with microsecond resolution. Timeout is scheduled via
+   * `ZmqEventLoop::scheduleHighResTimeout`.
+   */
+  template <
+      typename Duration,
+      std::enable_if_t<
+          std::is_same<Duration, std::chrono::microseconds>::value,
+          int> = 0>
+  void
+  scheduleTimeout(Duration timeoutPeriod, bool isPeriodic = false) {
+    scheduleTimeoutImpl(timeoutPeriod, true /* isHighRes */, isPeriodic);
+  }
+
   /**
    * Cancel already scheduled timeout, if it is running.
    */
@@ -103,6 +120,17 @@ class ZmqTimeout {
    */
   void timeoutExpiredHelper() noexcept;
 
+  /**
+   * Schedule timeout with given period in the event loop
+   */
+  void scheduleTimeoutImpl(
+      std::chrono::microseconds timeoutPeriod, bool isHighRes, bool isPeriodic);
+
+  /**
+   * Schedule next expiry of timeout in event loop and update token_
+   */
+  void scheduleNext();
+
   enum class TimeoutState {
     NONE = 1,
     SCHEDULED = 2,
@@ -119,7 +147,10 @@ class ZmqTimeout {
   int64_t token_{0};
 
   // Timeout duration associated with periodic timeout
-  std::chrono::milliseconds timeoutPeriod_{0};
+  std::chrono::microseconds timeoutPeriod_{0};
+
+  // Is timeout scheduled with microsecond resolution
+  bool isHighRes_{false};
 };
 
 } // namespace fbzmq
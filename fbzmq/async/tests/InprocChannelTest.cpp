@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/InprocChannel.h>
+#include <fbzmq/async/ZmqEventLoop.h>
+
+namespace fbzmq {
+
+namespace {
+
+struct Item {
+  explicit Item(int val) : val(val), payload(16, val) {}
+
+  int val{0};
+  std::vector<int> payload;
+};
+
+} // namespace
+
+TEST(InprocChannelTest, ReadWrite) {
+  InprocChannel<Item> channel(2);
+  EXPECT_EQ(nullptr, channel.read());
+
+  EXPECT_TRUE(channel.write(std::make_unique<Item>(1)));
+  EXPECT_TRUE(channel.write(std::make_unique<Item>(2)));
+  EXPECT_EQ(2, channel.size());
+
+  // channel is full, object stays with the writer
+  auto item = std::make_unique<Item>(3);
+  auto rawItem = item.get();
+  EXPECT_FALSE(channel.write(std::move(item)));
+  EXPECT_EQ(rawItem, item.get());
+
+  EXPECT_EQ(1, channel.read()->val);
+  EXPECT_TRUE(channel.write(std::move(item)));
+  EXPECT_EQ(2, channel.read()->val);
+
+  // object is moved, not copied
+  auto obj = channel.read();
+  EXPECT_EQ(rawItem, obj.get());
+  EXPECT_EQ(nullptr, channel.read());
+}
+
+TEST(InprocChannelTest, Reader) {
+  const int kNumItems = 10000;
+
+  ZmqEventLoop evl;
+  InprocChannel<Item> channel(64);
+
+  int numRead = 0;
+  channel.attachReader(
+      &evl,
+      [&](std::unique_ptr<Item> item) noexcept {
+        // objects arrive in order they were written
+        EXPECT_EQ(numRead, item->val);
+        EXPECT_EQ(numRead, item->payload.back());
+        if (++numRead == kNumItems) {
+          channel.detachReader();
+          evl.stop();
+        }
+      },
+      8 /* maxReadsPerWakeup */);
+
+  std::thread evlThread([&]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  std::thread writerThread([&]() {
+    for (int i = 0; i < kNumItems; ++i) {
+      auto item = std::make_unique<Item>(i);
+      while (not channel.write(std::move(item))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  writerThread.join();
+  evlThread.join();
+  EXPECT_EQ(kNumItems, numRead);
+  EXPECT_EQ(0, channel.size());
+}
+
+} // namespace fbzmq
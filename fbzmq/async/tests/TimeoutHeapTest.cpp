@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <random>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/TimeoutHeap.h>
+
+namespace fbzmq {
+
+namespace {
+
+const auto kStart = std::chrono::steady_clock::now();
+
+std::chrono::steady_clock::time_point
+at(int ms) {
+  return kStart + std::chrono::milliseconds(ms);
+}
+
+} // namespace
+
+TEST(TimeoutHeapTest, Ordering) {
+  TimeoutHeap heap;
+  std::vector<int> fired;
+  std::vector<int> order{5, 3, 9, 1, 7, 3, 0, 8};
+  for (size_t i = 0; i < order.size(); ++i) {
+    heap.push(at(order[i]), [&fired, i]() noexcept {
+      fired.push_back(static_cast<int>(i));
+    });
+  }
+  EXPECT_EQ(order.size(), heap.size());
+
+  while (!heap.empty()) {
+    heap.pop()();
+  }
+
+  // Timeouts with same scheduled time expire in order of insertion (1 & 5)
+  EXPECT_EQ((std::vector<int>{6, 3, 1, 5, 0, 4, 7, 2}), fired);
+}
+
+TEST(TimeoutHeapTest, EraseReclaimsMemory) {
+  TimeoutHeap heap;
+  auto state = std::make_shared<int>(0);
+
+  auto id1 = heap.push(at(10), [state]() noexcept {});
+  auto id2 = heap.push(at(20), [state]() noexcept {});
+  EXPECT_EQ(3, state.use_count());
+  EXPECT_EQ(2, heap.size());
+
+  // Callback must be destroyed right away
+  EXPECT_TRUE(heap.erase(id1));
+  EXPECT_EQ(2, state.use_count());
+  EXPECT_EQ(1, heap.size());
+  EXPECT_EQ(1, heap.getNumCancelled());
+
+  // Erasing again or erasing bogus ids must fail
+  EXPECT_FALSE(heap.erase(id1));
+  EXPECT_FALSE(heap.erase(-1));
+  EXPECT_FALSE(heap.erase(12345));
+  EXPECT_EQ(1, heap.getNumCancelled());
+
+  // Slot of id1 is reused but id1 must remain invalid
+  auto id3 = heap.push(at(30), []() noexcept {});
+  EXPECT_NE(id1, id3);
+  EXPECT_FALSE(heap.erase(id1));
+  EXPECT_EQ(2, heap.size());
+
+  // Fired timeout's id must not be valid anymore
+  heap.pop()();
+  EXPECT_EQ(1, state.use_count());
+  EXPECT_FALSE(heap.erase(id2));
+  EXPECT_TRUE(heap.erase(id3));
+  EXPECT_TRUE(heap.empty());
+}
+
+TEST(TimeoutHeapTest, RandomizedReArm) {
+  TimeoutHeap heap;
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int> timeDist(0, 100000);
+
+  // Simulate re-armed timers. Heap size must be bounded by number of live
+  // timers regardless of number of cancellations.
+  const size_t kNumTimers = 1000;
+  std::vector<int64_t> ids;
+  for (size_t i = 0; i < kNumTimers; ++i) {
+    ids.push_back(heap.push(at(timeDist(gen)), []() noexcept {}));
+  }
+  for (int round = 0; round < 100; ++round) {
+    for (auto& id : ids) {
+      EXPECT_TRUE(heap.erase(id));
+      id = heap.push(at(timeDist(gen)), []() noexcept {});
+    }
+    EXPECT_EQ(kNumTimers, heap.size());
+  }
+  EXPECT_EQ(kNumTimers * 100, heap.getNumCancelled());
+
+  // Pop everything and verify ordering
+  auto last = heap.topTime();
+  while (!heap.empty()) {
+    EXPECT_LE(last, heap.topTime());
+    last = heap.topTime();
+    heap.pop();
+  }
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <random>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/TimerWheel.h>
+
+namespace fbzmq {
+
+namespace {
+
+const auto kStart = std::chrono::steady_clock::now();
+
+std::chrono::steady_clock::time_point
+at(int64_t us) {
+  return kStart + std::chrono::microseconds(us);
+}
+
+// Advance wheel to given time and invoke all expired timers
+void
+advanceTo(TimerWheel& wheel, int64_t us) {
+  wheel.advance(at(us));
+  while (auto callback = wheel.popExpired()) {
+    callback();
+  }
+}
+
+} // namespace
+
+TEST(TimerWheelTest, ExpiryOrder) {
+  TimerWheel wheel(kStart);
+  std::vector<int> fired;
+  std::vector<int64_t> deadlines{
+      50, 10, 70000, 10, 4100, 1, 100000000000 /* beyond range of wheel */};
+  for (size_t i = 0; i < deadlines.size(); ++i) {
+    wheel.schedule(at(deadlines[i]), [&fired, i]() noexcept {
+      fired.push_back(static_cast<int>(i));
+    });
+  }
+  EXPECT_EQ(deadlines.size(), wheel.size());
+
+  // Nothing must fire before its deadline
+  advanceTo(wheel, 0);
+  EXPECT_TRUE(fired.empty());
+
+  advanceTo(wheel, 9);
+  EXPECT_EQ(std::vector<int>{5}, fired);
+
+  // Timers with same deadline fire in order of insertion
+  advanceTo(wheel, 50);
+  EXPECT_EQ((std::vector<int>{5, 1, 3, 0}), fired);
+
+  advanceTo(wheel, 69999);
+  EXPECT_EQ((std::vector<int>{5, 1, 3, 0, 4}), fired);
+
+  // Large jump fires everything in deadline order except far timer
+  advanceTo(wheel, 100000000);
+  EXPECT_EQ((std::vector<int>{5, 1, 3, 0, 4, 2}), fired);
+  EXPECT_EQ(1, wheel.size());
+
+  // Timer beyond range of wheel must be re-inserted and fire on time
+  advanceTo(wheel, 99999999999);
+  EXPECT_EQ(6, fired.size());
+  advanceTo(wheel, 100000000000);
+  EXPECT_EQ((std::vector<int>{5, 1, 3, 0, 4, 2, 6}), fired);
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_FALSE(wheel.nextWakeup().hasValue());
+}
+
+TEST(TimerWheelTest, Cancel) {
+  TimerWheel wheel(kStart);
+  auto state = std::make_shared<int>(0);
+  int numFired = 0;
+
+  auto id1 = wheel.schedule(at(100), [state, &numFired]() noexcept {
+    ++numFired;
+  });
+  auto id2 = wheel.schedule(at(100000), [state, &numFired]() noexcept {
+    ++numFired;
+  });
+  EXPECT_EQ(3, state.use_count());
+
+  // Callback must be destroyed right away
+  EXPECT_TRUE(wheel.cancel(id1));
+  EXPECT_FALSE(wheel.cancel(id1));
+  EXPECT_FALSE(wheel.cancel(-1));
+  EXPECT_EQ(2, state.use_count());
+  EXPECT_EQ(1, wheel.size());
+
+  advanceTo(wheel, 1000);
+  EXPECT_EQ(0, numFired);
+
+  // Cancel timer which is already expired but not popped yet
+  wheel.advance(at(100000));
+  EXPECT_TRUE(wheel.cancel(id2));
+  EXPECT_FALSE(static_cast<bool>(wheel.popExpired()));
+  EXPECT_EQ(0, numFired);
+  EXPECT_EQ(1, state.use_count());
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, NextWakeup) {
+  TimerWheel wheel(kStart);
+  EXPECT_FALSE(wheel.nextWakeup().hasValue());
+
+  // Level-0 deadline is exact
+  wheel.schedule(at(30), []() noexcept {});
+  EXPECT_EQ(at(30), wheel.nextWakeup().value());
+
+  // Higher level deadline is a lower bound
+  wheel.schedule(at(5000), []() noexcept {});
+  advanceTo(wheel, 30);
+  auto wakeup = wheel.nextWakeup().value();
+  EXPECT_LE(wakeup, at(5000));
+  EXPECT_LT(at(30), wakeup);
+
+  // Following lower bounds must converge to deadline
+  int iterations = 0;
+  while (!wheel.empty()) {
+    wheel.advance(wheel.nextWakeup().value());
+    while (wheel.popExpired()) {
+    }
+    ++iterations;
+  }
+  EXPECT_GE(6, iterations);
+}
+
+TEST(TimerWheelTest, Randomized) {
+  TimerWheel wheel(kStart);
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int64_t> delayDist(0, 10000000);
+
+  int64_t now = 0;
+  int64_t lastFired = 0;
+  int numFired = 0;
+  for (int i = 0; i < 10000; ++i) {
+    const auto deadline = now + delayDist(gen);
+    wheel.schedule(at(deadline), [&, deadline]() noexcept {
+      // Never before deadline and in order
+      EXPECT_LE(deadline, now);
+      EXPECT_LE(lastFired, deadline);
+      lastFired = deadline;
+      ++numFired;
+    });
+    if (i % 10 == 0) {
+      now += delayDist(gen) / 100;
+      advanceTo(wheel, now);
+      lastFired = 0;
+    }
+  }
+
+  now += 20000000;
+  advanceTo(wheel, now);
+  EXPECT_EQ(10000, numFired);
+  EXPECT_TRUE(wheel.empty());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqBufferedWriter.h>
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+namespace {
+
+void
+runBackpressureTest(PollerType pollerType) {
+  Context context;
+  ZmqEventLoop evl(1e4, pollerType);
+  const SocketUrl socketUrl{"inproc://buffered_writer_url"};
+  const int kNumMessages = 100;
+
+  // without any peer every send would block
+  Socket<ZMQ_PUSH, ZMQ_SERVER> pushSock{
+      context, folly::none, folly::none, NonblockingFlag{true}};
+  const int hwm = 10;
+  pushSock.setSockOpt(ZMQ_SNDHWM, &hwm, sizeof(hwm)).value();
+  pushSock.bind(socketUrl).value();
+
+  int numHigh = 0;
+  int numLow = 0;
+  ZmqBufferedWriter writer(
+      &evl,
+      &pushSock,
+      50 /* highWatermark */,
+      10 /* lowWatermark */,
+      [&]() noexcept { ++numHigh; },
+      [&]() noexcept { ++numLow; });
+
+  for (int i = 0; i < kNumMessages; ++i) {
+    writer.write(Message::from(i).value());
+  }
+  EXPECT_EQ(kNumMessages, writer.getNumQueued());
+  EXPECT_TRUE(writer.isAboveHighWatermark());
+  EXPECT_EQ(1, numHigh);
+  EXPECT_EQ(0, numLow);
+
+  // queue is flushed in order once peer shows up
+  int numReceived = 0;
+  Socket<ZMQ_PULL, ZMQ_CLIENT> pullSock{context};
+  pullSock.connect(socketUrl).value();
+  evl.addSocket(
+      RawZmqSocketPtr{*pullSock}, ZMQ_POLLIN, [&](int) noexcept {
+        auto msg = pullSock.recvOne().value();
+        EXPECT_EQ(numReceived, msg.read<int>().value());
+        if (++numReceived == kNumMessages) {
+          evl.stop();
+        }
+      });
+
+  std::thread evlThread([&]() noexcept { evl.run(); });
+  evlThread.join();
+
+  EXPECT_EQ(kNumMessages, numReceived);
+  EXPECT_EQ(0, writer.getNumQueued());
+  EXPECT_FALSE(writer.isAboveHighWatermark());
+  EXPECT_EQ(1, numHigh);
+  EXPECT_EQ(1, numLow);
+  EXPECT_EQ(0, writer.getNumErrors());
+
+  // socket is writable now, messages go out right away
+  writer.write(Message::from(kNumMessages).value());
+  EXPECT_EQ(0, writer.getNumQueued());
+  EXPECT_EQ(kNumMessages, pullSock.recvOne().value().read<int>().value());
+
+  evl.removeSocket(RawZmqSocketPtr{*pullSock});
+}
+
+} // namespace
+
+TEST(ZmqBufferedWriterTest, Backpressure) {
+  runBackpressureTest(PollerType::ZMQ_POLL);
+}
+
+TEST(ZmqBufferedWriterTest, BackpressureEpoll) {
+  runBackpressureTest(PollerType::EPOLL);
+}
+
+TEST(ZmqBufferedWriterTest, ReadCallback) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl socketUrl{"inproc://buffered_writer_pair_url"};
+
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server{
+      context, folly::none, folly::none, NonblockingFlag{true}};
+  server.bind(socketUrl).value();
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client{context};
+  client.connect(socketUrl).value();
+
+  // reads are handed over to user's callback, writes echo them back
+  std::unique_ptr<ZmqBufferedWriter> writer;
+  writer = std::make_unique<ZmqBufferedWriter>(
+      &evl,
+      &server,
+      10 /* highWatermark */,
+      5 /* lowWatermark */,
+      nullptr,
+      nullptr,
+      [&](int revents) noexcept {
+        EXPECT_EQ(ZMQ_POLLIN, revents);
+        writer->write(server.recvOne().value());
+      });
+
+  std::thread evlThread([&]() noexcept { evl.run(); });
+  evl.waitUntilRunning();
+
+  for (int i = 0; i < 10; ++i) {
+    client.sendOne(Message::from(i).value()).value();
+    EXPECT_EQ(i, client.recvOne().value().read<int>().value());
+  }
+
+  evl.stop();
+  evlThread.join();
+  EXPECT_EQ(0, writer->getNumQueued());
+}
+
+TEST(ZmqBufferedWriterTest, DrainAndStop) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl socketUrl{"inproc://buffered_writer_drain_url"};
+  const int kNumMessages = 20;
+
+  Socket<ZMQ_PUSH, ZMQ_SERVER> pushSock{
+      context, folly::none, folly::none, NonblockingFlag{true}};
+  pushSock.bind(socketUrl).value();
+  ZmqBufferedWriter writer(
+      &evl, &pushSock, 50 /* highWatermark */, 10 /* lowWatermark */);
+  for (int i = 0; i < kNumMessages; ++i) {
+    writer.write(Message::from(i).value());
+  }
+  EXPECT_EQ(kNumMessages, writer.getNumQueued());
+
+  // loop doesn't stop before queue has been flushed to late peer
+  std::thread evlThread([&]() noexcept { evl.run(); });
+  evl.waitUntilRunning();
+  evl.drainAndStop(std::chrono::seconds(5));
+
+  Socket<ZMQ_PULL, ZMQ_CLIENT> pullSock{context};
+  pullSock.connect(socketUrl).value();
+  for (int i = 0; i < kNumMessages; ++i) {
+    EXPECT_EQ(i, pullSock.recvOne().value().read<int>().value());
+  }
+  evlThread.join();
+
+  EXPECT_EQ(0, writer.getNumQueued());
+  EXPECT_FALSE(evl.getDrainStats().timedOut);
+  EXPECT_EQ(0, evl.getDrainStats().numPendingDropped);
+}
+
+} // namespace fbzmq
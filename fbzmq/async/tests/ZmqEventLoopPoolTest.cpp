@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <atomic>
+#include <mutex>
+#include <set>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoopPool.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Index of the loop calling thread is running in
+folly::Optional<size_t>
+currentLoop(ZmqEventLoopPool& pool) {
+  for (size_t i = 0; i < pool.getNumLoops(); ++i) {
+    if (pool.getLoop(i).isRunning() && pool.getLoop(i).isInEventLoop()) {
+      return i;
+    }
+  }
+  return folly::none;
+}
+
+void
+waitFor(std::atomic<int>& counter, int value) {
+  while (counter.load() < value) {
+    std::this_thread::yield();
+  }
+}
+
+} // namespace
+
+TEST(ZmqEventLoopPoolTest, RunInAnyLoop) {
+  ZmqEventLoopPool pool(4);
+  pool.start();
+
+  const int kNumCallbacks = 10000;
+  std::atomic<int> count{0};
+  std::mutex mutex;
+  std::set<size_t> loops;
+  for (int i = 0; i < kNumCallbacks; ++i) {
+    pool.runInAnyLoop([&]() noexcept {
+      auto loop = currentLoop(pool);
+      EXPECT_TRUE(loop.hasValue());
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        loops.insert(loop.value());
+      }
+      ++count;
+    });
+  }
+  waitFor(count, kNumCallbacks);
+  EXPECT_LE(1, loops.size());
+
+  pool.stop();
+}
+
+TEST(ZmqEventLoopPoolTest, RunInAnyLoopFromLoops) {
+  // tiny queues, loops posting to each other must not block on them
+  ZmqEventLoopPool pool(2, 4 /* queueCapacity */);
+  pool.start();
+
+  const int kNumRoots = 2;
+  const int kNumChildren = 500;
+  std::atomic<int> count{0};
+  for (int i = 0; i < kNumRoots; ++i) {
+    pool.runInAnyLoop([&]() noexcept {
+      for (int j = 0; j < kNumChildren; ++j) {
+        pool.runInAnyLoop([&]() noexcept { ++count; });
+      }
+      ++count;
+    });
+  }
+  waitFor(count, kNumRoots * (kNumChildren + 1));
+
+  pool.stop();
+}
+
+TEST(ZmqEventLoopPoolTest, SocketAffinityAndMove) {
+  Context context;
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server(context);
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client(context);
+  server.bind(SocketUrl{"inproc://pool-test"}).value();
+  client.connect(SocketUrl{"inproc://pool-test"}).value();
+
+  ZmqEventLoopPool pool(2);
+  pool.start();
+
+  std::atomic<int> count{0};
+  std::atomic<size_t> lastLoop{0};
+  const auto socketPtr = RawZmqSocketPtr{*server};
+  const auto index =
+      pool.addSocket(socketPtr, ZMQ_POLLIN, [&](int) noexcept {
+        auto msg = server.recvOne();
+        EXPECT_TRUE(msg.hasValue());
+        lastLoop = currentLoop(pool).value();
+        ++count;
+      });
+  EXPECT_EQ(index, pool.getSocketLoop(socketPtr).value());
+  EXPECT_EQ(1, pool.getNumSockets(index));
+  EXPECT_THROW(
+      pool.addSocket(socketPtr, ZMQ_POLLIN, [](int) noexcept {}),
+      std::runtime_error);
+
+  // Callbacks are invoked in assigned loop
+  client.sendOne(Message::from(std::string("hello")).value()).value();
+  waitFor(count, 1);
+  EXPECT_EQ(index, lastLoop.load());
+
+  // Second socket goes to the least loaded loop
+  Socket<ZMQ_PAIR, ZMQ_SERVER> other(context);
+  const auto otherIndex =
+      pool.addSocket(RawZmqSocketPtr{*other}, ZMQ_POLLIN, [](int) noexcept {});
+  EXPECT_NE(index, otherIndex);
+  pool.removeSocket(RawZmqSocketPtr{*other});
+  EXPECT_EQ(0, pool.getNumSockets(otherIndex));
+
+  // Migrate to other loop, messages are handled there from now on
+  const size_t newIndex = 1 - index;
+  EXPECT_TRUE(pool.moveSocket(socketPtr, newIndex));
+  EXPECT_EQ(newIndex, pool.getSocketLoop(socketPtr).value());
+  EXPECT_EQ(0, pool.getNumSockets(index));
+  EXPECT_EQ(1, pool.getNumSockets(newIndex));
+  client.sendOne(Message::from(std::string("world")).value()).value();
+  waitFor(count, 2);
+  EXPECT_EQ(newIndex, lastLoop.load());
+
+  // Unknown sockets can't be moved
+  pool.removeSocket(socketPtr);
+  EXPECT_FALSE(pool.getSocketLoop(socketPtr).hasValue());
+  EXPECT_FALSE(pool.moveSocket(socketPtr, index));
+
+  pool.stop();
+}
+
+TEST(ZmqEventLoopPoolTest, LoopForKey) {
+  ZmqEventLoopPool pool(3);
+  for (uint64_t key = 0; key < 100; ++key) {
+    EXPECT_EQ(&pool.getLoopForKey(key), &pool.getLoopForKey(key));
+  }
+  EXPECT_NE(&pool.getLoopForKey(0), &pool.getLoopForKey(1));
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
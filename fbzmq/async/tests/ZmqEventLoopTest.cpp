@@ -7,11 +7,20 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <future>
+
 #include <folly/Memory.h>
 #include <folly/system/ThreadName.h>
 #include <gtest/gtest.h>
 
 #include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/service/stats/ThreadData.h>
 #include <fbzmq/zmq/Zmq.h>
 
 using namespace folly;
@@ -242,6 +251,41 @@ TEST(ZmqEventLoopTest, RunInEventLoopApi) {
   EXPECT_EQ(100, count);
 }
 
+TEST(ZmqEventLoopTest, BulkAndTryRunInEventLoopApi) {
+  ZmqEventLoop evl(10);
+
+  // Queue can hold only 10 callbacks while loop is not running
+  int count = 0;
+  for (int i = 0; i < 10; i++) {
+    EXPECT_TRUE(evl.tryRunInEventLoop([&, i]() noexcept {
+      EXPECT_EQ(i, count);
+      ++count;
+    }));
+  }
+  EXPECT_FALSE(evl.tryRunInEventLoop([]() noexcept { ADD_FAILURE(); }));
+
+  std::thread evlThread([&]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  // Enqueue 100 (> 10) callbacks in bulk followed by stop
+  std::vector<TimeoutCallback> callbacks;
+  for (int i = 10; i < 110; i++) {
+    callbacks.emplace_back([&, i]() noexcept {
+      EXPECT_EQ(i, count);
+      ++count;
+      EXPECT_TRUE(evl.isInEventLoop());
+    });
+  }
+  callbacks.emplace_back([&]() noexcept {
+    EXPECT_EQ(110, count);
+    evl.stop();
+  });
+  evl.runInEventLoop(std::move(callbacks));
+
+  evlThread.join();
+  EXPECT_EQ(110, count);
+}
+
 TEST(ZmqEventLoopTest, RunImmediatelyOrInEventLoopApi) {
   ZmqEventLoop evl(10);
 
@@ -371,6 +415,530 @@ TEST(ZmqEventLoopTest, sendRecvMultipart) {
   evlThread.join();
 }
 
+TEST(ZmqEventLoopTest, EpollBackend) {
+  Context context;
+  ZmqEventLoop evl(1e4, PollerType::EPOLL);
+  const SocketUrl socketUrl{"inproc://epoll_server_url"};
+  const int kNumMessages = 100;
+
+  // Server reads only one message per callback. Remaining messages must be
+  // delivered without any new edge on ZMQ_FD.
+  int numReceived = 0;
+  Socket<ZMQ_PULL, ZMQ_SERVER> serverSock{context};
+  serverSock.bind(socketUrl).value();
+  evl.addSocket(
+      RawZmqSocketPtr{*serverSock}, ZMQ_POLLIN, [&](int revents) noexcept {
+        EXPECT_EQ(ZMQ_POLLIN, revents);
+        auto msg = serverSock.recvOne().value();
+        EXPECT_EQ(numReceived, msg.read<int>().value());
+        if (++numReceived == kNumMessages) {
+          evl.stop();
+        }
+      });
+
+  // raw fds are supported as well
+  int fd = eventfd(0 /* init-value */, EFD_NONBLOCK);
+  ASSERT_LE(0, fd);
+  bool fdCallbackInvoked = false;
+  evl.addSocketFd(fd, ZMQ_POLLIN, [&](int revents) noexcept {
+    EXPECT_EQ(ZMQ_POLLIN, revents);
+    uint64_t buf;
+    EXPECT_EQ(sizeof(buf), static_cast<size_t>(read(fd, &buf, sizeof(buf))));
+    fdCallbackInvoked = true;
+  });
+
+  // adding an invalid fd must throw
+  EXPECT_THROW(
+      evl.addSocketFd(-1, ZMQ_POLLIN, [](int) noexcept {}), std::runtime_error);
+
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> clientSock{context};
+  clientSock.connect(socketUrl).value();
+  for (int i = 0; i < kNumMessages; ++i) {
+    clientSock.sendOne(Message::from(i).value()).value();
+  }
+  uint64_t buf{1};
+  EXPECT_EQ(sizeof(buf), static_cast<size_t>(write(fd, &buf, sizeof(buf))));
+
+  std::thread evlThread([&]() noexcept {
+    LOG(INFO) << "Starting event loop";
+    evl.run();
+    LOG(INFO) << "Event loop stopped";
+  });
+
+  evlThread.join();
+  EXPECT_EQ(kNumMessages, numReceived);
+  EXPECT_TRUE(fdCallbackInvoked);
+
+  evl.removeSocket(RawZmqSocketPtr{*serverSock});
+  evl.removeSocketFd(fd);
+  close(fd);
+}
+
+TEST(ZmqEventLoopTest, EpollRemoveAndAdd) {
+  Context context;
+  ZmqEventLoop evl(1e4, PollerType::EPOLL);
+  const SocketUrl socketUrl{"inproc://epoll_readd_url"};
+
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server{
+      context, folly::none, folly::none, NonblockingFlag{true}};
+  server.bind(socketUrl).value();
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client{context};
+  client.connect(socketUrl).value();
+  client.sendOne(Message::from(1).value()).value();
+
+  // socket re-added before loop had a chance to evaluate it must be reported
+  // once, second callback would find nothing to read
+  int numCallbacks = 0;
+  evl.addSocket(RawZmqSocketPtr{*server}, ZMQ_POLLIN, [](int) noexcept {
+    ADD_FAILURE() << "removed callback invoked";
+  });
+  evl.removeSocket(RawZmqSocketPtr{*server});
+  evl.addSocket(RawZmqSocketPtr{*server}, ZMQ_POLLIN, [&](int) noexcept {
+    ++numCallbacks;
+    EXPECT_TRUE(server.recvOne().hasValue());
+  });
+  evl.scheduleTimeout(
+      std::chrono::milliseconds(100), [&]() noexcept { evl.stop(); });
+
+  evl.run();
+  EXPECT_EQ(1, numCallbacks);
+  evl.removeSocket(RawZmqSocketPtr{*server});
+}
+
+TEST(ZmqEventLoopTest, UpdateSocketEvents) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl socketUrl{"inproc://update_events_url"};
+
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server{context};
+  server.bind(socketUrl).value();
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client{context};
+  client.connect(socketUrl).value();
+
+  // nothing to read, callback gets invoked only once POLLOUT is subscribed
+  int numWritable = 0;
+  evl.addSocket(
+      RawZmqSocketPtr{*server}, ZMQ_POLLIN, [&](int revents) noexcept {
+        EXPECT_EQ(ZMQ_POLLOUT, revents);
+        ++numWritable;
+        evl.updateSocketEvents(RawZmqSocketPtr{*server}, ZMQ_POLLIN);
+        evl.scheduleTimeout(
+            std::chrono::milliseconds(100), [&]() noexcept { evl.stop(); });
+      });
+  evl.scheduleTimeout(std::chrono::milliseconds(100), [&]() noexcept {
+    EXPECT_EQ(0, numWritable);
+    evl.updateSocketEvents(RawZmqSocketPtr{*server}, ZMQ_POLLOUT);
+  });
+
+  // socket must be registered first
+  EXPECT_THROW(
+      evl.updateSocketEvents(RawZmqSocketPtr{*client}, ZMQ_POLLIN),
+      std::runtime_error);
+
+  evl.run();
+  EXPECT_EQ(1, numWritable);
+  evl.removeSocket(RawZmqSocketPtr{*server});
+}
+
+TEST(ZmqEventLoopTest, SocketPriority) {
+  Context context;
+  ZmqEventLoop evl;
+  std::vector<std::string> dispatched;
+
+  // pairs of sockets, use server side for receiving messages queued up front
+  std::vector<std::unique_ptr<Socket<ZMQ_PAIR, ZMQ_SERVER>>> servers;
+  std::vector<std::unique_ptr<Socket<ZMQ_PAIR, ZMQ_CLIENT>>> clients;
+  auto addPair = [&](std::string const& name, size_t numMessages) {
+    const SocketUrl socketUrl{"inproc://priority_" + name};
+    servers.emplace_back(
+        std::make_unique<Socket<ZMQ_PAIR, ZMQ_SERVER>>(context));
+    servers.back()->bind(socketUrl).value();
+    clients.emplace_back(
+        std::make_unique<Socket<ZMQ_PAIR, ZMQ_CLIENT>>(context));
+    clients.back()->connect(socketUrl).value();
+    for (size_t i = 0; i < numMessages; ++i) {
+      clients.back()->sendOne(Message::from(name).value()).value();
+    }
+
+    auto server = servers.back().get();
+    evl.addSocket(
+        RawZmqSocketPtr{**server}, ZMQ_POLLIN, [&, server](int) noexcept {
+          auto msg = server->recvOne().value();
+          dispatched.push_back(msg.read<std::string>().value());
+        });
+    return RawZmqSocketPtr{**server};
+  };
+
+  // bulk socket is registered first and has most messages queued
+  auto bulk = addPair("bulk", 20);
+  auto data = addPair("data", 5);
+  auto control = addPair("control", 1);
+  evl.setSocketPriority(bulk, SocketPriority::LOW, 10);
+  evl.setSocketPriority(control, SocketPriority::HIGH);
+  EXPECT_THROW(
+      evl.setSocketPriority(
+          RawZmqSocketPtr{**clients.front()}, SocketPriority::HIGH),
+      std::runtime_error);
+  EXPECT_THROW(
+      evl.setSocketFdPriority(-1, SocketPriority::HIGH), std::runtime_error);
+
+  evl.scheduleTimeout(std::chrono::milliseconds(0), [&]() noexcept {
+    dispatched.push_back("timer");
+  });
+  evl.scheduleTimeout(
+      std::chrono::milliseconds(100), [&]() noexcept { evl.stop(); });
+  evl.run();
+
+  // control socket and timer go first, then bulk socket is served up to its
+  // budget after other sockets of higher priority
+  ASSERT_LE(13, dispatched.size());
+  std::vector<std::string> expected{"control", "timer", "data"};
+  expected.insert(expected.end(), 10, "bulk");
+  EXPECT_EQ(
+      expected,
+      std::vector<std::string>(dispatched.begin(), dispatched.begin() + 13));
+  const std::string bulkMsg{"bulk"};
+  const std::string dataMsg{"data"};
+  EXPECT_EQ(20, std::count(dispatched.begin(), dispatched.end(), bulkMsg));
+  EXPECT_EQ(5, std::count(dispatched.begin(), dispatched.end(), dataMsg));
+
+  for (auto& server : servers) {
+    evl.removeSocket(RawZmqSocketPtr{**server});
+  }
+}
+
+TEST(ZmqEventLoopTest, DrainAndStop) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl socketUrl{"inproc://drain_url"};
+
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server{context};
+  server.bind(socketUrl).value();
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client{context};
+  client.connect(socketUrl).value();
+
+  int numRead = 0;
+  evl.addSocket(RawZmqSocketPtr{*server}, ZMQ_POLLIN, [&](int) noexcept {
+    server.recvOne().value();
+    ++numRead;
+  });
+
+  // drain waits for pending work, which completes from a timeout scheduled
+  // before drain started. Message sent meanwhile isn't read.
+  size_t numPending = 1;
+  int numCallbacks = 0;
+  int numHighResTimeouts = 0;
+  const auto checkId =
+      evl.addDrainCheck([&numPending]() { return numPending; });
+  evl.scheduleTimeout(std::chrono::milliseconds(0), [&]() noexcept {
+    evl.drainAndStop(std::chrono::seconds(5));
+  });
+  evl.scheduleTimeout(std::chrono::milliseconds(50), [&]() noexcept {
+    client.sendOne(Message::from(kRequestStr).value()).value();
+    numPending = 0;
+    // from within the loop, where runInEventLoop mustn't be used
+    EXPECT_TRUE(evl.tryRunInEventLoop([&]() noexcept { ++numCallbacks; }));
+    // due high resolution timeouts are run as well
+    evl.scheduleHighResTimeout(
+        std::chrono::microseconds(0), [&]() noexcept { ++numHighResTimeouts; });
+  });
+  const auto laterId = evl.scheduleTimeout(
+      std::chrono::seconds(10), [&]() noexcept { ADD_FAILURE(); });
+  evl.run();
+
+  auto stats = evl.getDrainStats();
+  EXPECT_EQ(0, numRead);
+  EXPECT_EQ(1, numCallbacks);
+  EXPECT_EQ(1, numHighResTimeouts);
+  EXPECT_EQ(1, stats.numCallbacksRun);
+  EXPECT_EQ(2, stats.numTimeoutsRun);
+  EXPECT_EQ(0, stats.numCallbacksDropped);
+  EXPECT_EQ(1, stats.numTimeoutsDropped);
+  EXPECT_EQ(0, stats.numPendingDropped);
+  EXPECT_FALSE(stats.timedOut);
+
+  // reading resumes on next run
+  EXPECT_TRUE(evl.cancelTimeout(laterId));
+  evl.scheduleTimeout(
+      std::chrono::milliseconds(50), [&]() noexcept { evl.stop(); });
+  evl.run();
+  EXPECT_EQ(1, numRead);
+
+  // drain gives up on work which doesn't complete in time
+  numPending = 3;
+  evl.scheduleTimeout(std::chrono::milliseconds(0), [&]() noexcept {
+    evl.drainAndStop(std::chrono::milliseconds(50));
+  });
+  evl.run();
+  stats = evl.getDrainStats();
+  EXPECT_TRUE(stats.timedOut);
+  EXPECT_EQ(3, stats.numPendingDropped);
+
+  evl.removeDrainCheck(checkId);
+  evl.removeSocket(RawZmqSocketPtr{*server});
+}
+
+TEST(ZmqEventLoopTest, HighResTimeouts) {
+  ZmqEventLoop evl;
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<int> fired;
+
+  // Microsecond timeouts go through timer wheel. Ids must not collide with
+  // regular timeouts.
+  evl.scheduleTimeout(std::chrono::microseconds(300), [&]() noexcept {
+    EXPECT_LE(
+        std::chrono::microseconds(300),
+        std::chrono::steady_clock::now() - start);
+    fired.push_back(2);
+    evl.stop();
+  });
+  auto cancelledId =
+      evl.scheduleTimeout(std::chrono::microseconds(200), [&]() noexcept {
+        ADD_FAILURE() << "Cancelled timeout must not fire";
+      });
+  auto regularId =
+      evl.scheduleTimeout(std::chrono::milliseconds(100), [&]() noexcept {
+        ADD_FAILURE() << "Cancelled timeout must not fire";
+      });
+  evl.scheduleHighResTimeout(std::chrono::microseconds(100), [&]() noexcept {
+    fired.push_back(1);
+  });
+  EXPECT_NE(cancelledId, regularId);
+  EXPECT_EQ(4, evl.getNumPendingTimeouts());
+  EXPECT_EQ(1, evl.getTimeoutHeapSize());
+
+  EXPECT_TRUE(evl.cancelTimeout(cancelledId));
+  EXPECT_FALSE(evl.cancelTimeout(cancelledId));
+  EXPECT_TRUE(evl.cancelTimeout(regularId));
+  EXPECT_EQ(2, evl.getNumPendingTimeouts());
+
+  evl.run();
+  EXPECT_EQ((std::vector<int>{1, 2}), fired);
+  EXPECT_EQ(0, evl.getNumPendingTimeouts());
+}
+
+TEST(ZmqEventLoopTest, BusyPoll) {
+  ZmqEventLoop evl;
+  evl.setBusyPollBudget(std::chrono::milliseconds(50));
+  EXPECT_EQ(
+      std::chrono::microseconds(50000), evl.getBusyPollStats().currentBudget);
+
+  // Spinning must not delay timeouts
+  const auto start = std::chrono::steady_clock::now();
+  evl.scheduleTimeout(std::chrono::milliseconds(5), [&]() noexcept {
+    EXPECT_GT(
+        std::chrono::milliseconds(50),
+        std::chrono::steady_clock::now() - start);
+    evl.stop();
+  });
+  evl.run();
+  auto stats = evl.getBusyPollStats();
+  EXPECT_LT(0, stats.numSpinPolls);
+  EXPECT_LT(0, stats.numSpinMisses);
+
+  // Callbacks from other threads are picked up while spinning
+  std::thread evlThread([&]() { evl.run(); });
+  evl.waitUntilRunning();
+  std::atomic<int> count{0};
+  for (int i = 0; i < 10; ++i) {
+    evl.runInEventLoop([&]() noexcept { ++count; });
+    while (count.load() <= i) {
+      std::this_thread::yield();
+    }
+  }
+  evl.stop();
+  evlThread.join();
+  EXPECT_LT(stats.numSpinHits, evl.getBusyPollStats().numSpinHits);
+
+  // Adaptive budget shrinks on misses
+  evl.setBusyPollBudget(std::chrono::microseconds(640), true /* adaptive */);
+  int numTimeouts = 0;
+  std::function<void()> scheduleNext = [&]() {
+    evl.scheduleTimeout(std::chrono::milliseconds(2), [&]() noexcept {
+      if (++numTimeouts == 10) {
+        evl.stop();
+      } else {
+        scheduleNext();
+      }
+    });
+  };
+  scheduleNext();
+  evl.run();
+  EXPECT_GT(
+      std::chrono::microseconds(640), evl.getBusyPollStats().currentBudget);
+  EXPECT_LE(
+      std::chrono::microseconds(10), evl.getBusyPollStats().currentBudget);
+
+  // Zero budget disables spinning
+  evl.setBusyPollBudget(std::chrono::microseconds(0));
+  const auto numSpinPolls = evl.getBusyPollStats().numSpinPolls;
+  evl.scheduleTimeout(
+      std::chrono::milliseconds(2), [&]() noexcept { evl.stop(); });
+  evl.run();
+  EXPECT_EQ(numSpinPolls, evl.getBusyPollStats().numSpinPolls);
+}
+
+TEST(ZmqEventLoopTest, ThreadAffinity) {
+  // pin to a CPU we are allowed to run on
+  cpu_set_t allowed;
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(allowed), &allowed));
+  int cpu = 0;
+  while (not CPU_ISSET(cpu, &allowed)) {
+    ++cpu;
+  }
+
+  ZmqEventLoop evl;
+  evl.setThreadAffinity({cpu});
+  std::thread evlThread([&]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  // number of CPUs loop's thread may run on, after applying given ones
+  auto setLoopCpus = [&evl](std::vector<int> cpus) {
+    std::promise<int> numCpus;
+    evl.runInEventLoop([&]() noexcept {
+      evl.setThreadAffinity(std::move(cpus));
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+      numCpus.set_value(CPU_COUNT(&set));
+    });
+    return numCpus.get_future().get();
+  };
+  // empty set leaves affinity set by `run` alone
+  EXPECT_EQ(1, setLoopCpus({}));
+
+  // widened back from within the loop
+  std::vector<int> allCpus;
+  for (int i = 0; i < CPU_SETSIZE; ++i) {
+    if (CPU_ISSET(i, &allowed)) {
+      allCpus.push_back(i);
+    }
+  }
+  EXPECT_EQ(CPU_COUNT(&allowed), setLoopCpus(allCpus));
+
+  evl.stop();
+  evlThread.join();
+}
+
+TEST(ZmqEventLoopTest, FutureApi) {
+  Context context;
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server(context);
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client(context);
+  server.bind(SocketUrl{"inproc://future-api-test"}).value();
+  client.connect(SocketUrl{"inproc://future-api-test"}).value();
+
+  ZmqEventLoop evl;
+  std::vector<std::string> received;
+  bool timedOut = false;
+
+  // Request/response flow driven by the loop: sleep, send, receive twice
+  // and finally time out on receive
+  evl.sleep(std::chrono::milliseconds(5))
+      .then([&]() {
+        client.sendOne(Message::from(kRequestStr).value()).value();
+        client.sendOne(Message::from(kResponseStr).value()).value();
+        return evl.recvAsync(server);
+      })
+      .then([&](Message&& msg) {
+        received.emplace_back(msg.read<std::string>().value());
+        return evl.recvAsync(server, std::chrono::milliseconds(100));
+      })
+      .then([&](Message&& msg) {
+        received.emplace_back(msg.read<std::string>().value());
+        return evl.recvAsync(server, std::chrono::milliseconds(10));
+      })
+      .onError([&](std::system_error const& e) {
+        timedOut = e.code().value() == EAGAIN;
+        return Message();
+      })
+      .then([&](Message&&) { evl.stop(); });
+
+  evl.run();
+  EXPECT_EQ((std::vector<std::string>{kRequestStr, kResponseStr}), received);
+  EXPECT_TRUE(timedOut);
+
+  // Socket must not be registered already
+  evl.addSocket(RawZmqSocketPtr{*server}, ZMQ_POLLIN, [](int) noexcept {});
+  EXPECT_TRUE(evl.readable(RawZmqSocketPtr{*server}).hasException());
+  evl.removeSocket(RawZmqSocketPtr{*server});
+
+  // Writable completes right away for PAIR socket with connected peer
+  bool isWritable = false;
+  evl.writable(RawZmqSocketPtr{*client}).then([&](int revents) {
+    isWritable = revents & ZMQ_POLLOUT;
+    evl.stop();
+  });
+  evl.run();
+  EXPECT_TRUE(isWritable);
+}
+
+TEST(ZmqEventLoopTest, Instrumentation) {
+  Context context;
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server(context);
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client(context);
+  server.bind(SocketUrl{"inproc://instrumentation-test"}).value();
+  client.connect(SocketUrl{"inproc://instrumentation-test"}).value();
+
+  ThreadData threadData;
+  ZmqEventLoop evl;
+  evl.enableInstrumentation(threadData, "evl");
+  EXPECT_TRUE(evl.isInstrumentationEnabled());
+
+  evl.addSocket(RawZmqSocketPtr{*server}, ZMQ_POLLIN, [&](int) noexcept {
+    server.recvOne().value();
+    // Stall the loop
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  });
+  evl.setSocketName(RawZmqSocketPtr{*server}, "server");
+
+  // unnamed subscriptions share a stat
+  int fd = eventfd(1 /* init-value */, EFD_NONBLOCK);
+  ASSERT_LE(0, fd);
+  evl.addSocketFd(fd, ZMQ_POLLIN, [&](int) noexcept {
+    uint64_t buf;
+    EXPECT_EQ(sizeof(buf), static_cast<size_t>(read(fd, &buf, sizeof(buf))));
+  });
+
+  evl.scheduleTimeout(std::chrono::milliseconds(5), [&]() noexcept {
+    client.sendOne(Message::from(kRequestStr).value()).value();
+  });
+  evl.scheduleTimeout(
+      std::chrono::milliseconds(50), [&]() noexcept { evl.stop(); });
+
+  std::thread evlThread([&]() { evl.run(); });
+  evl.waitUntilRunning();
+  std::atomic<bool> done{false};
+  evl.runInEventLoop([&]() noexcept { done = true; });
+  evlThread.join();
+  EXPECT_TRUE(done);
+
+  auto counters = threadData.getCounters();
+  EXPECT_LT(0, counters.at("evl.iteration_us.count.0"));
+  EXPECT_LT(0, counters.at("evl.idle_us.sum.0"));
+  EXPECT_EQ(1, counters.at("evl.callback_us.server.count.0"));
+  EXPECT_LE(2000, counters.at("evl.callback_us.server.max"));
+  EXPECT_EQ(0, counters.count("evl.callback_us.server.hist.le_1000"));
+  EXPECT_EQ(2, counters.at("evl.timeout_callback_us.count.0"));
+  EXPECT_EQ(2, counters.at("evl.timer_slip_us.count.0"));
+  EXPECT_EQ(1, counters.at("evl.queue_wait_us.count.0"));
+  EXPECT_EQ(1, counters.at("evl.callback_us.callback_queue.count.0"));
+  EXPECT_EQ(1, counters.at("evl.callback_us.stop_signal.count.0"));
+  EXPECT_EQ(1, counters.at("evl.callback_us.unnamed.count.0"));
+  for (auto const& kv : counters) {
+    EXPECT_EQ(std::string::npos, kv.first.find("callback_us.fd.")) << kv.first;
+  }
+
+  // Nothing is recorded once disabled
+  evl.disableInstrumentation();
+  EXPECT_FALSE(evl.isInstrumentationEnabled());
+  evl.scheduleTimeout(
+      std::chrono::milliseconds(1), [&]() noexcept { evl.stop(); });
+  evl.run();
+  EXPECT_EQ(2, threadData.getCounters().at("evl.timer_slip_us.count.0"));
+  evl.removeSocketFd(fd);
+  close(fd);
+}
+
 } // namespace fbzmq
 
 int
@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqHedgedClient.h>
+
+namespace chrono = std::chrono;
+
+namespace fbzmq {
+
+namespace {
+
+using Reply = folly::Expected<std::vector<Message>, Error>;
+
+// test replica replying with request payload after a delay, if not expired
+class Replica {
+ public:
+  Replica(
+      ZmqEventLoop* evl,
+      Context& context,
+      SocketUrl const& url,
+      chrono::milliseconds delay)
+      : evl_(evl), sock_(context), delay_(delay) {
+    sock_.bind(url).value();
+    evl_->addSocket(RawZmqSocketPtr{*sock_}, ZMQ_POLLIN, [this](int) noexcept {
+      auto frames = sock_.recvMultiple().value();
+      evl_->scheduleTimeout(delay_, [this, frames]() noexcept {
+        auto header = RequestHeader::decode(frames, 1);
+        EXPECT_TRUE(header.hasValue());
+        if (header.hasError() || header->isExpired()) {
+          ++numExpired;
+          return;
+        }
+        sock_.sendMultiple(frames).value();
+        ++numReplied;
+      });
+    });
+  }
+
+  ~Replica() {
+    evl_->removeSocket(RawZmqSocketPtr{*sock_});
+  }
+
+  int numReplied{0};
+  int numExpired{0};
+
+ private:
+  ZmqEventLoop* evl_{nullptr};
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> sock_;
+  const chrono::milliseconds delay_;
+};
+
+} // namespace
+
+TEST(ZmqHedgedClientTest, Hedging) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl slowUrl{"inproc://hedged-slow"};
+  const SocketUrl fastUrl{"inproc://hedged-fast"};
+  Replica slow(&evl, context, slowUrl, chrono::milliseconds(200));
+  Replica fast(&evl, context, fastUrl, chrono::milliseconds(0));
+
+  ZmqHedgedClient client(
+      &evl,
+      context,
+      {slowUrl, fastUrl},
+      95 /* hedgePercentile */,
+      chrono::milliseconds(20) /* initialHedgeDelay */);
+
+  int numReplies = 0;
+  evl.scheduleTimeout(chrono::milliseconds(0), [&]() noexcept {
+    // first request goes to slow replica and gets hedged
+    std::vector<Message> req1;
+    req1.push_back(Message::from(std::string("req1")).value());
+    client.request(
+        std::move(req1), chrono::seconds(1), [&](Reply reply) noexcept {
+          ASSERT_TRUE(reply.hasValue());
+          EXPECT_EQ("req1", reply->at(0).read<std::string>().value());
+          ++numReplies;
+
+          // second one goes to fast replica right away
+          std::vector<Message> req2;
+          req2.push_back(Message::from(std::string("req2")).value());
+          client.request(
+              std::move(req2), chrono::seconds(1), [&](Reply reply2) noexcept {
+                ASSERT_TRUE(reply2.hasValue());
+                ++numReplies;
+              });
+        });
+  });
+
+  // late reply of slow replica is discarded
+  evl.scheduleTimeout(chrono::milliseconds(400), [&]() noexcept {
+    evl.stop();
+  });
+  evl.run();
+
+  EXPECT_EQ(2, numReplies);
+  EXPECT_EQ(0, client.getNumPending());
+  auto stats = client.getStats();
+  EXPECT_EQ(2, stats.numRequests);
+  EXPECT_EQ(1, stats.numHedged);
+  EXPECT_EQ(1, stats.numHedgeWins);
+  EXPECT_EQ(1, stats.numLateReplies);
+  EXPECT_EQ(0, stats.numTimeouts);
+  EXPECT_EQ(1, slow.numReplied);
+  EXPECT_EQ(2, fast.numReplied);
+}
+
+TEST(ZmqHedgedClientTest, Deadline) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl url{"inproc://hedged-overloaded"};
+  Replica overloaded(&evl, context, url, chrono::milliseconds(100));
+
+  ZmqHedgedClient client(&evl, context, {url});
+
+  bool timedOut = false;
+  evl.scheduleTimeout(chrono::milliseconds(0), [&]() noexcept {
+    std::vector<Message> req;
+    req.push_back(Message::from(std::string("req")).value());
+    client.request(
+        std::move(req), chrono::milliseconds(30), [&](Reply reply) noexcept {
+          ASSERT_TRUE(reply.hasError());
+          EXPECT_EQ(ETIMEDOUT, reply.error().errNum);
+          timedOut = true;
+        });
+  });
+  evl.scheduleTimeout(chrono::milliseconds(200), [&]() noexcept {
+    evl.stop();
+  });
+  evl.run();
+
+  // server dropped request unprocessed, its deadline had passed
+  EXPECT_TRUE(timedOut);
+  EXPECT_EQ(1, overloaded.numExpired);
+  EXPECT_EQ(0, overloaded.numReplied);
+  EXPECT_EQ(1, client.getStats().numTimeouts);
+  EXPECT_EQ(0, client.getStats().numHedged);
+}
+
+} // namespace fbzmq
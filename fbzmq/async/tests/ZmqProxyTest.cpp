@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqProxy.h>
+
+namespace fbzmq {
+
+TEST(ZmqProxyTest, SteeringAndCapture) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl frontendUrl{"inproc://proxy-frontend"};
+  const SocketUrl backendUrl{"inproc://proxy-backend"};
+  const SocketUrl captureUrl{"inproc://proxy-capture"};
+  const SocketUrl controlUrl{"inproc://proxy-control"};
+  const int kNumMessages = 100;
+
+  // proxy side
+  Socket<ZMQ_PULL, ZMQ_SERVER> frontend{context};
+  Socket<ZMQ_PUSH, ZMQ_SERVER> backend{context};
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> capture{context};
+  Socket<ZMQ_PAIR, ZMQ_SERVER> control{context};
+  frontend.bind(frontendUrl).value();
+  backend.bind(backendUrl).value();
+  control.bind(controlUrl).value();
+
+  // peers
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> producer{context};
+  Socket<ZMQ_PULL, ZMQ_CLIENT> consumer{context};
+  Socket<ZMQ_PULL, ZMQ_SERVER> captureSink{context};
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> controller{context};
+  captureSink.bind(captureUrl).value();
+  capture.connect(captureUrl).value();
+  producer.connect(frontendUrl).value();
+  consumer.connect(backendUrl).value();
+  controller.connect(controlUrl).value();
+
+  ZmqProxy::CaptureOptions captureOptions;
+  captureOptions.sampleEvery = 10;
+  ZmqProxy proxy(&evl, &frontend, &backend, &capture, &control, captureOptions);
+  bool terminated = false;
+  proxy.setTerminateCallback([&]() noexcept {
+    terminated = true;
+    evl.stop();
+  });
+
+  std::thread evlThread([&]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  // every message is forwarded, 1 in 10 is captured
+  for (int i = 0; i < kNumMessages; ++i) {
+    producer.sendMultiple(Message::from(i).value(), Message::from(i).value())
+        .value();
+  }
+  for (int i = 0; i < kNumMessages; ++i) {
+    auto msgs = consumer.recvMultiple(std::chrono::milliseconds(1000)).value();
+    ASSERT_EQ(2, msgs.size());
+    EXPECT_EQ(i, msgs[0].read<int>().value());
+  }
+  for (int i = 0; i < kNumMessages / 10; ++i) {
+    auto msgs =
+        captureSink.recvMultiple(std::chrono::milliseconds(1000)).value();
+    EXPECT_EQ(i * 10, msgs[0].read<int>().value());
+  }
+
+  // paused proxy holds messages back
+  controller.sendOne(Message::from(std::string("PAUSE")).value()).value();
+  // STATISTICS is processed in order after PAUSE, hence proxy is paused
+  controller.sendOne(Message::from(std::string("STATISTICS")).value()).value();
+  auto stats = controller.recvMultiple(std::chrono::milliseconds(1000)).value();
+  ASSERT_EQ(8, stats.size());
+  EXPECT_EQ(kNumMessages, stats[0].read<uint64_t>().value());
+  EXPECT_EQ(kNumMessages * 2 * sizeof(int), stats[1].read<uint64_t>().value());
+  EXPECT_EQ(0, stats[2].read<uint64_t>().value());
+  EXPECT_EQ(kNumMessages, stats[6].read<uint64_t>().value());
+
+  producer.sendOne(Message::from(kNumMessages).value()).value();
+  EXPECT_TRUE(consumer.recvOne(std::chrono::milliseconds(100)).hasError());
+  controller.sendOne(Message::from(std::string("RESUME")).value()).value();
+  EXPECT_EQ(
+      kNumMessages,
+      consumer.recvOne(std::chrono::milliseconds(1000))
+          .value()
+          .read<int>()
+          .value());
+
+  controller.sendOne(Message::from(std::string("TERMINATE")).value()).value();
+  evlThread.join();
+  EXPECT_TRUE(terminated);
+  EXPECT_TRUE(proxy.isTerminated());
+
+  auto fwdStats = proxy.getStats(ZmqProxy::Direction::FRONTEND_TO_BACKEND);
+  EXPECT_EQ(kNumMessages + 1, fwdStats.numMsgs);
+  EXPECT_EQ(kNumMessages * 2 + 1, fwdStats.numFrames);
+  EXPECT_EQ(0, fwdStats.numDroppedMsgs);
+  EXPECT_EQ(kNumMessages / 10 + 1, fwdStats.numCapturedMsgs);
+
+  ThreadData tData;
+  proxy.exportStats(tData, "proxy");
+  EXPECT_EQ(
+      kNumMessages + 1,
+      tData.getCounters().at("proxy.frontend_to_backend.msgs"));
+}
+
+TEST(ZmqProxyTest, CaptureBudget) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl frontendUrl{"inproc://proxy-budget-frontend"};
+  const SocketUrl backendUrl{"inproc://proxy-budget-backend"};
+  const SocketUrl captureUrl{"inproc://proxy-budget-capture"};
+
+  Socket<ZMQ_PULL, ZMQ_SERVER> frontend{context};
+  Socket<ZMQ_PUSH, ZMQ_SERVER> backend{context};
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> capture{context};
+  Socket<ZMQ_PULL, ZMQ_SERVER> captureSink{context};
+  frontend.bind(frontendUrl).value();
+  backend.bind(backendUrl).value();
+  captureSink.bind(captureUrl).value();
+  capture.connect(captureUrl).value();
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> producer{context};
+  Socket<ZMQ_PULL, ZMQ_CLIENT> consumer{context};
+  producer.connect(frontendUrl).value();
+  consumer.connect(backendUrl).value();
+
+  // every message is sampled, but budget only fits four of them
+  ZmqProxy::CaptureOptions captureOptions;
+  captureOptions.sampleEvery = 1;
+  captureOptions.maxBytesPerSec = 4 * 100;
+  ZmqProxy proxy(
+      &evl, &frontend, &backend, &capture, nullptr, captureOptions);
+
+  std::thread evlThread([&]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  const std::string payload(100, 'x');
+  for (int i = 0; i < 10; ++i) {
+    producer.sendOne(Message::from(payload).value()).value();
+  }
+  for (int i = 0; i < 10; ++i) {
+    consumer.recvOne(std::chrono::milliseconds(1000)).value();
+  }
+
+  evl.stop();
+  evlThread.join();
+  auto stats = proxy.getStats(ZmqProxy::Direction::FRONTEND_TO_BACKEND);
+  EXPECT_EQ(10, stats.numMsgs);
+  EXPECT_EQ(1000, stats.numBytes);
+  EXPECT_EQ(4, stats.numCapturedMsgs);
+  EXPECT_EQ(400, stats.numCapturedBytes);
+}
+
+} // namespace fbzmq
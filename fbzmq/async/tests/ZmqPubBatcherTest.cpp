@@ -0,0 +1,223 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <cerrno>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqPubBatcher.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+namespace {
+
+// publish until subscription has made it to publisher
+void
+waitForSubscription(
+    ZmqPubBatcher& batcher, Socket<ZMQ_SUB, ZMQ_CLIENT>& sub) {
+  while (true) {
+    batcher.publish(Message::from(std::string("warmup")).value());
+    batcher.flush();
+    if (ZmqPubBatcher::recvUnbatched(&sub, std::chrono::milliseconds(10))
+            .hasValue()) {
+      break;
+    }
+  }
+}
+
+} // namespace
+
+TEST(ZmqPubBatcherTest, Batching) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl socketUrl{"inproc://pub_batcher_url"};
+
+  Socket<ZMQ_PUB, ZMQ_SERVER> pub{context};
+  ZmqPubBatcher batcher(
+      &evl, &pub, 1024 /* maxBatchBytes */, 64 * 1024 /* maxQueuedBytes */);
+  pub.bind(socketUrl).value();
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub{context};
+  sub.connect(socketUrl).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+
+  // HWM is expressed in batches
+  int hwm = 0;
+  size_t hwmLen = sizeof(hwm);
+  pub.getSockOpt(ZMQ_SNDHWM, &hwm, &hwmLen).value();
+  EXPECT_EQ(64, hwm);
+
+  waitForSubscription(batcher, sub);
+  auto stats = batcher.getStats();
+
+  // small publications are packed into a single batch, in order
+  for (int i = 0; i < 100; ++i) {
+    batcher.publish(Message::from(i).value());
+  }
+  EXPECT_EQ(100 * (4 + sizeof(int)), batcher.getNumPendingBytes());
+  batcher.flush();
+  EXPECT_EQ(0, batcher.getNumPendingBytes());
+  {
+    auto msgs = ZmqPubBatcher::recvUnbatched(&sub).value();
+    ASSERT_EQ(100, msgs.size());
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_EQ(i, msgs[i].read<int>().value());
+    }
+  }
+  EXPECT_EQ(stats.numBatches + 1, batcher.getStats().numBatches);
+
+  // full batches go out right away. Three records of 304 bytes fit in one.
+  const std::string payload(300, 'x');
+  for (int i = 0; i < 10; ++i) {
+    batcher.publish(Message::from(payload).value());
+  }
+  EXPECT_EQ(304, batcher.getNumPendingBytes());
+  batcher.flush();
+  for (size_t expected : {3, 3, 3, 1}) {
+    auto msgs = ZmqPubBatcher::recvUnbatched(&sub).value();
+    ASSERT_EQ(expected, msgs.size());
+    EXPECT_EQ(payload, msgs.front().read<std::string>().value());
+  }
+
+  // publication bigger than a batch is sent in fragments and reassembled
+  const std::string bigPayload(4000, 'y');
+  batcher.publish(Message::from(bigPayload).value());
+  EXPECT_EQ(0, batcher.getNumPendingBytes());
+  {
+    auto msgs = ZmqPubBatcher::recvUnbatched(&sub).value();
+    ASSERT_EQ(1, msgs.size());
+    EXPECT_EQ(bigPayload, msgs.front().read<std::string>().value());
+  }
+
+  stats = batcher.getStats();
+  EXPECT_EQ(1, stats.numOversized);
+  EXPECT_EQ(4, stats.numFragments);
+  EXPECT_EQ(0, stats.numErrors);
+
+  // topics are kept in front of their batches
+  batcher.publish("a/", Message::from(1).value());
+  batcher.publish("b/", Message::from(2).value());
+  batcher.publish("a/", Message::from(3).value());
+  batcher.flush();
+  std::map<std::string, std::vector<int>> byTopic;
+  for (int i = 0; i < 2; ++i) {
+    std::string topic;
+    auto msgs =
+        ZmqPubBatcher::recvUnbatched(&sub, folly::none, &topic).value();
+    for (auto const& msg : msgs) {
+      byTopic[topic].push_back(msg.read<int>().value());
+    }
+  }
+  EXPECT_EQ((std::vector<int>{1, 3}), byTopic["a/"]);
+  EXPECT_EQ((std::vector<int>{2}), byTopic["b/"]);
+}
+
+TEST(ZmqPubBatcherTest, OversizedWithinBudget) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl socketUrl{"inproc://pub_batcher_budget_url"};
+  const size_t kMaxQueuedBytes{64 * 1024};
+
+  Socket<ZMQ_PUB, ZMQ_SERVER> pub{context};
+  ZmqPubBatcher batcher(&evl, &pub, 1024 /* maxBatchBytes */, kMaxQueuedBytes);
+  pub.bind(socketUrl).value();
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub{context};
+  // inproc queue is made of both HWMs, leave (almost) all of it to publisher
+  const int rcvHwm = 1;
+  sub.setSockOpt(ZMQ_RCVHWM, &rcvHwm, sizeof(rcvHwm)).value();
+  sub.connect(socketUrl).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+  waitForSubscription(batcher, sub);
+
+  // publish way more than budget to a subscriber which doesn't read
+  const std::string payload(8 * 1024, 'z');
+  for (int i = 0; i < 100; ++i) {
+    batcher.publish(Message::from(payload).value());
+  }
+
+  // queued data is bounded by budget, and complete publications are intact
+  size_t numReceivedBytes{0};
+  while (true) {
+    auto msgs =
+        ZmqPubBatcher::recvUnbatched(&sub, std::chrono::milliseconds(100));
+    if (msgs.hasError()) {
+      break;
+    }
+    for (auto const& msg : msgs.value()) {
+      EXPECT_EQ(payload, msg.read<std::string>().value());
+      numReceivedBytes += msg.size();
+    }
+  }
+  EXPECT_LT(0, numReceivedBytes);
+  EXPECT_GE(kMaxQueuedBytes + 2 * 1024, numReceivedBytes);
+}
+
+TEST(ZmqPubBatcherTest, FlushFromLoop) {
+  Context context;
+  ZmqEventLoop evl;
+  const SocketUrl socketUrl{"inproc://pub_batcher_loop_url"};
+
+  Socket<ZMQ_PUB, ZMQ_SERVER> pub{context};
+  ZmqPubBatcher batcher(&evl, &pub);
+  pub.bind(socketUrl).value();
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub{context};
+  sub.connect(socketUrl).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+  waitForSubscription(batcher, sub);
+
+  // publications of a loop iteration are sent together once it ends
+  evl.scheduleTimeout(std::chrono::milliseconds(0), [&]() noexcept {
+    for (int i = 0; i < 5; ++i) {
+      batcher.publish(Message::from(i).value());
+    }
+    EXPECT_LT(0, batcher.getNumPendingBytes());
+    evl.scheduleTimeout(
+        std::chrono::milliseconds(50), [&]() noexcept { evl.stop(); });
+  });
+  evl.run();
+
+  EXPECT_EQ(0, batcher.getNumPendingBytes());
+  auto msgs = ZmqPubBatcher::recvUnbatched(&sub).value();
+  ASSERT_EQ(5, msgs.size());
+  EXPECT_EQ(4, msgs.back().read<int>().value());
+}
+
+TEST(ZmqPubBatcherTest, Unbatch) {
+  // frames which aren't batches are refused
+  auto msgs =
+      ZmqPubBatcher::unbatch(Message::from(std::string("plain")).value());
+  ASSERT_TRUE(msgs.hasError());
+  EXPECT_EQ(EPROTO, msgs.error().errNum);
+
+  auto shortMsgs = ZmqPubBatcher::unbatch(Message());
+  ASSERT_TRUE(shortMsgs.hasError());
+  EXPECT_EQ(EPROTO, shortMsgs.error().errNum);
+
+  // record of 10 bytes, only 2 of which are there
+  const std::string truncated{
+      "FZBB\x01\x00\x00\x00\x0a\x00\x00\x00"
+      "ab",
+      14};
+  auto truncatedMsgs =
+      ZmqPubBatcher::unbatch(Message::from(truncated).value());
+  ASSERT_TRUE(truncatedMsgs.hasError());
+  EXPECT_EQ(EPROTO, truncatedMsgs.error().errNum);
+
+  // empty batch is fine
+  const std::string empty{"FZBB\x00\x00\x00\x00", 8};
+  auto emptyMsgs = ZmqPubBatcher::unbatch(Message::from(empty).value());
+  ASSERT_TRUE(emptyMsgs.hasValue());
+  EXPECT_TRUE(emptyMsgs->empty());
+}
+
+} // namespace fbzmq
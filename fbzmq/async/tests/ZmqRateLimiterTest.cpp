@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqRateLimiter.h>
+
+namespace chrono = std::chrono;
+
+namespace fbzmq {
+
+TEST(ZmqRateLimiterTest, TokenBucket) {
+  const auto now = TokenBucket::Clock::now();
+  TokenBucket bucket(10 /* per second */, 5 /* burst */, now);
+
+  // whole burst is available right away
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(bucket.consume(1, now));
+  }
+  EXPECT_FALSE(bucket.consume(1, now));
+  EXPECT_EQ(chrono::milliseconds(100), bucket.getRetryAfter(1, now));
+  EXPECT_EQ(chrono::milliseconds(300), bucket.getRetryAfter(3, now));
+
+  // refilled at rate
+  EXPECT_FALSE(bucket.consume(1, now + chrono::milliseconds(50)));
+  EXPECT_TRUE(bucket.consume(1, now + chrono::milliseconds(100)));
+  EXPECT_EQ(
+      chrono::microseconds(0),
+      bucket.getRetryAfter(2, now + chrono::milliseconds(300)));
+
+  // but never beyond burst
+  EXPECT_DOUBLE_EQ(5, bucket.getAvailable(now + chrono::seconds(10)));
+}
+
+TEST(ZmqRateLimiterTest, Pacing) {
+  ZmqEventLoop evl;
+  ZmqRateLimiter limiter(&evl, 200 /* per second */, 10 /* burst */);
+  const int kNumCalls = 30;
+
+  // burst is run right away, rest of the calls are paced
+  int numCalls = 0;
+  const auto start = chrono::steady_clock::now();
+  for (int i = 0; i < kNumCalls; ++i) {
+    limiter.runWhenAllowed(1, [&, i]() noexcept {
+      EXPECT_EQ(i, numCalls);
+      if (++numCalls == kNumCalls) {
+        evl.stop();
+      }
+    });
+  }
+  EXPECT_EQ(10, numCalls);
+  EXPECT_EQ(20, limiter.getNumPending());
+
+  // waiting callbacks come first
+  EXPECT_FALSE(limiter.tryAcquire());
+  EXPECT_LT(chrono::microseconds(0), limiter.getRetryAfter());
+
+  evl.run();
+  EXPECT_EQ(kNumCalls, numCalls);
+  EXPECT_EQ(0, limiter.getNumPending());
+  // 20 calls at 200 per second
+  EXPECT_LE(chrono::milliseconds(90), chrono::steady_clock::now() - start);
+}
+
+TEST(ZmqRateLimiterTest, KeyedLimiter) {
+  ZmqEventLoop evl;
+  ZmqKeyedRateLimiter limiter(&evl, 5 /* limit */, chrono::milliseconds(100));
+
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(limiter.tryAcquire("peer1"));
+  }
+  EXPECT_FALSE(limiter.tryAcquire("peer1"));
+  // at latest once current fixed window is over and its weight decayed
+  const auto retryAfter = limiter.getRetryAfter("peer1");
+  EXPECT_LT(chrono::microseconds(0), retryAfter);
+  EXPECT_GE(chrono::milliseconds(200), retryAfter);
+
+  // keys are limited independently
+  EXPECT_EQ(chrono::microseconds(0), limiter.getRetryAfter("peer2"));
+  EXPECT_TRUE(limiter.tryAcquire("peer2"));
+  EXPECT_EQ(2, limiter.getNumKeys());
+
+  evl.scheduleTimeout(
+      chrono::duration_cast<chrono::milliseconds>(retryAfter) +
+          chrono::milliseconds(1),
+      [&]() noexcept { EXPECT_TRUE(limiter.tryAcquire("peer1")); });
+
+  // idle keys are dropped
+  evl.scheduleTimeout(chrono::milliseconds(500), [&]() noexcept {
+    EXPECT_EQ(0, limiter.getNumKeys());
+    evl.stop();
+  });
+
+  evl.run();
+}
+
+} // namespace fbzmq
@@ -90,6 +90,25 @@ TEST(ZmqTimeoutTest, TimeoutTest) {
   thread.join();
 }
 
+TEST(ZmqTimeoutTest, HighResPeriodicTimeout) {
+  ZmqEventLoop evl;
+  int count = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto timeout = ZmqTimeout::make(&evl, [&]() noexcept {
+    if (++count == 10) {
+      evl.stop();
+    }
+  });
+  timeout->scheduleTimeout(500us, true /* periodic */);
+  EXPECT_TRUE(timeout->isPeriodic());
+
+  evl.run();
+  EXPECT_EQ(10, count);
+  EXPECT_LE(5000us, std::chrono::steady_clock::now() - start);
+  timeout->cancelTimeout();
+  EXPECT_EQ(0, evl.getNumPendingTimeouts());
+}
+
 } // namespace fbzmq
 
 int
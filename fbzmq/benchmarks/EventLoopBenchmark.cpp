@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/zmq/Zmq.h>
+
+using namespace fbzmq;
+
+namespace {
+
+/**
+ * Event loop running in a thread of its own for the lifetime of the object
+ */
+class LoopThread {
+ public:
+  LoopThread() {
+    thread_ = std::thread([this]() { evl.run(); });
+    evl.waitUntilRunning();
+  }
+
+  ~LoopThread() {
+    evl.stop();
+    thread_.join();
+  }
+
+  ZmqEventLoop evl;
+
+ private:
+  std::thread thread_;
+};
+
+void
+waitFor(std::atomic<uint32_t> const& counter, uint32_t value) {
+  while (counter.load(std::memory_order_acquire) < value) {
+    std::this_thread::yield();
+  }
+}
+
+// from another thread, loop runs each of `iters` callbacks
+void
+runInEventLoop(uint32_t iters, size_t numProducers) {
+  folly::BenchmarkSuspender braces;
+  LoopThread loop;
+  std::atomic<uint32_t> numRun{0};
+  braces.dismiss();
+
+  std::vector<std::thread> producers;
+  for (size_t i = 0; i < numProducers; ++i) {
+    const uint32_t num = iters / numProducers + (i < iters % numProducers);
+    producers.emplace_back([&loop, &numRun, num]() {
+      for (uint32_t j = 0; j < num; ++j) {
+        loop.evl.runInEventLoop([&numRun]() noexcept {
+          numRun.fetch_add(1, std::memory_order_release);
+        });
+      }
+    });
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  waitFor(numRun, iters);
+
+  braces.rehire();
+}
+
+// a message sent to one of `numSockets` registered sockets (in turn) is
+// dispatched to its callback
+void
+pollDispatch(uint32_t iters, size_t numSockets) {
+  folly::BenchmarkSuspender braces;
+  Context ctx;
+  std::atomic<uint32_t> numRecvd{0};
+  std::vector<std::unique_ptr<Socket<ZMQ_PAIR, ZMQ_SERVER>>> servers;
+  std::vector<std::unique_ptr<Socket<ZMQ_PAIR, ZMQ_CLIENT>>> clients;
+  auto loop = std::make_unique<LoopThread>();
+  for (size_t i = 0; i < numSockets; ++i) {
+    const SocketUrl url{folly::sformat("inproc://fbzmq-benchmark-{}", i)};
+    servers.emplace_back(std::make_unique<Socket<ZMQ_PAIR, ZMQ_SERVER>>(
+        ctx, folly::none, folly::none, NonblockingFlag{true}));
+    servers.back()->bind(url).value();
+    clients.emplace_back(std::make_unique<Socket<ZMQ_PAIR, ZMQ_CLIENT>>(ctx));
+    clients.back()->connect(url).value();
+
+    auto server = servers.back().get();
+    std::atomic<bool> added{false};
+    loop->evl.runInEventLoop([&loop, &numRecvd, &added, server]() noexcept {
+      loop->evl.addSocket(
+          RawZmqSocketPtr{**server},
+          ZMQ_POLLIN,
+          [&numRecvd, server](int) noexcept {
+            while (server->recvOne().hasValue()) {
+              numRecvd.fetch_add(1, std::memory_order_release);
+            }
+          });
+      added = true;
+    });
+    while (not added) {
+      std::this_thread::yield();
+    }
+  }
+  const auto msg = Message::from(std::string(64, 'x')).value();
+  braces.dismiss();
+
+  // one message in flight at a time, so that each one takes a poll
+  for (uint32_t i = 0; i < iters; ++i) {
+    clients[i % numSockets]->sendOne(msg).value();
+    waitFor(numRecvd, i + 1);
+  }
+
+  // loop stops (and touches sockets for the last time) before they are
+  // destroyed
+  braces.rehire();
+  loop.reset();
+}
+
+} // namespace
+
+BENCHMARK_PARAM(runInEventLoop, 1)
+BENCHMARK_PARAM(runInEventLoop, 4)
+BENCHMARK_DRAW_LINE();
+
+// schedule and cancel timeouts on loop's timeout heap
+BENCHMARK(scheduleCancelTimeout, iters) {
+  folly::BenchmarkSuspender braces;
+  ZmqEventLoop evl;
+  braces.dismiss();
+
+  for (uint32_t i = 0; i < iters; ++i) {
+    const auto id =
+        evl.scheduleTimeout(std::chrono::milliseconds(1000), []() noexcept {});
+    evl.cancelTimeout(id);
+  }
+}
+
+// ditto, via ZmqTimeout object
+BENCHMARK_RELATIVE(scheduleCancelZmqTimeout, iters) {
+  folly::BenchmarkSuspender braces;
+  ZmqEventLoop evl;
+  auto timeout = ZmqTimeout::make(&evl, []() noexcept {});
+  braces.dismiss();
+
+  for (uint32_t i = 0; i < iters; ++i) {
+    timeout->scheduleTimeout(std::chrono::milliseconds(1000));
+    timeout->cancelTimeout();
+  }
+}
+
+// ditto, high resolution timeouts served by timer wheel
+BENCHMARK_RELATIVE(scheduleCancelHighResTimeout, iters) {
+  folly::BenchmarkSuspender braces;
+  ZmqEventLoop evl;
+  braces.dismiss();
+
+  for (uint32_t i = 0; i < iters; ++i) {
+    const auto id = evl.scheduleTimeout(
+        std::chrono::microseconds(1000000), []() noexcept {});
+    evl.cancelTimeout(id);
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+BENCHMARK_PARAM(pollDispatch, 1)
+BENCHMARK_PARAM(pollDispatch, 16)
+BENCHMARK_PARAM(pollDispatch, 128)
+BENCHMARK_PARAM(pollDispatch, 1024)
@@ -0,0 +1,24 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <folly/Benchmark.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+/**
+ * Runs benchmarks of all files linked into fbzmq_benchmarks, e.g.
+ *  fbzmq_benchmarks --bm_regex=inproc --bm_min_iters=100000
+ */
+int
+main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  folly::runBenchmarks();
+  return 0;
+}
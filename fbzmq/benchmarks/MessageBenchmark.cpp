@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <string>
+
+#include <folly/Benchmark.h>
+
+#include <fbzmq/zmq/Zmq.h>
+
+using namespace fbzmq;
+
+namespace {
+
+void
+messageFromString(uint32_t iters, size_t size) {
+  folly::BenchmarkSuspender braces;
+  const std::string str(size, 'x');
+  braces.dismiss();
+
+  for (uint32_t i = 0; i < iters; ++i) {
+    folly::doNotOptimizeAway(Message::from(str).value());
+  }
+}
+
+void
+messageWrapBuffer(uint32_t iters, size_t size) {
+  for (uint32_t i = 0; i < iters; ++i) {
+    folly::doNotOptimizeAway(
+        Message::wrapBuffer(folly::IOBuf::create(size)).value());
+  }
+}
+
+} // namespace
+
+BENCHMARK(messageFromInt, iters) {
+  for (uint32_t i = 0; i < iters; ++i) {
+    folly::doNotOptimizeAway(Message::from(static_cast<int64_t>(i)).value());
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+BENCHMARK_PARAM(messageFromString, 16)
+BENCHMARK_PARAM(messageFromString, 256)
+BENCHMARK_PARAM(messageFromString, 4096)
+BENCHMARK_PARAM(messageFromString, 65536)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_PARAM(messageWrapBuffer, 256)
+BENCHMARK_PARAM(messageWrapBuffer, 4096)
+BENCHMARK_PARAM(messageWrapBuffer, 65536)
+BENCHMARK_DRAW_LINE();
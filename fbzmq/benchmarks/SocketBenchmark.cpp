@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+#include <gflags/gflags.h>
+
+#include <fbzmq/zmq/Zmq.h>
+
+DEFINE_int32(
+    benchmark_tcp_port, 55555, "Port on localhost used by tcp benchmarks");
+
+using namespace fbzmq;
+
+namespace {
+
+// Messages in flight between sender and receiver, stays below default HWM
+const uint32_t kBatchSize{100};
+
+// Frames of multipart messages
+const size_t kNumFrames{3};
+
+std::string
+getUrl(std::string const& transport) {
+  if (transport == "inproc") {
+    return "inproc://fbzmq-benchmark";
+  }
+  if (transport == "ipc") {
+    return folly::sformat("ipc:///tmp/fbzmq-benchmark-{}", ::getpid());
+  }
+  return folly::sformat("tcp://127.0.0.1:{}", FLAGS_benchmark_tcp_port);
+}
+
+/**
+ * Connected pair of sockets, setup is not accounted to benchmarks
+ */
+struct SocketPair {
+  explicit SocketPair(std::string const& transport)
+      : server(ctx), client(ctx) {
+    const auto url = getUrl(transport);
+    server.bind(SocketUrl{url}).value();
+    client.connect(SocketUrl{url}).value();
+
+    // wait until connection is up
+    client.sendOne(Message::from(std::string{"ping"}).value()).value();
+    server.recvOne().value();
+  }
+
+  Context ctx;
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server;
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client;
+};
+
+void
+sendRecv(uint32_t iters, std::string const& transport, size_t size) {
+  folly::BenchmarkSuspender braces;
+  SocketPair sockets(transport);
+  const std::string payload(size, 'x');
+  braces.dismiss();
+
+  while (iters > 0) {
+    const auto batch = std::min(iters, kBatchSize);
+    for (uint32_t i = 0; i < batch; ++i) {
+      sockets.client.sendOne(Message::from(payload).value()).value();
+    }
+    for (uint32_t i = 0; i < batch; ++i) {
+      folly::doNotOptimizeAway(sockets.server.recvOne().value());
+    }
+    iters -= batch;
+  }
+
+  braces.rehire();
+}
+
+void
+inprocSendRecv(uint32_t iters, size_t size) {
+  sendRecv(iters, "inproc", size);
+}
+
+void
+ipcSendRecv(uint32_t iters, size_t size) {
+  sendRecv(iters, "ipc", size);
+}
+
+void
+tcpSendRecv(uint32_t iters, size_t size) {
+  sendRecv(iters, "tcp", size);
+}
+
+} // namespace
+
+BENCHMARK_PARAM(inprocSendRecv, 16)
+BENCHMARK_PARAM(inprocSendRecv, 256)
+BENCHMARK_PARAM(inprocSendRecv, 4096)
+BENCHMARK_PARAM(inprocSendRecv, 65536)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_PARAM(ipcSendRecv, 16)
+BENCHMARK_PARAM(ipcSendRecv, 256)
+BENCHMARK_PARAM(ipcSendRecv, 4096)
+BENCHMARK_PARAM(ipcSendRecv, 65536)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_PARAM(tcpSendRecv, 16)
+BENCHMARK_PARAM(tcpSendRecv, 256)
+BENCHMARK_PARAM(tcpSendRecv, 4096)
+BENCHMARK_PARAM(tcpSendRecv, 65536)
+BENCHMARK_DRAW_LINE();
+
+// multipart message of kNumFrames frames, sent as variadic arguments
+BENCHMARK(sendMultipleVariadic, iters) {
+  folly::BenchmarkSuspender braces;
+  SocketPair sockets("inproc");
+  const auto frame = Message::from(std::string(64, 'x')).value();
+  braces.dismiss();
+
+  while (iters > 0) {
+    const auto batch = std::min<uint32_t>(iters, kBatchSize);
+    for (uint32_t i = 0; i < batch; ++i) {
+      sockets.client.sendMultiple(frame, frame, frame).value();
+    }
+    for (uint32_t i = 0; i < batch; ++i) {
+      folly::doNotOptimizeAway(sockets.server.recvMultiple().value());
+    }
+    iters -= batch;
+  }
+
+  braces.rehire();
+}
+
+// ditto, frames passed as vector
+BENCHMARK_RELATIVE(sendMultipleVector, iters) {
+  folly::BenchmarkSuspender braces;
+  SocketPair sockets("inproc");
+  const std::vector<Message> frames(
+      kNumFrames, Message::from(std::string(64, 'x')).value());
+  braces.dismiss();
+
+  while (iters > 0) {
+    const auto batch = std::min<uint32_t>(iters, kBatchSize);
+    for (uint32_t i = 0; i < batch; ++i) {
+      sockets.client.sendMultiple(frames).value();
+    }
+    for (uint32_t i = 0; i < batch; ++i) {
+      folly::doNotOptimizeAway(sockets.server.recvMultiple().value());
+    }
+    iters -= batch;
+  }
+
+  braces.rehire();
+}
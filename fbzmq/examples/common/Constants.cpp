@@ -21,6 +21,8 @@ constexpr folly::StringPiece Constants::kMultipleCmdUrl;
 
 constexpr folly::StringPiece Constants::kPubUrl;
 
+constexpr folly::StringPiece Constants::kRouterCmdUrl;
+
 constexpr std::chrono::milliseconds Constants::kReadTimeout;
 
 } // namespace example
@@ -10,11 +10,22 @@
 
 #include <folly/Range.h>
 #include <chrono>
+#include <cstdint>
 #include <string>
 
 namespace fbzmq {
 namespace example {
 
+// command types served by router socket of ZmqServer. Requests are made of
+// request id (echoed back in reply), command type and frames of REP request
+// of the same type.
+enum class CommandType : uint32_t {
+  PRIMITIVE = 1,
+  STRING = 2,
+  THRIFT = 3,
+  MULTIPLE = 4,
+};
+
 class Constants {
  public:
   // the zmq url for request/reply primitive message
@@ -33,6 +44,9 @@ class Constants {
   // the zmq url for subscribe/publish primitive message
   static constexpr folly::StringPiece kPubUrl = "tcp://127.0.0.1:55559";
 
+  // the zmq url for dealer/router messages of any command type
+  static constexpr folly::StringPiece kRouterCmdUrl = "tcp://127.0.0.1:55560";
+
   // the default I/O read timeout in milliseconds
   static constexpr std::chrono::milliseconds kReadTimeout{500};
 };
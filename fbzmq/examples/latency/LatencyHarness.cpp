@@ -0,0 +1,211 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#include <fbzmq/examples/latency/LatencyHarness.h>
+
+#include <thread>
+#include <unordered_map>
+
+#include <fbzmq/examples/if/gen-cpp2/Example_types.h>
+
+namespace fbzmq {
+namespace example {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// requests not replied to within this time are given up on
+const std::chrono::milliseconds kReplyTimeout{1000};
+
+int64_t
+toMicros(Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+// Wait until `time`. Sleep is too coarse for short waits, spin then.
+void
+waitUntil(Clock::time_point time) {
+  const auto spinThreshold = std::chrono::microseconds(200);
+  auto now = Clock::now();
+  if (time - now > spinThreshold) {
+    std::this_thread::sleep_until(time - spinThreshold);
+  }
+  while (Clock::now() < time) {
+  }
+}
+
+} // namespace
+
+LatencyHarness::LatencyHarness(
+    fbzmq::Context& zmqContext,
+    const folly::Optional<fbzmq::PublicKey>& serverKey,
+    uint32_t requestRate,
+    std::chrono::seconds duration)
+    : zmqContext_(zmqContext),
+      serverKey_(serverKey),
+      interval_(std::chrono::nanoseconds(1000000000) / requestRate),
+      numRequests_(static_cast<uint64_t>(requestRate) * duration.count()) {
+  CHECK_LT(0, requestRate);
+  if (serverKey_) {
+    keyPair_ = fbzmq::util::genKeyPair();
+  }
+}
+
+template <int SocketType>
+void
+LatencyHarness::connect(
+    fbzmq::Socket<SocketType, fbzmq::ZMQ_CLIENT>& sock,
+    const std::string& url) {
+  if (serverKey_) {
+    sock.addServerKey(fbzmq::SocketUrl{url}, *serverKey_).value();
+  }
+  sock.connect(fbzmq::SocketUrl{url}).value();
+}
+
+std::vector<fbzmq::Message>
+LatencyHarness::makeRequest(CommandType type, size_t payloadSize) {
+  const std::string payload(payloadSize, 'x');
+  std::vector<fbzmq::Message> request;
+  switch (type) {
+  case CommandType::PRIMITIVE:
+    request.emplace_back(fbzmq::Message::from(uint32_t{42}).value());
+    break;
+
+  case CommandType::STRING:
+    request.emplace_back(fbzmq::Message::from(payload).value());
+    break;
+
+  case CommandType::THRIFT: {
+    thrift::Request thriftReq;
+    thriftReq.cmd = thrift::Command::KEY_SET;
+    thriftReq.key = payload;
+    thriftReq.value = 42;
+    request.emplace_back(
+        fbzmq::Message::fromThriftObj(thriftReq, serializer_).value());
+    break;
+  }
+
+  case CommandType::MULTIPLE: {
+    thrift::StrValue strValue;
+    strValue.value = payload;
+    request.emplace_back(fbzmq::Message::from(uint32_t{42}).value());
+    request.emplace_back(fbzmq::Message::from(payload).value());
+    request.emplace_back(
+        fbzmq::Message::fromThriftObj(strValue, serializer_).value());
+    break;
+  }
+  }
+  return request;
+}
+
+LatencyHarness::Result
+LatencyHarness::runReqRep(
+    const std::string& url, CommandType type, size_t payloadSize) {
+  Result result;
+  const auto request = makeRequest(type, payloadSize);
+  auto sock = std::make_unique<fbzmq::Socket<ZMQ_REQ, fbzmq::ZMQ_CLIENT>>(
+      zmqContext_, folly::none, keyPair_);
+  connect(*sock, url);
+
+  const auto start = Clock::now();
+  for (uint64_t i = 0; i < numRequests_; ++i) {
+    const auto scheduled = start + i * interval_;
+    waitUntil(scheduled);
+
+    const bool replied = sock->sendMultiple(request).hasValue() && [&] {
+      auto reply = sock->recvOne(kReplyTimeout);
+      return reply.hasValue() && !reply.value().empty();
+    }();
+    if (!replied) {
+      ++result.numErrors;
+      // REQ socket can't send again without reply, start over
+      sock = std::make_unique<fbzmq::Socket<ZMQ_REQ, fbzmq::ZMQ_CLIENT>>(
+          zmqContext_, folly::none, keyPair_);
+      connect(*sock, url);
+      continue;
+    }
+    result.latencyUs.addValue(toMicros(Clock::now() - scheduled));
+  }
+  result.sendRate = numRequests_ /
+      std::chrono::duration<double>(Clock::now() - start).count();
+  return result;
+}
+
+LatencyHarness::Result
+LatencyHarness::runDealerRouter(
+    const std::string& url, CommandType type, size_t payloadSize) {
+  Result result;
+  const auto request = makeRequest(type, payloadSize);
+  const auto typeMsg =
+      fbzmq::Message::from(static_cast<uint32_t>(type)).value();
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> sock(
+      zmqContext_, folly::none, keyPair_);
+  connect(sock, url);
+
+  // requests in flight by id (their index in schedule)
+  std::unordered_map<uint64_t, Clock::time_point> inflight;
+  const auto start = Clock::now();
+  uint64_t numSent = 0;
+  auto lastReply = start;
+  while (numSent < numRequests_ || !inflight.empty()) {
+    auto now = Clock::now();
+    const auto nextSend = start + numSent * interval_;
+    if (numSent < numRequests_ && now >= nextSend) {
+      const auto header = sock.sendMultipleMore(
+          fbzmq::Message::from(numSent).value(), typeMsg);
+      if (header.hasError() || sock.sendMultiple(request).hasError()) {
+        ++result.numErrors;
+      } else {
+        inflight.emplace(numSent, nextSend);
+      }
+      ++numSent;
+      continue;
+    }
+
+    // wait for replies until next request is due, give up on outstanding
+    // requests once replies stop coming
+    if (numSent == numRequests_ && now - lastReply > kReplyTimeout) {
+      result.numErrors += inflight.size();
+      break;
+    }
+    const auto wait = numSent < numRequests_
+        ? std::chrono::duration_cast<std::chrono::milliseconds>(nextSend - now)
+        : kReplyTimeout;
+    auto reply = sock.recvMultiple(wait);
+    if (reply.hasError()) {
+      continue;
+    }
+    now = Clock::now();
+    lastReply = now;
+    // request id and reply
+    auto& msgs = reply.value();
+    if (msgs.size() != 2) {
+      ++result.numErrors;
+      continue;
+    }
+    auto id = msgs[0].read<uint64_t>();
+    if (id.hasError() || msgs[1].empty()) {
+      ++result.numErrors;
+      continue;
+    }
+    auto it = inflight.find(id.value());
+    if (it == inflight.end()) {
+      continue;
+    }
+    result.latencyUs.addValue(toMicros(now - it->second));
+    inflight.erase(it);
+  }
+  result.sendRate = numSent /
+      std::chrono::duration<double>(Clock::now() - start).count();
+  return result;
+}
+
+} // namespace example
+} // namespace fbzmq
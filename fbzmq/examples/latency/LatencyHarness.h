@@ -0,0 +1,95 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fbzmq/examples/common/Constants.h>
+#include <fbzmq/service/stats/Histogram.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+namespace example {
+
+/**
+ * Open-loop latency harness for ZmqServer. Requests are issued on a fixed
+ * schedule of `requestRate` per second regardless of how fast replies come
+ * back, and latency of every request is measured from its scheduled send
+ * time rather than from when it actually got sent. Stalls of the server thus
+ * show up in latencies of all requests scheduled in the meantime, instead of
+ * being hidden by the client backing off (coordinated omission).
+ *
+ * Latencies are recorded in microseconds in log-linear (HDR style) histogram
+ * buckets of fbzmq::HistogramBuckets.
+ */
+class LatencyHarness {
+ public:
+  struct Result {
+    // latency in microseconds of requests which got replied to
+    HistogramBuckets latencyUs;
+    // requests without well-formed reply, or without reply in time
+    uint64_t numErrors{0};
+    // requests per second actually sent
+    double sendRate{0};
+  };
+
+  /**
+   * Client sockets use CURVE encryption if server's public key is given
+   */
+  LatencyHarness(
+      fbzmq::Context& zmqContext,
+      const folly::Optional<fbzmq::PublicKey>& serverKey,
+      uint32_t requestRate,
+      std::chrono::seconds duration);
+
+  /**
+   * Requests of `type` to REP socket of ZmqServer for the command type, with
+   * payloads of `payloadSize` bytes. REQ socket has a single request in
+   * flight, requests falling behind schedule are sent right away.
+   */
+  Result runReqRep(
+      const std::string& url, CommandType type, size_t payloadSize);
+
+  /**
+   * Ditto, to ROUTER socket of ZmqServer from DEALER socket. Requests are
+   * sent on schedule with any number of them in flight.
+   */
+  Result runDealerRouter(
+      const std::string& url, CommandType type, size_t payloadSize);
+
+ private:
+  // request frames of given command type, as served by REP sockets
+  std::vector<fbzmq::Message> makeRequest(
+      CommandType type, size_t payloadSize);
+
+  // connect client socket to `url`, with encryption if enabled
+  template <int SocketType>
+  void connect(
+      fbzmq::Socket<SocketType, fbzmq::ZMQ_CLIENT>& sock,
+      const std::string& url);
+
+  fbzmq::Context& zmqContext_;
+
+  // server's public key and own key pair, for CURVE encryption
+  const folly::Optional<fbzmq::PublicKey> serverKey_;
+  folly::Optional<fbzmq::KeyPair> keyPair_;
+
+  const std::chrono::nanoseconds interval_;
+  const uint64_t numRequests_{0};
+
+  // used for serialize/deserialize thrift obj
+  apache::thrift::CompactSerializer serializer_;
+};
+
+} // namespace example
+} // namespace fbzmq
@@ -0,0 +1,153 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#include <thread>
+
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fbzmq/examples/common/Constants.h>
+#include <fbzmq/examples/latency/LatencyHarness.h>
+#include <fbzmq/examples/server/ZmqServer.h>
+
+DEFINE_uint32(rate, 1000, "Requests issued per second");
+DEFINE_uint32(duration_s, 10, "Duration of each run in seconds");
+DEFINE_string(payload_sizes, "16,1024,65536", "Payload sizes in bytes");
+DEFINE_string(modes, "plain,curve", "Socket modes: plain and/or curve");
+DEFINE_string(patterns, "reqrep,dealer", "Patterns: reqrep and/or dealer");
+DEFINE_string(
+    commands,
+    "primitive,string,thrift,multiple",
+    "Command types of requests");
+
+namespace {
+
+using fbzmq::example::CommandType;
+using fbzmq::example::Constants;
+
+std::vector<std::string>
+splitFlag(const std::string& flag) {
+  std::vector<std::string> parts;
+  folly::split(',', flag, parts, true /* ignoreEmpty */);
+  return parts;
+}
+
+CommandType
+toCommandType(const std::string& name) {
+  if (name == "primitive") {
+    return CommandType::PRIMITIVE;
+  } else if (name == "string") {
+    return CommandType::STRING;
+  } else if (name == "thrift") {
+    return CommandType::THRIFT;
+  } else if (name == "multiple") {
+    return CommandType::MULTIPLE;
+  }
+  LOG(FATAL) << "Unknown command type: " << name;
+  return CommandType::PRIMITIVE;
+}
+
+std::string
+getReqRepUrl(CommandType type) {
+  switch (type) {
+  case CommandType::PRIMITIVE:
+    return Constants::kPrimitiveCmdUrl.str();
+  case CommandType::STRING:
+    return Constants::kStringCmdUrl.str();
+  case CommandType::THRIFT:
+    return Constants::kThriftCmdUrl.str();
+  case CommandType::MULTIPLE:
+    return Constants::kMultipleCmdUrl.str();
+  }
+  LOG(FATAL) << "Unknown command type";
+  return "";
+}
+
+void
+printResult(
+    const std::string& name, const fbzmq::example::LatencyHarness::Result& r) {
+  const auto& hist = r.latencyUs;
+  LOG(INFO) << folly::sformat(
+      "{:<36} sent/s {:>9.1f} ok {:>8} err {:>6} | us p50 {:>7} p90 {:>7} "
+      "p99 {:>7} p99.9 {:>7} max {:>7}",
+      name,
+      r.sendRate,
+      hist.getCount(),
+      r.numErrors,
+      hist.getPercentile(50),
+      hist.getPercentile(90),
+      hist.getPercentile(99),
+      hist.getPercentile(99.9),
+      hist.getPercentile(100));
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  fbzmq::Context ctx;
+  for (const auto& mode : splitFlag(FLAGS_modes)) {
+    CHECK(mode == "plain" || mode == "curve") << "Unknown mode: " << mode;
+    folly::Optional<fbzmq::KeyPair> serverKeyPair;
+    folly::Optional<fbzmq::PublicKey> serverKey;
+    if (mode == "curve") {
+      serverKeyPair = fbzmq::util::genKeyPair();
+      serverKey = serverKeyPair->publicKey;
+    }
+
+    // server in a thread of its own, sockets are released before next mode
+    // binds same urls
+    fbzmq::example::ZmqServer server(
+        ctx,
+        Constants::kPrimitiveCmdUrl.str(),
+        Constants::kStringCmdUrl.str(),
+        Constants::kThriftCmdUrl.str(),
+        Constants::kMultipleCmdUrl.str(),
+        Constants::kPubUrl.str(),
+        Constants::kRouterCmdUrl.str(),
+        serverKeyPair);
+    std::thread serverThread([&server]() noexcept { server.run(); });
+    server.waitUntilRunning();
+
+    fbzmq::example::LatencyHarness harness(
+        ctx,
+        serverKey,
+        FLAGS_rate,
+        std::chrono::seconds(FLAGS_duration_s));
+    for (const auto& pattern : splitFlag(FLAGS_patterns)) {
+      CHECK(pattern == "reqrep" || pattern == "dealer")
+          << "Unknown pattern: " << pattern;
+      for (const auto& command : splitFlag(FLAGS_commands)) {
+        const auto type = toCommandType(command);
+        for (const auto& size : splitFlag(FLAGS_payload_sizes)) {
+          const auto payloadSize = folly::to<size_t>(size);
+          auto result = pattern == "reqrep"
+              ? harness.runReqRep(getReqRepUrl(type), type, payloadSize)
+              : harness.runDealerRouter(
+                    Constants::kRouterCmdUrl.str(), type, payloadSize);
+          printResult(
+              folly::sformat("{}/{}/{}/{}B", mode, pattern, command, size),
+              result);
+        }
+      }
+    }
+
+    server.stop();
+    server.waitUntilStopped();
+    serverThread.join();
+  }
+
+  return 0;
+}
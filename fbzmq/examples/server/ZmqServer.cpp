@@ -20,17 +20,21 @@ ZmqServer::ZmqServer(
     const std::string& stringCmdUrl,
     const std::string& thriftCmdUrl,
     const std::string& multipleCmdUrl,
-    const std::string& pubUrl)
+    const std::string& pubUrl,
+    const std::string& routerCmdUrl,
+    const folly::Optional<fbzmq::KeyPair>& keyPair)
     : primitiveCmdUrl_(primitiveCmdUrl),
       stringCmdUrl_(stringCmdUrl),
       thriftCmdUrl_(thriftCmdUrl),
       multipleCmdUrl_(multipleCmdUrl),
       pubUrl_(pubUrl),
+      routerCmdUrl_(routerCmdUrl),
       // init sockets
-      primitiveCmdSock_(zmqContext),
-      stringCmdSock_(zmqContext),
-      thriftCmdSock_(zmqContext),
-      multipleCmdSock_(zmqContext),
+      primitiveCmdSock_(zmqContext, folly::none, keyPair),
+      stringCmdSock_(zmqContext, folly::none, keyPair),
+      thriftCmdSock_(zmqContext, folly::none, keyPair),
+      multipleCmdSock_(zmqContext, folly::none, keyPair),
+      routerCmdSock_(zmqContext, folly::none, keyPair),
       pubSock_(zmqContext) {
   prepare();
 }
@@ -54,7 +58,7 @@ ZmqServer::prepare() noexcept {
       fbzmq::RawZmqSocketPtr{*primitiveCmdSock_},
       ZMQ_POLLIN,
       [this](int) noexcept {
-        LOG(INFO) << "Received command request on primitiveCmdSock_";
+        VLOG(2) << "Received command request on primitiveCmdSock_";
         processPrimitiveCommand();
       });
 
@@ -63,7 +67,7 @@ ZmqServer::prepare() noexcept {
       fbzmq::RawZmqSocketPtr{*stringCmdSock_},
       ZMQ_POLLIN,
       [this](int) noexcept {
-        LOG(INFO) << "Received command request on stringCmdSock_";
+        VLOG(2) << "Received command request on stringCmdSock_";
         processStringCommand();
       });
 
@@ -72,7 +76,7 @@ ZmqServer::prepare() noexcept {
       fbzmq::RawZmqSocketPtr{*thriftCmdSock_},
       ZMQ_POLLIN,
       [this](int) noexcept {
-        LOG(INFO) << "Received command request on thriftCmdSock_";
+        VLOG(2) << "Received command request on thriftCmdSock_";
         processThriftCommand();
       });
 
@@ -81,95 +85,80 @@ ZmqServer::prepare() noexcept {
       fbzmq::RawZmqSocketPtr{*multipleCmdSock_},
       ZMQ_POLLIN,
       [this](int) noexcept {
-        LOG(INFO) << "Received command request on multipleCmdSock_";
+        VLOG(2) << "Received command request on multipleCmdSock_";
         processMultipleCommand();
       });
-}
 
-void
-ZmqServer::processPrimitiveCommand() noexcept {
-  // recv request
-  auto maybeMsg = primitiveCmdSock_.recvOne();
-  if (maybeMsg.hasError()) {
-    LOG(ERROR) << "recv primitive request failed: " << maybeMsg.error();
+  if (routerCmdUrl_.empty()) {
     return;
   }
 
+  LOG(INFO) << "Server: Binding routerCmdUrl_ '" << routerCmdUrl_ << "'";
+  routerCmdSock_.bind(fbzmq::SocketUrl{routerCmdUrl_}).value();
+
+  // attach callbacks for commands of any type
+  addSocket(
+      fbzmq::RawZmqSocketPtr{*routerCmdSock_},
+      ZMQ_POLLIN,
+      [this](int) noexcept {
+        VLOG(2) << "Received command request on routerCmdSock_";
+        processRouterCommand();
+      });
+}
+
+folly::Expected<fbzmq::Message, fbzmq::Error>
+ZmqServer::makePrimitiveReply(const fbzmq::Message& request) noexcept {
   // read out primitive (uin32_t in this example) request
-  auto maybeUint32t = maybeMsg->template read<uint32_t>();
+  auto maybeUint32t = request.read<uint32_t>();
   if (maybeUint32t.hasError()) {
     LOG(ERROR) << "read primitive request failed: " << maybeUint32t.error();
-    return;
+    return folly::makeUnexpected(maybeUint32t.error());
   }
-
-  uint32_t request = maybeUint32t.value();
-  VLOG(2) << "received request: " << request;
+  VLOG(2) << "received request: " << maybeUint32t.value();
 
   // process request (simply add one)
-  uint32_t reply = request + 1;
-
-  // send back reply message
-  auto replyMsg = fbzmq::Message::from(reply).value();
+  uint32_t reply = maybeUint32t.value() + 1;
   VLOG(2) << "sending reply: " << reply;
-  auto rc = primitiveCmdSock_.sendOne(replyMsg);
-  if (rc.hasError()) {
-    LOG(ERROR) << "send reply failed: " << rc.error();
-  }
+  return fbzmq::Message::from(reply);
 }
 
-void
-ZmqServer::processStringCommand() noexcept {
-  // recv request
-  auto maybeMsg = stringCmdSock_.recvOne();
-  if (maybeMsg.hasError()) {
-    LOG(ERROR) << "recv string request failed: " << maybeMsg.error();
-    return;
-  }
-
+folly::Expected<fbzmq::Message, fbzmq::Error>
+ZmqServer::makeStringReply(fbzmq::Message& request) noexcept {
   // read out string request
-  auto maybeString = maybeMsg.value().template read<std::string>();
+  auto maybeString = request.read<std::string>();
   if (maybeString.hasError()) {
     LOG(ERROR) << "read string request failed: " << maybeString.error();
-    return;
+    return folly::makeUnexpected(maybeString.error());
   }
-
-  const auto& request = maybeString.value();
-  VLOG(2) << "received request: " << request;
+  VLOG(2) << "received request: " << maybeString.value();
 
   // process request (simply append " world")
-  std::string reply = request + " world";
-  // send back reply message
-  auto replyMsg = fbzmq::Message::from(reply).value();
+  std::string reply = maybeString.value() + " world";
   VLOG(2) << "sending reply: " << reply;
-  auto rc = stringCmdSock_.sendOne(replyMsg);
-  if (rc.hasError()) {
-    LOG(ERROR) << "send reply failed: " << rc.error();
-  }
+  return fbzmq::Message::from(reply);
 }
 
-void
-ZmqServer::processMultipleCommand() noexcept {
-  fbzmq::Message msg1, msg2, msg3;
-
-  // recv request
-  multipleCmdSock_.recvMultiple(msg1, msg2, msg3).value();
-
+folly::Expected<fbzmq::Message, fbzmq::Error>
+ZmqServer::makeMultipleReply(
+    fbzmq::Message& msg1,
+    fbzmq::Message& msg2,
+    const fbzmq::Message& msg3) noexcept {
   auto intMsg = msg1.read<uint32_t>();
   if (intMsg.hasError()) {
     LOG(ERROR) << "read int request failed: " << intMsg.error();
-    return;
+    return folly::makeUnexpected(intMsg.error());
   }
 
   auto stringMsg = msg2.read<std::string>();
   if (stringMsg.hasError()) {
     LOG(ERROR) << "read string request failed: " << stringMsg.error();
-    return;
+    return folly::makeUnexpected(stringMsg.error());
   }
 
   auto thriftMsg = msg3.readThriftObj<thrift::StrValue>(serializer_);
   if (thriftMsg.hasError()) {
     LOG(ERROR) << "read thrift request failed: " << thriftMsg.error();
-    return;
+    return folly::makeUnexpected(thriftMsg.error());
   }
 
   std::string reply = folly::sformat(
@@ -177,69 +166,121 @@ ZmqServer::processMultipleCommand() noexcept {
       intMsg.value(),
       stringMsg.value(),
       thriftMsg.value().value);
-
-  // send back reply message
-  auto replyMsg = fbzmq::Message::from(reply).value();
   VLOG(2) << "sending reply: " << reply;
-  auto rc = multipleCmdSock_.sendOne(replyMsg);
-  if (rc.hasError()) {
-    LOG(ERROR) << "send reply failed: " << rc.error();
-  }
+  return fbzmq::Message::from(reply);
 }
 
-void
-ZmqServer::processThriftCommand() noexcept {
+folly::Expected<fbzmq::Message, fbzmq::Error>
+ZmqServer::makeThriftReply(const fbzmq::Message& request) noexcept {
   // read out thrift command
-  auto maybeThriftObj =
-      thriftCmdSock_.recvThriftObj<thrift::Request>(serializer_);
+  auto maybeThriftObj = request.readThriftObj<thrift::Request>(serializer_);
   if (maybeThriftObj.hasError()) {
     LOG(ERROR) << "read thrift request failed: " << maybeThriftObj.error();
-    return;
+    return folly::makeUnexpected(maybeThriftObj.error());
   }
 
-  const auto& request = maybeThriftObj.value();
-  const auto& key = request.key;
-  const auto& value = request.value;
+  const auto& thriftReq = maybeThriftObj.value();
+  const auto& key = thriftReq.key;
+  const auto& value = thriftReq.value;
 
-  switch (request.cmd) {
+  thrift::Response response;
+  switch (thriftReq.cmd) {
   case thrift::Command::KEY_SET: {
     VLOG(2) << "Received KEY_SET command (" << key << ": " << *value << ")";
     kvStore_[key] = *value;
-
-    thrift::Response response;
     response.success = true;
-    auto rc = thriftCmdSock_.sendThriftObj(response, serializer_);
-    if (rc.hasError()) {
-      LOG(ERROR) << "Sent response failed: " << rc.error();
-      return;
-    }
     break;
   }
 
   case thrift::Command::KEY_GET: {
     VLOG(2) << "Received KEY_GET command (" << key << ")";
     auto it = kvStore_.find(key);
-
-    thrift::Response response;
     if (it == kvStore_.end()) {
       response.success = false;
     } else {
       response.success = true;
       response.value = it->second;
     }
-
-    auto rc = thriftCmdSock_.sendThriftObj(response, serializer_);
-    if (rc.hasError()) {
-      LOG(ERROR) << "Sent response failed: " << rc.error();
-      return;
-    }
     break;
   }
 
   default: {
-    LOG(ERROR) << "Unknown thrift command: " << static_cast<int>(request.cmd);
-    break;
+    LOG(ERROR) << "Unknown thrift command: " << static_cast<int>(thriftReq.cmd);
+    return folly::makeUnexpected(fbzmq::Error(EPROTO));
+  }
+  }
+
+  return fbzmq::Message::fromThriftObj(response, serializer_);
+}
+
+void
+ZmqServer::processPrimitiveCommand() noexcept {
+  // recv request
+  auto maybeMsg = primitiveCmdSock_.recvOne();
+  if (maybeMsg.hasError()) {
+    LOG(ERROR) << "recv primitive request failed: " << maybeMsg.error();
+    return;
+  }
+
+  // REP socket must reply to every request
+  auto reply = makePrimitiveReply(maybeMsg.value());
+  auto rc = primitiveCmdSock_.sendOne(
+      reply.hasValue() ? std::move(reply.value()) : fbzmq::Message());
+  if (rc.hasError()) {
+    LOG(ERROR) << "send reply failed: " << rc.error();
+  }
+}
+
+void
+ZmqServer::processStringCommand() noexcept {
+  // recv request
+  auto maybeMsg = stringCmdSock_.recvOne();
+  if (maybeMsg.hasError()) {
+    LOG(ERROR) << "recv string request failed: " << maybeMsg.error();
+    return;
+  }
+
+  auto reply = makeStringReply(maybeMsg.value());
+  auto rc = stringCmdSock_.sendOne(
+      reply.hasValue() ? std::move(reply.value()) : fbzmq::Message());
+  if (rc.hasError()) {
+    LOG(ERROR) << "send reply failed: " << rc.error();
   }
+}
+
+void
+ZmqServer::processMultipleCommand() noexcept {
+  fbzmq::Message msg1, msg2, msg3;
+
+  // recv request
+  auto ret = multipleCmdSock_.recvMultiple(msg1, msg2, msg3);
+  if (ret.hasError()) {
+    LOG(ERROR) << "recv multiple request failed: " << ret.error();
+    return;
+  }
+
+  auto reply = makeMultipleReply(msg1, msg2, msg3);
+  auto rc = multipleCmdSock_.sendOne(
+      reply.hasValue() ? std::move(reply.value()) : fbzmq::Message());
+  if (rc.hasError()) {
+    LOG(ERROR) << "send reply failed: " << rc.error();
+  }
+}
+
+void
+ZmqServer::processThriftCommand() noexcept {
+  auto maybeMsg = thriftCmdSock_.recvOne();
+  if (maybeMsg.hasError()) {
+    LOG(ERROR) << "recv thrift request failed: " << maybeMsg.error();
+    return;
+  }
+
+  auto reply = makeThriftReply(maybeMsg.value());
+  auto rc = thriftCmdSock_.sendOne(
+      reply.hasValue() ? std::move(reply.value()) : fbzmq::Message());
+  if (rc.hasError()) {
+    LOG(ERROR) << "Sent response failed: " << rc.error();
+    return;
   }
 
   for (const auto& keyVal : kvStore_) {
@@ -247,5 +288,55 @@ ZmqServer::processThriftCommand() noexcept {
   }
 }
 
+void
+ZmqServer::processRouterCommand() noexcept {
+  // identity, request id, command type and request frames of command type
+  auto maybeMsgs = routerCmdSock_.recvMultiple();
+  if (maybeMsgs.hasError()) {
+    LOG(ERROR) << "recv router request failed: " << maybeMsgs.error();
+    return;
+  }
+  auto& msgs = maybeMsgs.value();
+  if (msgs.size() < 4) {
+    LOG(ERROR) << "Unexpected number of frames " << msgs.size();
+    return;
+  }
+  auto maybeType = msgs[2].read<uint32_t>();
+  if (maybeType.hasError()) {
+    LOG(ERROR) << "read command type failed: " << maybeType.error();
+    return;
+  }
+
+  auto reply = [this, &msgs, type = maybeType.value()]()
+      -> folly::Expected<fbzmq::Message, fbzmq::Error> {
+    switch (static_cast<CommandType>(type)) {
+    case CommandType::PRIMITIVE:
+      return makePrimitiveReply(msgs[3]);
+    case CommandType::STRING:
+      return makeStringReply(msgs[3]);
+    case CommandType::THRIFT:
+      return makeThriftReply(msgs[3]);
+    case CommandType::MULTIPLE:
+      if (msgs.size() == 6) {
+        return makeMultipleReply(msgs[3], msgs[4], msgs[5]);
+      }
+      break;
+    default:
+      LOG(ERROR) << "Unknown command type: " << type;
+    }
+    return folly::makeUnexpected(fbzmq::Error(EPROTO));
+  }();
+
+  // DEALER clients don't need to hear back about malformed requests
+  if (reply.hasError()) {
+    return;
+  }
+  auto rc = routerCmdSock_.sendMultiple(
+      std::move(msgs[0]), std::move(msgs[1]), std::move(reply.value()));
+  if (rc.hasError()) {
+    LOG(ERROR) << "send reply failed: " << rc.error();
+  }
+}
+
 } // namespace example
 } // namespace fbzmq
@@ -24,7 +24,12 @@ class ZmqServer final : public fbzmq::ZmqEventLoop {
       const std::string& stringCmdUrl,
       const std::string& thriftCmdUrl,
       const std::string& multipleCmdUrl,
-      const std::string& pubUrl);
+      const std::string& pubUrl,
+      // serves all command types over ROUTER socket unless empty, look at
+      // CommandType
+      const std::string& routerCmdUrl = "",
+      // enables CURVE encryption on command sockets
+      const folly::Optional<fbzmq::KeyPair>& keyPair = folly::none);
 
   // disable copying
   ZmqServer(const ZmqServer&) = delete;
@@ -46,12 +51,28 @@ class ZmqServer final : public fbzmq::ZmqEventLoop {
   // process received multiple command
   void processMultipleCommand() noexcept;
 
+  // process command received on router socket
+  void processRouterCommand() noexcept;
+
+  // build replies for command requests, shared by REP and ROUTER sockets
+  folly::Expected<fbzmq::Message, fbzmq::Error> makePrimitiveReply(
+      const fbzmq::Message& request) noexcept;
+  folly::Expected<fbzmq::Message, fbzmq::Error> makeStringReply(
+      fbzmq::Message& request) noexcept;
+  folly::Expected<fbzmq::Message, fbzmq::Error> makeThriftReply(
+      const fbzmq::Message& request) noexcept;
+  folly::Expected<fbzmq::Message, fbzmq::Error> makeMultipleReply(
+      fbzmq::Message& msg1,
+      fbzmq::Message& msg2,
+      const fbzmq::Message& msg3) noexcept;
+
   // communication urls
   const std::string primitiveCmdUrl_;
   const std::string stringCmdUrl_;
   const std::string thriftCmdUrl_;
   const std::string multipleCmdUrl_;
   const std::string pubUrl_;
+  const std::string routerCmdUrl_;
 
   // command socket for primitive type message
   fbzmq::Socket<ZMQ_REP, fbzmq::ZMQ_SERVER> primitiveCmdSock_;
@@ -61,6 +82,8 @@ class ZmqServer final : public fbzmq::ZmqEventLoop {
   fbzmq::Socket<ZMQ_REP, fbzmq::ZMQ_SERVER> thriftCmdSock_;
   // command socket for multiple message
   fbzmq::Socket<ZMQ_REP, fbzmq::ZMQ_SERVER> multipleCmdSock_;
+  // command socket for all command types, for DEALER clients
+  fbzmq::Socket<ZMQ_ROUTER, fbzmq::ZMQ_SERVER> routerCmdSock_;
 
   // publication socket
   fbzmq::Socket<ZMQ_PUB, fbzmq::ZMQ_SERVER> pubSock_;
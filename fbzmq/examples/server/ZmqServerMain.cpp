@@ -37,7 +37,8 @@ main(int argc, char** argv) {
       fbzmq::example::Constants::kStringCmdUrl.str(),
       fbzmq::example::Constants::kThriftCmdUrl.str(),
       fbzmq::example::Constants::kMultipleCmdUrl.str(),
-      fbzmq::example::Constants::kPubUrl.str());
+      fbzmq::example::Constants::kPubUrl.str(),
+      fbzmq::example::Constants::kRouterCmdUrl.str());
   std::thread serverThread([&server]() noexcept {
     LOG(INFO) << "Starting Server thread ...";
     server.run();
@@ -0,0 +1,238 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ZmqBroker.h"
+
+namespace fbzmq {
+
+ZmqBroker::ZmqBroker(
+    Context& zmqContext,
+    std::string const& frontendUrl,
+    std::string const& backendUrl,
+    size_t maxQueuedRequests,
+    std::chrono::milliseconds workerTimeout)
+    : maxQueuedRequests_(maxQueuedRequests),
+      workerTimeout_(workerTimeout),
+      frontendSock_{zmqContext},
+      backendSock_{zmqContext} {
+  CHECK_LT(0, maxQueuedRequests_) << "Broker must be able to queue requests";
+  CHECK_LT(0, workerTimeout_.count());
+
+  const auto frontendRet = frontendSock_.bind(SocketUrl{frontendUrl});
+  if (frontendRet.hasError()) {
+    LOG(FATAL) << "ZmqBroker: Error binding to '" << frontendUrl << "' "
+               << frontendRet.error();
+  }
+  const auto backendRet = backendSock_.bind(SocketUrl{backendUrl});
+  if (backendRet.hasError()) {
+    LOG(FATAL) << "ZmqBroker: Error binding to '" << backendUrl << "' "
+               << backendRet.error();
+  }
+
+  addSocket(
+      RawZmqSocketPtr{*backendSock_}, ZMQ_POLLIN, [this](int) noexcept {
+        processBackend();
+      });
+  // frontend starts out paused, resume it to register it with the loop
+  pauseFrontend(false);
+
+  expiryTimer_ = ZmqTimeout::make(this, [this]() noexcept { expireWorkers(); });
+  expiryTimer_->scheduleTimeout(workerTimeout_, true /* isPeriodic */);
+}
+
+folly::Expected<size_t, Error>
+ZmqBroker::sendCredits(
+    detail::SocketImpl const& workerSock, uint32_t credits) noexcept {
+  return workerSock.sendMultiple(Message(), Message::from(credits).value());
+}
+
+void
+ZmqBroker::processFrontend() noexcept {
+  auto frames = frontendSock_.recvMultiple();
+  if (frames.hasError()) {
+    LOG(ERROR) << "ZmqBroker: Error receiving request " << frames.error();
+    return;
+  }
+  if (frames->size() < 2) {
+    LOG(ERROR) << "ZmqBroker: Dropping request without frames";
+    return;
+  }
+
+  ++numRequests_;
+  queue_.push_back(std::move(frames.value()));
+  dispatch();
+}
+
+void
+ZmqBroker::processBackend() noexcept {
+  auto frames = backendSock_.recvMultiple();
+  if (frames.hasError()) {
+    LOG(ERROR) << "ZmqBroker: Error receiving from worker " << frames.error();
+    return;
+  }
+  auto& msgs = frames.value();
+
+  // credits are [worker identity][empty][credits], anything else is a reply
+  folly::Optional<uint32_t> credits;
+  if (msgs.size() >= 2 && msgs[1].empty()) {
+    if (msgs.size() != 3 || msgs[2].read<uint32_t>().hasError()) {
+      LOG(ERROR) << "ZmqBroker: Dropping malformed credits of worker";
+      return;
+    }
+    credits = msgs[2].read<uint32_t>().value();
+  } else if (msgs.size() < 2) {
+    LOG(ERROR) << "ZmqBroker: Dropping reply without frames";
+    return;
+  }
+
+  const auto workerId = msgs[0].read<std::string>().value();
+  auto& worker = workers_[workerId];
+  available_.erase(std::make_pair(worker.outstanding, workerId));
+  worker.lastSeen = std::chrono::steady_clock::now();
+
+  if (credits) {
+    worker.credits = *credits;
+  } else {
+    if (worker.outstanding > 0) {
+      --worker.outstanding;
+      --numOutstanding_;
+    }
+    msgs.erase(msgs.begin());
+    const auto ret = frontendSock_.sendMultiple(msgs);
+    if (ret.hasError()) {
+      // client is most likely gone
+      VLOG(2) << "ZmqBroker: Error sending reply " << ret.error();
+    } else {
+      ++numReplies_;
+    }
+  }
+
+  updateAvailable(workerId, worker);
+  dispatch();
+}
+
+void
+ZmqBroker::dispatch() noexcept {
+  while (!queue_.empty() && !available_.empty()) {
+    // least loaded worker with credit left
+    const auto workerId = available_.begin()->second;
+    available_.erase(available_.begin());
+    auto& worker = workers_.at(workerId);
+
+    auto const& request = queue_.front();
+    const auto idRet = backendSock_.sendMore(Message::from(workerId).value());
+    if (idRet.hasError()) {
+      // ROUTER_MANDATORY reports unreachable worker on first frame, request
+      // stays queued for the next one
+      LOG(ERROR) << "ZmqBroker: Dropping unreachable worker " << idRet.error();
+      removeWorker(workerId);
+      continue;
+    }
+    const auto ret = backendSock_.sendMultiple(request);
+    if (ret.hasError()) {
+      LOG(ERROR) << "ZmqBroker: Error sending request " << ret.error();
+    }
+
+    queue_.pop_front();
+    ++worker.outstanding;
+    ++numOutstanding_;
+    ++numDispatched_;
+    updateAvailable(workerId, worker);
+  }
+
+  pauseFrontend(queue_.size() >= maxQueuedRequests_);
+  updateGauges();
+}
+
+void
+ZmqBroker::expireWorkers() noexcept {
+  const auto now = std::chrono::steady_clock::now();
+  std::vector<std::string> expired;
+  for (auto const& kv : workers_) {
+    if (kv.second.lastSeen + workerTimeout_ < now) {
+      expired.push_back(kv.first);
+    }
+  }
+  for (auto const& workerId : expired) {
+    LOG(WARNING) << "ZmqBroker: Worker timed out";
+    removeWorker(workerId);
+  }
+  updateGauges();
+}
+
+void
+ZmqBroker::removeWorker(std::string const& workerId) {
+  auto it = workers_.find(workerId);
+  if (it == workers_.end()) {
+    return;
+  }
+  available_.erase(std::make_pair(it->second.outstanding, workerId));
+  numLostRequests_ += it->second.outstanding;
+  numOutstanding_ -= it->second.outstanding;
+  ++numExpiredWorkers_;
+  workers_.erase(it);
+}
+
+void
+ZmqBroker::updateAvailable(std::string const& workerId, Worker const& worker) {
+  if (worker.outstanding < worker.credits) {
+    available_.emplace(worker.outstanding, workerId);
+  }
+}
+
+void
+ZmqBroker::pauseFrontend(bool pause) {
+  if (pause == frontendPaused_) {
+    return;
+  }
+  frontendPaused_ = pause;
+  if (pause) {
+    removeSocket(RawZmqSocketPtr{*frontendSock_});
+    return;
+  }
+  addSocket(
+      RawZmqSocketPtr{*frontendSock_}, ZMQ_POLLIN, [this](int) noexcept {
+        processFrontend();
+      });
+}
+
+void
+ZmqBroker::updateGauges() {
+  queueDepth_ = queue_.size();
+  numWorkers_ = workers_.size();
+}
+
+ZmqBroker::Stats
+ZmqBroker::getStats() const {
+  Stats stats;
+  stats.numRequests = numRequests_;
+  stats.numDispatched = numDispatched_;
+  stats.numReplies = numReplies_;
+  stats.numExpiredWorkers = numExpiredWorkers_;
+  stats.numLostRequests = numLostRequests_;
+  stats.queueDepth = queueDepth_;
+  stats.numOutstanding = numOutstanding_;
+  stats.numWorkers = numWorkers_;
+  return stats;
+}
+
+void
+ZmqBroker::exportStats(ThreadData& tData, std::string const& prefix) const {
+  const auto stats = getStats();
+  tData.setCounter(prefix + ".requests", stats.numRequests);
+  tData.setCounter(prefix + ".dispatched", stats.numDispatched);
+  tData.setCounter(prefix + ".replies", stats.numReplies);
+  tData.setCounter(prefix + ".expired_workers", stats.numExpiredWorkers);
+  tData.setCounter(prefix + ".lost_requests", stats.numLostRequests);
+  tData.setCounter(prefix + ".queue_depth", stats.queueDepth);
+  tData.setCounter(prefix + ".outstanding", stats.numOutstanding);
+  tData.setCounter(prefix + ".workers", stats.numWorkers);
+}
+
+} // namespace fbzmq
@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/service/stats/ThreadData.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+/**
+ * Request broker between clients and a pool of workers which dispatches every
+ * request to the least loaded worker, unlike round-robin of `proxy()` which
+ * keeps feeding slow workers until their queues are deep.
+ *
+ * Clients (REQ or DEALER) connect to ROUTER at `frontendUrl`, workers
+ * (DEALER) connect to ROUTER at `backendUrl`. Workers take part with credit
+ * based flow control:
+ *
+ *  - worker announces how many requests it may have outstanding at once by
+ *    sending `[empty frame][uint32_t credits]` (look at `sendCredits`). Doing
+ *    it again updates credits and serves as heartbeat.
+ *  - worker receives requests as `[client identity][request frames...]` and
+ *    replies with the same leading identity frame, e.g. by echoing the frames
+ *    up to its reply. Every reply gives one credit back.
+ *
+ * Requests are dispatched right away to the worker with fewest outstanding
+ * requests which has credit left. Otherwise they are queued in order, up to
+ * `maxQueuedRequests`. Frontend isn't read while queue is full, so clients
+ * are pushed back by their socket's high watermark instead of broker's memory
+ * growing without bound.
+ *
+ * Workers not heard of (reply or credits) for `workerTimeout` are dropped,
+ * which is checked every `workerTimeout`. Their outstanding requests are
+ * considered lost, clients must retry them.
+ *
+ * Loop must be run in a thread of its own, like ZmqMonitor.
+ */
+class ZmqBroker final : public ZmqEventLoop {
+ public:
+  struct Stats {
+    // requests received from clients
+    uint64_t numRequests{0};
+    // requests sent to workers
+    uint64_t numDispatched{0};
+    // replies sent back to clients
+    uint64_t numReplies{0};
+    // workers dropped because of timeout or being unreachable
+    uint64_t numExpiredWorkers{0};
+    // requests outstanding on dropped workers
+    uint64_t numLostRequests{0};
+    // requests waiting for a worker with credit
+    uint64_t queueDepth{0};
+    // requests sent to workers and not replied to yet
+    uint64_t numOutstanding{0};
+    uint64_t numWorkers{0};
+  };
+
+  ZmqBroker(
+      Context& zmqContext,
+      std::string const& frontendUrl,
+      std::string const& backendUrl,
+      size_t maxQueuedRequests = 10000,
+      std::chrono::milliseconds workerTimeout = std::chrono::seconds(10));
+
+  /**
+   * Announce `credits` of a worker to broker over worker's backend socket
+   */
+  static folly::Expected<size_t, Error> sendCredits(
+      detail::SocketImpl const& workerSock, uint32_t credits) noexcept;
+
+  /**
+   * Counters of the broker, can be read from any thread
+   */
+  Stats getStats() const;
+
+  /**
+   * Export stats as counters `<prefix>.queue_depth`, `<prefix>.outstanding`,
+   * `<prefix>.workers` etc. into thread data of calling thread
+   */
+  void exportStats(ThreadData& tData, std::string const& prefix) const;
+
+ private:
+  ZmqBroker(ZmqBroker const&) = delete;
+  ZmqBroker& operator=(ZmqBroker const&) = delete;
+
+  struct Worker {
+    uint32_t credits{0};
+    uint64_t outstanding{0};
+    std::chrono::steady_clock::time_point lastSeen;
+  };
+
+  // read request from a client
+  void processFrontend() noexcept;
+
+  // read reply or credits from a worker
+  void processBackend() noexcept;
+
+  // send queued requests to workers while any has credit left
+  void dispatch() noexcept;
+
+  // drop workers not heard of for workerTimeout_
+  void expireWorkers() noexcept;
+
+  void removeWorker(std::string const& workerId);
+
+  // add worker in available_ if it has credit left
+  void updateAvailable(std::string const& workerId, Worker const& worker);
+
+  // stop or resume reading frontend
+  void pauseFrontend(bool pause);
+
+  void updateGauges();
+
+  const size_t maxQueuedRequests_{0};
+  const std::chrono::milliseconds workerTimeout_{0};
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> frontendSock_;
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> backendSock_;
+
+  std::unordered_map<std::string /* worker id */, Worker> workers_;
+
+  // workers with credit left, ordered by outstanding requests
+  std::set<std::pair<uint64_t, std::string>> available_;
+
+  // requests as [client identity][request frames...]
+  std::deque<std::vector<Message>> queue_;
+  // frontend is registered with the loop by constructor
+  bool frontendPaused_{true};
+
+  std::unique_ptr<ZmqTimeout> expiryTimer_;
+
+  // counters, only written by broker's thread
+  std::atomic<uint64_t> numRequests_{0};
+  std::atomic<uint64_t> numDispatched_{0};
+  std::atomic<uint64_t> numReplies_{0};
+  std::atomic<uint64_t> numExpiredWorkers_{0};
+  std::atomic<uint64_t> numLostRequests_{0};
+  std::atomic<uint64_t> queueDepth_{0};
+  std::atomic<uint64_t> numOutstanding_{0};
+  std::atomic<uint64_t> numWorkers_{0};
+};
+
+} // namespace fbzmq
@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <set>
+#include <thread>
+
+#include <folly/Format.h>
+#include <folly/ScopeGuard.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/broker/ZmqBroker.h>
+
+using namespace fbzmq;
+
+namespace {
+
+const std::string kFrontendUrl{"inproc://broker-frontend"};
+const std::string kBackendUrl{"inproc://broker-backend"};
+
+// wait for broker's loop to get to expected state
+template <typename Predicate>
+bool
+waitFor(ZmqBroker const& broker, Predicate predicate) {
+  for (int i = 0; i < 1000; ++i) {
+    if (predicate(broker.getStats())) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+// receive request on worker, returns its payload and echoes it back later
+std::string
+recvRequest(
+    Socket<ZMQ_DEALER, ZMQ_CLIENT>& worker, std::vector<Message>& request) {
+  request = worker.recvMultiple(std::chrono::milliseconds(1000)).value();
+  EXPECT_EQ(2, request.size());
+  return request.back().read<std::string>().value();
+}
+
+} // namespace
+
+TEST(ZmqBrokerTest, LeastLoadedDispatch) {
+  Context context;
+  ZmqBroker broker(context, kFrontendUrl, kBackendUrl);
+  std::thread brokerThread([&broker]() { broker.run(); });
+  broker.waitUntilRunning();
+  SCOPE_EXIT {
+    broker.stop();
+    brokerThread.join();
+  };
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> workerA{context, IdentityString{"workerA"}};
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> workerB{context, IdentityString{"workerB"}};
+  workerA.connect(SocketUrl{kBackendUrl}).value();
+  workerB.connect(SocketUrl{kBackendUrl}).value();
+  ZmqBroker::sendCredits(workerA, 1).value();
+  ZmqBroker::sendCredits(workerB, 2).value();
+  ASSERT_TRUE(waitFor(
+      broker, [](ZmqBroker::Stats const& s) { return s.numWorkers == 2; }));
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> client{context};
+  client.connect(SocketUrl{kFrontendUrl}).value();
+  for (int i = 0; i < 4; ++i) {
+    client.sendOne(Message::from(folly::sformat("req-{}", i)).value()).value();
+  }
+
+  // workers get as many requests as they have credits, last one waits
+  ASSERT_TRUE(waitFor(broker, [](ZmqBroker::Stats const& s) {
+    return s.numOutstanding == 3 && s.queueDepth == 1;
+  }));
+  std::vector<Message> reqA;
+  std::vector<Message> reqB1;
+  std::vector<Message> reqB2;
+  EXPECT_EQ("req-0", recvRequest(workerA, reqA));
+  EXPECT_EQ("req-1", recvRequest(workerB, reqB1));
+  EXPECT_EQ("req-2", recvRequest(workerB, reqB2));
+
+  // reply gives credit back, queued request goes to least loaded worker
+  workerB.sendMultiple(reqB1).value();
+  std::vector<Message> reqB3;
+  EXPECT_EQ("req-3", recvRequest(workerB, reqB3));
+
+  workerA.sendMultiple(reqA).value();
+  workerB.sendMultiple(reqB2).value();
+  workerB.sendMultiple(reqB3).value();
+
+  std::set<std::string> replies;
+  for (int i = 0; i < 4; ++i) {
+    auto reply = client.recvOne(std::chrono::milliseconds(1000)).value();
+    replies.insert(reply.read<std::string>().value());
+  }
+  EXPECT_EQ(4, replies.size());
+
+  ASSERT_TRUE(waitFor(
+      broker, [](ZmqBroker::Stats const& s) { return s.numReplies == 4; }));
+  auto stats = broker.getStats();
+  EXPECT_EQ(4, stats.numRequests);
+  EXPECT_EQ(4, stats.numDispatched);
+  EXPECT_EQ(0, stats.numOutstanding);
+  EXPECT_EQ(0, stats.queueDepth);
+
+  ThreadData tData;
+  broker.exportStats(tData, "broker");
+  auto counters = tData.getCounters();
+  EXPECT_EQ(4, counters.at("broker.replies"));
+  EXPECT_EQ(2, counters.at("broker.workers"));
+}
+
+TEST(ZmqBrokerTest, WorkerExpiry) {
+  Context context;
+  ZmqBroker broker(
+      context,
+      kFrontendUrl,
+      kBackendUrl,
+      10 /* maxQueuedRequests */,
+      std::chrono::milliseconds(50) /* workerTimeout */);
+  std::thread brokerThread([&broker]() { broker.run(); });
+  broker.waitUntilRunning();
+  SCOPE_EXIT {
+    broker.stop();
+    brokerThread.join();
+  };
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> worker{context, IdentityString{"worker"}};
+  worker.connect(SocketUrl{kBackendUrl}).value();
+  ZmqBroker::sendCredits(worker, 1).value();
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> client{context};
+  client.connect(SocketUrl{kFrontendUrl}).value();
+  client.sendOne(Message::from(std::string("req")).value()).value();
+
+  // worker never replies, it gets dropped along with its request
+  std::vector<Message> request;
+  EXPECT_EQ("req", recvRequest(worker, request));
+  ASSERT_TRUE(waitFor(broker, [](ZmqBroker::Stats const& s) {
+    return s.numWorkers == 0;
+  }));
+  auto stats = broker.getStats();
+  EXPECT_EQ(1, stats.numExpiredWorkers);
+  EXPECT_EQ(1, stats.numLostRequests);
+  EXPECT_EQ(0, stats.numOutstanding);
+}
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -13,6 +13,9 @@ namespace py fbzmq.Monitor
 typedef map<string, Counter>
   (cpp.type = "std::unordered_map<std::string, Counter>") CounterMap
 
+typedef map<string, i64>
+  (cpp.type = "std::unordered_map<std::string, int64_t>") CounterDeltaMap
+
 enum MonitorCommand {
   // operations on counters in the monitor
   SET_COUNTER_VALUES = 1,
@@ -20,9 +23,15 @@ enum MonitorCommand {
   DUMP_ALL_COUNTER_NAMES = 3,
   DUMP_ALL_COUNTER_DATA = 4
   BUMP_COUNTER = 5,
+  BUMP_COUNTER_BY = 6,
+  GET_COUNTERS_BY_PREFIX = 7,
+  DUMP_COUNTER_DATA_STREAMED = 8,
+  GET_COUNTER_HISTORY = 9,
+  DELETE_COUNTERS = 10,
 
   // operations on logs, which are not saved in the monitor
   LOG_EVENT = 11,
+  LOG_EVENT_BATCH = 12,
 }
 
 //
@@ -59,11 +68,91 @@ struct CounterBumpParams {
   1: list<string> counterNames
 }
 
+// parameters for BUMP_COUNTER_BY command
+struct CounterBumpByParams {
+  // counter name -> delta to add
+  1: CounterDeltaMap counterDeltas
+}
+
+// parameters for GET_COUNTERS_BY_PREFIX command. Counters are scanned in
+// lexicographic order of their names and returned in pages.
+struct CounterQueryParams {
+  // only names starting with prefix, empty for all
+  1: string prefix
+  // glob pattern (fnmatch(3)) names have to match as well, empty for any
+  2: string pattern
+  // resume scan after this name, i.e. `lastCounterName` of previous page
+  3: string startAfter
+  // max number of counters per page, 0 or anything above the monitor's
+  // limit means the limit
+  4: i32 maxCounters
+  // return names only
+  5: bool namesOnly
+}
+
+// parameters for DUMP_COUNTER_DATA_STREAMED command. Counters are streamed
+// in lexicographic order of their names as a sequence of CounterDumpChunk
+// responses, one per iteration of monitor's loop.
+struct CounterDumpParams {
+  // resume after this name, i.e. `continuationToken` of a previous chunk
+  1: string startAfter
+  // max number of counters per chunk, 0 or anything above the monitor's
+  // limit means the limit
+  2: i32 maxCountersPerChunk
+}
+
+// parameters for GET_COUNTER_HISTORY command, monitor must keep history
+struct CounterHistoryParams {
+  1: list<string> counterNames
+  // counters with names starting with prefix as well, unless empty
+  2: string prefix
+}
+
+// parameters for DELETE_COUNTERS command
+struct CounterDeleteParams {
+  1: list<string> counterNames
+  // counters with names starting with prefix as well, unless empty
+  2: string prefix
+}
+
+// Binary encoding of LogSample with a typed column per value type. Columns
+// are keyed by index of the key in EventLog.keys, look at LogSample::appendTo
+struct LogSampleColumns {
+  1: map<i32, i64> ints
+  2: map<i32, double> doubles
+  3: map<i32, string> strings
+  4: map<i32, list<string>> stringVectors
+  5: map<i32, set<string>> stringTagsets
+}
+
 // parameters for LOG_EVENT
 struct EventLog {
   // name/id of the event log
   1: string category
+  // json encoded samples, look at LogSample::toJson
   2: list<string> samples
+  // keys interned by binarySamples
+  3: list<string> keys
+  4: list<LogSampleColumns> binarySamples
+}
+
+enum CompressionType {
+  NONE = 0,
+  ZSTD = 1,
+}
+
+// batch of event logs before compression
+struct EventLogBatch {
+  1: list<EventLog> eventLogs
+}
+
+// parameters for LOG_EVENT_BATCH, compact serialized and compressed
+// EventLogBatch, look at EventLogCodec.h
+struct CompressedEventLogs {
+  1: CompressionType compression
+  2: binary payload
+  3: i32 numEventLogs
+  4: i32 numSamples
 }
 
 //
@@ -77,6 +166,12 @@ struct MonitorRequest {
   3: CounterGetParams counterGetParams
   4: CounterBumpParams counterBumpParams
   5: EventLog eventLog
+  6: CounterBumpByParams counterBumpByParams
+  7: CounterQueryParams counterQueryParams
+  8: CounterDumpParams counterDumpParams
+  9: CounterHistoryParams counterHistoryParams
+  10: CompressedEventLogs compressedEventLogs
+  11: CounterDeleteParams counterDeleteParams
 }
 
 //
@@ -91,6 +186,46 @@ struct CounterNamesResponse {
   1: list<string> counterNames
 }
 
+// page of GET_COUNTERS_BY_PREFIX
+struct CounterQueryResponse {
+  // matching counters, unless `namesOnly` was requested
+  1: CounterMap counters
+  // sorted matching names, if `namesOnly` was requested
+  2: list<string> counterNames
+  // more matching counters after `lastCounterName`
+  3: bool hasMore
+  4: string lastCounterName
+}
+
+// one response of DUMP_COUNTER_DATA_STREAMED
+struct CounterDumpChunk {
+  1: CounterMap counters
+  // position of chunk in the stream, starting with 0
+  2: i32 chunkIndex
+  // name of last counter streamed so far
+  3: string continuationToken
+  // no more chunks follow
+  4: bool last
+}
+
+// aggregates of samples of a counter recorded by monitor within a window
+// ending now, the shorter the window the finer its resolution
+struct WindowStats {
+  // 60, 600 or 3600
+  1: i32 windowSec
+  2: i64 numSamples
+  3: double minValue
+  4: double maxValue
+  5: double avgValue
+  // change of value per second within window, i.e. rate of a COUNTER
+  6: double rate
+}
+
+struct CounterHistoryResponse {
+  // counter name -> stats per window, counters without samples are omitted
+  1: map<string, list<WindowStats>> counterWindows
+}
+
 //
 // Publication
 //
@@ -98,10 +233,13 @@ struct CounterNamesResponse {
 enum PubType {
   COUNTER_PUB = 1,
   EVENT_LOG_PUB = 2,
+  // batch as sent by client, still compressed
+  EVENT_LOG_BATCH_PUB = 3,
 }
 
 struct MonitorPub {
   1: PubType pubType
   2: CounterValuesResponse counterPub
   3: EventLog eventLogPub
+  4: CompressedEventLogs eventLogBatchPub
 }
@@ -9,7 +9,10 @@
 
 #include "LogSample.h"
 
+#include <algorithm>
+
 #include <folly/DynamicConverter.h>
+#include <folly/Format.h>
 #include <folly/json.h>
 
 namespace {
@@ -25,6 +28,20 @@ const std::string STRINGTAGSET_KEY{"tagset"};
 
 const std::string kTimeCol{"time"};
 
+/**
+ * Index of key in keys, appending it if not there yet
+ */
+int32_t
+internKey(std::vector<std::string>& keys, folly::StringPiece key) {
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (key == keys[i]) {
+      return static_cast<int32_t>(i);
+    }
+  }
+  keys.emplace_back(key.str());
+  return static_cast<int32_t>(keys.size() - 1);
+}
+
 } // anonymous namespace
 
 namespace fbzmq {
@@ -75,6 +92,119 @@ LogSample::mergeSample(const LogSample& sample) {
   }
 }
 
+void
+LogSample::mergeInto(thrift::EventLog& eventLog) const {
+  for (auto& sample : eventLog.samples) {
+    try {
+      // throws if this sample doesn't have a timestamp, pass it along without
+      // appending then
+      auto ls = LogSample::fromJson(sample);
+      ls.mergeSample(*this);
+      sample = ls.toJson();
+    } catch (...) {
+    }
+  }
+
+  if (eventLog.binarySamples.empty()) {
+    return;
+  }
+
+  // map::insert doesn't overwrite present entries
+  const auto columns = toColumns(eventLog.keys);
+  for (auto& sample : eventLog.binarySamples) {
+    sample.ints.insert(columns.ints.begin(), columns.ints.end());
+    sample.doubles.insert(columns.doubles.begin(), columns.doubles.end());
+    sample.strings.insert(columns.strings.begin(), columns.strings.end());
+    sample.stringVectors.insert(
+        columns.stringVectors.begin(), columns.stringVectors.end());
+    sample.stringTagsets.insert(
+        columns.stringTagsets.begin(), columns.stringTagsets.end());
+  }
+}
+
+void
+LogSample::appendTo(thrift::EventLog& eventLog) const {
+  eventLog.binarySamples.emplace_back(toColumns(eventLog.keys));
+}
+
+std::vector<LogSample>
+LogSample::fromEventLog(const thrift::EventLog& eventLog) {
+  std::vector<LogSample> samples;
+  samples.reserve(eventLog.samples.size() + eventLog.binarySamples.size());
+  for (auto const& json : eventLog.samples) {
+    samples.emplace_back(fromJson(json));
+  }
+  for (auto const& columns : eventLog.binarySamples) {
+    samples.emplace_back(fromColumns(eventLog, columns));
+  }
+  return samples;
+}
+
+LogSample
+LogSample::fromColumns(
+    const thrift::EventLog& eventLog,
+    const thrift::LogSampleColumns& columns) {
+  auto const& keys = eventLog.keys;
+  auto getKey = [&keys](int32_t index) -> const std::string& {
+    if (index < 0 || static_cast<size_t>(index) >= keys.size()) {
+      throw std::invalid_argument(
+          folly::sformat("invalid key index: {}", index));
+    }
+    return keys[index];
+  };
+
+  // will throw if this sample doesn't have a timestamp
+  const auto timeIndex = std::find(keys.begin(), keys.end(), kTimeCol);
+  const auto timeIt = columns.ints.find(timeIndex - keys.begin());
+  if (timeIt == columns.ints.end()) {
+    throw std::invalid_argument("sample doesn't have a timestamp");
+  }
+
+  LogSample sample(std::chrono::system_clock::time_point(
+      std::chrono::seconds(timeIt->second)));
+  for (auto const& kv : columns.ints) {
+    sample.addInt(getKey(kv.first), kv.second);
+  }
+  for (auto const& kv : columns.doubles) {
+    sample.addDouble(getKey(kv.first), kv.second);
+  }
+  for (auto const& kv : columns.strings) {
+    sample.addString(getKey(kv.first), kv.second);
+  }
+  for (auto const& kv : columns.stringVectors) {
+    sample.addStringVector(getKey(kv.first), kv.second);
+  }
+  for (auto const& kv : columns.stringTagsets) {
+    sample.addStringTagset(getKey(kv.first), kv.second);
+  }
+  return sample;
+}
+
+thrift::LogSampleColumns
+LogSample::toColumns(std::vector<std::string>& keys) const {
+  thrift::LogSampleColumns columns;
+  for (auto const& typeKv : json_.items()) {
+    auto const& keyType = typeKv.first.getString();
+    for (auto const& kv : typeKv.second.items()) {
+      const auto index = internKey(keys, kv.first.getString());
+      if (keyType == INT_KEY) {
+        columns.ints[index] = kv.second.asInt();
+      } else if (keyType == DOUBLE_KEY) {
+        columns.doubles[index] = kv.second.asDouble();
+      } else if (keyType == STRING_KEY) {
+        columns.strings[index] = kv.second.asString();
+      } else if (keyType == STRINGVECTOR_KEY) {
+        columns.stringVectors[index] =
+            folly::convertTo<std::vector<std::string>>(kv.second);
+      } else if (keyType == STRINGTAGSET_KEY) {
+        columns.stringTagsets[index] =
+            folly::convertTo<std::set<std::string>>(kv.second);
+      }
+    }
+  }
+  return columns;
+}
+
 void
 LogSample::addInt(folly::StringPiece key, int64_t value) {
   if (json_.find(INT_KEY) == json_.items().end()) {
@@ -14,6 +14,7 @@
 #include <string>
 #include <vector>
 
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
 #include <folly/Range.h>
 #include <folly/dynamic.h>
 
@@ -38,6 +39,14 @@ namespace fbzmq {
  *    auto json = sample.toJson();
  *    myMonitoringServiceClient.send(sample.json)
  *
+ * Samples can also be carried in binary form within thrift::EventLog, which
+ * spares JSON serialization and parsing and can be merged without decoding:
+ *
+ *    thrift::EventLog eventLog;
+ *    sample.appendTo(eventLog);
+ *    ...
+ *    auto samples = LogSample::fromEventLog(eventLog);
+ *
  * NOTE: Timestamp is critical part of Sample as it tells when event/log was
  * generated. It must be a measurement related to system clock (no steady
  * clock) to get absolute notion of time.
@@ -66,6 +75,21 @@ class LogSample {
    */
   std::string toJson() const;
 
+  /**
+   * Append binary representation of the Sample to `eventLog.binarySamples`,
+   * interning its keys in `eventLog.keys`.
+   */
+  void appendTo(thrift::EventLog& eventLog) const;
+
+  /**
+   * Decode all samples of the eventLog, json and binary ones. Throws if any of
+   * them is malformed or doesn't have a timestamp.
+   */
+  static std::vector<LogSample> fromEventLog(const thrift::EventLog& eventLog);
+  static LogSample fromColumns(
+      const thrift::EventLog& eventLog,
+      const thrift::LogSampleColumns& columns);
+
   /**
    * Get the timestamp associated with this sample.
    */
@@ -78,6 +102,15 @@ class LogSample {
    * Merges two LogSample objects, preferring the values in this.
    */
   void mergeSample(const LogSample& sample);
+
+  /**
+   * Merges this into every sample of eventLog, preferring their values. Json
+   * samples are parsed, merged and serialized back (and left as they are if
+   * malformed), binary samples are merged without decoding by adding missing
+   * column entries.
+   */
+  void mergeInto(thrift::EventLog& eventLog) const;
+
   /**
    * APIs to add different types of values
    */
@@ -109,6 +142,9 @@ class LogSample {
   bool isStringTagsetSet(folly::StringPiece key) const;
 
  private:
+  // binary representation of this sample interning keys in `keys`
+  thrift::LogSampleColumns toColumns(std::vector<std::string>& keys) const;
+
   bool isInnerValueSet(
       folly::StringPiece keyType, folly::StringPiece key) const;
   const folly::dynamic& getInnerValue(
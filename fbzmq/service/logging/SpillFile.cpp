@@ -0,0 +1,154 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "SpillFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+namespace {
+
+// identifies files written by SpillFile, stored in header
+const uint64_t kMagic{0x46425a4d5350494c}; // "FBZMSPIL"
+
+// each record is prefixed by its length
+using RecordLength = uint32_t;
+
+} // namespace
+
+struct SpillFile::Header {
+  uint64_t magic;
+  uint64_t capacity;
+  // offsets of first unconsumed record and of the end of last record
+  uint64_t readOffset;
+  uint64_t writeOffset;
+  uint64_t numRecords;
+};
+
+SpillFile::SpillFile(std::string const& path, size_t capacity)
+    : path_(path), capacity_(capacity) {
+  CHECK_LT(sizeof(Header) + sizeof(RecordLength), capacity_)
+      << "SpillFile capacity too small";
+
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::system_category(), "open " + path_);
+  }
+
+  struct stat st;
+  if (::fstat(fd_, &st) != 0 ||
+      ::ftruncate(fd_, static_cast<off_t>(capacity_)) != 0) {
+    const int err = errno;
+    ::close(fd_);
+    throw std::system_error(err, std::system_category(), "resize " + path_);
+  }
+
+  void* ptr =
+      ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (ptr == MAP_FAILED) {
+    const int err = errno;
+    ::close(fd_);
+    throw std::system_error(err, std::system_category(), "mmap " + path_);
+  }
+  data_ = static_cast<uint8_t*>(ptr);
+
+  // Resume records of previous instance if file was written by one with same
+  // capacity, start afresh otherwise
+  auto& hdr = header();
+  const bool valid = static_cast<size_t>(st.st_size) >= sizeof(Header) &&
+      hdr.magic == kMagic && hdr.capacity == capacity_ &&
+      hdr.readOffset >= sizeof(Header) && hdr.readOffset <= hdr.writeOffset &&
+      hdr.writeOffset <= capacity_;
+  if (!valid) {
+    hdr.magic = kMagic;
+    hdr.capacity = capacity_;
+    hdr.readOffset = sizeof(Header);
+    hdr.writeOffset = sizeof(Header);
+    hdr.numRecords = 0;
+  }
+}
+
+SpillFile::~SpillFile() {
+  ::munmap(data_, capacity_);
+  ::close(fd_);
+}
+
+SpillFile::Header&
+SpillFile::header() const {
+  return *reinterpret_cast<Header*>(data_);
+}
+
+size_t
+SpillFile::getNumRecords() const {
+  return header().numRecords;
+}
+
+size_t
+SpillFile::getUsedBytes() const {
+  return header().writeOffset - header().readOffset;
+}
+
+bool
+SpillFile::append(folly::ByteRange record) {
+  auto& hdr = header();
+  const size_t needed = sizeof(RecordLength) + record.size();
+  if (hdr.writeOffset + needed > capacity_) {
+    // move unconsumed records to the front if that makes room
+    const size_t used = getUsedBytes();
+    if (sizeof(Header) + used + needed > capacity_) {
+      return false;
+    }
+    std::memmove(data_ + sizeof(Header), data_ + hdr.readOffset, used);
+    hdr.readOffset = sizeof(Header);
+    hdr.writeOffset = sizeof(Header) + used;
+  }
+
+  const RecordLength length = record.size();
+  std::memcpy(data_ + hdr.writeOffset, &length, sizeof(length));
+  std::memcpy(
+      data_ + hdr.writeOffset + sizeof(length), record.data(), record.size());
+  hdr.writeOffset += needed;
+  hdr.numRecords += 1;
+  return true;
+}
+
+folly::ByteRange
+SpillFile::front() const {
+  CHECK(!empty());
+  auto const& hdr = header();
+  RecordLength length;
+  std::memcpy(&length, data_ + hdr.readOffset, sizeof(length));
+  return folly::ByteRange(data_ + hdr.readOffset + sizeof(length), length);
+}
+
+void
+SpillFile::pop() {
+  CHECK(!empty());
+  auto& hdr = header();
+  RecordLength length;
+  std::memcpy(&length, data_ + hdr.readOffset, sizeof(length));
+  hdr.readOffset += sizeof(length) + length;
+  hdr.numRecords -= 1;
+  if (hdr.numRecords == 0) {
+    hdr.readOffset = sizeof(Header);
+    hdr.writeOffset = sizeof(Header);
+  }
+}
+
+} // namespace fbzmq
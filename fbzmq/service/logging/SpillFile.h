@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <folly/Range.h>
+
+namespace fbzmq {
+
+/**
+ * FIFO queue of binary records in an append-only memory mapped file of fixed
+ * capacity. Records are appended at the tail and consumed from the head, and
+ * consumed space is reclaimed once the queue drains (or moved over when an
+ * append wouldn't fit otherwise). Offsets are kept in the file's header, so
+ * records survive process restarts and are resumed by next SpillFile opened
+ * on the same path.
+ *
+ * Not thread safe.
+ */
+class SpillFile : public boost::noncopyable {
+ public:
+  /**
+   * Open or create file of `capacity` bytes (including header) at `path`.
+   * Throws std::system_error if file can't be opened or mapped.
+   */
+  SpillFile(std::string const& path, size_t capacity);
+  ~SpillFile();
+
+  /**
+   * Append record, false if it doesn't fit in remaining space
+   */
+  bool append(folly::ByteRange record);
+
+  bool
+  empty() const {
+    return getNumRecords() == 0;
+  }
+
+  size_t getNumRecords() const;
+
+  /**
+   * Bytes used by unconsumed records
+   */
+  size_t getUsedBytes() const;
+
+  /**
+   * Record at the head of the queue, must not be empty. Valid until next
+   * append or pop.
+   */
+  folly::ByteRange front() const;
+
+  /**
+   * Consume record at the head of the queue, must not be empty
+   */
+  void pop();
+
+ private:
+  struct Header;
+
+  Header& header() const;
+
+  const std::string path_;
+  const size_t capacity_{0};
+  int fd_{-1};
+  uint8_t* data_{nullptr};
+};
+
+} // namespace fbzmq
@@ -193,6 +193,61 @@ TEST(LogSampleTest, updateMissingJsonTest) {
   auto resultDynamic = folly::parseJson(sample.toJson());
 }
 
+TEST(LogSampleTest, BinaryTest) {
+  const std::vector<std::string> values = {{"val1", "val2"}};
+  const std::set<std::string> tags = {{"tag1", "tag2"}};
+
+  LogSample sample1(
+      std::chrono::system_clock::time_point(std::chrono::seconds(111)));
+  sample1.addInt("int-key", 123);
+  sample1.addDouble("double-key", 123.456);
+  sample1.addString("string-key", "hello world");
+  sample1.addStringVector("vector-key", values);
+  sample1.addStringTagset("tagset-key", tags);
+  LogSample sample2(
+      std::chrono::system_clock::time_point(std::chrono::seconds(222)));
+  sample2.addInt("int-key", 456);
+
+  // Keys are interned across samples of an event log
+  thrift::EventLog eventLog;
+  eventLog.samples.emplace_back(sample2.toJson());
+  sample1.appendTo(eventLog);
+  sample2.appendTo(eventLog);
+  EXPECT_EQ(6, eventLog.keys.size());
+  EXPECT_EQ(2, eventLog.binarySamples.size());
+
+  // Merge adds missing entries only
+  LogSample toMerge;
+  toMerge.addString("domain", "terragraph");
+  toMerge.addInt("int-key", 789);
+  toMerge.mergeInto(eventLog);
+  EXPECT_EQ(7, eventLog.keys.size());
+
+  auto samples = LogSample::fromEventLog(eventLog);
+  ASSERT_EQ(3, samples.size());
+  EXPECT_EQ(sample2.toJson(), samples[0].toJson());
+  EXPECT_FALSE(samples[0].isStringSet("domain"));
+
+  auto const& decoded = samples[1];
+  EXPECT_EQ(sample1.getTimestamp(), decoded.getTimestamp());
+  EXPECT_EQ(111, decoded.getInt("time"));
+  EXPECT_EQ(123, decoded.getInt("int-key"));
+  EXPECT_EQ(123.456, decoded.getDouble("double-key"));
+  EXPECT_EQ("hello world", decoded.getString("string-key"));
+  EXPECT_EQ(values, decoded.getStringVector("vector-key"));
+  EXPECT_EQ(tags, decoded.getStringTagset("tagset-key"));
+  EXPECT_EQ("terragraph", decoded.getString("domain"));
+  EXPECT_EQ(456, samples[2].getInt("int-key"));
+  EXPECT_EQ("terragraph", samples[2].getString("domain"));
+
+  // Samples without timestamp or valid keys are rejected
+  eventLog.binarySamples.emplace_back();
+  EXPECT_THROW(LogSample::fromEventLog(eventLog), std::invalid_argument);
+  eventLog.binarySamples.back().ints[0] = 1;
+  eventLog.binarySamples.back().ints[42] = 1;
+  EXPECT_THROW(LogSample::fromEventLog(eventLog), std::invalid_argument);
+}
+
 } // namespace fbzmq
 
 int
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <unistd.h>
+
+#include <folly/Format.h>
+#include <folly/ScopeGuard.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/logging/SpillFile.h>
+
+using namespace fbzmq;
+
+TEST(SpillFileTest, ApiTest) {
+  const auto path = folly::sformat("/tmp/fbzmq-spill-file-test-{}", getpid());
+  ::unlink(path.c_str());
+  SCOPE_EXIT {
+    ::unlink(path.c_str());
+  };
+
+  {
+    SpillFile spill(path, 256);
+    EXPECT_TRUE(spill.empty());
+    EXPECT_TRUE(spill.append(folly::StringPiece("first")));
+    EXPECT_TRUE(spill.append(folly::StringPiece("second")));
+    EXPECT_EQ(2, spill.getNumRecords());
+    EXPECT_EQ("first", folly::StringPiece(spill.front()));
+    spill.pop();
+    EXPECT_EQ("second", folly::StringPiece(spill.front()));
+
+    // Records which don't fit are refused
+    EXPECT_FALSE(spill.append(folly::StringPiece(std::string(256, 'x'))));
+    EXPECT_EQ(1, spill.getNumRecords());
+  }
+
+  // Records survive reopening
+  {
+    SpillFile spill(path, 256);
+    EXPECT_EQ(1, spill.getNumRecords());
+    EXPECT_EQ("second", folly::StringPiece(spill.front()));
+
+    // Consumed space is reclaimed
+    const std::string record(100, 'y');
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_TRUE(spill.append(folly::StringPiece(record)));
+      spill.pop();
+      EXPECT_EQ(1, spill.getNumRecords());
+      EXPECT_EQ(record, folly::StringPiece(spill.front()).str());
+    }
+    spill.pop();
+    EXPECT_TRUE(spill.empty());
+    EXPECT_EQ(0, spill.getUsedBytes());
+  }
+
+  // File of different capacity starts afresh
+  {
+    SpillFile spill(path, 256);
+    EXPECT_TRUE(spill.append(folly::StringPiece("third")));
+  }
+  SpillFile spill(path, 512);
+  EXPECT_TRUE(spill.empty());
+}
+
+int
+main(int argc, char* argv[]) {
+  // Parse command line flags
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  // Run the tests
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "CounterHistory.h"
+
+#include <algorithm>
+
+namespace fbzmq {
+
+constexpr size_t CounterHistory::kNumLevels;
+constexpr size_t CounterHistory::kSlotsPerLevel;
+
+namespace {
+
+// Same levels as windows of ExportedStat, except all time
+const std::array<int32_t, CounterHistory::kNumLevels> kLevelSecs = {
+    60, // One minute
+    600, // Ten minutes
+    3600, // One hour
+};
+
+int64_t
+getSlotMs(size_t level) {
+  return kLevelSecs[level] * 1000 / CounterHistory::kSlotsPerLevel;
+}
+
+} // namespace
+
+void
+CounterHistory::addSample(double value, int64_t nowMs) {
+  for (size_t level = 0; level < kNumLevels; ++level) {
+    const int64_t epoch = nowMs / getSlotMs(level);
+    auto& slot = levels_[level][epoch % kSlotsPerLevel];
+    if (slot.epoch != epoch) {
+      // Slot of an expired interval, start over
+      slot.epoch = epoch;
+      slot.firstTs = nowMs;
+      slot.first = value;
+      slot.min = value;
+      slot.max = value;
+      slot.sum = 0;
+      slot.count = 0;
+    }
+    slot.lastTs = nowMs;
+    slot.last = value;
+    slot.min = std::min(slot.min, value);
+    slot.max = std::max(slot.max, value);
+    slot.sum += value;
+    ++slot.count;
+  }
+}
+
+std::vector<thrift::WindowStats>
+CounterHistory::getWindowStats(int64_t nowMs) const {
+  std::vector<thrift::WindowStats> windows;
+  for (size_t level = 0; level < kNumLevels; ++level) {
+    const int64_t currentEpoch = nowMs / getSlotMs(level);
+
+    thrift::WindowStats stats;
+    stats.windowSec = kLevelSecs[level];
+    Slot const* oldest = nullptr;
+    Slot const* newest = nullptr;
+    double sum = 0;
+    for (auto const& slot : levels_[level]) {
+      if (slot.count == 0 or slot.epoch > currentEpoch or
+          slot.epoch <= currentEpoch - static_cast<int64_t>(kSlotsPerLevel)) {
+        continue;
+      }
+      if (stats.numSamples == 0) {
+        stats.minValue = slot.min;
+        stats.maxValue = slot.max;
+      }
+      stats.numSamples += slot.count;
+      stats.minValue = std::min(stats.minValue, slot.min);
+      stats.maxValue = std::max(stats.maxValue, slot.max);
+      sum += slot.sum;
+      if (not oldest or slot.epoch < oldest->epoch) {
+        oldest = &slot;
+      }
+      if (not newest or slot.epoch > newest->epoch) {
+        newest = &slot;
+      }
+    }
+
+    if (stats.numSamples > 0) {
+      stats.avgValue = sum / stats.numSamples;
+      const int64_t elapsedMs = newest->lastTs - oldest->firstTs;
+      if (elapsedMs > 0) {
+        stats.rate = (newest->last - oldest->first) * 1000 / elapsedMs;
+      }
+    }
+    windows.emplace_back(std::move(stats));
+  }
+  return windows;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+
+namespace fbzmq {
+
+/**
+ * Compact history of recent samples of a counter. Every level spans one of
+ * the 60/600/3600 second windows used by ExportedStat and is a ring of
+ * `kSlotsPerLevel` slots, each aggregating samples of its part of the span
+ * (6s, 60s and 360s respectively). Memory footprint is fixed (~2KB) no matter
+ * how often counter gets updated.
+ *
+ * Timestamps are supplied by caller, in milliseconds of a monotonic clock.
+ */
+class CounterHistory {
+ public:
+  static constexpr size_t kNumLevels = 3;
+  static constexpr size_t kSlotsPerLevel = 10;
+
+  /**
+   * Record new value of counter
+   */
+  void addSample(double value, int64_t nowMs);
+
+  /**
+   * Aggregates of samples within every level's window ending at `nowMs`, from
+   * shortest to longest window. Window extends over whole slots, so it covers
+   * a bit less than its span at times.
+   */
+  std::vector<thrift::WindowStats> getWindowStats(int64_t nowMs) const;
+
+ private:
+  struct Slot {
+    // absolute index of slot's interval, i.e. time divided by slot duration
+    int64_t epoch{-1};
+    int64_t firstTs{0};
+    int64_t lastTs{0};
+    double first{0};
+    double last{0};
+    double min{0};
+    double max{0};
+    double sum{0};
+    uint32_t count{0};
+  };
+
+  std::array<std::array<Slot, kSlotsPerLevel>, kNumLevels> levels_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,274 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "CounterSnapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <folly/ExceptionString.h>
+#include <folly/ScopeGuard.h>
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+namespace {
+
+// identifies files written by CounterSnapshot, stored in header
+const uint64_t kMagic{0x46425a4d534e4150}; // "FBZMSNAP"
+const uint32_t kVersion{1};
+
+struct Header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t numCounters;
+};
+
+// fixed part of each record, followed by `nameLength` bytes of name
+struct Record {
+  double value;
+  int64_t timestamp;
+  int32_t valueType;
+  uint32_t nameLength;
+};
+
+static_assert(sizeof(Header) == 24, "unexpected padding of Header");
+static_assert(sizeof(Record) == 24, "unexpected padding of Record");
+
+// Walk records of snapshot, invoking callback for each unless it is null.
+// False if snapshot is malformed.
+bool
+forEachRecord(
+    folly::ByteRange data, CounterSnapshot::CounterCallback const* callback) {
+  Header hdr;
+  if (data.size() < sizeof(hdr)) {
+    return false;
+  }
+  std::memcpy(&hdr, data.data(), sizeof(hdr));
+  if (hdr.magic != kMagic || hdr.version != kVersion) {
+    return false;
+  }
+  data.advance(sizeof(hdr));
+
+  for (uint64_t i = 0; i < hdr.numCounters; ++i) {
+    Record record;
+    if (data.size() < sizeof(record)) {
+      return false;
+    }
+    std::memcpy(&record, data.data(), sizeof(record));
+    data.advance(sizeof(record));
+    if (data.size() < record.nameLength) {
+      return false;
+    }
+    if (callback) {
+      thrift::Counter counter(
+          apache::thrift::FRAGILE,
+          record.value,
+          static_cast<thrift::CounterValueType>(record.valueType),
+          record.timestamp);
+      (*callback)(
+          std::string(
+              reinterpret_cast<const char*>(data.data()), record.nameLength),
+          std::move(counter));
+    }
+    data.advance(record.nameLength);
+  }
+  return data.empty();
+}
+
+void
+appendRecord(
+    std::string& snapshot,
+    folly::StringPiece name,
+    thrift::Counter const& counter) {
+  Record record{counter.value,
+                counter.timestamp,
+                static_cast<int32_t>(counter.valueType),
+                static_cast<uint32_t>(name.size())};
+  snapshot.append(reinterpret_cast<const char*>(&record), sizeof(record));
+  snapshot.append(name.data(), name.size());
+}
+
+void
+appendHeader(std::string& snapshot, uint64_t numCounters) {
+  Header hdr{kMagic, kVersion, 0, numCounters};
+  snapshot.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+}
+
+} // namespace
+
+std::string
+CounterSnapshot::encode(CounterMap const& counters) {
+  size_t size = sizeof(Header);
+  for (auto const& kv : counters) {
+    size += sizeof(Record) + kv.first.size();
+  }
+
+  std::string snapshot;
+  snapshot.reserve(size);
+  appendHeader(snapshot, counters.size());
+  for (auto const& kv : counters) {
+    appendRecord(snapshot, kv.first, kv.second);
+  }
+  return snapshot;
+}
+
+std::string
+CounterSnapshot::encode(CounterStore const& counters) {
+  size_t size = sizeof(Header);
+  counters.forEachCounter([&size](folly::StringPiece name, thrift::Counter) {
+    size += sizeof(Record) + name.size();
+  });
+
+  std::string snapshot;
+  snapshot.reserve(size);
+  appendHeader(snapshot, counters.size());
+  counters.forEachCounter(
+      [&snapshot](folly::StringPiece name, thrift::Counter const& counter) {
+        appendRecord(snapshot, name, counter);
+      });
+  return snapshot;
+}
+
+void
+CounterSnapshot::write(std::string const& path, folly::StringPiece snapshot) {
+  const auto tmpPath = path + ".tmp";
+  const int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(), "open " + tmpPath);
+  }
+  auto closeGuard = folly::makeGuard([fd] { ::close(fd); });
+
+  while (not snapshot.empty()) {
+    const auto written = ::write(fd, snapshot.data(), snapshot.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(
+          errno, std::system_category(), "write " + tmpPath);
+    }
+    snapshot.advance(written);
+  }
+  if (::fsync(fd) != 0) {
+    throw std::system_error(errno, std::system_category(), "fsync " + tmpPath);
+  }
+
+  closeGuard.dismiss();
+  ::close(fd);
+  if (::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    throw std::system_error(errno, std::system_category(), "rename " + path);
+  }
+}
+
+size_t
+CounterSnapshot::load(
+    std::string const& path, CounterCallback const& callback) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      LOG(ERROR) << "CounterSnapshot: Could not open " << path << ": "
+                 << std::strerror(errno);
+    }
+    return 0;
+  }
+  SCOPE_EXIT {
+    ::close(fd);
+  };
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+    return 0;
+  }
+  const size_t size = st.st_size;
+  void* ptr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (ptr == MAP_FAILED) {
+    LOG(ERROR) << "CounterSnapshot: Could not mmap " << path << ": "
+               << std::strerror(errno);
+    return 0;
+  }
+  SCOPE_EXIT {
+    ::munmap(ptr, size);
+  };
+
+  // validate whole snapshot first, so malformed one loads nothing
+  const folly::ByteRange data(static_cast<const uint8_t*>(ptr), size);
+  if (not forEachRecord(data, nullptr)) {
+    LOG(ERROR) << "CounterSnapshot: Ignoring malformed snapshot " << path;
+    return 0;
+  }
+  Header hdr;
+  std::memcpy(&hdr, data.data(), sizeof(hdr));
+  forEachRecord(data, &callback);
+  return hdr.numCounters;
+}
+
+CounterSnapshotWriter::CounterSnapshotWriter(std::string const& path)
+    : path_(path), thread_([this]() { run(); }) {}
+
+CounterSnapshotWriter::~CounterSnapshotWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void
+CounterSnapshotWriter::submit(std::string snapshot) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ = std::move(snapshot);
+  }
+  cv_.notify_all();
+}
+
+void
+CounterSnapshotWriter::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return not pending_.hasValue() and not writing_; });
+}
+
+void
+CounterSnapshotWriter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stop_ or pending_.hasValue(); });
+    // pending snapshot is written before stopping
+    if (not pending_.hasValue()) {
+      return;
+    }
+    auto snapshot = std::move(*pending_);
+    pending_.clear();
+    writing_ = true;
+    lock.unlock();
+
+    try {
+      CounterSnapshot::write(path_, snapshot);
+      numWritten_.fetch_add(1, std::memory_order_relaxed);
+    } catch (std::exception const& e) {
+      numErrors_.fetch_add(1, std::memory_order_relaxed);
+      LOG(ERROR) << "CounterSnapshotWriter: " << folly::exceptionStr(e);
+    }
+
+    lock.lock();
+    writing_ = false;
+    cv_.notify_all();
+  }
+}
+
+} // namespace fbzmq
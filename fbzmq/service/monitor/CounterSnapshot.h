@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/noncopyable.hpp>
+#include <fbzmq/service/monitor/CounterStore.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+
+namespace fbzmq {
+
+/**
+ * Compact binary snapshot of monitor counters, used for warm restarts of
+ * ZmqMonitor. File consists of a header followed by one record per counter,
+ * i.e. fixed size value, type and timestamp followed by counter's name.
+ * Snapshots are written to a temporary file which is renamed over the
+ * previous one, so readers never see a partially written snapshot.
+ */
+class CounterSnapshot {
+ public:
+  using CounterCallback =
+      std::function<void(std::string&& name, thrift::Counter&& counter)>;
+
+  /**
+   * Encode counters into snapshot, as written to file
+   */
+  static std::string encode(CounterMap const& counters);
+  static std::string encode(CounterStore const& counters);
+
+  /**
+   * Atomically replace file at `path` with `snapshot`. Throws
+   * std::system_error on failure.
+   */
+  static void write(std::string const& path, folly::StringPiece snapshot);
+
+  /**
+   * Map snapshot file at `path` and invoke callback for each of its counters.
+   * Returns number of counters loaded, none if file is missing or malformed.
+   */
+  static size_t load(std::string const& path, CounterCallback const& callback);
+};
+
+/**
+ * Writes snapshots submitted by the monitor's loop from a background thread
+ * of its own, so file I/O never blocks the loop. Only the latest snapshot
+ * submitted while a write is in progress is kept. Pending snapshot is
+ * written before destruction completes.
+ */
+class CounterSnapshotWriter : public boost::noncopyable {
+ public:
+  explicit CounterSnapshotWriter(std::string const& path);
+  ~CounterSnapshotWriter();
+
+  /**
+   * Queue snapshot for writing, replacing one still waiting to be written
+   */
+  void submit(std::string snapshot);
+
+  /**
+   * Wait until queued snapshot (if any) has been written
+   */
+  void flush();
+
+  uint64_t
+  getNumWritten() const {
+    return numWritten_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t
+  getNumErrors() const {
+    return numErrors_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void run();
+
+  const std::string path_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  folly::Optional<std::string> pending_;
+  bool writing_{false};
+  bool stop_{false};
+
+  std::atomic<uint64_t> numWritten_{0};
+  std::atomic<uint64_t> numErrors_{0};
+
+  std::thread thread_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,425 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "CounterStore.h"
+
+#include <fnmatch.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <limits>
+
+#include <folly/Hash.h>
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+constexpr int32_t CounterStore::kMaxPageSize;
+
+namespace {
+
+// Initial size of hash table, it is doubled once more than half full
+const size_t kMinSlots{64};
+
+// Arena isn't compacted while erased names take less than this
+const size_t kMinNameGarbage{4096};
+
+int64_t
+getSteadyMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+CounterStore::CounterStore(bool keepHistory)
+    : keepHistory_(keepHistory), slots_(kMinSlots) {}
+
+uint64_t
+CounterStore::hashName(folly::StringPiece name) {
+  return folly::hash::fnv64_buf(name.data(), name.size());
+}
+
+void
+CounterStore::setCounter(
+    folly::StringPiece name, thrift::Counter const& counter) {
+  const auto index = getOrCreateCounter(name);
+  values_[index] = counter.value;
+  timestamps_[index] = counter.timestamp;
+  valueTypes_[index] = static_cast<uint8_t>(counter.valueType);
+  recordUpdate(index);
+}
+
+thrift::Counter
+CounterStore::bumpCounter(folly::StringPiece name, double delta) {
+  const auto index = getOrCreateCounter(name);
+  values_[index] += delta;
+  recordUpdate(index);
+  return getCounterAt(index);
+}
+
+void
+CounterStore::recordUpdate(uint32_t index) {
+  const auto nowMs = getSteadyMs();
+  updateTimesMs_[index] = nowMs;
+  if (keepHistory_) {
+    histories_[index]->addSample(values_[index], nowMs);
+  }
+}
+
+thrift::Counter
+CounterStore::getCounterAt(uint32_t index) const {
+  return thrift::Counter(
+      apache::thrift::FRAGILE,
+      values_[index],
+      static_cast<thrift::CounterValueType>(valueTypes_[index]),
+      timestamps_[index]);
+}
+
+size_t
+CounterStore::findSlot(folly::StringPiece name, uint64_t hash) const {
+  const size_t mask = slots_.size() - 1;
+  const auto tag = static_cast<uint32_t>(hash);
+  for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+    auto const& slot = slots_[pos];
+    if (slot.index == 0 ||
+        (slot.hash == tag && getName(slot.index - 1) == name)) {
+      return pos;
+    }
+  }
+}
+
+uint32_t
+CounterStore::getOrCreateCounter(folly::StringPiece name) {
+  const auto hash = hashName(name);
+  auto pos = findSlot(name, hash);
+  if (slots_[pos].index != 0) {
+    return slots_[pos].index - 1;
+  }
+
+  // positions and arena offsets are 32 bits
+  CHECK_LT(size(), std::numeric_limits<uint32_t>::max() - 1);
+  CHECK_LT(
+      nameArena_.size() + name.size(), std::numeric_limits<uint32_t>::max());
+  const auto index = static_cast<uint32_t>(size());
+  nameOffsets_.push_back(nameArena_.size());
+  nameLengths_.push_back(name.size());
+  nameArena_.insert(nameArena_.end(), name.begin(), name.end());
+  nameArena_.push_back('\0');
+  values_.push_back(0);
+  timestamps_.push_back(std::time(nullptr));
+  valueTypes_.push_back(
+      static_cast<uint8_t>(thrift::CounterValueType::COUNTER));
+  updateTimesMs_.push_back(getSteadyMs());
+  if (keepHistory_) {
+    histories_.emplace_back(std::make_unique<CounterHistory>());
+  }
+
+  slots_[pos].hash = static_cast<uint32_t>(hash);
+  slots_[pos].index = index + 1;
+  if (size() * 2 > slots_.size()) {
+    rehash(slots_.size() * 2);
+  }
+  return index;
+}
+
+void
+CounterStore::rehash(size_t numSlots) {
+  std::vector<Slot> oldSlots(numSlots);
+  oldSlots.swap(slots_);
+  const size_t mask = numSlots - 1;
+  for (auto const& slot : oldSlots) {
+    if (slot.index == 0) {
+      continue;
+    }
+    size_t pos = slot.hash & mask;
+    while (slots_[pos].index != 0) {
+      pos = (pos + 1) & mask;
+    }
+    slots_[pos] = slot;
+  }
+}
+
+void
+CounterStore::removeSlot(size_t pos) {
+  const size_t mask = slots_.size() - 1;
+  size_t hole = pos;
+  for (size_t next = (hole + 1) & mask; slots_[next].index != 0;
+       next = (next + 1) & mask) {
+    // entry can fill the hole unless its home lies between hole and it
+    const size_t home = slots_[next].hash & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      slots_[hole] = slots_[next];
+      hole = next;
+    }
+  }
+  slots_[hole] = Slot{};
+}
+
+void
+CounterStore::eraseAt(uint32_t index, size_t pos) {
+  removeSlot(pos);
+  nameGarbage_ += nameLengths_[index] + 1;
+
+  // move last counter into erased position
+  const uint32_t last = size() - 1;
+  if (index != last) {
+    const auto lastName = getName(last);
+    slots_[findSlot(lastName, hashName(lastName))].index = index + 1;
+    nameOffsets_[index] = nameOffsets_[last];
+    nameLengths_[index] = nameLengths_[last];
+    values_[index] = values_[last];
+    timestamps_[index] = timestamps_[last];
+    valueTypes_[index] = valueTypes_[last];
+    updateTimesMs_[index] = updateTimesMs_[last];
+    if (keepHistory_) {
+      histories_[index] = std::move(histories_[last]);
+    }
+  }
+  nameOffsets_.pop_back();
+  nameLengths_.pop_back();
+  values_.pop_back();
+  timestamps_.pop_back();
+  valueTypes_.pop_back();
+  updateTimesMs_.pop_back();
+  if (keepHistory_) {
+    histories_.pop_back();
+  }
+
+  // positions have changed, index is rebuilt by next query
+  sortedIndex_.clear();
+  if (nameGarbage_ >= kMinNameGarbage && nameGarbage_ * 2 > nameArena_.size()) {
+    compactNames();
+  }
+}
+
+void
+CounterStore::compactNames() {
+  std::vector<char> arena;
+  arena.reserve(nameArena_.size() - nameGarbage_);
+  for (uint32_t index = 0; index < size(); ++index) {
+    const auto name = getName(index);
+    nameOffsets_[index] = arena.size();
+    arena.insert(arena.end(), name.begin(), name.end() + 1);
+  }
+  nameArena_.swap(arena);
+  nameGarbage_ = 0;
+}
+
+bool
+CounterStore::eraseCounter(folly::StringPiece name) {
+  const auto pos = findSlot(name, hashName(name));
+  if (slots_[pos].index == 0) {
+    return false;
+  }
+  eraseAt(slots_[pos].index - 1, pos);
+  return true;
+}
+
+size_t
+CounterStore::eraseCountersByPrefix(folly::StringPiece prefix) {
+  // collect names first, erasing invalidates sorted index
+  updateSortedIndex();
+  std::vector<std::string> names;
+  for (auto it = std::lower_bound(
+           sortedIndex_.begin(),
+           sortedIndex_.end(),
+           prefix,
+           [this](uint32_t index, folly::StringPiece name) {
+             return getName(index) < name;
+           });
+       it != sortedIndex_.end() && getName(*it).startsWith(prefix);
+       ++it) {
+    names.emplace_back(getName(*it).str());
+  }
+  for (auto const& name : names) {
+    eraseCounter(name);
+  }
+  return names.size();
+}
+
+size_t
+CounterStore::expireCounters(
+    std::chrono::milliseconds ttl, size_t maxScanned) {
+  const auto cutoffMs = getSteadyMs() - ttl.count();
+  const size_t numScans = std::min(maxScanned, size());
+  size_t numExpired = 0;
+  for (size_t i = 0; i < numScans && size() > 0; ++i) {
+    // Start over from last counter once first one has been looked at.
+    // Counters moved into erased positions have been looked at already.
+    if (sweepPos_ == 0 || sweepPos_ > size()) {
+      sweepPos_ = size();
+    }
+    const auto index = static_cast<uint32_t>(--sweepPos_);
+    if (updateTimesMs_[index] > cutoffMs) {
+      continue;
+    }
+    const auto name = getName(index);
+    eraseAt(index, findSlot(name, hashName(name)));
+    ++numExpired;
+  }
+  return numExpired;
+}
+
+folly::Optional<thrift::Counter>
+CounterStore::getCounter(folly::StringPiece name) const {
+  const auto& slot = slots_[findSlot(name, hashName(name))];
+  if (slot.index == 0) {
+    return folly::none;
+  }
+  return getCounterAt(slot.index - 1);
+}
+
+CounterMap
+CounterStore::getCounters() const {
+  CounterMap counters;
+  counters.reserve(size());
+  forEachCounter(
+      [&counters](folly::StringPiece name, thrift::Counter const& counter) {
+        counters.emplace(name.str(), counter);
+      });
+  return counters;
+}
+
+std::vector<std::string>
+CounterStore::getCounterNames() const {
+  std::vector<std::string> names;
+  names.reserve(size());
+  for (uint32_t index = 0; index < size(); ++index) {
+    names.emplace_back(getName(index).str());
+  }
+  return names;
+}
+
+size_t
+CounterStore::getMemoryUsage() const {
+  return sizeof(*this) + nameArena_.capacity() +
+      nameOffsets_.capacity() * sizeof(uint32_t) +
+      nameLengths_.capacity() * sizeof(uint32_t) +
+      values_.capacity() * sizeof(double) +
+      timestamps_.capacity() * sizeof(int64_t) + valueTypes_.capacity() +
+      updateTimesMs_.capacity() * sizeof(int64_t) +
+      histories_.capacity() * sizeof(std::unique_ptr<CounterHistory>) +
+      slots_.capacity() * sizeof(Slot) +
+      sortedIndex_.capacity() * sizeof(uint32_t);
+}
+
+void
+CounterStore::updateSortedIndex() const {
+  const size_t numSorted = sortedIndex_.size();
+  if (numSorted == size()) {
+    return;
+  }
+
+  // sort new counters on their own and merge them in
+  for (uint32_t index = numSorted; index < size(); ++index) {
+    sortedIndex_.push_back(index);
+  }
+  auto byName = [this](uint32_t lhs, uint32_t rhs) {
+    return getName(lhs) < getName(rhs);
+  };
+  std::sort(sortedIndex_.begin() + numSorted, sortedIndex_.end(), byName);
+  std::inplace_merge(
+      sortedIndex_.begin(),
+      sortedIndex_.begin() + numSorted,
+      sortedIndex_.end(),
+      byName);
+}
+
+thrift::CounterQueryResponse
+CounterStore::query(thrift::CounterQueryParams const& params) const {
+  updateSortedIndex();
+  const folly::StringPiece prefix(params.prefix);
+  const int32_t maxCounters = params.maxCounters > 0
+      ? std::min(params.maxCounters, kMaxPageSize)
+      : kMaxPageSize;
+
+  // start at first name of prefix (inclusive) unless resuming past it
+  const folly::StringPiece startAfter(params.startAfter);
+  auto it = params.startAfter.empty() || startAfter < prefix
+      ? std::lower_bound(
+            sortedIndex_.begin(),
+            sortedIndex_.end(),
+            prefix,
+            [this](uint32_t index, folly::StringPiece name) {
+              return getName(index) < name;
+            })
+      : std::upper_bound(
+            sortedIndex_.begin(),
+            sortedIndex_.end(),
+            startAfter,
+            [this](folly::StringPiece name, uint32_t index) {
+              return name < getName(index);
+            });
+
+  thrift::CounterQueryResponse response;
+  int32_t numCounters = 0;
+  for (; it != sortedIndex_.end() && getName(*it).startsWith(prefix); ++it) {
+    const auto name = getName(*it);
+    // names in arena are null terminated
+    if (not params.pattern.empty() &&
+        fnmatch(params.pattern.c_str(), name.data(), 0) != 0) {
+      continue;
+    }
+    if (numCounters == maxCounters) {
+      response.hasMore = true;
+      break;
+    }
+    ++numCounters;
+    if (params.namesOnly) {
+      response.counterNames.emplace_back(name.str());
+    } else {
+      response.counters.emplace(name.str(), getCounterAt(*it));
+    }
+    response.lastCounterName = name.str();
+  }
+  return response;
+}
+
+thrift::CounterHistoryResponse
+CounterStore::getHistory(thrift::CounterHistoryParams const& params) const {
+  thrift::CounterHistoryResponse response;
+  if (not keepHistory_) {
+    return response;
+  }
+
+  const auto nowMs = getSteadyMs();
+  for (auto const& name : params.counterNames) {
+    const auto& slot = slots_[findSlot(name, hashName(name))];
+    if (slot.index != 0) {
+      response.counterWindows[name] =
+          histories_[slot.index - 1]->getWindowStats(nowMs);
+    }
+  }
+
+  if (params.prefix.empty()) {
+    return response;
+  }
+  updateSortedIndex();
+  const folly::StringPiece prefix(params.prefix);
+  auto it = std::lower_bound(
+      sortedIndex_.begin(),
+      sortedIndex_.end(),
+      prefix,
+      [this](uint32_t index, folly::StringPiece name) {
+        return getName(index) < name;
+      });
+  int32_t numMatched = 0;
+  for (; it != sortedIndex_.end() && getName(*it).startsWith(prefix) &&
+       numMatched < kMaxPageSize;
+       ++it, ++numMatched) {
+    response.counterWindows[getName(*it).str()] =
+        histories_[*it]->getWindowStats(nowMs);
+  }
+  return response;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/service/monitor/CounterHistory.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+
+namespace fbzmq {
+
+using CounterMap =
+    std::unordered_map<std::string /* counter name */, thrift::Counter>;
+
+/**
+ * Counters of a monitor keyed by name, stored column-wise for compactness
+ * and sequential scans. Names are interned back to back (null terminated) in
+ * a single arena, and values, types and timestamps are kept in parallel
+ * arrays indexed by counter's position. An open addressing hash table maps
+ * names to positions. Sorted index of positions serves prefix scans and
+ * paging, it is updated lazily by queries if counters have been added since.
+ * Counters are erased by moving last counter into their position, which
+ * keeps columns dense but invalidates the sorted index (rebuilt by next
+ * query) and positions in the arena are reclaimed once half of it is unused.
+ *
+ * Time of last update of each counter is tracked as well (on monotonic clock
+ * of the store, regardless of counter's timestamp), for expiry of counters
+ * which stopped being updated.
+ *
+ * With `keepHistory` every update is recorded in counter's CounterHistory as
+ * well. Not thread-safe, it is meant to be owned by a single event loop.
+ */
+class CounterStore {
+ public:
+  // Max number of counters returned by single `query`
+  static constexpr int32_t kMaxPageSize = 10000;
+
+  explicit CounterStore(bool keepHistory = false);
+
+  CounterStore(CounterStore const&) = delete;
+  CounterStore& operator=(CounterStore const&) = delete;
+
+  void setCounter(folly::StringPiece name, thrift::Counter const& counter);
+
+  /**
+   * Add delta to counter, which is created as COUNTER with zero value if
+   * missing. Returns updated counter.
+   */
+  thrift::Counter bumpCounter(folly::StringPiece name, double delta);
+
+  /**
+   * Counter with given name, if any
+   */
+  folly::Optional<thrift::Counter> getCounter(folly::StringPiece name) const;
+
+  /**
+   * Erase counter with given name, false if there is no such counter
+   */
+  bool eraseCounter(folly::StringPiece name);
+
+  /**
+   * Erase all counters with names starting with prefix. Returns number of
+   * erased counters.
+   */
+  size_t eraseCountersByPrefix(folly::StringPiece prefix);
+
+  /**
+   * Incremental sweep erasing counters not updated for `ttl`. Every call
+   * looks at up to `maxScanned` counters, resuming where previous call
+   * stopped, so a sweep over all counters can be spread over many calls.
+   * Returns number of erased counters.
+   */
+  size_t expireCounters(std::chrono::milliseconds ttl, size_t maxScanned);
+
+  /**
+   * Copy of all counters and their names, in no particular order
+   */
+  CounterMap getCounters() const;
+  std::vector<std::string> getCounterNames() const;
+
+  /**
+   * Invoke `fn(folly::StringPiece name, thrift::Counter const& counter)` for
+   * every counter, in order of their creation. Names are valid until next
+   * update of the store.
+   */
+  template <typename Fn>
+  void
+  forEachCounter(Fn&& fn) const {
+    for (uint32_t i = 0; i < size(); ++i) {
+      fn(getName(i), getCounterAt(i));
+    }
+  }
+
+  size_t
+  size() const {
+    return values_.size();
+  }
+
+  /**
+   * Page of counters matching query, in lexicographic order of names. Look
+   * at thrift::CounterQueryParams. Page size is limited to `kMaxPageSize`.
+   */
+  thrift::CounterQueryResponse query(
+      thrift::CounterQueryParams const& params) const;
+
+  /**
+   * Windowed stats of requested counters, empty unless history is kept. At
+   * most `kMaxPageSize` counters are matched by prefix.
+   */
+  thrift::CounterHistoryResponse getHistory(
+      thrift::CounterHistoryParams const& params) const;
+
+  /**
+   * Approximate heap memory used by the store, in bytes (excluding history)
+   */
+  size_t getMemoryUsage() const;
+
+ private:
+  // Entry of hash table, position of counter plus one (zero if slot is
+  // empty) along with lower half of hash of its name, i.e. slot's home
+  // position in tables of up to 2^32 slots
+  struct Slot {
+    uint32_t hash{0};
+    uint32_t index{0};
+  };
+
+  static uint64_t hashName(folly::StringPiece name);
+
+  folly::StringPiece
+  getName(uint32_t index) const {
+    return folly::StringPiece(
+        nameArena_.data() + nameOffsets_[index], nameLengths_[index]);
+  }
+
+  thrift::Counter getCounterAt(uint32_t index) const;
+
+  // Slot of counter with given name, or the empty slot it would go into
+  size_t findSlot(folly::StringPiece name, uint64_t hash) const;
+
+  // Clear slot, shifting back entries of its probe sequence
+  void removeSlot(size_t pos);
+
+  // Erase counter at given position, which is found in slot `pos`
+  void eraseAt(uint32_t index, size_t pos);
+
+  // Rewrite arena without names of erased counters
+  void compactNames();
+
+  // Position of counter with given name, created as COUNTER with zero value
+  // if missing
+  uint32_t getOrCreateCounter(folly::StringPiece name);
+
+  // Grow hash table to `numSlots` (power of two) and re-insert counters
+  void rehash(size_t numSlots);
+
+  // Merge counters created since last call into sorted index
+  void updateSortedIndex() const;
+
+  // Record update of counter, in its history too if kept
+  void recordUpdate(uint32_t index);
+
+  const bool keepHistory_{false};
+
+  // Names of counters, back to back and null terminated, and number of
+  // bytes still taken by erased ones
+  std::vector<char> nameArena_;
+  size_t nameGarbage_{0};
+
+  // Columns, indexed by position of counter
+  std::vector<uint32_t> nameOffsets_;
+  std::vector<uint32_t> nameLengths_;
+  std::vector<double> values_;
+  std::vector<int64_t> timestamps_;
+  std::vector<uint8_t> valueTypes_;
+  std::vector<int64_t> updateTimesMs_;
+
+  // History of counters, if kept
+  std::vector<std::unique_ptr<CounterHistory>> histories_;
+
+  // Hash table with linear probing, size is a power of two
+  std::vector<Slot> slots_;
+
+  // Position of next counter looked at by `expireCounters`, counters are
+  // swept from last to first
+  size_t sweepPos_{0};
+
+  // Positions of counters sorted by their names
+  mutable std::vector<uint32_t> sortedIndex_;
+};
+
+} // namespace fbzmq
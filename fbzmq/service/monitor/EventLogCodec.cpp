@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "EventLogCodec.h"
+
+#include <stdexcept>
+
+#include <fbzmq/zmq/Common.h>
+#include <folly/ExceptionString.h>
+#include <folly/Format.h>
+#include <folly/io/Compression.h>
+#include <folly/io/IOBuf.h>
+#include <glog/logging.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+namespace fbzmq {
+
+thrift::CompressedEventLogs
+compressEventLogs(
+    std::vector<thrift::EventLog> eventLogs,
+    thrift::CompressionType compression) {
+  thrift::CompressedEventLogs compressed;
+  compressed.compression = compression;
+  compressed.numEventLogs = eventLogs.size();
+  compressed.numSamples = 0;
+  for (auto const& eventLog : eventLogs) {
+    compressed.numSamples +=
+        eventLog.samples.size() + eventLog.binarySamples.size();
+  }
+
+  thrift::EventLogBatch batch;
+  batch.eventLogs = std::move(eventLogs);
+  apache::thrift::CompactSerializer serializer;
+  auto serialized = util::writeThriftObjStr(batch, serializer);
+
+  switch (compression) {
+  case thrift::CompressionType::NONE:
+    compressed.payload = std::move(serialized);
+    break;
+  case thrift::CompressionType::ZSTD: {
+    auto codec = folly::io::getCodec(folly::io::CodecType::ZSTD);
+    auto buf = folly::IOBuf::wrapBuffer(serialized.data(), serialized.size());
+    compressed.payload =
+        codec->compress(buf.get())->moveToFbString().toStdString();
+    break;
+  }
+  default:
+    throw std::runtime_error(folly::sformat(
+        "unsupported compression type: {}", static_cast<int>(compression)));
+  }
+  return compressed;
+}
+
+std::vector<thrift::EventLog>
+decompressEventLogs(thrift::CompressedEventLogs const& compressed) {
+  std::string serialized;
+  switch (compressed.compression) {
+  case thrift::CompressionType::NONE:
+    serialized = compressed.payload;
+    break;
+  case thrift::CompressionType::ZSTD: {
+    auto codec = folly::io::getCodec(folly::io::CodecType::ZSTD);
+    auto buf = folly::IOBuf::wrapBuffer(
+        compressed.payload.data(), compressed.payload.size());
+    serialized = codec->uncompress(buf.get())->moveToFbString().toStdString();
+    break;
+  }
+  default:
+    throw std::runtime_error(folly::sformat(
+        "unsupported compression type: {}",
+        static_cast<int>(compressed.compression)));
+  }
+
+  apache::thrift::CompactSerializer serializer;
+  auto batch =
+      util::readThriftObjStr<thrift::EventLogBatch>(serialized, serializer);
+  if (batch.eventLogs.size() != static_cast<size_t>(compressed.numEventLogs)) {
+    throw std::runtime_error(folly::sformat(
+        "expected {} event logs, decoded {}",
+        compressed.numEventLogs,
+        batch.eventLogs.size()));
+  }
+  return std::move(batch.eventLogs);
+}
+
+void
+mergeIntoEventLogs(
+    LogSample const& sample, thrift::CompressedEventLogs& compressed) {
+  try {
+    auto eventLogs = decompressEventLogs(compressed);
+    for (auto& eventLog : eventLogs) {
+      sample.mergeInto(eventLog);
+    }
+    compressed =
+        compressEventLogs(std::move(eventLogs), compressed.compression);
+  } catch (std::exception const& e) {
+    LOG(ERROR) << "Failed to merge into event log batch: "
+               << folly::exceptionStr(e);
+  }
+}
+
+} // namespace fbzmq
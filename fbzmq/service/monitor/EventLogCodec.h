@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/service/logging/LogSample.h>
+
+namespace fbzmq {
+
+/**
+ * Encode event logs as single payload of LOG_EVENT_BATCH request, compact
+ * serialized thrift::EventLogBatch compressed with given codec.
+ */
+thrift::CompressedEventLogs compressEventLogs(
+    std::vector<thrift::EventLog> eventLogs,
+    thrift::CompressionType compression = thrift::CompressionType::ZSTD);
+
+/**
+ * Decode payload created by compressEventLogs, e.g. of EVENT_LOG_BATCH_PUB
+ * publications. Throws std::runtime_error on malformed payload.
+ */
+std::vector<thrift::EventLog> decompressEventLogs(
+    thrift::CompressedEventLogs const& compressed);
+
+/**
+ * Merge sample into every event log of compressed batch, look at
+ * LogSample::mergeInto. Batch is decoded and encoded back, malformed batch is
+ * left as it is.
+ */
+void mergeIntoEventLogs(
+    LogSample const& sample, thrift::CompressedEventLogs& compressed);
+
+} // namespace fbzmq
@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "EventLogSink.h"
+
+namespace fbzmq {
+
+namespace {
+
+// Requests sent per loop iteration, to not starve other events of the loop
+const size_t kMaxSendsPerDrain{1000};
+
+} // namespace
+
+EventLogSink::EventLogSink(
+    Context& zmqContext,
+    std::string const& monitorCmdUrl,
+    size_t maxBufferedLogs,
+    std::string const& spillFilePath,
+    size_t maxSpillBytes,
+    std::chrono::milliseconds retryInterval)
+    : retryInterval_(retryInterval),
+      monitorCmdSock_{
+          zmqContext, folly::none, folly::none, NonblockingFlag{true}},
+      maxBufferedLogs_(maxBufferedLogs) {
+  CHECK_LT(0, maxBufferedLogs_);
+
+  // hold messages back while monitor isn't connected
+  const int immediate = 1;
+  const auto immediateRet = monitorCmdSock_.setSockOpt(
+      ZMQ_IMMEDIATE, &immediate, sizeof(immediate));
+  if (immediateRet.hasError()) {
+    LOG(FATAL) << "EventLogSink: Could not set ZMQ_IMMEDIATE "
+               << immediateRet.error();
+  }
+  if (monitorCmdSock_.connect(SocketUrl{monitorCmdUrl}).hasError()) {
+    LOG(FATAL) << "Error connecting to monitor '" << monitorCmdUrl << "'";
+  }
+
+  if (!spillFilePath.empty()) {
+    spillFile_ = std::make_unique<SpillFile>(spillFilePath, maxSpillBytes);
+  }
+
+  retryTimer_ = ZmqTimeout::make(this, [this]() noexcept { drain(); });
+
+  // replay what previous instance has left in spill file
+  if (spillFile_ && !spillFile_->empty()) {
+    drainScheduled_ = true;
+    runInEventLoop([this]() noexcept {
+      drainScheduled_ = false;
+      drain();
+    });
+  }
+}
+
+bool
+EventLogSink::addEventLog(thrift::EventLog const& eventLog) {
+  ++numAdded_;
+
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::LOG_EVENT;
+  thriftReq.eventLog = eventLog;
+  auto request = util::writeThriftObjStr(thriftReq, serializer_);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const bool spilling = spillFile_ && !spillFile_->empty();
+    if (!spilling && ring_.size() < maxBufferedLogs_) {
+      ring_.emplace_back(std::move(request));
+    } else if (spillFile_ && spillFile_->append(folly::StringPiece(request))) {
+      ++numSpilled_;
+    } else {
+      ++numDropped_;
+      return false;
+    }
+  }
+
+  if (!drainScheduled_.exchange(true)) {
+    runInEventLoop([this]() noexcept {
+      drainScheduled_ = false;
+      drain();
+    });
+  }
+  return true;
+}
+
+void
+EventLogSink::drain() noexcept {
+  for (size_t i = 0; i < kMaxSendsPerDrain; ++i) {
+    // Take next request, spilled ones only once ring is empty
+    std::string request;
+    bool fromSpill = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!ring_.empty()) {
+        request = std::move(ring_.front());
+        ring_.pop_front();
+      } else if (spillFile_ && !spillFile_->empty()) {
+        request = folly::StringPiece(spillFile_->front()).str();
+        fromSpill = true;
+      } else {
+        return;
+      }
+    }
+
+    const auto ret = monitorCmdSock_.sendOne(Message::from(request).value());
+    if (ret.hasError()) {
+      if (ret.error().errNum != EAGAIN) {
+        LOG(ERROR) << "EventLogSink: error sending message " << ret.error();
+      }
+      // put request back and retry later, only this thread takes requests
+      if (!fromSpill) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ring_.emplace_front(std::move(request));
+      }
+      if (!retryTimer_->isScheduled()) {
+        retryTimer_->scheduleTimeout(retryInterval_);
+      }
+      return;
+    }
+
+    ++numSent_;
+    if (fromSpill) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      spillFile_->pop();
+      ++numReplayed_;
+    }
+  }
+
+  // more to send, continue after other events of the loop. We are in the
+  // loop already, where runInEventLoop mustn't be used.
+  if (!drainScheduled_.exchange(true)) {
+    scheduleTimeout(std::chrono::milliseconds(0), [this]() noexcept {
+      drainScheduled_ = false;
+      drain();
+    });
+  }
+}
+
+EventLogSink::Stats
+EventLogSink::getStats() const {
+  Stats stats;
+  stats.numAdded = numAdded_;
+  stats.numSent = numSent_;
+  stats.numDropped = numDropped_;
+  stats.numSpilled = numSpilled_;
+  stats.numReplayed = numReplayed_;
+  return stats;
+}
+
+size_t
+EventLogSink::getNumPending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return ring_.size() + (spillFile_ ? spillFile_->getNumRecords() : 0);
+}
+
+} // namespace fbzmq
@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/service/logging/SpillFile.h>
+#include <fbzmq/zmq/Zmq.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+namespace fbzmq {
+
+/**
+ * Asynchronous sink of event logs for ZmqMonitor which doesn't block the
+ * emitting threads nor loses logs while monitor is down or can't keep up.
+ *
+ * `addEventLog` can be called from any thread, it serializes the event log
+ * into a LOG_EVENT request and queues it in a bounded memory ring. Sink's own
+ * loop sends queued requests to monitor without blocking. Socket is set up
+ * with ZMQ_IMMEDIATE, so requests are held back (instead of piling up in
+ * socket's queue) while monitor is unreachable, as well as once socket's
+ * ZMQ_SNDHWM is reached. Sending is then retried every `retryInterval`.
+ *
+ * Once ring holds `maxBufferedLogs` requests, newer ones are spilled to a
+ * SpillFile at `spillFilePath` of `maxSpillBytes`, and replayed in order
+ * once ring has been drained. Requests which fit in neither (or ring only
+ * without spill file) are dropped. Spilled requests survive restarts of the
+ * process and are replayed by next sink using the same file.
+ *
+ * Loop must be run in a thread of its own, like ZmqMonitor.
+ */
+class EventLogSink final : public ZmqEventLoop {
+ public:
+  struct Stats {
+    // event logs passed to addEventLog
+    uint64_t numAdded{0};
+    // requests sent to monitor
+    uint64_t numSent{0};
+    // event logs dropped for lack of room in ring and spill file
+    uint64_t numDropped{0};
+    // event logs written to spill file
+    uint64_t numSpilled{0};
+    // spilled requests sent to monitor
+    uint64_t numReplayed{0};
+  };
+
+  EventLogSink(
+      Context& zmqContext,
+      std::string const& monitorCmdUrl,
+      size_t maxBufferedLogs,
+      std::string const& spillFilePath = "",
+      size_t maxSpillBytes = 64 * 1024 * 1024,
+      std::chrono::milliseconds retryInterval = std::chrono::milliseconds(100));
+
+  /**
+   * Queue event log for sending, never blocks. False if it had to be dropped.
+   */
+  bool addEventLog(thrift::EventLog const& eventLog);
+
+  /**
+   * Counters of the sink, can be read from any thread
+   */
+  Stats getStats() const;
+
+  /**
+   * Requests waiting to be sent, in memory and in spill file
+   */
+  size_t getNumPending() const;
+
+ private:
+  EventLogSink(EventLogSink const&) = delete;
+  EventLogSink& operator=(EventLogSink const&) = delete;
+
+  // send pending requests until none is left or socket can't take more
+  void drain() noexcept;
+
+  const std::chrono::milliseconds retryInterval_;
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> monitorCmdSock_;
+
+  // serializer used by emitting threads, it is stateless
+  apache::thrift::CompactSerializer serializer_;
+
+  // serialized requests. Spilled ones are newer than the ones in ring, ring
+  // is only appended to while spill file is empty.
+  mutable std::mutex mutex_;
+  std::deque<std::string> ring_;
+  const size_t maxBufferedLogs_{0};
+  std::unique_ptr<SpillFile> spillFile_;
+
+  // whether drain has been requested via runInEventLoop and not run yet
+  std::atomic<bool> drainScheduled_{false};
+
+  std::unique_ptr<ZmqTimeout> retryTimer_;
+
+  std::atomic<uint64_t> numAdded_{0};
+  std::atomic<uint64_t> numSent_{0};
+  std::atomic<uint64_t> numDropped_{0};
+  std::atomic<uint64_t> numSpilled_{0};
+  std::atomic<uint64_t> numReplayed_{0};
+};
+
+} // namespace fbzmq
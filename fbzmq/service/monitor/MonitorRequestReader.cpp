@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "MonitorRequestReader.h"
+
+namespace fbzmq {
+
+using apache::thrift::protocol::TType;
+
+MonitorRequestReader::MonitorRequestReader(folly::ByteRange data)
+    : buf_(folly::IOBuf::wrapBufferAsValue(data)) {
+  reader_.setInput(&buf_);
+}
+
+bool
+MonitorRequestReader::readCommand() noexcept {
+  try {
+    std::string name;
+    TType type;
+    int16_t id;
+    reader_.readStructBegin(name);
+    reader_.readFieldBegin(name, type, id);
+    if (id != Field::CMD || type != TType::T_I32) {
+      LOG(ERROR) << "MonitorRequestReader: request doesn't start with cmd";
+      return false;
+    }
+    int32_t cmd;
+    reader_.readI32(cmd);
+    reader_.readFieldEnd();
+    cmd_ = static_cast<thrift::MonitorCommand>(cmd);
+    return true;
+  } catch (std::exception const& e) {
+    LOG(ERROR) << "MonitorRequestReader: failed reading cmd: "
+               << folly::exceptionStr(e);
+  }
+  return false;
+}
+
+bool
+MonitorRequestReader::seekField(Field field) {
+  std::string name;
+  TType type;
+  int16_t id;
+  while (not atEnd_) {
+    reader_.readFieldBegin(name, type, id);
+    if (type == TType::T_STOP) {
+      reader_.readStructEnd();
+      atEnd_ = true;
+      break;
+    }
+    if (id == field) {
+      return true;
+    }
+    reader_.skip(type);
+    reader_.readFieldEnd();
+  }
+  return false;
+}
+
+bool
+MonitorRequestReader::readCounterSetParams(CounterVisitor visitor) noexcept {
+  try {
+    if (not seekField(Field::COUNTER_SET_PARAMS)) {
+      return true;
+    }
+
+    // CounterSetParams, look for its counters map
+    std::string name;
+    TType type;
+    int16_t id;
+    reader_.readStructBegin(name);
+    while (true) {
+      reader_.readFieldBegin(name, type, id);
+      if (type == TType::T_STOP) {
+        break;
+      }
+      if (id != 1 || type != TType::T_MAP) {
+        reader_.skip(type);
+        reader_.readFieldEnd();
+        continue;
+      }
+
+      TType keyType;
+      TType valueType;
+      uint32_t size;
+      reader_.readMapBegin(keyType, valueType, size);
+      for (uint32_t i = 0; i < size; ++i) {
+        std::string counterName;
+        thrift::Counter counter;
+        reader_.readString(counterName);
+        counter.read(&reader_);
+        visitor(std::move(counterName), std::move(counter));
+      }
+      reader_.readMapEnd();
+      reader_.readFieldEnd();
+    }
+    reader_.readStructEnd();
+    reader_.readFieldEnd();
+    return true;
+  } catch (std::exception const& e) {
+    LOG(ERROR) << "MonitorRequestReader: failed reading counters: "
+               << folly::exceptionStr(e);
+  }
+  return false;
+}
+
+} // namespace fbzmq
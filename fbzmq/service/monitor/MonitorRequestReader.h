@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <folly/ExceptionString.h>
+#include <folly/Function.h>
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <glog/logging.h>
+#include <thrift/lib/cpp2/protocol/CompactProtocol.h>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+
+namespace fbzmq {
+
+/**
+ * Partial decoder of compact serialized thrift::MonitorRequest. Rather than
+ * materializing every params struct of the request, command is peeked at
+ * first and only the params field it needs is decoded, other fields are
+ * skipped over.
+ *
+ * Thrift writes fields in order of their ids, so `cmd` is expected to be the
+ * first field, requests which don't start with it are rejected.
+ *
+ * Reader points into `data`, which must outlive it. Fields can only be read
+ * forward, i.e. a single params field per request.
+ */
+class MonitorRequestReader {
+ public:
+  // ids of MonitorRequest fields, look at Monitor.thrift
+  enum Field : int16_t {
+    CMD = 1,
+    COUNTER_SET_PARAMS = 2,
+    COUNTER_GET_PARAMS = 3,
+    COUNTER_BUMP_PARAMS = 4,
+    EVENT_LOG = 5,
+    COUNTER_BUMP_BY_PARAMS = 6,
+    COUNTER_QUERY_PARAMS = 7,
+    COUNTER_DUMP_PARAMS = 8,
+    COUNTER_HISTORY_PARAMS = 9,
+    COMPRESSED_EVENT_LOGS = 10,
+    COUNTER_DELETE_PARAMS = 11,
+  };
+
+  using CounterVisitor =
+      folly::FunctionRef<void(std::string&& name, thrift::Counter&& counter)>;
+
+  explicit MonitorRequestReader(folly::ByteRange data);
+
+  /**
+   * Decode command, must be called before reading any params. False if
+   * request is malformed.
+   */
+  bool readCommand() noexcept;
+
+  thrift::MonitorCommand
+  getCommand() const {
+    return cmd_;
+  }
+
+  /**
+   * Decode params struct from field `field`, other fields are skipped.
+   * Params are left untouched if request doesn't carry the field. False if
+   * request is malformed.
+   */
+  template <typename Params>
+  bool
+  readParams(Field field, Params& params) noexcept {
+    try {
+      if (seekField(field)) {
+        params.read(&reader_);
+        reader_.readFieldEnd();
+      }
+      return true;
+    } catch (std::exception const& e) {
+      LOG(ERROR) << "MonitorRequestReader: failed reading field " << field
+                 << ": " << folly::exceptionStr(e);
+    }
+    return false;
+  }
+
+  /**
+   * Decode counters of CounterSetParams one at a time, without building a
+   * map of them. False if request is malformed, in which case visitor may
+   * have seen some of the counters already.
+   */
+  bool readCounterSetParams(CounterVisitor visitor) noexcept;
+
+ private:
+  // advance to field `field`, skipping over others. False if there is no
+  // such field left
+  bool seekField(Field field);
+
+  folly::IOBuf buf_;
+  apache::thrift::CompactProtocolReader reader_;
+  thrift::MonitorCommand cmd_{};
+
+  // whether end of request has been reached
+  bool atEnd_{false};
+};
+
+} // namespace fbzmq
@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <fbzmq/service/monitor/CounterStore.h>
+#include <folly/Range.h>
+
+namespace fbzmq {
+
+/**
+ * Topic frames preceding publications of monitors in topic mode, so that SUB
+ * sockets can filter them within libzmq via ZMQ_SUBSCRIBE (which matches
+ * prefix of the first frame).
+ *
+ * - COUNTER_PUB: "counter/<first name component>", where component includes
+ *   the '.' following it if any. E.g. "counter/foo." for "foo.bar.baz".
+ *   Counters of an update are split into a publication per topic.
+ * - EVENT_LOG_PUB: "log/<category>"
+ * - EVENT_LOG_BATCH_PUB: "log_batch/", batches may span categories
+ *
+ * E.g. subscribing to "counter/foo." delivers updates of all "foo.*" counters
+ * only, and to "log/" all event logs which are not batched.
+ */
+const std::string kCounterTopicPrefix{"counter/"};
+const std::string kEventLogTopicPrefix{"log/"};
+const std::string kEventLogBatchTopic{"log_batch/"};
+
+inline std::string
+getCounterTopic(folly::StringPiece counterName) {
+  const auto pos = counterName.find('.');
+  if (pos != folly::StringPiece::npos) {
+    counterName = counterName.subpiece(0, pos + 1);
+  }
+  return kCounterTopicPrefix + counterName.str();
+}
+
+inline std::string
+getEventLogTopic(folly::StringPiece category) {
+  return kEventLogTopicPrefix + category.str();
+}
+
+/**
+ * Split counters by their topic
+ */
+inline std::map<std::string, CounterMap>
+splitCountersByTopic(CounterMap const& counters) {
+  std::map<std::string, CounterMap> topics;
+  for (auto const& kv : counters) {
+    topics[getCounterTopic(kv.first)].emplace(kv);
+  }
+  return topics;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,546 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ZmqMonitor.h"
+
+#include <fbzmq/service/monitor/EventLogCodec.h>
+#include <fbzmq/service/monitor/MonitorRequestReader.h>
+#include <fbzmq/service/monitor/PubTopic.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Counters looked at by each slice of expiry sweep, and interval of slices
+const size_t kMaxCountersPerExpirySlice{10000};
+const std::chrono::milliseconds kExpirySliceInterval{100};
+
+} // namespace
+
+ZmqMonitor::Options::Options() {}
+
+ZmqMonitor::Options&
+ZmqMonitor::Options::setPubInterval(std::chrono::milliseconds pubInterval) {
+  pubInterval_ = pubInterval;
+  return *this;
+}
+
+ZmqMonitor::Options&
+ZmqMonitor::Options::setMaxPubBatchSize(size_t maxPubBatchSize) {
+  maxPubBatchSize_ = maxPubBatchSize;
+  return *this;
+}
+
+ZmqMonitor::Options&
+ZmqMonitor::Options::setKeepHistory(bool keepHistory) {
+  keepHistory_ = keepHistory;
+  return *this;
+}
+
+ZmqMonitor::Options&
+ZmqMonitor::Options::setTopicFrames(bool topicFrames) {
+  topicFrames_ = topicFrames;
+  return *this;
+}
+
+ZmqMonitor::Options&
+ZmqMonitor::Options::setSnapshotPath(std::string const& snapshotPath) {
+  snapshotPath_ = snapshotPath;
+  return *this;
+}
+
+ZmqMonitor::Options&
+ZmqMonitor::Options::setSnapshotInterval(
+    std::chrono::milliseconds snapshotInterval) {
+  snapshotInterval_ = snapshotInterval;
+  return *this;
+}
+
+ZmqMonitor::Options&
+ZmqMonitor::Options::setCounterTtl(std::chrono::milliseconds counterTtl) {
+  counterTtl_ = counterTtl;
+  return *this;
+}
+
+ZmqMonitor::ZmqMonitor(
+    const std::string& monitorSubmitUrl,
+    const std::string& monitorPubUrl,
+    Context& zmqContext,
+    const folly::Optional<LogSample>& logSampleToMerge,
+    Options const& options)
+    : monitorSubmitUrl_(monitorSubmitUrl),
+      monitorPubUrl_(monitorPubUrl),
+      monitorReceiveSock_{zmqContext},
+      monitorPubSock_{zmqContext},
+      counters_(options.keepHistory_),
+      logSampleToMerge_{logSampleToMerge},
+      topicFrames_(options.topicFrames_),
+      maxPubBatchSize_(options.maxPubBatchSize_),
+      counterTtl_(options.counterTtl_) {
+  CHECK_LT(0, maxPubBatchSize_) << "Publication batch size can't be zero";
+  if (options.pubInterval_.count() > 0) {
+    pubThrottle_ = std::make_unique<ZmqThrottle>(
+        this, options.pubInterval_, [this]() noexcept {
+          publishDirtyCounters();
+        });
+  }
+
+  // Warm restart from snapshot of previous instance
+  const auto& snapshotPath = options.snapshotPath_;
+  if (not snapshotPath.empty()) {
+    CHECK_LT(0, options.snapshotInterval_.count())
+        << "Snapshot interval can't be zero";
+    numRestoredCounters_ = CounterSnapshot::load(
+        snapshotPath, [this](std::string&& name, thrift::Counter&& counter) {
+          counters_.setCounter(name, counter);
+        });
+    LOG(INFO) << "ZmqMonitor: Restored " << numRestoredCounters_
+              << " counters from '" << snapshotPath << "'";
+    snapshotWriter_ = std::make_unique<CounterSnapshotWriter>(snapshotPath);
+    snapshotTimer_ =
+        ZmqTimeout::make(this, [this]() noexcept { snapshotCounters(); });
+    snapshotTimer_->scheduleTimeout(
+        options.snapshotInterval_, true /* periodic */);
+  }
+
+  if (counterTtl_.count() > 0) {
+    expiryTimer_ =
+        ZmqTimeout::make(this, [this]() noexcept { expireCounters(); });
+    expiryTimer_->scheduleTimeout(kExpirySliceInterval, true /* periodic */);
+  }
+
+  // Prepare router socket to talk to Broker/other processes
+  const int handover = 1;
+  const auto handoverRet = monitorReceiveSock_.setSockOpt(
+      ZMQ_ROUTER_HANDOVER, &handover, sizeof(int));
+  if (handoverRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitor: Could not set ZMQ_ROUTER_HANDOVER "
+               << handoverRet.error();
+  }
+
+  // bind monitor router socket
+  VLOG(2) << "ZmqMonitor: Binding to monitorSubmitUrl '" << monitorSubmitUrl_
+          << "'";
+  const auto receiveBindRet =
+      monitorReceiveSock_.bind(SocketUrl{monitorSubmitUrl_});
+  if (receiveBindRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitor: Error binding to '" << monitorSubmitUrl_
+               << "' " << receiveBindRet.error();
+  }
+
+  // Prepare PUB socket for updating monitor
+  const int hwm = 1024;
+  const auto hwmRet =
+      monitorPubSock_.setSockOpt(ZMQ_SNDHWM, &hwm, sizeof(int));
+  if (hwmRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitor: Could not set ZMQ_SNDHWM " << hwmRet.error();
+  }
+
+  // bind monitor pub socket
+  // bind monitor router socket
+  VLOG(2) << "ZmqMonitor: Binding to monitorPubUrl '" << monitorPubUrl_
+          << "'";
+  const auto pubBindRet = monitorPubSock_.bind(SocketUrl{monitorPubUrl_});
+  if (pubBindRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitor: Error binding to '" << monitorPubUrl_ << "' "
+               << pubBindRet.error();
+  }
+
+  // Attach callback on monitor socket for read events
+  addSocket(
+      RawZmqSocketPtr{*monitorReceiveSock_},
+      ZMQ_POLLIN,
+      [this](int /* revents */) noexcept {
+        VLOG(4) << "ZmqMonitor: monitor request received...";
+        try {
+          processRequest();
+        } catch (std::exception const& e) {
+          LOG(ERROR) << "Error processing MonitorRequest: "
+                     << folly::exceptionStr(e);
+        }
+      });
+}
+
+ZmqMonitor::~ZmqMonitor() {
+  // Loop isn't running anymore, final snapshot is written by writer's d-tor
+  if (snapshotWriter_) {
+    snapshotCounters();
+  }
+}
+
+void
+ZmqMonitor::snapshotCounters() {
+  if (not countersChanged_) {
+    return;
+  }
+  countersChanged_ = false;
+  snapshotWriter_->submit(CounterSnapshot::encode(counters_));
+}
+
+void
+ZmqMonitor::expireCounters() {
+  const auto numExpired =
+      counters_.expireCounters(counterTtl_, kMaxCountersPerExpirySlice);
+  if (numExpired > 0) {
+    VLOG(2) << "ZmqMonitor: Expired " << numExpired << " counters";
+    numExpired_.fetch_add(numExpired, std::memory_order_relaxed);
+    countersChanged_ = true;
+  }
+}
+
+void
+ZmqMonitor::processRequest() {
+  thrift::CounterValuesResponse thriftValueRep;
+  thrift::CounterNamesResponse thriftNameRep;
+  thrift::MonitorPub thriftPub;
+
+  auto ret = monitorReceiveSock_.recvMultiple();
+  if (ret.hasError()) {
+    LOG(ERROR) << "processRequest: Error receiving command: " << ret.error();
+    return;
+  }
+  if (ret.value().size() < 2) {
+    LOG(ERROR) << "processRequest: Unexpected number of frames "
+               << ret.value().size();
+    return;
+  }
+
+  // Last frame is the actual request. Frames before it form the envelope,
+  // i.e. identity supplied by router socket optionally followed by request
+  // id of pipelining clients, and are echoed back along with the response.
+  std::vector<Message> envelope = std::move(ret.value());
+  Message thriftReqMsg = std::move(envelope.back());
+  envelope.pop_back();
+  auto sendResponse = [this, &envelope](Message response) {
+    sendEnvelopedResponse(envelope, std::move(response));
+  };
+
+  // Peek at command and decode only the params it uses
+  MonitorRequestReader reader(thriftReqMsg.data());
+  if (not reader.readCommand()) {
+    LOG(ERROR) << "processRequest: failed reading thrift::MonitorRequest";
+    return;
+  }
+
+  switch (reader.getCommand()) {
+  case thrift::MonitorCommand::SET_COUNTER_VALUES: {
+    // Decode counters straight into the store, publication takes them over
+    CounterMap updated;
+    const bool ok = reader.readCounterSetParams(
+        [this, &updated](std::string&& name, thrift::Counter&& counter) {
+          counters_.setCounter(name, counter);
+          updated[std::move(name)] = std::move(counter);
+        });
+    // Dump new monitor values to the publish socket, including ones set
+    // before a malformed part of the request
+    publishCounters(std::move(updated));
+    if (not ok) {
+      LOG(ERROR) << "processRequest: failed reading counterSetParams";
+    }
+    break;
+  }
+
+  case thrift::MonitorCommand::GET_COUNTER_VALUES: {
+    thrift::CounterGetParams params;
+    if (not reader.readParams(
+            MonitorRequestReader::COUNTER_GET_PARAMS, params)) {
+      return;
+    }
+    for (auto const& counterName : params.counterNames) {
+      auto counter = counters_.getCounter(counterName);
+      if (counter) {
+        thriftValueRep.counters[counterName] = *counter;
+      }
+    }
+    sendResponse(
+        SerializeBuffer::get().toMessage(thriftValueRep, serializer_).value());
+    break;
+  }
+
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES:
+    thriftNameRep.counterNames = counters_.getCounterNames();
+    sendResponse(
+        SerializeBuffer::get().toMessage(thriftNameRep, serializer_).value());
+    break;
+
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA:
+    thriftValueRep.counters = counters_.getCounters();
+    sendResponse(
+        SerializeBuffer::get().toMessage(thriftValueRep, serializer_).value());
+    break;
+
+  case thrift::MonitorCommand::GET_COUNTERS_BY_PREFIX: {
+    thrift::CounterQueryParams params;
+    if (not reader.readParams(
+            MonitorRequestReader::COUNTER_QUERY_PARAMS, params)) {
+      return;
+    }
+    sendResponse(
+        SerializeBuffer::get().toMessage(counters_.query(params), serializer_)
+            .value());
+    break;
+  }
+
+  case thrift::MonitorCommand::DUMP_COUNTER_DATA_STREAMED: {
+    thrift::CounterDumpParams params;
+    if (not reader.readParams(
+            MonitorRequestReader::COUNTER_DUMP_PARAMS, params)) {
+      return;
+    }
+    streamCounters(
+        std::move(envelope),
+        params.startAfter,
+        params.maxCountersPerChunk,
+        0 /* chunkIndex */);
+    break;
+  }
+
+  case thrift::MonitorCommand::GET_COUNTER_HISTORY: {
+    thrift::CounterHistoryParams params;
+    if (not reader.readParams(
+            MonitorRequestReader::COUNTER_HISTORY_PARAMS, params)) {
+      return;
+    }
+    sendResponse(
+        SerializeBuffer::get()
+            .toMessage(counters_.getHistory(params), serializer_)
+            .value());
+    break;
+  }
+
+  case thrift::MonitorCommand::BUMP_COUNTER: {
+    thrift::CounterBumpParams params;
+    if (not reader.readParams(
+            MonitorRequestReader::COUNTER_BUMP_PARAMS, params)) {
+      return;
+    }
+    CounterMap updated;
+    for (auto const& name : params.counterNames) {
+      updated[name] = counters_.bumpCounter(name, 1);
+    }
+    // Dump new counter values to the publish socket.
+    publishCounters(std::move(updated));
+    break;
+  }
+
+  case thrift::MonitorCommand::BUMP_COUNTER_BY: {
+    thrift::CounterBumpByParams params;
+    if (not reader.readParams(
+            MonitorRequestReader::COUNTER_BUMP_BY_PARAMS, params)) {
+      return;
+    }
+    CounterMap updated;
+    for (auto const& kv : params.counterDeltas) {
+      updated[kv.first] = counters_.bumpCounter(kv.first, kv.second);
+    }
+    // Single publication for all bumped counters
+    publishCounters(std::move(updated));
+    break;
+  }
+
+  case thrift::MonitorCommand::DELETE_COUNTERS: {
+    thrift::CounterDeleteParams params;
+    if (not reader.readParams(
+            MonitorRequestReader::COUNTER_DELETE_PARAMS, params)) {
+      return;
+    }
+    size_t numDeleted = 0;
+    for (auto const& name : params.counterNames) {
+      numDeleted += counters_.eraseCounter(name) ? 1 : 0;
+    }
+    if (not params.prefix.empty()) {
+      numDeleted += counters_.eraseCountersByPrefix(params.prefix);
+    }
+    numDeleted_.fetch_add(numDeleted, std::memory_order_relaxed);
+    countersChanged_ = countersChanged_ or numDeleted > 0;
+    break;
+  }
+
+  case thrift::MonitorCommand::LOG_EVENT:
+    // simply forward, do not store logs
+    if (not reader.readParams(
+            MonitorRequestReader::EVENT_LOG, thriftPub.eventLogPub)) {
+      return;
+    }
+    thriftPub.pubType = thrift::PubType::EVENT_LOG_PUB;
+    if (logSampleToMerge_) {
+      logSampleToMerge_->mergeInto(thriftPub.eventLogPub);
+    }
+    sendPub(getEventLogTopic(thriftPub.eventLogPub.category), thriftPub);
+    break;
+
+  case thrift::MonitorCommand::LOG_EVENT_BATCH:
+    // forward batch as it is, it is only decoded to merge logSampleToMerge_
+    if (not reader.readParams(
+            MonitorRequestReader::COMPRESSED_EVENT_LOGS,
+            thriftPub.eventLogBatchPub)) {
+      return;
+    }
+    thriftPub.pubType = thrift::PubType::EVENT_LOG_BATCH_PUB;
+    if (logSampleToMerge_) {
+      mergeIntoEventLogs(*logSampleToMerge_, thriftPub.eventLogBatchPub);
+    }
+    sendPub(kEventLogBatchTopic, thriftPub);
+    break;
+
+  default:
+    LOG(ERROR) << "Unknown monitor command received";
+  }
+
+  VLOG(4) << "processMonitorRequest has finished";
+}
+
+void
+ZmqMonitor::sendEnvelopedResponse(
+    std::vector<Message> const& envelope, Message response) {
+  auto sendRet = monitorReceiveSock_.sendMultiple(envelope, true);
+  if (sendRet.hasValue()) {
+    sendRet = monitorReceiveSock_.sendOne(std::move(response));
+  }
+  if (sendRet.hasError()) {
+    LOG(ERROR) << "processRequest: Error sending response: "
+               << sendRet.error();
+  }
+}
+
+void
+ZmqMonitor::streamCounters(
+    std::vector<Message> envelope,
+    std::string const& startAfter,
+    int32_t maxCountersPerChunk,
+    int32_t chunkIndex) {
+  // Resume from name rather than iterator, counters may come and go between
+  // chunks
+  thrift::CounterQueryParams params;
+  params.startAfter = startAfter;
+  params.maxCounters = maxCountersPerChunk;
+  auto page = counters_.query(params);
+
+  thrift::CounterDumpChunk chunk;
+  chunk.counters = std::move(page.counters);
+  chunk.chunkIndex = chunkIndex;
+  chunk.continuationToken =
+      page.lastCounterName.empty() ? startAfter : page.lastCounterName;
+  chunk.last = not page.hasMore;
+  sendEnvelopedResponse(
+      envelope, SerializeBuffer::get().toMessage(chunk, serializer_).value());
+  if (chunk.last) {
+    return;
+  }
+
+  // Let other requests in before sending next chunk. Zero timeout rather
+  // than runInEventLoop, which mustn't be called from within the loop.
+  scheduleTimeout(std::chrono::milliseconds(0), [
+    this,
+    envelope = std::move(envelope),
+    token = std::move(chunk.continuationToken),
+    maxCountersPerChunk,
+    chunkIndex
+  ]() mutable noexcept {
+    streamCounters(
+        std::move(envelope), token, maxCountersPerChunk, chunkIndex + 1);
+  });
+}
+
+void
+ZmqMonitor::publishCounters(CounterMap updated) {
+  numUpdates_.fetch_add(updated.size(), std::memory_order_relaxed);
+  countersChanged_ = countersChanged_ or not updated.empty();
+
+  if (not pubThrottle_) {
+    thrift::MonitorPub thriftPub;
+    thriftPub.pubType = thrift::PubType::COUNTER_PUB;
+    thriftPub.counterPub.counters = std::move(updated);
+    sendCounterPub(thriftPub);
+    return;
+  }
+
+  // Defer to coalesced publication of latest values
+  numSuppressedUpdates_.fetch_add(updated.size(), std::memory_order_relaxed);
+  for (auto const& kv : updated) {
+    if (not dirtyCounters_.insert(kv.first).second) {
+      numMergedUpdates_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  if (dirtyCounters_.size() >= maxPubBatchSize_) {
+    publishDirtyCounters();
+  } else {
+    (*pubThrottle_)();
+  }
+}
+
+void
+ZmqMonitor::publishDirtyCounters() {
+  thrift::MonitorPub thriftPub;
+  thriftPub.pubType = thrift::PubType::COUNTER_PUB;
+  for (auto const& name : dirtyCounters_) {
+    auto counter = counters_.getCounter(name);
+    if (not counter) {
+      continue;
+    }
+    thriftPub.counterPub.counters.emplace(name, *counter);
+    if (thriftPub.counterPub.counters.size() >= maxPubBatchSize_) {
+      sendCounterPub(thriftPub);
+      thriftPub.counterPub.counters.clear();
+    }
+  }
+  if (not thriftPub.counterPub.counters.empty()) {
+    sendCounterPub(thriftPub);
+  }
+  dirtyCounters_.clear();
+}
+
+void
+ZmqMonitor::sendCounterPub(thrift::MonitorPub const& thriftPub) {
+  if (not topicFrames_) {
+    numPublications_.fetch_add(1, std::memory_order_relaxed);
+    sendPub("", thriftPub);
+    return;
+  }
+
+  thrift::MonitorPub topicPub;
+  topicPub.pubType = thrift::PubType::COUNTER_PUB;
+  for (auto& kv : splitCountersByTopic(thriftPub.counterPub.counters)) {
+    numPublications_.fetch_add(1, std::memory_order_relaxed);
+    topicPub.counterPub.counters = std::move(kv.second);
+    sendPub(kv.first, topicPub);
+  }
+}
+
+void
+ZmqMonitor::sendPub(
+    std::string const& topic, thrift::MonitorPub const& thriftPub) {
+  auto msg = SerializeBuffer::get().toMessage(thriftPub, serializer_).value();
+  if (topicFrames_) {
+    monitorPubSock_.sendMultiple(Message::from(topic).value(), std::move(msg));
+  } else {
+    monitorPubSock_.sendOne(std::move(msg));
+  }
+}
+
+ZmqMonitor::PubStats
+ZmqMonitor::getPubStats() const {
+  PubStats stats;
+  stats.numUpdates = numUpdates_.load(std::memory_order_relaxed);
+  stats.numSuppressedUpdates =
+      numSuppressedUpdates_.load(std::memory_order_relaxed);
+  stats.numMergedUpdates = numMergedUpdates_.load(std::memory_order_relaxed);
+  stats.numPublications = numPublications_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+ZmqMonitor::EvictionStats
+ZmqMonitor::getEvictionStats() const {
+  EvictionStats stats;
+  stats.numExpired = numExpired_.load(std::memory_order_relaxed);
+  stats.numDeleted = numDeleted_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+} // namespace fbzmq
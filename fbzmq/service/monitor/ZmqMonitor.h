@@ -9,11 +9,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <boost/serialization/strong_typedef.hpp>
 #include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqThrottle.h>
+#include <fbzmq/async/ZmqTimeout.h>
 #include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/service/monitor/CounterSnapshot.h>
+#include <fbzmq/service/monitor/CounterStore.h>
 #include <fbzmq/service/logging/LogSample.h>
 #include <fbzmq/zmq/Zmq.h>
 #include <folly/gen/Base.h>
@@ -23,71 +32,129 @@
 
 namespace fbzmq {
 
-using CounterMap =
-    std::unordered_map<std::string /* counter name */, thrift::Counter>;
-
 class ZmqMonitor final : public ZmqEventLoop {
  public:
+  /**
+   * Counters of counter publisher, look at constructor
+   */
+  struct PubStats {
+    // Counter updates received via set/bump requests
+    uint64_t numUpdates{0};
+
+    // Updates deferred to coalesced publications instead of being published
+    // on their own
+    uint64_t numSuppressedUpdates{0};
+
+    // Updates of counters which had unpublished updates already, only the
+    // latest value gets published
+    uint64_t numMergedUpdates{0};
+
+    // COUNTER_PUB publications sent
+    uint64_t numPublications{0};
+  };
+
+  /**
+   * Counters of removed counters, look at constructor
+   */
+  struct EvictionStats {
+    // Counters expired for not being updated within TTL
+    uint64_t numExpired{0};
+
+    // Counters removed via DELETE_COUNTERS requests
+    uint64_t numDeleted{0};
+  };
+
+  /**
+   * Optional knobs of monitor, unset ones keep defaults, e.g.
+   *
+   *  ZmqMonitor monitor(
+   *      submitUrl,
+   *      pubUrl,
+   *      context,
+   *      folly::none,
+   *      ZmqMonitor::Options()
+   *          .setPubInterval(std::chrono::milliseconds(100))
+   *          .setTopicFrames(true));
+   */
+  class Options {
+   public:
+    Options();
+
+    // By default every set/bump request is published right away on PUB
+    // socket. With non-zero `pubInterval` publications are coalesced
+    // instead. Changed counters are tracked in a dirty set and published
+    // with their latest values at most once per `pubInterval` (via
+    // ZmqThrottle), as merged COUNTER_PUBs of at most `maxPubBatchSize`
+    // counters each. Dirty set reaching `maxPubBatchSize` is published right
+    // away.
+    Options& setPubInterval(std::chrono::milliseconds pubInterval);
+    Options& setMaxPubBatchSize(size_t maxPubBatchSize);
+
+    // Record samples of every counter in a CounterHistory for
+    // GET_COUNTER_HISTORY requests
+    Options& setKeepHistory(bool keepHistory);
+
+    // Precede every publication by a topic frame for subscribers to filter
+    // on, look at PubTopic.h
+    Options& setTopicFrames(bool topicFrames);
+
+    // Counters are restored from the snapshot found at `snapshotPath` on
+    // construction, so clients don't have to re-push them after a restart.
+    // While running, counters are snapshotted there every `snapshotInterval`
+    // if they have changed, and once more on destruction. Snapshots are
+    // encoded in the loop and written by a background thread, look at
+    // CounterSnapshot.
+    Options& setSnapshotPath(std::string const& snapshotPath);
+    Options& setSnapshotInterval(std::chrono::milliseconds snapshotInterval);
+
+    // With non-zero `counterTtl` counters which haven't been updated for
+    // that long are expired, e.g. ones of peers which are gone. Store is
+    // swept incrementally from a periodic timeout, a bounded slice of
+    // counters at a time, so sweeping never stalls the loop. Counters can be
+    // removed explicitly with DELETE_COUNTERS requests as well.
+    Options& setCounterTtl(std::chrono::milliseconds counterTtl);
+
+   private:
+    friend class ZmqMonitor;
+
+    std::chrono::milliseconds pubInterval_{0};
+    size_t maxPubBatchSize_{1000};
+    bool keepHistory_{false};
+    bool topicFrames_{false};
+    std::string snapshotPath_;
+    std::chrono::milliseconds snapshotInterval_{std::chrono::seconds(10)};
+    std::chrono::milliseconds counterTtl_{0};
+  };
+
+  /**
+   * Every received LogSample gets `logSampleToMerge` merged into it, look at
+   * Options for the rest.
+   */
   ZmqMonitor(
       const std::string& monitorSubmitUrl,
       const std::string& monitorPubUrl,
       Context& zmqContext,
-      const folly::Optional<LogSample>& logSampleToMerge = folly::none)
-      : monitorSubmitUrl_(monitorSubmitUrl),
-        monitorPubUrl_(monitorPubUrl),
-        monitorReceiveSock_{zmqContext},
-        monitorPubSock_{zmqContext},
-        logSampleToMerge_{logSampleToMerge} {
-    // Prepare router socket to talk to Broker/other processes
-    const int handover = 1;
-    const auto handoverRet = monitorReceiveSock_.setSockOpt(
-        ZMQ_ROUTER_HANDOVER, &handover, sizeof(int));
-    if (handoverRet.hasError()) {
-      LOG(FATAL) << "ZmqMonitor: Could not set ZMQ_ROUTER_HANDOVER "
-                 << handoverRet.error();
-    }
-
-    // bind monitor router socket
-    VLOG(2) << "ZmqMonitor: Binding to monitorSubmitUrl '" << monitorSubmitUrl_
-            << "'";
-    const auto receiveBindRet =
-        monitorReceiveSock_.bind(SocketUrl{monitorSubmitUrl_});
-    if (receiveBindRet.hasError()) {
-      LOG(FATAL) << "ZmqMonitor: Error binding to '" << monitorSubmitUrl_
-                 << "' " << receiveBindRet.error();
-    }
-
-    // Prepare PUB socket for updating monitor
-    const int hwm = 1024;
-    const auto hwmRet =
-        monitorPubSock_.setSockOpt(ZMQ_SNDHWM, &hwm, sizeof(int));
-    if (hwmRet.hasError()) {
-      LOG(FATAL) << "ZmqMonitor: Could not set ZMQ_SNDHWM " << hwmRet.error();
-    }
-
-    // bind monitor pub socket
-    // bind monitor router socket
-    VLOG(2) << "ZmqMonitor: Binding to monitorPubUrl '" << monitorPubUrl_
-            << "'";
-    const auto pubBindRet = monitorPubSock_.bind(SocketUrl{monitorPubUrl_});
-    if (pubBindRet.hasError()) {
-      LOG(FATAL) << "ZmqMonitor: Error binding to '" << monitorPubUrl_ << "' "
-                 << pubBindRet.error();
-    }
-
-    // Attach callback on monitor socket for read events
-    addSocket(
-        RawZmqSocketPtr{*monitorReceiveSock_},
-        ZMQ_POLLIN,
-        [this](int /* revents */) noexcept {
-          VLOG(4) << "ZmqMonitor: monitor request received...";
-          try {
-            processRequest();
-          } catch (std::exception const& e) {
-            LOG(ERROR) << "Error processing MonitorRequest: "
-                       << folly::exceptionStr(e);
-          }
-        });
+      const folly::Optional<LogSample>& logSampleToMerge = folly::none,
+      Options const& options = Options());
+
+  ~ZmqMonitor();
+
+  /**
+   * Publisher counters, can be read from any thread
+   */
+  PubStats getPubStats() const;
+
+  /**
+   * Eviction counters, can be read from any thread
+   */
+  EvictionStats getEvictionStats() const;
+
+  /**
+   * Number of counters restored from snapshot on construction
+   */
+  size_t
+  getNumRestoredCounters() const {
+    return numRestoredCounters_;
   }
 
  private:
@@ -95,119 +162,35 @@ class ZmqMonitor final : public ZmqEventLoop {
   ZmqMonitor& operator=(ZmqMonitor const&) = delete;
 
   // process a monitor request pending oni monitorReceiveSock_
-  void
-  processRequest() {
-    thrift::CounterValuesResponse thriftValueRep;
-    thrift::CounterNamesResponse thriftNameRep;
-    thrift::MonitorPub thriftPub;
-
-    Message requestIdMsg, thriftReqMsg;
-    const auto ret =
-        monitorReceiveSock_.recvMultiple(requestIdMsg, thriftReqMsg);
-    if (ret.hasError()) {
-      LOG(ERROR) << "processRequest: Error receiving command: " << ret.error();
-      return;
-    }
-
-    // read the request id supplied by router socket
-    const auto requestId = requestIdMsg.read<std::string>().value();
-
-    // read actual request
-    const auto maybeThriftReq =
-        thriftReqMsg.readThriftObj<thrift::MonitorRequest>(serializer_);
-
-    if (maybeThriftReq.hasError()) {
-      LOG(ERROR) << "processRequest: failed reading thrift::MonitorRequest "
-                 << maybeThriftReq.error();
-      return;
-    }
-
-    const auto thriftReq = maybeThriftReq.value();
-
-    switch (thriftReq.cmd) {
-    case thrift::MonitorCommand::SET_COUNTER_VALUES:
-      for (auto const& kv : thriftReq.counterSetParams.counters) {
-        counters_[kv.first] = kv.second;
-      }
-      // Dump new monitor values to the publish socket.
-      thriftPub.pubType = thrift::PubType::COUNTER_PUB;
-      thriftPub.counterPub.counters = thriftReq.counterSetParams.counters;
-      monitorPubSock_.sendOne(
-          Message::fromThriftObj(thriftPub, serializer_).value());
-      break;
-
-    case thrift::MonitorCommand::GET_COUNTER_VALUES:
-      for (auto const& counterName : thriftReq.counterGetParams.counterNames) {
-        auto it = counters_.find(counterName);
-        if (it != counters_.end()) {
-          thriftValueRep.counters[counterName] = it->second;
-        }
-      }
-      monitorReceiveSock_.sendMultiple(
-          requestIdMsg,
-          Message::fromThriftObj(thriftValueRep, serializer_).value());
-      break;
-
-    case thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES:
-      thriftNameRep.counterNames = folly::gen::from(counters_) |
-          folly::gen::get<0>() | folly::gen::as<std::vector<std::string>>();
-      monitorReceiveSock_.sendMultiple(
-          requestIdMsg,
-          Message::fromThriftObj(thriftNameRep, serializer_).value());
-      break;
-
-    case thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA:
-      thriftValueRep.counters.insert(counters_.begin(), counters_.end());
-      monitorReceiveSock_.sendMultiple(
-          requestIdMsg,
-          Message::fromThriftObj(thriftValueRep, serializer_).value());
-      break;
-
-    case thrift::MonitorCommand::BUMP_COUNTER:
-      for (auto const& name : thriftReq.counterBumpParams.counterNames) {
-        if (counters_.find(name) == counters_.end()) {
-          thrift::Counter counter(
-              apache::thrift::FRAGILE,
-              0,
-              thrift::CounterValueType::COUNTER,
-              std::time(nullptr));
-          counters_.emplace(name, counter);
-        }
-        auto& counter = counters_[name];
-        ++counter.value;
-        thriftPub.counterPub.counters.emplace(name, counter);
-      }
-      // Dump new counter values to the publish socket.
-      thriftPub.pubType = thrift::PubType::COUNTER_PUB;
-      monitorPubSock_.sendOne(
-          Message::fromThriftObj(thriftPub, serializer_).value());
-      break;
-
-    case thrift::MonitorCommand::LOG_EVENT:
-      // simply forward, do not store logs
-      thriftPub.pubType = thrift::PubType::EVENT_LOG_PUB;
-      thriftPub.eventLogPub = thriftReq.eventLog;
-      if (logSampleToMerge_) {
-        for(auto& sample : thriftPub.eventLogPub.samples) {
-          try {
-            // throws if this sample doesn't have a timestamp
-            // in that case, lets just pass this sample along without appending
-            auto ls = LogSample::fromJson(sample);
-            ls.mergeSample(*logSampleToMerge_);
-            sample = ls.toJson();
-          } catch (...) {}
-        }
-      }
-      monitorPubSock_.sendOne(
-          Message::fromThriftObj(thriftPub, serializer_).value());
-      break;
-
-    default:
-      LOG(ERROR) << "Unknown monitor command received";
-    }
-
-    VLOG(4) << "processMonitorRequest has finished";
-  }
+  void processRequest();
+
+  // send response to requester identified by envelope frames
+  void sendEnvelopedResponse(
+      std::vector<Message> const& envelope, Message response);
+
+  // send one chunk of DUMP_COUNTER_DATA_STREAMED and schedule next one
+  void streamCounters(
+      std::vector<Message> envelope,
+      std::string const& startAfter,
+      int32_t maxCountersPerChunk,
+      int32_t chunkIndex);
+
+  // publish updated counters right away or mark them dirty
+  void publishCounters(CounterMap updated);
+
+  // publish latest values of dirty counters and clear dirty set
+  void publishDirtyCounters();
+
+  void sendCounterPub(thrift::MonitorPub const& thriftPub);
+
+  // hand snapshot of counters over to snapshot writer if they have changed
+  void snapshotCounters();
+
+  // expire next slice of counters not updated within TTL
+  void expireCounters();
+
+  // send publication, preceded by topic frame in topic mode
+  void sendPub(std::string const& topic, thrift::MonitorPub const& thriftPub);
 
   const std::string monitorSubmitUrl_;
   const std::string monitorPubUrl_;
@@ -219,10 +202,38 @@ class ZmqMonitor final : public ZmqEventLoop {
   apache::thrift::CompactSerializer serializer_;
 
   // track critical statistics, e.g., number of times functions are called
-  CounterMap counters_;
+  CounterStore counters_;
 
   // LogSample to merge to each LogSample we recv
   const folly::Optional<LogSample> logSampleToMerge_;
+
+  // Whether publications are preceded by topic frame
+  const bool topicFrames_{false};
+
+  // Coalescing publisher, only if publication interval is configured
+  const size_t maxPubBatchSize_{0};
+  std::unique_ptr<ZmqThrottle> pubThrottle_;
+  std::unordered_set<std::string> dirtyCounters_;
+
+  // Snapshots of counters, only if snapshot path is configured
+  size_t numRestoredCounters_{0};
+  std::unique_ptr<CounterSnapshotWriter> snapshotWriter_;
+  std::unique_ptr<ZmqTimeout> snapshotTimer_;
+  bool countersChanged_{false};
+
+  // Expiry of counters, only if TTL is configured
+  const std::chrono::milliseconds counterTtl_{0};
+  std::unique_ptr<ZmqTimeout> expiryTimer_;
+
+  // Eviction counters, only written by monitor's thread
+  std::atomic<uint64_t> numExpired_{0};
+  std::atomic<uint64_t> numDeleted_{0};
+
+  // Publisher counters, only written by monitor's thread
+  std::atomic<uint64_t> numUpdates_{0};
+  std::atomic<uint64_t> numSuppressedUpdates_{0};
+  std::atomic<uint64_t> numMergedUpdates_{0};
+  std::atomic<uint64_t> numPublications_{0};
 };
 
 } // namespace fbzmq
@@ -0,0 +1,228 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ZmqMonitorAsyncClient.h"
+
+#include <stdexcept>
+#include <system_error>
+
+namespace fbzmq {
+
+namespace {
+
+// Flush batched `getCounter` calls right away once there are this many
+const size_t kMaxGetCounterBatchSize = 512;
+
+} // namespace
+
+ZmqMonitorAsyncClient::ZmqMonitorAsyncClient(
+    ZmqEventLoop& evl,
+    Context& zmqContext,
+    std::string const& monitorCmdUrl,
+    std::chrono::milliseconds requestTimeout,
+    std::string const& socketId)
+    : evl_(evl),
+      monitorCmdUrl_(monitorCmdUrl),
+      requestTimeout_(requestTimeout),
+      monitorCmdSock_{
+          zmqContext, folly::none, folly::none, NonblockingFlag{true}} {
+  if (!socketId.empty()) {
+    const auto idRet = monitorCmdSock_.setSockOpt(
+        ZMQ_IDENTITY, socketId.c_str(), socketId.length());
+    if (idRet.hasError()) {
+      LOG(FATAL) << "Error setting ZMQ_IDENTITY to " << socketId << " "
+                 << idRet.error();
+    }
+  }
+  if (monitorCmdSock_.connect(SocketUrl{monitorCmdUrl_}).hasError()) {
+    LOG(FATAL) << "Error connecting to monitor '" << monitorCmdUrl_ << "'";
+  }
+
+  evl_.addSocket(
+      RawZmqSocketPtr{*monitorCmdSock_},
+      ZMQ_POLLIN,
+      [this](int /* revents */) noexcept { processResponses(); });
+}
+
+ZmqMonitorAsyncClient::~ZmqMonitorAsyncClient() {
+  CHECK(evl_.isInEventLoop());
+  evl_.removeSocket(RawZmqSocketPtr{*monitorCmdSock_});
+
+  // Timeouts refer to this object. Promises are broken on destruction.
+  if (flushTimeoutId_) {
+    evl_.cancelTimeout(*flushTimeoutId_);
+  }
+  for (auto const& kv : pendingRequests_) {
+    evl_.cancelTimeout(kv.second.timeoutId);
+  }
+}
+
+folly::Future<folly::Optional<thrift::Counter>>
+ZmqMonitorAsyncClient::getCounter(std::string const& name) {
+  CHECK(evl_.isInEventLoop());
+  CounterPromise promise;
+  auto future = promise.getFuture();
+  pendingGets_.emplace_back(name, std::move(promise));
+
+  if (pendingGets_.size() >= kMaxGetCounterBatchSize) {
+    flushGetCounters();
+  } else if (not flushTimeoutId_) {
+    // Flush after calls of current iteration are in
+    flushTimeoutId_ = evl_.scheduleTimeout(
+        std::chrono::milliseconds(0), [this]() noexcept {
+          flushTimeoutId_.clear();
+          flushGetCounters();
+        });
+  }
+  return future;
+}
+
+folly::Future<CounterMap>
+ZmqMonitorAsyncClient::getCounters(std::vector<std::string> names) {
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::GET_COUNTER_VALUES;
+  thriftReq.counterGetParams.counterNames = std::move(names);
+
+  return sendRequest(thriftReq).then([this](Message&& msg) {
+    return readResponse<thrift::CounterValuesResponse>(msg).counters;
+  });
+}
+
+folly::Future<std::vector<std::string>>
+ZmqMonitorAsyncClient::dumpCounterNames() {
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES;
+
+  return sendRequest(thriftReq).then([this](Message&& msg) {
+    return readResponse<thrift::CounterNamesResponse>(msg).counterNames;
+  });
+}
+
+folly::Future<CounterMap>
+ZmqMonitorAsyncClient::dumpCounters() {
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA;
+
+  return sendRequest(thriftReq).then([this](Message&& msg) {
+    return readResponse<thrift::CounterValuesResponse>(msg).counters;
+  });
+}
+
+folly::Future<Message>
+ZmqMonitorAsyncClient::sendRequest(thrift::MonitorRequest const& request) {
+  CHECK(evl_.isInEventLoop());
+  const uint64_t requestId = nextRequestId_++;
+
+  const auto ret = monitorCmdSock_.sendFrames(
+      requestId, Message::fromThriftObj(request, serializer_).value());
+  if (ret.hasError()) {
+    LOG(ERROR) << "sendRequest: error sending message " << ret.error();
+    return folly::makeFuture<Message>(std::system_error(
+        ret.error().errNum, std::generic_category(), ret.error().errString));
+  }
+
+  auto& pending = pendingRequests_[requestId];
+  pending.timeoutId =
+      evl_.scheduleTimeout(requestTimeout_, [this, requestId]() noexcept {
+        auto it = pendingRequests_.find(requestId);
+        if (it == pendingRequests_.end()) {
+          return;
+        }
+        auto promise = std::move(it->second.promise);
+        pendingRequests_.erase(it);
+        promise.setException(std::system_error(
+            EAGAIN, std::generic_category(), "Monitor request timed out"));
+      });
+  return pending.promise.getFuture();
+}
+
+void
+ZmqMonitorAsyncClient::processResponses() {
+  while (true) {
+    auto ret = monitorCmdSock_.recvFrames<uint64_t, Message>();
+    if (ret.hasError()) {
+      if (ret.error().errNum == EAGAIN) {
+        return;
+      }
+      // Malformed message is consumed as a whole, carry on with next one
+      LOG(ERROR) << "processResponses: error receiving message "
+                 << ret.error();
+      if (ret.error().errNum == EPROTO) {
+        continue;
+      }
+      return;
+    }
+
+    auto it = pendingRequests_.find(std::get<0>(ret.value()));
+    if (it == pendingRequests_.end()) {
+      // Timed out already
+      continue;
+    }
+    auto pending = std::move(it->second);
+    pendingRequests_.erase(it);
+    evl_.cancelTimeout(pending.timeoutId);
+    pending.promise.setValue(std::move(std::get<1>(ret.value())));
+  }
+}
+
+void
+ZmqMonitorAsyncClient::flushGetCounters() {
+  if (flushTimeoutId_) {
+    evl_.cancelTimeout(*flushTimeoutId_);
+    flushTimeoutId_.clear();
+  }
+  if (pendingGets_.empty()) {
+    return;
+  }
+
+  std::vector<std::pair<std::string, CounterPromise>> gets;
+  gets.swap(pendingGets_);
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::GET_COUNTER_VALUES;
+  for (auto const& get : gets) {
+    thriftReq.counterGetParams.counterNames.emplace_back(get.first);
+  }
+
+  sendRequest(thriftReq).then(
+      [ this, gets = std::move(gets) ](folly::Try<Message> && msg) mutable {
+        CounterMap counters;
+        try {
+          counters =
+              readResponse<thrift::CounterValuesResponse>(msg.value()).counters;
+        } catch (std::exception const& e) {
+          auto ew = folly::exception_wrapper(std::current_exception(), e);
+          for (auto& get : gets) {
+            get.second.setException(ew);
+          }
+          return;
+        }
+
+        for (auto& get : gets) {
+          auto it = counters.find(get.first);
+          if (it == counters.end()) {
+            get.second.setValue(folly::none);
+          } else {
+            get.second.setValue(it->second);
+          }
+        }
+      });
+}
+
+template <typename ThriftType>
+ThriftType
+ZmqMonitorAsyncClient::readResponse(Message const& msg) {
+  auto response = msg.readThriftObj<ThriftType>(serializer_);
+  if (response.hasError()) {
+    throw std::runtime_error(
+        "Error reading monitor response: " + response.error().errString);
+  }
+  return std::move(response).value();
+}
+
+} // namespace fbzmq
@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/zmq/Zmq.h>
+#include <folly/Optional.h>
+#include <folly/futures/Future.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include "ZmqMonitor.h"
+
+namespace fbzmq {
+
+/**
+ * Non-blocking counterpart of `ZmqMonitorClient` driven by a `ZmqEventLoop`.
+ *
+ * Requests are tagged with an id (sent as an extra frame before the request,
+ * which monitor echoes back with the response) so that any number of them
+ * can be in flight on the same socket. Responses are matched to requests by
+ * id and returned via futures, which are fulfilled within the loop's thread.
+ *
+ * Concurrent `getCounter` calls issued within an iteration of the loop are
+ * merged into a single GET_COUNTER_VALUES request.
+ *
+ * Client must be created, used and destroyed within the loop's thread (or
+ * while loop isn't running). Pending futures fail with std::system_error
+ * (EAGAIN) after `requestTimeout` and with folly::BrokenPromise if client
+ * is destroyed.
+ */
+class ZmqMonitorAsyncClient {
+ public:
+  ZmqMonitorAsyncClient(
+      ZmqEventLoop& evl,
+      fbzmq::Context& zmqContext,
+      std::string const& monitorCmdUrl,
+      std::chrono::milliseconds requestTimeout = std::chrono::seconds(5),
+      std::string const& socketId = "");
+
+  ~ZmqMonitorAsyncClient();
+
+  ZmqMonitorAsyncClient(ZmqMonitorAsyncClient const&) = delete;
+  ZmqMonitorAsyncClient& operator=(ZmqMonitorAsyncClient const&) = delete;
+
+  /**
+   * Get single counter. Batched with other `getCounter` calls, look above.
+   */
+  folly::Future<folly::Optional<thrift::Counter>> getCounter(
+      std::string const& name);
+
+  /**
+   * Get multiple counters with single request. Unknown counters are omitted.
+   */
+  folly::Future<CounterMap> getCounters(std::vector<std::string> names);
+
+  /**
+   * Dump all counter names in ZmqMonitor
+   */
+  folly::Future<std::vector<std::string>> dumpCounterNames();
+
+  /**
+   * Dump ZmqMonitor
+   */
+  folly::Future<CounterMap> dumpCounters();
+
+  /**
+   * Number of requests sent and awaiting response
+   */
+  size_t
+  getNumPendingRequests() const {
+    return pendingRequests_.size();
+  }
+
+ private:
+  using CounterPromise = folly::Promise<folly::Optional<thrift::Counter>>;
+
+  struct PendingRequest {
+    folly::Promise<Message> promise;
+    int64_t timeoutId{0};
+  };
+
+  /**
+   * Send request tagged with new id and return response
+   */
+  folly::Future<Message> sendRequest(thrift::MonitorRequest const& request);
+
+  /**
+   * Receive all available responses and fulfill their requests
+   */
+  void processResponses();
+
+  /**
+   * Send batched `getCounter` calls as one request
+   */
+  void flushGetCounters();
+
+  /**
+   * Deserialize response, throws std::runtime_error on failure
+   */
+  template <typename ThriftType>
+  ThriftType readResponse(Message const& msg);
+
+  ZmqEventLoop& evl_;
+
+  const std::string monitorCmdUrl_;
+
+  const std::chrono::milliseconds requestTimeout_;
+
+  // Non-blocking DEALER socket
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> monitorCmdSock_;
+
+  // Serializer object for thrift-obj <-> string conversion
+  apache::thrift::CompactSerializer serializer_;
+
+  // Requests awaiting response, keyed by request id
+  std::unordered_map<uint64_t, PendingRequest> pendingRequests_;
+  uint64_t nextRequestId_{1};
+
+  // `getCounter` calls to be sent with next flush
+  std::vector<std::pair<std::string, CounterPromise>> pendingGets_;
+  folly::Optional<int64_t> flushTimeoutId_;
+};
+
+} // namespace fbzmq
@@ -14,7 +14,8 @@ namespace fbzmq {
 ZmqMonitorClient::ZmqMonitorClient(
     Context& zmqContext,
     const std::string& monitorSubmitUrl,
-    std::string const& socketId)
+    std::string const& socketId,
+    folly::Optional<std::chrono::milliseconds> recvTimeout)
     : monitorCmdUrl_(std::move(monitorSubmitUrl)),
       monitorCmdSock_{
           zmqContext, folly::none, folly::none, NonblockingFlag{false}} {
@@ -26,6 +27,15 @@ ZmqMonitorClient::ZmqMonitorClient(
                  << idRet.error();
     }
   }
+  // Receive timeout is cached by socket and enforced by zmq, no polling is
+  // needed for round trips
+  if (recvTimeout) {
+    const auto timeoutRet = monitorCmdSock_.setRecvTimeout(recvTimeout);
+    if (timeoutRet.hasError()) {
+      LOG(FATAL) << "Error setting ZMQ_RCVTIMEO to " << recvTimeout->count()
+                 << "ms " << timeoutRet.error();
+    }
+  }
   // allow for empty url mainly in unit tests
   if (!monitorCmdUrl_.empty()) {
     if (monitorCmdSock_.connect(SocketUrl{monitorCmdUrl_}).hasError()) {
@@ -34,9 +44,115 @@ ZmqMonitorClient::ZmqMonitorClient(
   }
 }
 
+ZmqMonitorClient::~ZmqMonitorClient() {
+  flush();
+}
+
+void
+ZmqMonitorClient::enableBuffering(size_t flushThreshold) {
+  CHECK_LT(0, flushThreshold);
+  buffered_ = true;
+  flushThreshold_ = flushThreshold;
+}
+
+void
+ZmqMonitorClient::enableBuffering(
+    size_t flushThreshold,
+    ZmqEventLoop* eventLoop,
+    std::chrono::milliseconds flushInterval) {
+  enableBuffering(flushThreshold);
+  flushTimer_ = ZmqTimeout::make(eventLoop, [this]() noexcept { flush(); });
+  flushTimer_->scheduleTimeout(flushInterval, true /* isPeriodic */);
+}
+
+void
+ZmqMonitorClient::enableLogBatching(
+    size_t maxBatchSamples, thrift::CompressionType compression) {
+  CHECK_LT(0, maxBatchSamples);
+  logBatching_ = true;
+  maxBatchSamples_ = maxBatchSamples;
+  compression_ = compression;
+}
+
+void
+ZmqMonitorClient::enableLogBatching(
+    size_t maxBatchSamples,
+    ZmqEventLoop* eventLoop,
+    std::chrono::milliseconds flushInterval,
+    thrift::CompressionType compression) {
+  enableLogBatching(maxBatchSamples, compression);
+  logFlushTimer_ =
+      ZmqTimeout::make(eventLoop, [this]() noexcept { flushEventLogs(); });
+  logFlushTimer_->scheduleTimeout(flushInterval, true /* isPeriodic */);
+}
+
+void
+ZmqMonitorClient::maybeFlush() {
+  if (getNumBufferedCounters() >= flushThreshold_) {
+    flush();
+  }
+}
+
+void
+ZmqMonitorClient::flush() {
+  // Sets go first, bumps buffered after them apply on top
+  if (not bufferedSets_.empty()) {
+    thrift::MonitorRequest thriftReq;
+    thriftReq.cmd = thrift::MonitorCommand::SET_COUNTER_VALUES;
+    thriftReq.counterSetParams.counters.swap(bufferedSets_);
+
+    const auto ret = monitorCmdSock_.sendOne(
+        Message::fromThriftObj(thriftReq, serializer_).value());
+    if (ret.hasError()) {
+      LOG(ERROR) << "flush: error sending message " << ret.error();
+    }
+  }
+
+  if (not bufferedBumps_.empty()) {
+    thrift::MonitorRequest thriftReq;
+    thriftReq.cmd = thrift::MonitorCommand::BUMP_COUNTER_BY;
+    thriftReq.counterBumpByParams.counterDeltas.swap(bufferedBumps_);
+
+    const auto ret = monitorCmdSock_.sendOne(
+        Message::fromThriftObj(thriftReq, serializer_).value());
+    if (ret.hasError()) {
+      LOG(ERROR) << "flush: error sending message " << ret.error();
+    }
+  }
+
+  flushEventLogs();
+}
+
+void
+ZmqMonitorClient::flushEventLogs() {
+  if (batchedEventLogs_.empty()) {
+    return;
+  }
+
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::LOG_EVENT_BATCH;
+  thriftReq.compressedEventLogs =
+      compressEventLogs(std::move(batchedEventLogs_), compression_);
+  batchedEventLogs_.clear();
+  numBatchedSamples_ = 0;
+
+  const auto ret = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (ret.hasError()) {
+    LOG(ERROR) << "flushEventLogs: error sending message " << ret.error();
+  }
+}
+
 void
 ZmqMonitorClient::setCounter(
     std::string const& name, thrift::Counter const& counter) {
+  if (buffered_) {
+    bufferedBumps_.erase(name);
+    bufferedSets_[name] = counter;
+    maybeFlush();
+    return;
+  }
+
   thrift::MonitorRequest thriftReq;
   thriftReq.cmd = thrift::MonitorCommand::SET_COUNTER_VALUES;
   thriftReq.counterSetParams.counters.emplace(name, counter);
@@ -50,6 +166,15 @@ ZmqMonitorClient::setCounter(
 
 void
 ZmqMonitorClient::setCounters(CounterMap const& counters) {
+  if (buffered_) {
+    for (auto const& kv : counters) {
+      bufferedBumps_.erase(kv.first);
+      bufferedSets_[kv.first] = kv.second;
+    }
+    maybeFlush();
+    return;
+  }
+
   thrift::MonitorRequest thriftReq;
   thriftReq.cmd = thrift::MonitorCommand::SET_COUNTER_VALUES;
   thriftReq.counterSetParams.counters = counters;
@@ -63,6 +188,7 @@ ZmqMonitorClient::setCounters(CounterMap const& counters) {
 
 folly::Optional<thrift::Counter>
 ZmqMonitorClient::getCounter(std::string const& name) {
+  flush();
   thrift::MonitorRequest thriftReq;
   thriftReq.cmd = thrift::MonitorCommand::GET_COUNTER_VALUES;
   thriftReq.counterGetParams.counterNames.emplace_back(name);
@@ -97,6 +223,7 @@ ZmqMonitorClient::getCounter(std::string const& name) {
 
 std::vector<std::string /* name */>
 ZmqMonitorClient::dumpCounterNames() {
+  flush();
   thrift::MonitorRequest thriftReq;
   thriftReq.cmd = thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES;
 
@@ -126,6 +253,7 @@ ZmqMonitorClient::dumpCounterNames() {
 
 CounterMap
 ZmqMonitorClient::dumpCounters() {
+  flush();
   thrift::MonitorRequest thriftReq;
   thriftReq.cmd = thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA;
 
@@ -154,8 +282,193 @@ ZmqMonitorClient::dumpCounters() {
   return response.value().counters;
 }
 
+thrift::CounterQueryResponse
+ZmqMonitorClient::queryCounters(thrift::CounterQueryParams const& params) {
+  flush();
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::GET_COUNTERS_BY_PREFIX;
+  thriftReq.counterQueryParams = params;
+
+  thrift::CounterQueryResponse emptyResponse;
+
+  const auto sendRet = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (sendRet.hasError()) {
+    LOG(ERROR) << "queryCounters: error sending message " << sendRet.error();
+    return emptyResponse;
+  }
+
+  const auto respMsg = monitorCmdSock_.recvOne();
+  if (respMsg.hasError()) {
+    LOG(ERROR) << "queryCounters: error receiving message " << respMsg.error();
+    return emptyResponse;
+  }
+
+  auto response =
+      respMsg.value().readThriftObj<thrift::CounterQueryResponse>(serializer_);
+  if (response.hasError()) {
+    LOG(ERROR) << "queryCounters: error reading message" << response.error();
+    return emptyResponse;
+  }
+
+  return std::move(response).value();
+}
+
+CounterMap
+ZmqMonitorClient::getCountersByPrefix(
+    std::string const& prefix, std::string const& pattern) {
+  thrift::CounterQueryParams params;
+  params.prefix = prefix;
+  params.pattern = pattern;
+
+  CounterMap counters;
+  while (true) {
+    auto page = queryCounters(params);
+    counters.insert(page.counters.begin(), page.counters.end());
+    if (not page.hasMore) {
+      break;
+    }
+    params.startAfter = std::move(page.lastCounterName);
+  }
+  return counters;
+}
+
+std::map<std::string, std::vector<thrift::WindowStats>>
+ZmqMonitorClient::getCounterHistory(
+    std::vector<std::string> const& names, std::string const& prefix) {
+  flush();
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::GET_COUNTER_HISTORY;
+  thriftReq.counterHistoryParams.counterNames = names;
+  thriftReq.counterHistoryParams.prefix = prefix;
+
+  std::map<std::string, std::vector<thrift::WindowStats>> emptyHistory;
+
+  const auto sendRet = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (sendRet.hasError()) {
+    LOG(ERROR) << "getCounterHistory: error sending message "
+               << sendRet.error();
+    return emptyHistory;
+  }
+
+  const auto respMsg = monitorCmdSock_.recvOne();
+  if (respMsg.hasError()) {
+    LOG(ERROR) << "getCounterHistory: error receiving message "
+               << respMsg.error();
+    return emptyHistory;
+  }
+
+  auto response =
+      respMsg.value().readThriftObj<thrift::CounterHistoryResponse>(
+          serializer_);
+  if (response.hasError()) {
+    LOG(ERROR) << "getCounterHistory: error reading message"
+               << response.error();
+    return emptyHistory;
+  }
+
+  return std::move(response.value().counterWindows);
+}
+
+ZmqMonitorClient::CounterStream
+ZmqMonitorClient::streamCounters(
+    int32_t maxCountersPerChunk, std::string const& startAfter) {
+  flush();
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::DUMP_COUNTER_DATA_STREAMED;
+  thriftReq.counterDumpParams.startAfter = startAfter;
+  thriftReq.counterDumpParams.maxCountersPerChunk = maxCountersPerChunk;
+
+  const auto sendRet = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (sendRet.hasError()) {
+    LOG(ERROR) << "streamCounters: error sending message " << sendRet.error();
+  }
+  CounterStream stream(this, sendRet.hasError());
+  stream.continuationToken_ = startAfter;
+  return stream;
+}
+
+ZmqMonitorClient::CounterStream::CounterStream(
+    ZmqMonitorClient* client, bool failed)
+    : client_(client), finished_(failed), failed_(failed) {}
+
+ZmqMonitorClient::CounterStream::CounterStream(CounterStream&& other) noexcept
+    : client_(other.client_),
+      nextChunkIndex_(other.nextChunkIndex_),
+      finished_(other.finished_),
+      failed_(other.failed_),
+      continuationToken_(std::move(other.continuationToken_)) {
+  other.finished_ = true;
+}
+
+ZmqMonitorClient::CounterStream::~CounterStream() {
+  if (not finished_) {
+    fail();
+  }
+}
+
+folly::Optional<CounterMap>
+ZmqMonitorClient::CounterStream::next() {
+  if (finished_) {
+    return folly::none;
+  }
+
+  const auto respMsg = client_->monitorCmdSock_.recvOne();
+  if (respMsg.hasError()) {
+    LOG(ERROR) << "streamCounters: error receiving message "
+               << respMsg.error();
+    // Nothing to drain if monitor isn't responding
+    failed_ = finished_ = true;
+    return folly::none;
+  }
+
+  auto chunk = respMsg.value().readThriftObj<thrift::CounterDumpChunk>(
+      client_->serializer_);
+  if (chunk.hasError()) {
+    LOG(ERROR) << "streamCounters: error reading message" << chunk.error();
+    fail();
+    return folly::none;
+  }
+  if (chunk->chunkIndex != nextChunkIndex_) {
+    // Chunks dropped on their way, e.g. by HWM of monitor's socket
+    LOG(ERROR) << "streamCounters: expected chunk " << nextChunkIndex_
+               << " but received " << chunk->chunkIndex;
+    finished_ = chunk->last;
+    fail();
+    return folly::none;
+  }
+
+  ++nextChunkIndex_;
+  continuationToken_ = std::move(chunk->continuationToken);
+  finished_ = chunk->last;
+  return std::move(chunk->counters);
+}
+
+void
+ZmqMonitorClient::CounterStream::fail() {
+  failed_ = true;
+  while (not finished_) {
+    const auto respMsg = client_->monitorCmdSock_.recvOne();
+    if (respMsg.hasError()) {
+      break;
+    }
+    const auto chunk = respMsg.value().readThriftObj<thrift::CounterDumpChunk>(
+        client_->serializer_);
+    finished_ = chunk.hasError() or chunk->last;
+  }
+  finished_ = true;
+}
+
 void
 ZmqMonitorClient::bumpCounter(std::string const& name) {
+  if (buffered_) {
+    ++bufferedBumps_[name];
+    maybeFlush();
+    return;
+  }
+
   thrift::MonitorRequest thriftReq;
   thriftReq.cmd = thrift::MonitorCommand::BUMP_COUNTER;
   thriftReq.counterBumpParams.counterNames.emplace_back(name);
@@ -168,8 +481,57 @@ ZmqMonitorClient::bumpCounter(std::string const& name) {
   }
 }
 
+void
+ZmqMonitorClient::bumpCounterBy(std::string const& name, int64_t delta) {
+  if (buffered_) {
+    bufferedBumps_[name] += delta;
+    maybeFlush();
+    return;
+  }
+
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::BUMP_COUNTER_BY;
+  thriftReq.counterBumpByParams.counterDeltas.emplace(name, delta);
+
+  const auto ret = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (ret.hasError()) {
+    LOG(ERROR) << "bumpCounterBy: error sending message " << ret.error();
+  }
+}
+
+void
+ZmqMonitorClient::deleteCounters(
+    std::vector<std::string> const& names, std::string const& prefix) {
+  // buffered updates must not recreate deleted counters afterwards
+  if (buffered_) {
+    flush();
+  }
+
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::DELETE_COUNTERS;
+  thriftReq.counterDeleteParams.counterNames = names;
+  thriftReq.counterDeleteParams.prefix = prefix;
+
+  const auto ret = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (ret.hasError()) {
+    LOG(ERROR) << "deleteCounters: error sending message " << ret.error();
+  }
+}
+
 void
 ZmqMonitorClient::addEventLog(thrift::EventLog const& eventLog) {
+  if (logBatching_) {
+    batchedEventLogs_.push_back(eventLog);
+    numBatchedSamples_ +=
+        eventLog.samples.size() + eventLog.binarySamples.size();
+    if (numBatchedSamples_ >= maxBatchSamples_) {
+      flushEventLogs();
+    }
+    return;
+  }
+
   thrift::MonitorRequest thriftReq;
   thriftReq.cmd = thrift::MonitorCommand::LOG_EVENT;
   thriftReq.eventLog = eventLog;
@@ -9,11 +9,17 @@
 
 #pragma once
 
+#include <map>
+#include <memory>
+#include <unordered_map>
+
 #include <boost/serialization/strong_typedef.hpp>
+#include <fbzmq/async/ZmqTimeout.h>
 #include <fbzmq/zmq/Zmq.h>
 #include <folly/Optional.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
+#include "EventLogCodec.h"
 #include "ZmqMonitor.h"
 
 namespace fbzmq {
@@ -27,14 +33,134 @@ namespace fbzmq {
  */
 class ZmqMonitorClient {
  public:
+  /**
+   * Incremental reader of counters streamed by monitor, look at
+   * `streamCounters`. Client can't be used for other requests until stream is
+   * finished. Unfinished stream is drained on destruction.
+   */
+  class CounterStream {
+   public:
+    CounterStream(CounterStream&& other) noexcept;
+    CounterStream& operator=(CounterStream&&) = delete;
+    ~CounterStream();
+
+    /**
+     * Next chunk of counters, none once stream is finished or failed
+     */
+    folly::Optional<CounterMap> next();
+
+    bool
+    isFinished() const {
+      return finished_;
+    }
+
+    /**
+     * Stream was cut short by an error or lost chunks
+     */
+    bool
+    hasFailed() const {
+      return failed_;
+    }
+
+    /**
+     * Name of last counter received. Failed stream can be resumed by passing
+     * it as `startAfter` to a new stream.
+     */
+    std::string const&
+    getContinuationToken() const {
+      return continuationToken_;
+    }
+
+   private:
+    friend class ZmqMonitorClient;
+
+    CounterStream(ZmqMonitorClient* client, bool failed);
+
+    // fail stream and discard rest of its chunks
+    void fail();
+
+    ZmqMonitorClient* client_{nullptr};
+    int32_t nextChunkIndex_{0};
+    bool finished_{false};
+    bool failed_{false};
+    std::string continuationToken_;
+  };
+
   /**
    * Creates and initializes all necessary sockets for communicating with
-   * ZmqMonitor.
+   * ZmqMonitor. Responses are waited for indefinitely unless `recvTimeout` is
+   * specified.
    */
   ZmqMonitorClient(
       fbzmq::Context& zmqContext,
       std::string const& monitorCmdUrl,
-      std::string const& socketId = "");
+      std::string const& socketId = "",
+      folly::Optional<std::chrono::milliseconds> recvTimeout = folly::none);
+
+  /**
+   * Flushes buffered updates if any
+   */
+  ~ZmqMonitorClient();
+
+  /**
+   * Buffered mode for hot code paths. `setCounter(s)` and `bumpCounter(By)` are
+   * accumulated locally, sets with last write wins and bumps by summing up
+   * their deltas (set discards bumps buffered before it). Buffered updates
+   * are sent with one request per kind on `flush`, which happens when number
+   * of buffered counters reaches `flushThreshold`, before every read request
+   * (so that reads observe own writes) and on destruction.
+   *
+   * With `eventLoop` updates are also flushed every `flushInterval` via a
+   * ZmqTimeout. Client must then be used and destroyed within the loop's
+   * thread.
+   */
+  void enableBuffering(size_t flushThreshold);
+  void enableBuffering(
+      size_t flushThreshold,
+      ZmqEventLoop* eventLoop,
+      std::chrono::milliseconds flushInterval);
+
+  /**
+   * Batch event logs in bursty code paths. Instead of request per
+   * `addEventLog` they are accumulated locally and sent as single compressed
+   * LOG_EVENT_BATCH request on `flush`, which happens once `maxBatchSamples`
+   * samples are buffered and on destruction. Monitor publishes batches as
+   * they are (EVENT_LOG_BATCH_PUB), subscribers decode them with
+   * `decompressEventLogs`.
+   *
+   * With `eventLoop` batches are also flushed every `flushInterval` via a
+   * ZmqTimeout. Client must then be used and destroyed within the loop's
+   * thread.
+   */
+  void enableLogBatching(
+      size_t maxBatchSamples,
+      thrift::CompressionType compression = thrift::CompressionType::ZSTD);
+  void enableLogBatching(
+      size_t maxBatchSamples,
+      ZmqEventLoop* eventLoop,
+      std::chrono::milliseconds flushInterval,
+      thrift::CompressionType compression = thrift::CompressionType::ZSTD);
+
+  /**
+   * Send buffered updates and event logs, if any
+   */
+  void flush();
+
+  /**
+   * Number of distinct counters buffered currently
+   */
+  size_t
+  getNumBufferedCounters() const {
+    return bufferedSets_.size() + bufferedBumps_.size();
+  }
+
+  /**
+   * Number of event log samples batched currently
+   */
+  size_t
+  getNumBatchedSamples() const {
+    return numBatchedSamples_;
+  }
 
   //
   // Synchronous wrapper calls around ZmqMonitor
@@ -62,17 +188,70 @@ class ZmqMonitorClient {
    */
   CounterMap dumpCounters();
 
+  /**
+   * One page of counters matching query, look at thrift::CounterQueryParams.
+   * Empty page without `hasMore` is returned on error.
+   */
+  thrift::CounterQueryResponse queryCounters(
+      thrift::CounterQueryParams const& params);
+
+  /**
+   * All counters with names starting with `prefix` (and matching glob
+   * `pattern` unless empty), fetched page by page.
+   */
+  CounterMap getCountersByPrefix(
+      std::string const& prefix, std::string const& pattern = "");
+
+  /**
+   * Server computed stats of counters over 60/600/3600 second windows, for
+   * counters of given names and names starting with `prefix` unless empty.
+   * Monitor must keep history, look at ZmqMonitor.
+   */
+  std::map<std::string, std::vector<thrift::WindowStats>> getCounterHistory(
+      std::vector<std::string> const& names, std::string const& prefix = "");
+
+  /**
+   * Stream all counters in chunks of at most `maxCountersPerChunk`, starting
+   * after `startAfter` name if given. Unlike `dumpCounters` neither monitor
+   * nor client hold a full copy of counters and monitor keeps serving other
+   * requests in between chunks.
+   */
+  CounterStream streamCounters(
+      int32_t maxCountersPerChunk = 1000, std::string const& startAfter = "");
+
   /**
    * Bump counter.
    */
   void bumpCounter(std::string const& name);
 
+  /**
+   * Bump counter by given delta (can be negative) with single request
+   */
+  void bumpCounterBy(std::string const& name, int64_t delta);
+
+  /**
+   * Delete counters from monitor, along with all counters with names starting
+   * with `prefix` unless it is empty. Buffered updates are flushed first.
+   */
+  void deleteCounters(
+      std::vector<std::string> const& names, std::string const& prefix = "");
+
   /**
    * Add an event log.
    */
   void addEventLog(thrift::EventLog const& eventLog);
 
  private:
+  /**
+   * Flush if buffered counters crossed the threshold
+   */
+  void maybeFlush();
+
+  /**
+   * Send batched event logs, if any
+   */
+  void flushEventLogs();
+
   //
   // Mutable state
   //
@@ -84,6 +263,21 @@ class ZmqMonitorClient {
 
   // Serializer object for thrift-obj <-> string conversion
   apache::thrift::CompactSerializer serializer_;
+
+  // Buffered mode state, look at `enableBuffering`
+  bool buffered_{false};
+  size_t flushThreshold_{0};
+  CounterMap bufferedSets_;
+  thrift::CounterDeltaMap bufferedBumps_;
+  std::unique_ptr<ZmqTimeout> flushTimer_;
+
+  // Event log batching state, look at `enableLogBatching`
+  bool logBatching_{false};
+  size_t maxBatchSamples_{0};
+  thrift::CompressionType compression_{thrift::CompressionType::ZSTD};
+  std::vector<thrift::EventLog> batchedEventLogs_;
+  size_t numBatchedSamples_{0};
+  std::unique_ptr<ZmqTimeout> logFlushTimer_;
 };
 
 } // namespace fbzmq
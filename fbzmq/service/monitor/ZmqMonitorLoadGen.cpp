@@ -0,0 +1,324 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/Random.h>
+#include <folly/String.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fbzmq/service/monitor/ZmqMonitor.h>
+#include <fbzmq/service/monitor/ZmqMonitorClient.h>
+#include <fbzmq/service/monitor/ZmqShardedMonitor.h>
+
+/**
+ * Load generator for sizing monitor deployments. Runs a monitor in process,
+ * drives it with `num_clients` ZmqMonitorClient threads and counts what
+ * `num_subscribers` SUB sockets receive. Reports
+ * - ingest rate: counter updates per second processed by monitor
+ * - publish drop rate: publications which didn't make it to subscribers
+ * - dump latency: DUMP_ALL_COUNTER_DATA round trip at given store sizes
+ */
+
+DEFINE_int32(num_clients, 4, "Client threads sending updates");
+DEFINE_int32(num_subscribers, 2, "Subscribers of monitor's publications");
+DEFINE_int32(num_counters, 10000, "Distinct counter names updated");
+DEFINE_int32(counters_per_set, 10, "Counters per SET_COUNTER_VALUES request");
+DEFINE_int32(set_percent, 50, "Percent of requests which are sets, vs bumps");
+DEFINE_int32(duration_s, 10, "Duration of ingest phase");
+DEFINE_int32(num_shards, 0, "Run ZmqShardedMonitor with shards, if non-zero");
+DEFINE_int32(pub_interval_ms, 0, "Coalescing interval of ZmqMonitor");
+DEFINE_int32(max_pub_batch_size, 1000, "Publication batch size of ZmqMonitor");
+DEFINE_int32(flush_threshold, 0, "Buffer client updates, if non-zero");
+DEFINE_string(
+    dump_store_sizes,
+    "1000,10000,100000",
+    "Store sizes to measure dump latency at, empty to skip");
+DEFINE_int32(num_dumps, 10, "Dumps per store size");
+DEFINE_string(
+    monitor_cmd_url, "inproc://monitor-loadgen-cmd", "Monitor command url");
+DEFINE_string(
+    monitor_pub_url, "inproc://monitor-loadgen-pub", "Monitor publish url");
+
+using namespace fbzmq;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const std::string kSyncCounter{"loadgen.sync"};
+
+// counts publications a subscriber received
+struct SubscriberStats {
+  std::atomic<uint64_t> numPubs{0};
+  std::atomic<uint64_t> numCounters{0};
+};
+
+std::string
+getCounterName(uint32_t index) {
+  return folly::sformat("loadgen.counter.{}", index);
+}
+
+double
+getSeconds(Clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+void
+runSubscriber(
+    Context& context, SubscriberStats& stats, std::atomic<bool> const& stop) {
+  apache::thrift::CompactSerializer serializer;
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+  sub.connect(SocketUrl{FLAGS_monitor_pub_url}).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+
+  while (not stop) {
+    auto pub = sub.recvThriftObj<thrift::MonitorPub>(
+        serializer, std::chrono::milliseconds(100));
+    if (pub.hasError() ||
+        pub.value().pubType != thrift::PubType::COUNTER_PUB) {
+      continue;
+    }
+    stats.numPubs.fetch_add(1, std::memory_order_relaxed);
+    stats.numCounters.fetch_add(
+        pub.value().counterPub.counters.size(), std::memory_order_relaxed);
+  }
+}
+
+// send random mix of sets and bumps until deadline, returns number of
+// counter updates sent
+uint64_t
+runClient(Context& context, Clock::time_point deadline) {
+  ZmqMonitorClient client(context, FLAGS_monitor_cmd_url);
+  if (FLAGS_flush_threshold > 0) {
+    client.enableBuffering(FLAGS_flush_threshold);
+  }
+
+  uint64_t numUpdates = 0;
+  while (Clock::now() < deadline) {
+    // check clock every few requests only
+    for (int i = 0; i < 100; ++i) {
+      if (folly::Random::rand32(100) <
+          static_cast<uint32_t>(FLAGS_set_percent)) {
+        CounterMap counters;
+        for (int j = 0; j < FLAGS_counters_per_set; ++j) {
+          thrift::Counter counter;
+          counter.value = folly::Random::rand32();
+          counter.valueType = thrift::CounterValueType::GAUGE;
+          counters[getCounterName(
+              folly::Random::rand32(FLAGS_num_counters))] = counter;
+        }
+        numUpdates += counters.size();
+        client.setCounters(counters);
+      } else {
+        client.bumpCounter(
+            getCounterName(folly::Random::rand32(FLAGS_num_counters)));
+        numUpdates += 1;
+      }
+    }
+  }
+
+  // round trip, all earlier requests of this client have been processed
+  // once it returns
+  client.dumpCounterNames();
+  return numUpdates;
+}
+
+void
+measureIngest(Context& context, ZmqMonitor* monitor) {
+  std::atomic<bool> stopSubscribers{false};
+  std::vector<std::unique_ptr<SubscriberStats>> subStats;
+  std::vector<std::thread> subscribers;
+  for (int i = 0; i < FLAGS_num_subscribers; ++i) {
+    subStats.emplace_back(std::make_unique<SubscriberStats>());
+    subscribers.emplace_back(
+        [&context, &stopSubscribers, stats = subStats.back().get()]() {
+          runSubscriber(context, *stats, stopSubscribers);
+        });
+  }
+
+  // Bump until every subscriber is connected and gets publications
+  {
+    ZmqMonitorClient client(context, FLAGS_monitor_cmd_url);
+    auto allConnected = [&subStats]() {
+      return std::all_of(
+          subStats.begin(), subStats.end(), [](auto const& stats) {
+            return stats->numPubs > 0;
+          });
+    };
+    while (not allConnected()) {
+      client.bumpCounter(kSyncCounter);
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    client.dumpCounterNames();
+  }
+  // publications of sync bumps may still be in flight
+  std::this_thread::sleep_for(
+      std::chrono::milliseconds(2 * FLAGS_pub_interval_ms + 500));
+  std::vector<uint64_t> basePubs;
+  std::vector<uint64_t> baseCounters;
+  for (auto const& stats : subStats) {
+    basePubs.push_back(stats->numPubs);
+    baseCounters.push_back(stats->numCounters);
+  }
+  const auto basePubStats =
+      monitor ? monitor->getPubStats() : ZmqMonitor::PubStats{};
+
+  LOG(INFO) << "Running " << FLAGS_num_clients << " clients for "
+            << FLAGS_duration_s << "s";
+  const auto start = Clock::now();
+  const auto deadline = start + std::chrono::seconds(FLAGS_duration_s);
+  std::vector<uint64_t> numUpdates(FLAGS_num_clients, 0);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < FLAGS_num_clients; ++i) {
+    clients.emplace_back([&context, &numUpdates, deadline, i]() {
+      numUpdates[i] = runClient(context, deadline);
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  const auto elapsed = getSeconds(Clock::now() - start);
+
+  uint64_t totalUpdates = 0;
+  for (auto num : numUpdates) {
+    totalUpdates += num;
+  }
+  LOG(INFO) << folly::sformat(
+      "ingest: {} updates in {:.2f}s, {:.0f} updates/s",
+      totalUpdates,
+      elapsed,
+      totalUpdates / elapsed);
+
+  // let last publications drain
+  std::this_thread::sleep_for(
+      std::chrono::milliseconds(2 * FLAGS_pub_interval_ms + 1000));
+  stopSubscribers = true;
+  for (auto& subscriber : subscribers) {
+    subscriber.join();
+  }
+
+  // Every update appears in exactly one publication unless ZmqMonitor
+  // coalesces them, compare against its count of publications then
+  uint64_t expectedPubs = 0;
+  if (monitor) {
+    const auto pubStats = monitor->getPubStats();
+    expectedPubs = pubStats.numPublications - basePubStats.numPublications;
+    LOG(INFO) << folly::sformat(
+        "publish: {} publications, {} updates coalesced, {} merged",
+        expectedPubs,
+        pubStats.numSuppressedUpdates - basePubStats.numSuppressedUpdates,
+        pubStats.numMergedUpdates - basePubStats.numMergedUpdates);
+  }
+  for (size_t i = 0; i < subStats.size(); ++i) {
+    const uint64_t numPubs = subStats[i]->numPubs - basePubs[i];
+    const uint64_t numCounters = subStats[i]->numCounters - baseCounters[i];
+    const double dropRate = expectedPubs
+        ? 1.0 - static_cast<double>(numPubs) / expectedPubs
+        : 1.0 - static_cast<double>(numCounters) / totalUpdates;
+    LOG(INFO) << folly::sformat(
+        "subscriber {}: {} publications, {} counters, drop rate {:.4f}",
+        i,
+        numPubs,
+        numCounters,
+        std::max(0.0, dropRate));
+  }
+}
+
+void
+measureDumpLatency(Context& context) {
+  std::vector<uint32_t> storeSizes;
+  folly::splitTo<uint32_t>(
+      ',', FLAGS_dump_store_sizes, std::back_inserter(storeSizes), true);
+  std::sort(storeSizes.begin(), storeSizes.end());
+
+  ZmqMonitorClient client(context, FLAGS_monitor_cmd_url);
+  uint32_t numFilled = 0;
+  for (auto storeSize : storeSizes) {
+    // fill store with extra counters of their own, in chunks
+    while (numFilled < storeSize) {
+      CounterMap counters;
+      for (int i = 0; i < 1000 && numFilled < storeSize; ++i, ++numFilled) {
+        thrift::Counter counter;
+        counter.value = numFilled;
+        counters[folly::sformat("loadgen.dump.{}", numFilled)] = counter;
+      }
+      client.setCounters(counters);
+    }
+
+    Clock::duration total{0};
+    Clock::duration worst{0};
+    size_t numDumped = 0;
+    for (int i = 0; i < FLAGS_num_dumps; ++i) {
+      const auto start = Clock::now();
+      numDumped = client.dumpCounters().size();
+      const auto latency = Clock::now() - start;
+      total += latency;
+      worst = std::max(worst, latency);
+    }
+    LOG(INFO) << folly::sformat(
+        "dump of {} counters: avg {:.2f}ms, max {:.2f}ms",
+        numDumped,
+        getSeconds(total) * 1000 / std::max(1, FLAGS_num_dumps),
+        getSeconds(worst) * 1000);
+  }
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[]) {
+  // Parse command line flags
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+
+  Context context;
+
+  // ZmqMonitor exposes publication stats, ZmqShardedMonitor doesn't
+  std::unique_ptr<ZmqEventLoop> monitor;
+  ZmqMonitor* zmqMonitor = nullptr;
+  if (FLAGS_num_shards > 0) {
+    monitor = std::make_unique<ZmqShardedMonitor>(
+        FLAGS_monitor_cmd_url,
+        FLAGS_monitor_pub_url,
+        context,
+        FLAGS_num_shards);
+  } else {
+    auto zmqMonitorPtr = std::make_unique<ZmqMonitor>(
+        FLAGS_monitor_cmd_url,
+        FLAGS_monitor_pub_url,
+        context,
+        folly::none,
+        ZmqMonitor::Options()
+            .setPubInterval(std::chrono::milliseconds(FLAGS_pub_interval_ms))
+            .setMaxPubBatchSize(FLAGS_max_pub_batch_size));
+    zmqMonitor = zmqMonitorPtr.get();
+    monitor = std::move(zmqMonitorPtr);
+  }
+  std::thread monitorThread([&monitor]() { monitor->run(); });
+  monitor->waitUntilRunning();
+
+  measureIngest(context, zmqMonitor);
+  measureDumpLatency(context);
+
+  monitor->stop();
+  monitorThread.join();
+  return 0;
+}
@@ -0,0 +1,595 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ZmqShardedMonitor.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include <fbzmq/service/monitor/EventLogCodec.h>
+#include <fbzmq/service/monitor/PubTopic.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Merge pages of all shards into first page of combined counters
+thrift::CounterQueryResponse
+mergePages(
+    std::vector<thrift::CounterQueryResponse> pages,
+    int32_t maxCounters,
+    bool namesOnly) {
+  const size_t limit = maxCounters > 0
+      ? std::min(maxCounters, CounterStore::kMaxPageSize)
+      : CounterStore::kMaxPageSize;
+
+  thrift::CounterQueryResponse response;
+  std::vector<std::string> names;
+  CounterMap counters;
+  for (auto& page : pages) {
+    response.hasMore |= page.hasMore;
+    if (namesOnly) {
+      std::move(
+          page.counterNames.begin(),
+          page.counterNames.end(),
+          std::back_inserter(names));
+      continue;
+    }
+    for (auto& kv : page.counters) {
+      names.emplace_back(kv.first);
+      counters.emplace(kv.first, std::move(kv.second));
+    }
+  }
+
+  // Every shard returned its first `limit` matches, which leaves first
+  // `limit` of all of them within the union
+  std::sort(names.begin(), names.end());
+  if (names.size() > limit) {
+    response.hasMore = true;
+    names.resize(limit);
+  }
+  if (not names.empty()) {
+    response.lastCounterName = names.back();
+  }
+  if (namesOnly) {
+    response.counterNames = std::move(names);
+  } else {
+    for (auto const& name : names) {
+      response.counters.emplace(name, std::move(counters.at(name)));
+    }
+  }
+  return response;
+}
+
+} // namespace
+
+ZmqShardedMonitor::ZmqShardedMonitor(
+    const std::string& monitorSubmitUrl,
+    const std::string& monitorPubUrl,
+    Context& zmqContext,
+    size_t numShards,
+    const folly::Optional<LogSample>& logSampleToMerge,
+    bool keepHistory,
+    bool topicFrames)
+    : monitorSubmitUrl_(monitorSubmitUrl),
+      monitorPubUrl_(monitorPubUrl),
+      monitorReceiveSock_{zmqContext},
+      monitorPubSock_{zmqContext},
+      logSampleToMerge_{logSampleToMerge},
+      topicFrames_(topicFrames),
+      shardLoops_(numShards) {
+  CHECK_LT(0, numShards) << "ZmqShardedMonitor needs at least one shard";
+  for (size_t i = 0; i < numShards; ++i) {
+    stores_.emplace_back(std::make_unique<CounterStore>(keepHistory));
+  }
+
+  // Prepare router socket to talk to Broker/other processes
+  const int handover = 1;
+  const auto handoverRet = monitorReceiveSock_.setSockOpt(
+      ZMQ_ROUTER_HANDOVER, &handover, sizeof(int));
+  if (handoverRet.hasError()) {
+    LOG(FATAL) << "ZmqShardedMonitor: Could not set ZMQ_ROUTER_HANDOVER "
+               << handoverRet.error();
+  }
+
+  // bind monitor router socket
+  VLOG(2) << "ZmqShardedMonitor: Binding to monitorSubmitUrl '"
+          << monitorSubmitUrl_ << "'";
+  const auto receiveBindRet =
+      monitorReceiveSock_.bind(SocketUrl{monitorSubmitUrl_});
+  if (receiveBindRet.hasError()) {
+    LOG(FATAL) << "ZmqShardedMonitor: Error binding to '" << monitorSubmitUrl_
+               << "' " << receiveBindRet.error();
+  }
+
+  // Prepare PUB socket for updating monitor
+  const int hwm = 1024;
+  const auto hwmRet =
+      monitorPubSock_.setSockOpt(ZMQ_SNDHWM, &hwm, sizeof(int));
+  if (hwmRet.hasError()) {
+    LOG(FATAL) << "ZmqShardedMonitor: Could not set ZMQ_SNDHWM "
+               << hwmRet.error();
+  }
+
+  // bind monitor pub socket
+  VLOG(2) << "ZmqShardedMonitor: Binding to monitorPubUrl '" << monitorPubUrl_
+          << "'";
+  const auto pubBindRet = monitorPubSock_.bind(SocketUrl{monitorPubUrl_});
+  if (pubBindRet.hasError()) {
+    LOG(FATAL) << "ZmqShardedMonitor: Error binding to '" << monitorPubUrl_
+               << "' " << pubBindRet.error();
+  }
+
+  // Attach callback on monitor socket for read events
+  addSocket(
+      RawZmqSocketPtr{*monitorReceiveSock_},
+      ZMQ_POLLIN,
+      [this](int /* revents */) noexcept {
+        VLOG(4) << "ZmqShardedMonitor: monitor request received...";
+        try {
+          processRequest();
+        } catch (std::exception const& e) {
+          LOG(ERROR) << "Error processing MonitorRequest: "
+                     << folly::exceptionStr(e);
+        }
+      });
+
+  // Results and publications of shards
+  addSocketFd(repliesSignal_.getFd(), ZMQ_POLLIN, [this](int) noexcept {
+    processReplies();
+  });
+
+  shardLoops_.start();
+}
+
+ZmqShardedMonitor::~ZmqShardedMonitor() {
+  // Shards must be gone before their stores and this loop
+  shardLoops_.stop();
+  removeSocketFd(repliesSignal_.getFd());
+}
+
+size_t
+ZmqShardedMonitor::getShard(std::string const& name) const {
+  return std::hash<std::string>()(name) % stores_.size();
+}
+
+void
+ZmqShardedMonitor::processRequest() {
+  auto ret = monitorReceiveSock_.recvMultiple();
+  if (ret.hasError()) {
+    LOG(ERROR) << "processRequest: Error receiving command: " << ret.error();
+    return;
+  }
+  if (ret.value().size() < 2) {
+    LOG(ERROR) << "processRequest: Unexpected number of frames "
+               << ret.value().size();
+    return;
+  }
+
+  // Last frame is the actual request, frames before it form the envelope
+  std::vector<Message> envelope = std::move(ret.value());
+  Message thriftReqMsg = std::move(envelope.back());
+  envelope.pop_back();
+
+  auto maybeThriftReq =
+      thriftReqMsg.readThriftObj<thrift::MonitorRequest>(serializer_);
+  if (maybeThriftReq.hasError()) {
+    LOG(ERROR) << "processRequest: failed reading thrift::MonitorRequest "
+               << maybeThriftReq.error();
+    return;
+  }
+
+  auto thriftReq = std::move(maybeThriftReq).value();
+  const size_t numShards = getNumShards();
+
+  switch (thriftReq.cmd) {
+  case thrift::MonitorCommand::SET_COUNTER_VALUES: {
+    std::vector<CounterMap> perShard(numShards);
+    for (auto& kv : thriftReq.counterSetParams.counters) {
+      perShard[getShard(kv.first)].emplace(kv.first, std::move(kv.second));
+    }
+    for (size_t shard = 0; shard < numShards; ++shard) {
+      if (perShard[shard].empty()) {
+        continue;
+      }
+      runInShard(
+          shard,
+          [ this, counters = std::move(perShard[shard]) ](
+              CounterStore & store) {
+            for (auto const& kv : counters) {
+              store.setCounter(kv.first, kv.second);
+            }
+            publishFromShard(counters);
+          });
+    }
+    break;
+  }
+
+  case thrift::MonitorCommand::BUMP_COUNTER: {
+    std::vector<std::vector<std::string>> perShard(numShards);
+    for (auto& name : thriftReq.counterBumpParams.counterNames) {
+      perShard[getShard(name)].emplace_back(std::move(name));
+    }
+    for (size_t shard = 0; shard < numShards; ++shard) {
+      if (perShard[shard].empty()) {
+        continue;
+      }
+      runInShard(
+          shard,
+          [ this, names = std::move(perShard[shard]) ](CounterStore & store) {
+            CounterMap updated;
+            for (auto const& name : names) {
+              updated[name] = store.bumpCounter(name, 1);
+            }
+            publishFromShard(updated);
+          });
+    }
+    break;
+  }
+
+  case thrift::MonitorCommand::BUMP_COUNTER_BY: {
+    std::vector<thrift::CounterDeltaMap> perShard(numShards);
+    for (auto const& kv : thriftReq.counterBumpByParams.counterDeltas) {
+      perShard[getShard(kv.first)].emplace(kv);
+    }
+    for (size_t shard = 0; shard < numShards; ++shard) {
+      if (perShard[shard].empty()) {
+        continue;
+      }
+      runInShard(
+          shard,
+          [ this, deltas = std::move(perShard[shard]) ](CounterStore & store) {
+            CounterMap updated;
+            for (auto const& kv : deltas) {
+              updated[kv.first] = store.bumpCounter(kv.first, kv.second);
+            }
+            publishFromShard(updated);
+          });
+    }
+    break;
+  }
+
+  case thrift::MonitorCommand::DELETE_COUNTERS: {
+    // named counters go to their shard, prefix to all of them
+    auto const& params = thriftReq.counterDeleteParams;
+    std::vector<std::vector<std::string>> perShard(numShards);
+    for (auto const& name : params.counterNames) {
+      perShard[getShard(name)].emplace_back(name);
+    }
+    for (size_t shard = 0; shard < numShards; ++shard) {
+      if (perShard[shard].empty() && params.prefix.empty()) {
+        continue;
+      }
+      runInShard(
+          shard,
+          [ names = std::move(perShard[shard]), prefix = params.prefix ](
+              CounterStore & store) {
+            for (auto const& name : names) {
+              store.eraseCounter(name);
+            }
+            if (not prefix.empty()) {
+              store.eraseCountersByPrefix(prefix);
+            }
+          });
+    }
+    break;
+  }
+
+  case thrift::MonitorCommand::GET_COUNTER_VALUES: {
+    std::vector<std::vector<std::string>> perShard(numShards);
+    for (auto& name : thriftReq.counterGetParams.counterNames) {
+      perShard[getShard(name)].emplace_back(std::move(name));
+    }
+    std::vector<std::function<CounterMap(CounterStore&)>> fns;
+    for (auto& names : perShard) {
+      fns.emplace_back([names = std::move(names)](CounterStore & store) {
+        CounterMap counters;
+        for (auto const& name : names) {
+          auto counter = store.getCounter(name);
+          if (counter) {
+            counters[name] = *counter;
+          }
+        }
+        return counters;
+      });
+    }
+    scatterGather<CounterMap>(
+        std::move(fns),
+        [ this, envelope = std::move(envelope) ](
+            std::vector<CounterMap> results) {
+          thrift::CounterValuesResponse thriftValueRep;
+          for (auto& counters : results) {
+            thriftValueRep.counters.insert(counters.begin(), counters.end());
+          }
+          sendEnvelopedResponse(
+              envelope,
+              Message::fromThriftObj(thriftValueRep, serializer_).value());
+        });
+    break;
+  }
+
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES:
+    scatterGatherAll<std::vector<std::string>>(
+        [](CounterStore& store) { return store.getCounterNames(); },
+        [ this, envelope = std::move(envelope) ](
+            std::vector<std::vector<std::string>> results) {
+          thrift::CounterNamesResponse thriftNameRep;
+          for (auto& names : results) {
+            std::move(
+                names.begin(),
+                names.end(),
+                std::back_inserter(thriftNameRep.counterNames));
+          }
+          sendEnvelopedResponse(
+              envelope,
+              Message::fromThriftObj(thriftNameRep, serializer_).value());
+        });
+    break;
+
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA:
+    scatterGatherAll<CounterMap>(
+        [](CounterStore& store) { return store.getCounters(); },
+        [ this, envelope = std::move(envelope) ](
+            std::vector<CounterMap> results) {
+          thrift::CounterValuesResponse thriftValueRep;
+          for (auto& counters : results) {
+            thriftValueRep.counters.insert(counters.begin(), counters.end());
+          }
+          sendEnvelopedResponse(
+              envelope,
+              Message::fromThriftObj(thriftValueRep, serializer_).value());
+        });
+    break;
+
+  case thrift::MonitorCommand::GET_COUNTERS_BY_PREFIX: {
+    auto const params = thriftReq.counterQueryParams;
+    scatterGatherAll<thrift::CounterQueryResponse>(
+        [params](CounterStore& store) { return store.query(params); },
+        [ this, params, envelope = std::move(envelope) ](
+            std::vector<thrift::CounterQueryResponse> results) {
+          sendEnvelopedResponse(
+              envelope,
+              Message::fromThriftObj(
+                  mergePages(
+                      std::move(results), params.maxCounters, params.namesOnly),
+                  serializer_)
+                  .value());
+        });
+    break;
+  }
+
+  case thrift::MonitorCommand::GET_COUNTER_HISTORY: {
+    // Shards only know about their own counters
+    auto const params = thriftReq.counterHistoryParams;
+    scatterGatherAll<thrift::CounterHistoryResponse>(
+        [params](CounterStore& store) { return store.getHistory(params); },
+        [ this, envelope = std::move(envelope) ](
+            std::vector<thrift::CounterHistoryResponse> results) {
+          thrift::CounterHistoryResponse response;
+          for (auto& result : results) {
+            response.counterWindows.insert(
+                std::make_move_iterator(result.counterWindows.begin()),
+                std::make_move_iterator(result.counterWindows.end()));
+          }
+          sendEnvelopedResponse(
+              envelope, Message::fromThriftObj(response, serializer_).value());
+        });
+    break;
+  }
+
+  case thrift::MonitorCommand::DUMP_COUNTER_DATA_STREAMED:
+    streamCounters(
+        std::move(envelope),
+        thriftReq.counterDumpParams.startAfter,
+        thriftReq.counterDumpParams.maxCountersPerChunk,
+        0 /* chunkIndex */);
+    break;
+
+  case thrift::MonitorCommand::LOG_EVENT: {
+    // simply forward, do not store logs
+    thrift::MonitorPub thriftPub;
+    thriftPub.pubType = thrift::PubType::EVENT_LOG_PUB;
+    thriftPub.eventLogPub = std::move(thriftReq.eventLog);
+    if (logSampleToMerge_) {
+      logSampleToMerge_->mergeInto(thriftPub.eventLogPub);
+    }
+    sendPub(
+        getEventLogTopic(thriftPub.eventLogPub.category),
+        Message::fromThriftObj(thriftPub, serializer_).value());
+    break;
+  }
+
+  case thrift::MonitorCommand::LOG_EVENT_BATCH: {
+    // forward batch as it is, it is only decoded to merge logSampleToMerge_
+    thrift::MonitorPub thriftPub;
+    thriftPub.pubType = thrift::PubType::EVENT_LOG_BATCH_PUB;
+    thriftPub.eventLogBatchPub = std::move(thriftReq.compressedEventLogs);
+    if (logSampleToMerge_) {
+      mergeIntoEventLogs(*logSampleToMerge_, thriftPub.eventLogBatchPub);
+    }
+    sendPub(
+        kEventLogBatchTopic,
+        Message::fromThriftObj(thriftPub, serializer_).value());
+    break;
+  }
+
+  default:
+    LOG(ERROR) << "Unknown monitor command received";
+  }
+}
+
+void
+ZmqShardedMonitor::sendEnvelopedResponse(
+    std::vector<Message> const& envelope, Message response) {
+  auto sendRet = monitorReceiveSock_.sendMultiple(envelope, true);
+  if (sendRet.hasValue()) {
+    sendRet = monitorReceiveSock_.sendOne(std::move(response));
+  }
+  if (sendRet.hasError()) {
+    LOG(ERROR) << "processRequest: Error sending response: "
+               << sendRet.error();
+  }
+}
+
+void
+ZmqShardedMonitor::runInShard(
+    size_t shard, folly::Function<void(CounterStore&)> callback) {
+  shardLoops_.getLoop(shard).runInEventLoop(
+      [ this, shard, callback = std::move(callback) ]() mutable noexcept {
+        callback(*stores_[shard]);
+      });
+}
+
+void
+ZmqShardedMonitor::runInFrontLoop(TimeoutCallback callback) {
+  {
+    std::lock_guard<std::mutex> lock(repliesMutex_);
+    replies_.emplace_back(std::move(callback));
+  }
+  repliesSignal_.signal();
+}
+
+void
+ZmqShardedMonitor::processReplies() {
+  // replies queued from now on signal again
+  repliesSignal_.clear();
+  std::vector<TimeoutCallback> replies;
+  {
+    std::lock_guard<std::mutex> lock(repliesMutex_);
+    replies.swap(replies_);
+  }
+  for (auto& reply : replies) {
+    reply();
+  }
+}
+
+template <typename Result>
+void
+ZmqShardedMonitor::scatterGather(
+    std::vector<std::function<Result(CounterStore&)>> fns,
+    folly::Function<void(std::vector<Result>)> done) {
+  CHECK_EQ(getNumShards(), fns.size());
+
+  // Only touched within this loop, results are handed back via replies
+  struct Gather {
+    std::vector<Result> results;
+    size_t numPending{0};
+    folly::Function<void(std::vector<Result>)> done;
+  };
+  auto gather = std::make_shared<Gather>();
+  gather->results.resize(fns.size());
+  gather->numPending = fns.size();
+  gather->done = std::move(done);
+
+  for (size_t shard = 0; shard < fns.size(); ++shard) {
+    runInShard(
+        shard,
+        [ this, gather, shard, fn = std::move(fns[shard]) ](
+            CounterStore & store) {
+          auto result = fn(store);
+          runInFrontLoop(
+              [ gather, shard, result = std::move(result) ]() mutable noexcept {
+                gather->results[shard] = std::move(result);
+                if (--gather->numPending == 0) {
+                  gather->done(std::move(gather->results));
+                }
+              });
+        });
+  }
+}
+
+template <typename Result>
+void
+ZmqShardedMonitor::scatterGatherAll(
+    std::function<Result(CounterStore&)> fn,
+    folly::Function<void(std::vector<Result>)> done) {
+  scatterGather<Result>(
+      std::vector<std::function<Result(CounterStore&)>>(getNumShards(), fn),
+      std::move(done));
+}
+
+void
+ZmqShardedMonitor::publishFromShard(CounterMap const& updated) {
+  thrift::MonitorPub thriftPub;
+  thriftPub.pubType = thrift::PubType::COUNTER_PUB;
+  if (not topicFrames_) {
+    thriftPub.counterPub.counters = updated;
+    runInFrontLoop([
+      this,
+      msg = Message::fromThriftObj(thriftPub, serializer_).value()
+    ]() mutable noexcept { sendPub("", std::move(msg)); });
+    return;
+  }
+
+  // pairs of topic and publication
+  std::vector<std::pair<std::string, Message>> pubs;
+  for (auto& kv : splitCountersByTopic(updated)) {
+    thriftPub.counterPub.counters = std::move(kv.second);
+    pubs.emplace_back(
+        kv.first, Message::fromThriftObj(thriftPub, serializer_).value());
+  }
+  runInFrontLoop([ this, pubs = std::move(pubs) ]() mutable noexcept {
+    for (auto& pub : pubs) {
+      sendPub(pub.first, std::move(pub.second));
+    }
+  });
+}
+
+void
+ZmqShardedMonitor::sendPub(std::string const& topic, Message msg) {
+  if (topicFrames_) {
+    monitorPubSock_.sendMultiple(Message::from(topic).value(), std::move(msg));
+  } else {
+    monitorPubSock_.sendOne(std::move(msg));
+  }
+}
+
+void
+ZmqShardedMonitor::streamCounters(
+    std::vector<Message> envelope,
+    std::string const& startAfter,
+    int32_t maxCountersPerChunk,
+    int32_t chunkIndex) {
+  thrift::CounterQueryParams params;
+  params.startAfter = startAfter;
+  params.maxCounters = maxCountersPerChunk;
+
+  scatterGatherAll<thrift::CounterQueryResponse>(
+      [params](CounterStore& store) { return store.query(params); },
+      [
+        this,
+        envelope = std::move(envelope),
+        startAfter,
+        maxCountersPerChunk,
+        chunkIndex
+      ](std::vector<thrift::CounterQueryResponse> results) mutable {
+        auto page = mergePages(
+            std::move(results), maxCountersPerChunk, false /* namesOnly */);
+
+        thrift::CounterDumpChunk chunk;
+        chunk.counters = std::move(page.counters);
+        chunk.chunkIndex = chunkIndex;
+        chunk.continuationToken =
+            page.lastCounterName.empty() ? startAfter : page.lastCounterName;
+        chunk.last = not page.hasMore;
+        sendEnvelopedResponse(
+            envelope, Message::fromThriftObj(chunk, serializer_).value());
+
+        // Next chunk is gathered while other requests are served
+        if (not chunk.last) {
+          streamCounters(
+              std::move(envelope),
+              chunk.continuationToken,
+              maxCountersPerChunk,
+              chunkIndex + 1);
+        }
+      });
+}
+
+} // namespace fbzmq
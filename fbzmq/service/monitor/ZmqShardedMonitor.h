@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fbzmq/async/InprocChannel.h>
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqEventLoopPool.h>
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/service/logging/LogSample.h>
+#include <fbzmq/service/monitor/CounterStore.h>
+#include <fbzmq/zmq/Zmq.h>
+#include <folly/Function.h>
+#include <folly/Optional.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+namespace fbzmq {
+
+/**
+ * Multi-threaded counterpart of ZmqMonitor for hosts where single monitor
+ * thread can't keep up with counter updates. It speaks the same protocol on
+ * the same kind of sockets, so clients don't need to change.
+ *
+ * Counters are partitioned by hash of their name across `numShards` worker
+ * loops, each of which owns a CounterStore. This loop is a front end: it
+ * receives and decodes requests, splits updates by shard and hands them off.
+ * Counter updates and serialization of their publications happen in shard
+ * threads. Reads (get, dumps, prefix queries and streamed dumps) are
+ * scattered to shards and their results gathered back in this loop, which
+ * keeps serving other requests in the meantime.
+ *
+ * Unlike ZmqMonitor, update requests spanning multiple shards result in a
+ * publication per shard, and publications are never coalesced. Counters are
+ * only removed by DELETE_COUNTERS requests, they don't expire.
+ *
+ * Work is handed to shards via their loops' bounded queues (of 1e4
+ * callbacks). Front end blocks while queue of a lagging shard is full, which
+ * pushes back on clients. Results and publications come back through a
+ * queue of this loop which shards never block on, so that shards keep
+ * draining their queues while this loop is blocked on one of them.
+ */
+class ZmqShardedMonitor final : public ZmqEventLoop {
+ public:
+  /**
+   * Shard loops are started right away and stopped on destruction. Look at
+   * ZmqMonitor::Options for `keepHistory` and `topicFrames`.
+   */
+  ZmqShardedMonitor(
+      const std::string& monitorSubmitUrl,
+      const std::string& monitorPubUrl,
+      Context& zmqContext,
+      size_t numShards,
+      const folly::Optional<LogSample>& logSampleToMerge = folly::none,
+      bool keepHistory = false,
+      bool topicFrames = false);
+
+  ~ZmqShardedMonitor() override;
+
+  size_t
+  getNumShards() const {
+    return stores_.size();
+  }
+
+  /**
+   * Shard owning counter of given name
+   */
+  size_t getShard(std::string const& name) const;
+
+ private:
+  ZmqShardedMonitor(ZmqShardedMonitor const&) = delete;
+  ZmqShardedMonitor& operator=(ZmqShardedMonitor const&) = delete;
+
+  // process a monitor request pending on monitorReceiveSock_
+  void processRequest();
+
+  // send response to requester identified by envelope frames
+  void sendEnvelopedResponse(
+      std::vector<Message> const& envelope, Message response);
+
+  // run callback with shard's store within shard's loop, blocks while
+  // shard's queue is full
+  void runInShard(size_t shard, folly::Function<void(CounterStore&)> callback);
+
+  // run `fns[i]` in loop of shard `i` and `done` with their results in this
+  // loop once all of them have finished
+  template <typename Result>
+  void scatterGather(
+      std::vector<std::function<Result(CounterStore&)>> fns,
+      folly::Function<void(std::vector<Result>)> done);
+
+  // same as above with same function for all shards
+  template <typename Result>
+  void scatterGatherAll(
+      std::function<Result(CounterStore&)> fn,
+      folly::Function<void(std::vector<Result>)> done);
+
+  // hand callback over from shard's thread to this loop, never blocks
+  void runInFrontLoop(TimeoutCallback callback);
+
+  // run callbacks handed over by shards
+  void processReplies();
+
+  // serialize publication of updated counters within shard's thread and
+  // have it sent from this loop
+  void publishFromShard(CounterMap const& updated);
+
+  // send serialized publication, preceded by topic frame in topic mode
+  void sendPub(std::string const& topic, Message msg);
+
+  // gather one chunk of DUMP_COUNTER_DATA_STREAMED and schedule next one
+  void streamCounters(
+      std::vector<Message> envelope,
+      std::string const& startAfter,
+      int32_t maxCountersPerChunk,
+      int32_t chunkIndex);
+
+  const std::string monitorSubmitUrl_;
+  const std::string monitorPubUrl_;
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> monitorReceiveSock_;
+  Socket<ZMQ_PUB, ZMQ_SERVER> monitorPubSock_;
+
+  // the serializer/deserializer helper we'll be using, it is stateless hence
+  // shared by shard threads
+  apache::thrift::CompactSerializer serializer_;
+
+  // LogSample to merge to each LogSample we recv
+  const folly::Optional<LogSample> logSampleToMerge_;
+
+  // Whether publications are preceded by topic frame
+  const bool topicFrames_{false};
+
+  // Counters of shard `i` are only accessed within loop `i` of the pool
+  std::vector<std::unique_ptr<CounterStore>> stores_;
+
+  // Callbacks handed over by shards to this loop, unbounded unlike loop's
+  // own queue, and wakeup of this loop once there are any
+  std::mutex repliesMutex_;
+  std::vector<TimeoutCallback> replies_;
+  detail::InprocChannelSignal repliesSignal_;
+
+  ZmqEventLoopPool shardLoops_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/monitor/CounterHistory.h>
+
+namespace fbzmq {
+
+TEST(CounterHistoryTest, WindowStats) {
+  CounterHistory history;
+
+  // No samples yet
+  auto windows = history.getWindowStats(0);
+  ASSERT_EQ(3, windows.size());
+  EXPECT_EQ(60, windows[0].windowSec);
+  EXPECT_EQ(600, windows[1].windowSec);
+  EXPECT_EQ(3600, windows[2].windowSec);
+  for (auto const& stats : windows) {
+    EXPECT_EQ(0, stats.numSamples);
+    EXPECT_EQ(0, stats.rate);
+  }
+
+  // Counter growing by 10 every second for 30 seconds
+  const int64_t kStartMs = 1000000;
+  for (int i = 0; i <= 30; ++i) {
+    history.addSample(i * 10, kStartMs + i * 1000);
+  }
+  windows = history.getWindowStats(kStartMs + 30 * 1000);
+  for (auto const& stats : windows) {
+    EXPECT_EQ(31, stats.numSamples);
+    EXPECT_EQ(0, stats.minValue);
+    EXPECT_EQ(300, stats.maxValue);
+    EXPECT_EQ(150, stats.avgValue);
+    EXPECT_DOUBLE_EQ(10, stats.rate);
+  }
+
+  // Two minutes later samples have only expired from shortest window
+  windows = history.getWindowStats(kStartMs + 150 * 1000);
+  EXPECT_EQ(0, windows[0].numSamples);
+  EXPECT_EQ(31, windows[1].numSamples);
+  EXPECT_EQ(31, windows[2].numSamples);
+
+  // Newer samples replace expired slots of shortest window
+  history.addSample(1000, kStartMs + 150 * 1000);
+  history.addSample(1500, kStartMs + 155 * 1000);
+  windows = history.getWindowStats(kStartMs + 155 * 1000);
+  EXPECT_EQ(2, windows[0].numSamples);
+  EXPECT_EQ(1000, windows[0].minValue);
+  EXPECT_EQ(1500, windows[0].maxValue);
+  EXPECT_DOUBLE_EQ(100, windows[0].rate);
+  EXPECT_EQ(33, windows[1].numSamples);
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
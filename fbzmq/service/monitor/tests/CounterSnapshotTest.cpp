@@ -0,0 +1,146 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <unistd.h>
+
+#include <folly/Format.h>
+#include <folly/ScopeGuard.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/monitor/CounterSnapshot.h>
+
+using namespace fbzmq;
+
+namespace {
+
+thrift::Counter
+makeCounter(double value, thrift::CounterValueType valueType, int64_t ts) {
+  return thrift::Counter(apache::thrift::FRAGILE, value, valueType, ts);
+}
+
+CounterMap
+loadCounters(std::string const& path, size_t& numLoaded) {
+  CounterMap counters;
+  numLoaded = CounterSnapshot::load(
+      path, [&counters](std::string&& name, thrift::Counter&& counter) {
+        counters.emplace(std::move(name), std::move(counter));
+      });
+  return counters;
+}
+
+} // namespace
+
+TEST(CounterSnapshotTest, WriteAndLoad) {
+  const auto path = folly::sformat("/tmp/fbzmq-counter-snapshot-{}", getpid());
+  ::unlink(path.c_str());
+  SCOPE_EXIT {
+    ::unlink(path.c_str());
+  };
+
+  // missing file loads nothing
+  size_t numLoaded = 1;
+  EXPECT_TRUE(loadCounters(path, numLoaded).empty());
+  EXPECT_EQ(0, numLoaded);
+
+  CounterMap counters;
+  counters["foo"] = makeCounter(1.5, thrift::CounterValueType::GAUGE, 10);
+  counters["bar.baz"] = makeCounter(-3, thrift::CounterValueType::COUNTER, 20);
+  counters[""] = makeCounter(0, thrift::CounterValueType::COUNTER, 30);
+  CounterSnapshot::write(path, CounterSnapshot::encode(counters));
+  EXPECT_EQ(0, ::access(path.c_str(), F_OK));
+  EXPECT_NE(0, ::access((path + ".tmp").c_str(), F_OK));
+
+  auto loaded = loadCounters(path, numLoaded);
+  EXPECT_EQ(3, numLoaded);
+  EXPECT_EQ(counters, loaded);
+
+  // snapshot is replaced as a whole
+  counters.erase("foo");
+  CounterSnapshot::write(path, CounterSnapshot::encode(counters));
+  EXPECT_EQ(counters, loadCounters(path, numLoaded));
+  EXPECT_EQ(2, numLoaded);
+}
+
+TEST(CounterSnapshotTest, Malformed) {
+  const auto path =
+      folly::sformat("/tmp/fbzmq-counter-snapshot-bad-{}", getpid());
+  SCOPE_EXIT {
+    ::unlink(path.c_str());
+  };
+
+  CounterMap counters;
+  counters["foo"] = makeCounter(1, thrift::CounterValueType::GAUGE, 10);
+  counters["bar"] = makeCounter(2, thrift::CounterValueType::GAUGE, 10);
+  const auto snapshot = CounterSnapshot::encode(counters);
+
+  // truncated, trailing garbage and foreign files load nothing
+  size_t numLoaded = 1;
+  CounterSnapshot::write(path, folly::StringPiece(snapshot).subpiece(0, 40));
+  EXPECT_TRUE(loadCounters(path, numLoaded).empty());
+  EXPECT_EQ(0, numLoaded);
+
+  CounterSnapshot::write(path, snapshot + "x");
+  EXPECT_TRUE(loadCounters(path, numLoaded).empty());
+  EXPECT_EQ(0, numLoaded);
+
+  CounterSnapshot::write(path, "not a snapshot of counters at all");
+  EXPECT_TRUE(loadCounters(path, numLoaded).empty());
+  EXPECT_EQ(0, numLoaded);
+}
+
+TEST(CounterSnapshotTest, Writer) {
+  const auto path =
+      folly::sformat("/tmp/fbzmq-counter-snapshot-writer-{}", getpid());
+  ::unlink(path.c_str());
+  SCOPE_EXIT {
+    ::unlink(path.c_str());
+  };
+
+  CounterMap counters;
+  size_t numLoaded = 0;
+  {
+    CounterSnapshotWriter writer(path);
+    for (int i = 0; i < 10; ++i) {
+      counters[folly::sformat("counter{}", i)] =
+          makeCounter(i, thrift::CounterValueType::COUNTER, i);
+      writer.submit(CounterSnapshot::encode(counters));
+    }
+    writer.flush();
+    EXPECT_EQ(counters, loadCounters(path, numLoaded));
+    EXPECT_LE(1, writer.getNumWritten());
+    EXPECT_EQ(0, writer.getNumErrors());
+
+    // pending snapshot is written on destruction
+    counters.clear();
+    writer.submit(CounterSnapshot::encode(counters));
+  }
+  EXPECT_TRUE(loadCounters(path, numLoaded).empty());
+  EXPECT_EQ(0, numLoaded);
+
+  // failed writes are counted
+  CounterSnapshotWriter writer("/nonexistent-dir/snapshot");
+  writer.submit(CounterSnapshot::encode(counters));
+  writer.flush();
+  EXPECT_EQ(0, writer.getNumWritten());
+  EXPECT_EQ(1, writer.getNumErrors());
+}
+
+int
+main(int argc, char* argv[]) {
+  // Parse command line flags
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  // Run the tests
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,269 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include <folly/Format.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/monitor/CounterStore.h>
+
+using namespace fbzmq;
+
+namespace {
+
+thrift::Counter
+makeCounter(double value, thrift::CounterValueType valueType, int64_t ts) {
+  return thrift::Counter(apache::thrift::FRAGILE, value, valueType, ts);
+}
+
+} // namespace
+
+TEST(CounterStoreTest, SetBumpGet) {
+  CounterStore store;
+  EXPECT_EQ(0, store.size());
+  EXPECT_FALSE(store.getCounter("foo").hasValue());
+
+  store.setCounter("foo", makeCounter(5, thrift::CounterValueType::GAUGE, 7));
+  auto foo = store.getCounter("foo");
+  ASSERT_TRUE(foo.hasValue());
+  EXPECT_EQ(5, foo->value);
+  EXPECT_EQ(thrift::CounterValueType::GAUGE, foo->valueType);
+  EXPECT_EQ(7, foo->timestamp);
+
+  // bump keeps type and timestamp, missing counters are created
+  EXPECT_EQ(8, store.bumpCounter("foo", 3).value);
+  EXPECT_EQ(
+      thrift::CounterValueType::GAUGE, store.getCounter("foo")->valueType);
+  auto bar = store.bumpCounter("bar", -1);
+  EXPECT_EQ(-1, bar.value);
+  EXPECT_EQ(thrift::CounterValueType::COUNTER, bar.valueType);
+  EXPECT_EQ(2, store.size());
+
+  // names which are prefixes of each other are distinct counters
+  store.bumpCounter("fo", 1);
+  store.bumpCounter("", 1);
+  EXPECT_EQ(4, store.size());
+  EXPECT_EQ(8, store.getCounter("foo")->value);
+
+  auto counters = store.getCounters();
+  EXPECT_EQ(4, counters.size());
+  EXPECT_EQ(8, counters.at("foo").value);
+  EXPECT_EQ(-1, counters.at("bar").value);
+  auto names = store.getCounterNames();
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ((std::vector<std::string>{"", "bar", "fo", "foo"}), names);
+}
+
+TEST(CounterStoreTest, ManyCounters) {
+  // enough counters for the hash table to grow several times
+  const int kNumCounters = 100000;
+  CounterStore store;
+  for (int i = 0; i < kNumCounters; ++i) {
+    store.setCounter(
+        folly::sformat("module.submodule.counter.{}", i),
+        makeCounter(i, thrift::CounterValueType::GAUGE, i));
+  }
+  EXPECT_EQ(kNumCounters, store.size());
+  for (int i = 0; i < kNumCounters; i += 997) {
+    auto counter =
+        store.getCounter(folly::sformat("module.submodule.counter.{}", i));
+    ASSERT_TRUE(counter.hasValue());
+    EXPECT_EQ(i, counter->value);
+  }
+  EXPECT_FALSE(store.getCounter("module.submodule.counter.").hasValue());
+
+  // sequential scan visits counters in order of creation
+  int expected = 0;
+  store.forEachCounter(
+      [&expected](folly::StringPiece name, thrift::Counter const& counter) {
+        EXPECT_EQ(
+            folly::sformat("module.submodule.counter.{}", expected), name);
+        EXPECT_EQ(expected++, counter.value);
+      });
+  EXPECT_EQ(kNumCounters, expected);
+
+  // columns need a fraction of a node based map per counter
+  LOG(INFO) << "Memory per counter: "
+            << store.getMemoryUsage() / kNumCounters << " bytes";
+  EXPECT_GT(128 * kNumCounters, store.getMemoryUsage());
+}
+
+TEST(CounterStoreTest, QueryAfterUpdates) {
+  CounterStore store;
+  for (auto const& name : {"b.2", "a.1", "b.1"}) {
+    store.bumpCounter(name, 1);
+  }
+
+  thrift::CounterQueryParams params;
+  params.prefix = "b.";
+  auto response = store.query(params);
+  EXPECT_EQ(2, response.counters.size());
+  EXPECT_EQ("b.2", response.lastCounterName);
+  EXPECT_FALSE(response.hasMore);
+
+  // counters created after a query are merged into sorted index
+  for (auto const& name : {"b.0", "c.1", "b.3", "a.0"}) {
+    store.bumpCounter(name, 1);
+  }
+  params.prefix = "";
+  params.namesOnly = true;
+  params.maxCounters = 3;
+  response = store.query(params);
+  EXPECT_EQ(
+      (std::vector<std::string>{"a.0", "a.1", "b.0"}), response.counterNames);
+  EXPECT_TRUE(response.hasMore);
+
+  params.startAfter = response.lastCounterName;
+  response = store.query(params);
+  EXPECT_EQ(
+      (std::vector<std::string>{"b.1", "b.2", "b.3"}), response.counterNames);
+  EXPECT_TRUE(response.hasMore);
+
+  params.startAfter = response.lastCounterName;
+  params.pattern = "c.*";
+  response = store.query(params);
+  EXPECT_EQ((std::vector<std::string>{"c.1"}), response.counterNames);
+  EXPECT_FALSE(response.hasMore);
+
+  // counter named as prefix itself is kept when resuming before prefix
+  store.bumpCounter("b", 1);
+  params.prefix = "b";
+  params.pattern = "";
+  params.startAfter = "a.1";
+  response = store.query(params);
+  EXPECT_EQ(
+      (std::vector<std::string>{"b", "b.0", "b.1"}), response.counterNames);
+  EXPECT_TRUE(response.hasMore);
+}
+
+TEST(CounterStoreTest, History) {
+  CounterStore store(true /* keepHistory */);
+  store.bumpCounter("foo.1", 1);
+  store.bumpCounter("foo.1", 1);
+  store.bumpCounter("foo.2", 5);
+  store.bumpCounter("bar", 5);
+
+  thrift::CounterHistoryParams params;
+  params.counterNames = {"bar", "missing"};
+  params.prefix = "foo.";
+  auto response = store.getHistory(params);
+  EXPECT_EQ(3, response.counterWindows.size());
+  ASSERT_EQ(1, response.counterWindows.count("foo.1"));
+  EXPECT_EQ(2, response.counterWindows.at("foo.1").at(0).numSamples);
+  EXPECT_EQ(2, response.counterWindows.at("foo.1").at(0).maxValue);
+
+  CounterStore noHistory;
+  noHistory.bumpCounter("foo.1", 1);
+  EXPECT_TRUE(noHistory.getHistory(params).counterWindows.empty());
+}
+
+TEST(CounterStoreTest, Erase) {
+  CounterStore store(true /* keepHistory */);
+  for (int i = 0; i < 1000; ++i) {
+    store.bumpCounter(folly::sformat("a.{}", i), i);
+    store.bumpCounter(folly::sformat("b.{}", i), i);
+  }
+  EXPECT_FALSE(store.eraseCounter("c.1"));
+  EXPECT_TRUE(store.eraseCounter("a.0"));
+  EXPECT_FALSE(store.eraseCounter("a.0"));
+  EXPECT_EQ(1999, store.size());
+
+  // query rebuilds sorted index after erasures
+  thrift::CounterQueryParams params;
+  params.prefix = "a.";
+  params.namesOnly = true;
+  params.maxCounters = 2;
+  EXPECT_EQ(
+      (std::vector<std::string>{"a.1", "a.10"}),
+      store.query(params).counterNames);
+
+  EXPECT_EQ(999, store.eraseCountersByPrefix("a."));
+  EXPECT_EQ(0, store.eraseCountersByPrefix("a."));
+  EXPECT_EQ(1000, store.size());
+
+  // remaining counters, moved around by erasures, are intact
+  for (int i = 0; i < 1000; ++i) {
+    const auto name = folly::sformat("b.{}", i);
+    auto counter = store.getCounter(name);
+    ASSERT_TRUE(counter.hasValue()) << name;
+    EXPECT_EQ(i, counter->value);
+  }
+  thrift::CounterHistoryParams historyParams;
+  historyParams.counterNames = {"b.999"};
+  auto history = store.getHistory(historyParams);
+  EXPECT_EQ(999, history.counterWindows.at("b.999").at(0).maxValue);
+
+  // erased names can be reused
+  store.bumpCounter("a.0", 5);
+  EXPECT_EQ(5, store.getCounter("a.0")->value);
+  EXPECT_EQ(1001, store.size());
+}
+
+TEST(CounterStoreTest, Churn) {
+  // counters come and go, hash table and arena stay consistent
+  CounterStore store;
+  const int kNumLive = 500;
+  for (int i = 0; i < 20000; ++i) {
+    store.bumpCounter(folly::sformat("peer{}.counter", i), i);
+    if (i >= kNumLive) {
+      EXPECT_TRUE(
+          store.eraseCounter(folly::sformat("peer{}.counter", i - kNumLive)));
+    }
+  }
+  EXPECT_EQ(kNumLive, store.size());
+  for (int i = 20000 - kNumLive; i < 20000; ++i) {
+    EXPECT_EQ(i, store.getCounter(folly::sformat("peer{}.counter", i))->value);
+  }
+  EXPECT_FALSE(store.getCounter("peer0.counter").hasValue());
+  EXPECT_GT(100 * 1024, store.getMemoryUsage());
+}
+
+TEST(CounterStoreTest, Expire) {
+  CounterStore store;
+  for (int i = 0; i < 100; ++i) {
+    store.bumpCounter(folly::sformat("stale.{}", i), 1);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  for (int i = 0; i < 10; ++i) {
+    store.bumpCounter(folly::sformat("fresh.{}", i), 1);
+  }
+
+  // sweep is spread over several calls of bounded size
+  const std::chrono::milliseconds ttl(50);
+  size_t numExpired = 0;
+  for (int i = 0; i < 5; ++i) {
+    const auto expired = store.expireCounters(ttl, 22);
+    EXPECT_GE(22, expired);
+    numExpired += expired;
+  }
+  EXPECT_EQ(100, numExpired);
+  EXPECT_EQ(10, store.size());
+  EXPECT_TRUE(store.getCounter("fresh.0").hasValue());
+  EXPECT_FALSE(store.getCounter("stale.0").hasValue());
+
+  // updated counters don't expire
+  EXPECT_EQ(0, store.expireCounters(std::chrono::seconds(60), 100));
+  EXPECT_EQ(10, store.size());
+}
+
+int
+main(int argc, char* argv[]) {
+  // Parse command line flags
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  // Run the tests
+  return RUN_ALL_TESTS();
+}
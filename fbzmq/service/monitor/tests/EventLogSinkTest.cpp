@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <unistd.h>
+
+#include <thread>
+
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/ScopeGuard.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/monitor/EventLogSink.h>
+
+using namespace fbzmq;
+
+using apache::thrift::CompactSerializer;
+
+namespace {
+
+thrift::EventLog
+makeEventLog(int i) {
+  thrift::EventLog eventLog;
+  eventLog.category = folly::to<std::string>(i);
+  eventLog.samples = {"sample"};
+  return eventLog;
+}
+
+} // namespace
+
+TEST(EventLogSinkTest, DropWithoutSpill) {
+  Context context;
+  EventLogSink sink(context, "inproc://sink-nowhere", 2);
+  EXPECT_TRUE(sink.addEventLog(makeEventLog(0)));
+  EXPECT_TRUE(sink.addEventLog(makeEventLog(1)));
+  EXPECT_FALSE(sink.addEventLog(makeEventLog(2)));
+
+  auto stats = sink.getStats();
+  EXPECT_EQ(3, stats.numAdded);
+  EXPECT_EQ(1, stats.numDropped);
+  EXPECT_EQ(0, stats.numSpilled);
+  EXPECT_EQ(2, sink.getNumPending());
+}
+
+TEST(EventLogSinkTest, SpillAndReplay) {
+  const auto path = folly::sformat("/tmp/fbzmq-event-log-sink-{}", getpid());
+  ::unlink(path.c_str());
+  SCOPE_EXIT {
+    ::unlink(path.c_str());
+  };
+
+  // more than sink sends per drain, so replay takes several of them
+  const int kNumLogs = 2500;
+  Context context;
+  CompactSerializer serializer;
+
+  // Monitor isn't there yet, logs beyond ring's capacity get spilled
+  EventLogSink sink(
+      context,
+      "inproc://sink-monitor-rep",
+      3 /* maxBufferedLogs */,
+      path,
+      1024 * 1024 /* maxSpillBytes */,
+      std::chrono::milliseconds(10) /* retryInterval */);
+  for (int i = 0; i < kNumLogs; ++i) {
+    EXPECT_TRUE(sink.addEventLog(makeEventLog(i)));
+  }
+  EXPECT_EQ(kNumLogs - 3, sink.getStats().numSpilled);
+  EXPECT_EQ(kNumLogs, sink.getNumPending());
+
+  std::thread sinkThread([&sink]() { sink.run(); });
+  sink.waitUntilRunning();
+  SCOPE_EXIT {
+    sink.stop();
+    sinkThread.join();
+  };
+  // Nothing is lost while monitor is down
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(0, sink.getStats().numSent);
+  EXPECT_EQ(kNumLogs, sink.getNumPending());
+
+  // Once monitor is up, all logs are delivered in order
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> monitorSock(context);
+  monitorSock.bind(SocketUrl{"inproc://sink-monitor-rep"}).value();
+  for (int i = 0; i < kNumLogs; ++i) {
+    Message identity, request;
+    monitorSock
+        .recvMultipleTimeout(std::chrono::milliseconds(1000), identity, request)
+        .value();
+    auto thriftReq =
+        request.readThriftObj<thrift::MonitorRequest>(serializer).value();
+    EXPECT_EQ(thrift::MonitorCommand::LOG_EVENT, thriftReq.cmd);
+    EXPECT_EQ(folly::to<std::string>(i), thriftReq.eventLog.category);
+  }
+
+  // Spilled requests are consumed right after being sent
+  while (sink.getStats().numReplayed < kNumLogs - 3) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto stats = sink.getStats();
+  EXPECT_EQ(kNumLogs, stats.numSent);
+  EXPECT_EQ(kNumLogs - 3, stats.numReplayed);
+  EXPECT_EQ(0, stats.numDropped);
+  EXPECT_EQ(0, sink.getNumPending());
+}
+
+int
+main(int argc, char* argv[]) {
+  // Parse command line flags
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  // Run the tests
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fbzmq/service/monitor/MonitorRequestReader.h>
+#include <fbzmq/zmq/Common.h>
+
+using namespace fbzmq;
+
+using apache::thrift::CompactSerializer;
+
+namespace {
+
+folly::ByteRange
+toRange(std::string const& str) {
+  return folly::StringPiece(str);
+}
+
+} // namespace
+
+TEST(MonitorRequestReaderTest, ReadParams) {
+  CompactSerializer serializer;
+
+  // request carrying fields which are not used by its command
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::BUMP_COUNTER;
+  thriftReq.counterGetParams.counterNames = {"foo"};
+  thriftReq.counterBumpParams.counterNames = {"bar", "baz"};
+  thriftReq.eventLog.category = "cat";
+  const auto data = util::writeThriftObjStr(thriftReq, serializer);
+
+  MonitorRequestReader reader(toRange(data));
+  ASSERT_TRUE(reader.readCommand());
+  EXPECT_EQ(thrift::MonitorCommand::BUMP_COUNTER, reader.getCommand());
+
+  thrift::CounterBumpParams params;
+  ASSERT_TRUE(
+      reader.readParams(MonitorRequestReader::COUNTER_BUMP_PARAMS, params));
+  EXPECT_EQ(thriftReq.counterBumpParams, params);
+
+  // Fields can only be read forward
+  thrift::CounterGetParams getParams;
+  ASSERT_TRUE(
+      reader.readParams(MonitorRequestReader::COUNTER_GET_PARAMS, getParams));
+  EXPECT_TRUE(getParams.counterNames.empty());
+
+  thrift::EventLog eventLog;
+  ASSERT_TRUE(reader.readParams(MonitorRequestReader::EVENT_LOG, eventLog));
+  EXPECT_EQ("cat", eventLog.category);
+}
+
+TEST(MonitorRequestReaderTest, ReadCounterSetParams) {
+  CompactSerializer serializer;
+
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::SET_COUNTER_VALUES;
+  for (int i = 0; i < 10; ++i) {
+    thrift::Counter counter;
+    counter.value = i;
+    counter.timestamp = 1000 + i;
+    thriftReq.counterSetParams.counters["foo" + std::to_string(i)] = counter;
+  }
+  thriftReq.counterBumpParams.counterNames = {"bar"};
+  const auto data = util::writeThriftObjStr(thriftReq, serializer);
+
+  MonitorRequestReader reader(toRange(data));
+  ASSERT_TRUE(reader.readCommand());
+  EXPECT_EQ(thrift::MonitorCommand::SET_COUNTER_VALUES, reader.getCommand());
+
+  std::map<std::string, thrift::Counter> counters;
+  ASSERT_TRUE(reader.readCounterSetParams(
+      [&counters](std::string&& name, thrift::Counter&& counter) {
+        counters.emplace(std::move(name), std::move(counter));
+      }));
+  EXPECT_EQ(thriftReq.counterSetParams.counters, counters);
+
+  // fields following counters are still readable
+  thrift::CounterBumpParams params;
+  ASSERT_TRUE(
+      reader.readParams(MonitorRequestReader::COUNTER_BUMP_PARAMS, params));
+  EXPECT_EQ(thriftReq.counterBumpParams, params);
+}
+
+TEST(MonitorRequestReaderTest, MalformedRequest) {
+  CompactSerializer serializer;
+
+  // not a request at all
+  const std::string garbage{"\xff\xff\xff"};
+  MonitorRequestReader garbageReader(toRange(garbage));
+  EXPECT_FALSE(garbageReader.readCommand());
+
+  // truncated in the middle of params
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::GET_COUNTER_VALUES;
+  thriftReq.counterGetParams.counterNames = {"foo", "bar"};
+  const auto data = util::writeThriftObjStr(thriftReq, serializer);
+  const auto truncated = data.substr(0, data.size() - 4);
+
+  MonitorRequestReader reader(toRange(truncated));
+  ASSERT_TRUE(reader.readCommand());
+  thrift::CounterGetParams params;
+  EXPECT_FALSE(
+      reader.readParams(MonitorRequestReader::COUNTER_GET_PARAMS, params));
+}
+
+int
+main(int argc, char* argv[]) {
+  // Parse command line flags
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  // Run the tests
+  return RUN_ALL_TESTS();
+}
@@ -7,12 +7,16 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
+
+#include <folly/Format.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <thread>
 
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
+#include <fbzmq/service/monitor/ZmqMonitorAsyncClient.h>
 #include <fbzmq/service/monitor/ZmqMonitorClient.h>
 
 using namespace std;
@@ -177,12 +181,422 @@ TEST(ZmqMonitorClientTest, BasicOperation) {
   EXPECT_EQ(1, counters["baz"].value);
 
   // publish some logs
-  thrift::EventLog eventLog(
-      apache::thrift::FRAGILE, "log_category", {"log1", "log2"});
+  thrift::EventLog eventLog;
+  eventLog.category = "log_category";
+  eventLog.samples = {"log1", "log2"};
   zmqMonitorClient->addEventLog(eventLog);
   LOG(INFO) << "done publishing logs...";
 }
 
+TEST(ZmqMonitorClientTest, BufferedMode) {
+  Context context;
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-buffered-rep"},
+      std::string{"inproc://monitor-buffered-pub"},
+      context);
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  zmqMonitor->waitUntilRunning();
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+
+  ZmqMonitorClient otherClient(context, "inproc://monitor-buffered-rep");
+  ZmqMonitorClient client(context, "inproc://monitor-buffered-rep");
+  client.enableBuffering(3);
+
+  thrift::Counter counter;
+  counter.value = 10;
+  client.bumpCounter("bumped");
+  client.bumpCounter("bumped");
+  client.setCounter("set", counter);
+  counter.value = 20;
+  client.setCounter("set", counter);
+  EXPECT_EQ(2, client.getNumBufferedCounters());
+  // Nothing has been sent yet
+  EXPECT_FALSE(otherClient.getCounter("set").hasValue());
+
+  // Read flushes buffered updates first, last set wins
+  EXPECT_EQ(2, client.getCounter("bumped")->value);
+  EXPECT_EQ(20, client.getCounter("set")->value);
+  EXPECT_EQ(0, client.getNumBufferedCounters());
+
+  // Set discards bumps buffered before it, later bumps apply on top
+  client.bumpCounter("set");
+  client.setCounter("set", counter);
+  client.bumpCounter("set");
+  EXPECT_EQ(21, client.getCounter("set")->value);
+
+  // Deltas are summed into a single bump
+  client.bumpCounterBy("bumped", 500);
+  client.bumpCounterBy("bumped", -100);
+  client.bumpCounter("bumped");
+  EXPECT_EQ(1, client.getNumBufferedCounters());
+  EXPECT_EQ(403, client.getCounter("bumped")->value);
+
+  // Unbuffered bump by delta
+  otherClient.bumpCounterBy("other", 42);
+  EXPECT_EQ(42, otherClient.getCounter("other")->value);
+
+  // Crossing threshold flushes
+  client.setCounters({{"a", counter}, {"b", counter}, {"c", counter}});
+  EXPECT_EQ(0, client.getNumBufferedCounters());
+
+  // Periodic flush with event loop
+  ZmqEventLoop evl;
+  ZmqMonitorClient timedClient(context, "inproc://monitor-buffered-rep");
+  timedClient.enableBuffering(
+      100, &evl, std::chrono::milliseconds(10) /* flushInterval */);
+  evl.scheduleTimeout(std::chrono::milliseconds(0), [&]() noexcept {
+    timedClient.bumpCounter("timed");
+    EXPECT_EQ(1, timedClient.getNumBufferedCounters());
+  });
+  evl.scheduleTimeout(std::chrono::milliseconds(50), [&]() noexcept {
+    EXPECT_EQ(0, timedClient.getNumBufferedCounters());
+    evl.stop();
+  });
+  evl.run();
+  EXPECT_EQ(1, otherClient.getCounter("timed")->value);
+}
+
+TEST(ZmqMonitorClientTest, LogBatching) {
+  Context context;
+  CompactSerializer serializer;
+  LogSample sampleToMerge;
+  sampleToMerge.addString("domain", "terragraph");
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-batch-rep"},
+      std::string{"inproc://monitor-batch-pub"},
+      context,
+      sampleToMerge);
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  zmqMonitor->waitUntilRunning();
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+  sub.connect(SocketUrl{"inproc://monitor-batch-pub"}).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+  ZmqMonitorClient client(context, "inproc://monitor-batch-rep");
+
+  // Wait for subscription to take effect
+  while (true) {
+    client.bumpCounter("sync");
+    auto pub = sub.recvThriftObj<thrift::MonitorPub>(
+        serializer, std::chrono::milliseconds(100));
+    if (pub.hasValue()) {
+      break;
+    }
+  }
+  auto recvBatch = [&]() {
+    while (true) {
+      auto pub = sub.recvThriftObj<thrift::MonitorPub>(serializer).value();
+      if (pub.pubType == thrift::PubType::EVENT_LOG_BATCH_PUB) {
+        return pub.eventLogBatchPub;
+      }
+      EXPECT_EQ(thrift::PubType::COUNTER_PUB, pub.pubType);
+    }
+  };
+
+  LogSample sample;
+  sample.addString("key", "value");
+  thrift::EventLog first;
+  first.category = "first";
+  first.samples = {sample.toJson(), sample.toJson()};
+  thrift::EventLog second;
+  second.category = "second";
+  sample.appendTo(second);
+
+  // Batch is sent once it reaches size limit
+  client.enableLogBatching(3);
+  client.addEventLog(first);
+  EXPECT_EQ(2, client.getNumBatchedSamples());
+  client.addEventLog(second);
+  EXPECT_EQ(0, client.getNumBatchedSamples());
+
+  auto batch = recvBatch();
+  EXPECT_EQ(thrift::CompressionType::ZSTD, batch.compression);
+  EXPECT_EQ(2, batch.numEventLogs);
+  EXPECT_EQ(3, batch.numSamples);
+  auto eventLogs = decompressEventLogs(batch);
+  ASSERT_EQ(2, eventLogs.size());
+  EXPECT_EQ("first", eventLogs[0].category);
+  EXPECT_EQ("second", eventLogs[1].category);
+  for (auto const& eventLog : eventLogs) {
+    for (auto const& decoded : LogSample::fromEventLog(eventLog)) {
+      EXPECT_EQ("value", decoded.getString("key"));
+      EXPECT_EQ("terragraph", decoded.getString("domain"));
+    }
+  }
+
+  // And on flush
+  client.addEventLog(second);
+  EXPECT_EQ(1, client.getNumBatchedSamples());
+  client.flush();
+  eventLogs = decompressEventLogs(recvBatch());
+  ASSERT_EQ(1, eventLogs.size());
+  EXPECT_EQ("second", eventLogs[0].category);
+
+  // Malformed payloads are rejected
+  batch.payload = "garbage";
+  EXPECT_THROW(decompressEventLogs(batch), std::runtime_error);
+}
+
+TEST(ZmqMonitorClientTest, PrefixQuery) {
+  Context context;
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-query-rep"},
+      std::string{"inproc://monitor-query-pub"},
+      context);
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  zmqMonitor->waitUntilRunning();
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+
+  ZmqMonitorClient client(context, "inproc://monitor-query-rep");
+  thrift::Counter counter;
+  CounterMap counters;
+  for (int i = 0; i < 10; ++i) {
+    counter.value = i;
+    counters[folly::sformat("fib.route.{}", i)] = counter;
+    counters[folly::sformat("kvstore.key.{}", i)] = counter;
+  }
+  counters["fib"] = counter;
+  counters["fia"] = counter;
+  client.setCounters(counters);
+  client.bumpCounter("fib.bumped");
+
+  // Range scan over prefix only
+  EXPECT_EQ(11, client.getCountersByPrefix("fib.").size());
+  EXPECT_EQ(12, client.getCountersByPrefix("fib").size());
+  EXPECT_EQ(10, client.getCountersByPrefix("kvstore.").size());
+  EXPECT_EQ(0, client.getCountersByPrefix("spark").size());
+  EXPECT_EQ(23, client.getCountersByPrefix("").size());
+
+  // Glob pattern within prefix
+  auto matched = client.getCountersByPrefix("fib.", "fib.route.[0-4]");
+  EXPECT_EQ(5, matched.size());
+  EXPECT_EQ(3, matched.at("fib.route.3").value);
+  EXPECT_EQ(10, client.getCountersByPrefix("", "*.key.*").size());
+
+  // Paging, names are returned in sorted order
+  thrift::CounterQueryParams params;
+  params.prefix = "kvstore.";
+  params.maxCounters = 4;
+  params.namesOnly = true;
+  std::vector<std::string> names;
+  while (true) {
+    auto page = client.queryCounters(params);
+    EXPECT_GE(4, page.counterNames.size());
+    EXPECT_TRUE(page.counters.empty());
+    names.insert(
+        names.end(), page.counterNames.begin(), page.counterNames.end());
+    if (not page.hasMore) {
+      break;
+    }
+    EXPECT_EQ(page.counterNames.back(), page.lastCounterName);
+    params.startAfter = page.lastCounterName;
+  }
+  EXPECT_EQ(10, names.size());
+  EXPECT_TRUE(std::is_sorted(names.begin(), names.end()));
+  EXPECT_EQ("kvstore.key.0", names.front());
+  EXPECT_EQ("kvstore.key.9", names.back());
+}
+
+TEST(ZmqMonitorClientTest, StreamedDump) {
+  Context context;
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-stream-rep"},
+      std::string{"inproc://monitor-stream-pub"},
+      context);
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  zmqMonitor->waitUntilRunning();
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+
+  ZmqMonitorClient client(context, "inproc://monitor-stream-rep");
+  thrift::Counter counter;
+  CounterMap counters;
+  for (int i = 0; i < 25; ++i) {
+    counter.value = i;
+    counters[folly::sformat("counter.{:02d}", i)] = counter;
+  }
+  client.setCounters(counters);
+
+  // Bounded chunks covering all counters
+  CounterMap streamed;
+  std::vector<size_t> chunkSizes;
+  {
+    auto stream = client.streamCounters(10);
+    while (auto chunk = stream.next()) {
+      chunkSizes.push_back(chunk->size());
+      streamed.insert(chunk->begin(), chunk->end());
+    }
+    EXPECT_TRUE(stream.isFinished());
+    EXPECT_FALSE(stream.hasFailed());
+    EXPECT_EQ("counter.24", stream.getContinuationToken());
+  }
+  EXPECT_EQ((std::vector<size_t>{10, 10, 5}), chunkSizes);
+  EXPECT_EQ(counters, streamed);
+
+  // Resume after a given name
+  {
+    auto stream = client.streamCounters(100, "counter.19");
+    auto chunk = stream.next();
+    ASSERT_TRUE(chunk.hasValue());
+    EXPECT_EQ(5, chunk->size());
+    EXPECT_EQ(1, chunk->count("counter.20"));
+    EXPECT_FALSE(stream.next().hasValue());
+  }
+
+  // Abandoned stream is drained, client stays usable
+  {
+    auto stream = client.streamCounters(1);
+    EXPECT_EQ(1, stream.next()->size());
+  }
+  EXPECT_EQ(7, client.getCounter("counter.07")->value);
+}
+
+TEST(ZmqMonitorClientTest, CounterHistory) {
+  Context context;
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-history-rep"},
+      std::string{"inproc://monitor-history-pub"},
+      context,
+      folly::none,
+      ZmqMonitor::Options().setKeepHistory(true));
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  zmqMonitor->waitUntilRunning();
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+
+  ZmqMonitorClient client(context, "inproc://monitor-history-rep");
+  thrift::Counter gauge;
+  gauge.valueType = thrift::CounterValueType::GAUGE;
+  for (int i = 1; i <= 5; ++i) {
+    client.bumpCounterBy("history.bytes", 100);
+    gauge.value = i;
+    client.setCounter("history.gauge", gauge);
+    // Let counter grow over time for a rate
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  client.bumpCounter("other");
+
+  auto history = client.getCounterHistory({"other", "unknown"}, "history.");
+  EXPECT_EQ(3, history.size());
+  EXPECT_EQ(0, history.count("unknown"));
+
+  auto const& bytes = history.at("history.bytes");
+  ASSERT_EQ(3, bytes.size());
+  for (auto const& stats : bytes) {
+    EXPECT_EQ(5, stats.numSamples);
+    EXPECT_EQ(100, stats.minValue);
+    EXPECT_EQ(500, stats.maxValue);
+    EXPECT_LT(0, stats.rate);
+  }
+  auto const& gaugeStats = history.at("history.gauge").front();
+  EXPECT_EQ(60, gaugeStats.windowSec);
+  EXPECT_EQ(3, gaugeStats.avgValue);
+  EXPECT_EQ(1, history.at("other").front().numSamples);
+}
+
+TEST(ZmqMonitorClientTest, AsyncClient) {
+  Context context;
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-async-rep"},
+      std::string{"inproc://monitor-async-pub"},
+      context);
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  zmqMonitor->waitUntilRunning();
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+
+  thrift::Counter counterBar;
+  counterBar.value = 1234;
+  thrift::Counter counterFoo;
+  counterFoo.value = 5678;
+  ZmqMonitorClient syncClient(context, "inproc://monitor-async-rep");
+  syncClient.setCounters({{"bar", counterBar}, {"foo", counterFoo}});
+  // Make sure counters are set before async requests are issued
+  EXPECT_EQ(2, syncClient.dumpCounters().size());
+
+  ZmqEventLoop evl;
+  ZmqMonitorAsyncClient client(
+      evl, context, "inproc://monitor-async-rep", std::chrono::seconds(5));
+
+  // Silent peer to time out against
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> silentSock(context);
+  silentSock.bind(SocketUrl{"inproc://monitor-async-silent"}).value();
+  ZmqMonitorAsyncClient silentClient(
+      evl,
+      context,
+      "inproc://monitor-async-silent",
+      std::chrono::milliseconds(10));
+
+  const int kNumGets = 100;
+  int numDone = 0;
+  const int kNumRequests = kNumGets + 3;
+  auto done = [&]() {
+    if (++numDone == kNumRequests) {
+      evl.stop();
+    }
+  };
+
+  evl.scheduleTimeout(std::chrono::milliseconds(0), [&]() noexcept {
+    // Concurrent gets are merged into a single request, sent right after
+    for (int i = 0; i < kNumGets; ++i) {
+      const auto name = i % 3 == 0 ? "foo" : (i % 3 == 1 ? "bar" : "baz");
+      client.getCounter(name).then(
+          [&, i](folly::Optional<thrift::Counter> counter) {
+            if (i % 3 == 0) {
+              EXPECT_EQ(5678, counter->value);
+            } else if (i % 3 == 1) {
+              EXPECT_EQ(1234, counter->value);
+            } else {
+              EXPECT_FALSE(counter.hasValue());
+            }
+            done();
+          });
+    }
+    EXPECT_EQ(0, client.getNumPendingRequests());
+
+    // Pipelined with the gets
+    client.dumpCounterNames().then([&](std::vector<std::string> names) {
+      EXPECT_EQ(
+          std::set<std::string>({"bar", "foo"}),
+          std::set<std::string>(names.begin(), names.end()));
+      done();
+    });
+    client.dumpCounters().then([&](CounterMap counters) {
+      EXPECT_EQ(2, counters.size());
+      done();
+    });
+    // Gets are still batched
+    EXPECT_EQ(2, client.getNumPendingRequests());
+
+    silentClient.dumpCounters().onError([&](std::system_error const& e) {
+      EXPECT_EQ(EAGAIN, e.code().value());
+      EXPECT_EQ(0, silentClient.getNumPendingRequests());
+      done();
+      return CounterMap{};
+    });
+  });
+
+  evl.run();
+  EXPECT_EQ(kNumRequests, numDone);
+  EXPECT_EQ(0, client.getNumPendingRequests());
+}
+
 int
 main(int argc, char* argv[]) {
   // Parse command line flags
@@ -7,13 +7,20 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <unistd.h>
+
+#include <algorithm>
+
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <thread>
 
+#include <folly/Format.h>
+
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
 #include <fbzmq/service/monitor/ZmqMonitor.h>
+#include <fbzmq/service/monitor/ZmqMonitorClient.h>
 
 using namespace std;
 using namespace fbzmq;
@@ -137,6 +144,13 @@ TEST(ZmqMonitorTest, BasicOperation) {
       EXPECT_EQ(ls1.getString("domain"), "terragraph");
       EXPECT_EQ(ls2.getString("key"), "second sample");
       EXPECT_EQ(ls2.getString("domain"), "terragraph");
+
+      // binary samples get merged as well, preferring their own values
+      auto samples = LogSample::fromEventLog(publication.eventLogPub);
+      ASSERT_EQ(3, samples.size());
+      EXPECT_EQ(samples[2].getString("key"), "binary sample");
+      EXPECT_EQ(samples[2].getString("domain"), "other");
+      EXPECT_EQ(samples[2].getInt("value"), 42);
     }
 
     LOG(INFO) << "subscriber thread finishing";
@@ -199,17 +213,423 @@ TEST(ZmqMonitorTest, BasicOperation) {
 
   // publish some logs
   thriftReq.cmd = thrift::MonitorCommand::LOG_EVENT;
-  fbzmq::LogSample sample1, sample2;
+  fbzmq::LogSample sample1, sample2, sample3;
   sample1.addString("key", "first sample");
   sample2.addString("key", "second sample");
-  thriftReq.eventLog = thrift::EventLog(
-      apache::thrift::FRAGILE,
-      "log_category",
-      {sample1.toJson(), sample2.toJson()});
+  sample3.addString("key", "binary sample");
+  sample3.addString("domain", "other");
+  sample3.addInt("value", 42);
+  thriftReq.eventLog = thrift::EventLog();
+  thriftReq.eventLog.category = "log_category";
+  thriftReq.eventLog.samples = {sample1.toJson(), sample2.toJson()};
+  sample3.appendTo(thriftReq.eventLog);
   dealer.sendThriftObj(thriftReq, serializer).value();
   LOG(INFO) << "done publishing logs...";
 }
 
+TEST(ZmqMonitorTest, BumpCounterBy) {
+  Context context;
+  CompactSerializer serializer;
+  auto monitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-bump-rep"},
+      std::string{"inproc://monitor-bump-pub"},
+      context);
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  monitor->waitUntilRunning();
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+  sub.connect(SocketUrl{"inproc://monitor-bump-pub"}).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  dealer.connect(SocketUrl{"inproc://monitor-bump-rep"}).value();
+
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::SET_COUNTER_VALUES;
+  thrift::Counter counterFoo;
+  counterFoo.value = 5;
+  thriftReq.counterSetParams.counters["foo"] = counterFoo;
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  // Existing and new counters are bumped by their deltas with single
+  // publication for all of them
+  thriftReq.cmd = thrift::MonitorCommand::BUMP_COUNTER_BY;
+  thriftReq.counterBumpByParams.counterDeltas = {{"foo", 500}, {"bar", -3}};
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  thriftReq.cmd = thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA;
+  dealer.sendThriftObj(thriftReq, serializer).value();
+  auto counters =
+      dealer.recvThriftObj<thrift::CounterValuesResponse>(serializer)
+          .value()
+          .counters;
+  EXPECT_EQ(2, counters.size());
+  EXPECT_EQ(505, counters["foo"].value);
+  EXPECT_EQ(-3, counters["bar"].value);
+  EXPECT_EQ(thrift::CounterValueType::COUNTER, counters["bar"].valueType);
+
+  // Publications may have been missed before subscription got connected,
+  // look for the one of bump
+  while (true) {
+    auto pub = sub.recvThriftObj<thrift::MonitorPub>(
+                      serializer, std::chrono::milliseconds(1000))
+                   .value();
+    if (pub.counterPub.counters.size() == 2) {
+      EXPECT_EQ(505, pub.counterPub.counters["foo"].value);
+      EXPECT_EQ(-3, pub.counterPub.counters["bar"].value);
+      break;
+    }
+  }
+}
+
+TEST(ZmqMonitorTest, CoalescedPublication) {
+  Context context;
+  CompactSerializer serializer;
+  auto monitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-coalesce-rep"},
+      std::string{"inproc://monitor-coalesce-pub"},
+      context,
+      folly::none,
+      ZmqMonitor::Options()
+          .setPubInterval(std::chrono::milliseconds(100))
+          .setMaxPubBatchSize(3));
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  monitor->waitUntilRunning();
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+  sub.connect(SocketUrl{"inproc://monitor-coalesce-pub"}).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  dealer.connect(SocketUrl{"inproc://monitor-coalesce-rep"}).value();
+
+  // Bump until subscription is connected and publication makes it through
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::BUMP_COUNTER;
+  thriftReq.counterBumpParams.counterNames = {"warmup"};
+  while (true) {
+    dealer.sendThriftObj(thriftReq, serializer).value();
+    auto pub = sub.recvThriftObj<thrift::MonitorPub>(
+        serializer, std::chrono::milliseconds(500));
+    if (pub.hasValue()) {
+      break;
+    }
+  }
+  // Response implies all earlier requests got processed
+  thriftReq.cmd = thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES;
+  dealer.sendThriftObj(thriftReq, serializer).value();
+  dealer.recvThriftObj<thrift::CounterNamesResponse>(serializer).value();
+  const auto warmupStats = monitor->getPubStats();
+
+  // Many updates of same counter end up in single publication with latest
+  // value
+  const int kNumBumps = 50;
+  thriftReq.cmd = thrift::MonitorCommand::BUMP_COUNTER;
+  thriftReq.counterBumpParams.counterNames = {"foo"};
+  for (int i = 0; i < kNumBumps; ++i) {
+    dealer.sendThriftObj(thriftReq, serializer).value();
+  }
+  auto pub = sub.recvThriftObj<thrift::MonitorPub>(
+                    serializer, std::chrono::milliseconds(1000))
+                 .value();
+  while (pub.counterPub.counters["foo"].value != kNumBumps) {
+    pub = sub.recvThriftObj<thrift::MonitorPub>(
+                 serializer, std::chrono::milliseconds(1000))
+              .value();
+  }
+
+  auto stats = monitor->getPubStats();
+  EXPECT_EQ(kNumBumps, stats.numUpdates - warmupStats.numUpdates);
+  EXPECT_EQ(stats.numUpdates, stats.numSuppressedUpdates);
+  EXPECT_LT(0, stats.numMergedUpdates);
+  EXPECT_GT(kNumBumps, stats.numPublications - warmupStats.numPublications);
+
+  // Dirty set reaching batch size is published right away in chunks
+  thriftReq.cmd = thrift::MonitorCommand::SET_COUNTER_VALUES;
+  for (int i = 0; i < 5; ++i) {
+    thrift::Counter counter;
+    counter.value = i;
+    thriftReq.counterSetParams.counters["bar" + std::to_string(i)] = counter;
+  }
+  dealer.sendThriftObj(thriftReq, serializer).value();
+  size_t numPublished = 0;
+  while (numPublished < 5) {
+    pub = sub.recvThriftObj<thrift::MonitorPub>(
+                 serializer, std::chrono::milliseconds(1000))
+              .value();
+    EXPECT_GE(3, pub.counterPub.counters.size());
+    numPublished += pub.counterPub.counters.size();
+  }
+  EXPECT_EQ(5, numPublished);
+}
+
+TEST(ZmqMonitorTest, TopicFrames) {
+  Context context;
+  CompactSerializer serializer;
+  auto monitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-topic-rep"},
+      std::string{"inproc://monitor-topic-pub"},
+      context,
+      folly::none,
+      ZmqMonitor::Options()
+          .setPubInterval(std::chrono::milliseconds(100))
+          .setTopicFrames(true));
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  monitor->waitUntilRunning();
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+  sub.connect(SocketUrl{"inproc://monitor-topic-pub"}).value();
+  for (std::string topic : {"counter/warmup", "counter/foo.", "log/cat1"}) {
+    sub.setSockOpt(ZMQ_SUBSCRIBE, topic.data(), topic.size()).value();
+  }
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  dealer.connect(SocketUrl{"inproc://monitor-topic-rep"}).value();
+
+  // receive next publication, expects topic frame followed by publication
+  auto recvPub = [&](std::chrono::milliseconds timeout) {
+    Message topic, pub;
+    auto ret = sub.recvMultipleTimeout(timeout, topic, pub);
+    if (ret.hasError()) {
+      return std::make_pair(std::string{}, thrift::MonitorPub{});
+    }
+    return std::make_pair(
+        topic.read<std::string>().value(),
+        pub.readThriftObj<thrift::MonitorPub>(serializer).value());
+  };
+
+  // Bump until subscription is connected and publication makes it through
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::BUMP_COUNTER;
+  thriftReq.counterBumpParams.counterNames = {"warmup"};
+  while (true) {
+    dealer.sendThriftObj(thriftReq, serializer).value();
+    auto pub = recvPub(std::chrono::milliseconds(500));
+    if (!pub.first.empty()) {
+      EXPECT_EQ("counter/warmup", pub.first);
+      break;
+    }
+  }
+  // drain publications of further warmup bumps, if any
+  while (!recvPub(std::chrono::milliseconds(300)).first.empty()) {
+  }
+
+  // Only counters and logs of subscribed topics are delivered
+  thriftReq.cmd = thrift::MonitorCommand::SET_COUNTER_VALUES;
+  for (auto const& name : {"foo.a", "foo.b", "bar.c", "foobar"}) {
+    thrift::Counter counter;
+    counter.value = 1;
+    thriftReq.counterSetParams.counters[name] = counter;
+  }
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  auto pub = recvPub(std::chrono::milliseconds(1000));
+  EXPECT_EQ("counter/foo.", pub.first);
+  EXPECT_EQ(thrift::PubType::COUNTER_PUB, pub.second.pubType);
+  EXPECT_EQ(2, pub.second.counterPub.counters.size());
+  EXPECT_EQ(1, pub.second.counterPub.counters.count("foo.a"));
+  EXPECT_EQ(1, pub.second.counterPub.counters.count("foo.b"));
+
+  thriftReq.cmd = thrift::MonitorCommand::LOG_EVENT;
+  for (auto const& category : {"cat2", "cat1"}) {
+    thriftReq.eventLog.category = category;
+    dealer.sendThriftObj(thriftReq, serializer).value();
+  }
+  pub = recvPub(std::chrono::milliseconds(1000));
+  EXPECT_EQ("log/cat1", pub.first);
+  EXPECT_EQ(thrift::PubType::EVENT_LOG_PUB, pub.second.pubType);
+  EXPECT_EQ("cat1", pub.second.eventLogPub.category);
+
+  // nothing else made it through
+  EXPECT_TRUE(recvPub(std::chrono::milliseconds(300)).first.empty());
+}
+
+TEST(ZmqMonitorTest, SnapshotWarmRestart) {
+  const auto path = folly::sformat("/tmp/fbzmq-monitor-snapshot-{}", getpid());
+  ::unlink(path.c_str());
+  SCOPE_EXIT {
+    ::unlink(path.c_str());
+  };
+
+  Context context;
+  CompactSerializer serializer;
+  auto makeMonitor = [&]() {
+    return make_shared<ZmqMonitor>(
+        std::string{"inproc://monitor-snapshot-rep"},
+        std::string{"inproc://monitor-snapshot-pub"},
+        context,
+        folly::none,
+        ZmqMonitor::Options().setSnapshotPath(path).setSnapshotInterval(
+            std::chrono::milliseconds(50)));
+  };
+
+  {
+    auto monitor = makeMonitor();
+    EXPECT_EQ(0, monitor->getNumRestoredCounters());
+    std::thread monitorThread([monitor]() { monitor->run(); });
+    monitor->waitUntilRunning();
+
+    Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+    dealer.connect(SocketUrl{"inproc://monitor-snapshot-rep"}).value();
+    thrift::MonitorRequest thriftReq;
+    thriftReq.cmd = thrift::MonitorCommand::SET_COUNTER_VALUES;
+    thrift::Counter counterFoo;
+    counterFoo.value = 5678;
+    counterFoo.valueType = thrift::CounterValueType::GAUGE;
+    counterFoo.timestamp = 42;
+    thriftReq.counterSetParams.counters["foo"] = counterFoo;
+    dealer.sendThriftObj(thriftReq, serializer).value();
+    thriftReq.cmd = thrift::MonitorCommand::BUMP_COUNTER_BY;
+    thriftReq.counterBumpByParams.counterDeltas = {{"bar", 3}};
+    dealer.sendThriftObj(thriftReq, serializer).value();
+    thriftReq.cmd = thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA;
+    dealer.sendThriftObj(thriftReq, serializer).value();
+    EXPECT_EQ(
+        2,
+        dealer.recvThriftObj<thrift::CounterValuesResponse>(serializer)
+            .value()
+            .counters.size());
+
+    // wait for periodic snapshot to land on disk
+    while (access(path.c_str(), F_OK) != 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    monitor->stop();
+    monitorThread.join();
+  }
+
+  // counters of previous instance are served right away
+  auto monitor = makeMonitor();
+  EXPECT_EQ(2, monitor->getNumRestoredCounters());
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  monitor->waitUntilRunning();
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  dealer.connect(SocketUrl{"inproc://monitor-snapshot-rep"}).value();
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA;
+  dealer.sendThriftObj(thriftReq, serializer).value();
+  auto counters =
+      dealer.recvThriftObj<thrift::CounterValuesResponse>(serializer)
+          .value()
+          .counters;
+  EXPECT_EQ(2, counters.size());
+  EXPECT_EQ(5678, counters["foo"].value);
+  EXPECT_EQ(thrift::CounterValueType::GAUGE, counters["foo"].valueType);
+  EXPECT_EQ(42, counters["foo"].timestamp);
+  EXPECT_EQ(3, counters["bar"].value);
+}
+
+TEST(ZmqMonitorTest, DeleteAndExpireCounters) {
+  Context context;
+  CompactSerializer serializer;
+  auto monitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-expire-rep"},
+      std::string{"inproc://monitor-expire-pub"},
+      context,
+      folly::none,
+      ZmqMonitor::Options().setCounterTtl(std::chrono::milliseconds(500)));
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  monitor->waitUntilRunning();
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+
+  ZmqMonitorClient client(context, "inproc://monitor-expire-rep");
+  for (auto const& name : {"foo", "bar", "peer1.a", "peer1.b", "peer2.a"}) {
+    client.bumpCounter(name);
+  }
+  EXPECT_EQ(5, client.dumpCounterNames().size());
+
+  client.deleteCounters({"foo", "missing"}, "peer1.");
+  auto names = client.dumpCounterNames();
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ((std::vector<std::string>{"bar", "peer2.a"}), names);
+  EXPECT_EQ(3, monitor->getEvictionStats().numDeleted);
+  EXPECT_EQ(0, monitor->getEvictionStats().numExpired);
+
+  // counters which keep being updated outlive TTL, others expire
+  const auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+    client.bumpCounter("bar");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  EXPECT_EQ((std::vector<std::string>{"bar"}), client.dumpCounterNames());
+  EXPECT_EQ(1, monitor->getEvictionStats().numExpired);
+}
+
+TEST(ZmqMonitorTest, StreamedDumpChunks) {
+  Context context;
+  CompactSerializer serializer;
+  auto monitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-chunks-rep"},
+      std::string{"inproc://monitor-chunks-pub"},
+      context);
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  monitor->waitUntilRunning();
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  dealer.connect(SocketUrl{"inproc://monitor-chunks-rep"}).value();
+
+  thrift::MonitorRequest thriftReq;
+  thriftReq.cmd = thrift::MonitorCommand::SET_COUNTER_VALUES;
+  thrift::Counter counter;
+  for (int i = 0; i < 5; ++i) {
+    counter.value = i;
+    thriftReq.counterSetParams.counters[folly::sformat("c{}", i)] = counter;
+  }
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  // chunks keep coming from the running loop
+  thriftReq.cmd = thrift::MonitorCommand::DUMP_COUNTER_DATA_STREAMED;
+  thriftReq.counterDumpParams.maxCountersPerChunk = 2;
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  CounterMap streamed;
+  std::vector<size_t> chunkSizes;
+  while (true) {
+    auto chunk = dealer
+                     .recvThriftObj<thrift::CounterDumpChunk>(
+                         serializer, std::chrono::seconds(5))
+                     .value();
+    EXPECT_EQ(chunkSizes.size(), chunk.chunkIndex);
+    chunkSizes.push_back(chunk.counters.size());
+    streamed.insert(chunk.counters.begin(), chunk.counters.end());
+    if (chunk.last) {
+      break;
+    }
+  }
+  EXPECT_EQ((std::vector<size_t>{2, 2, 1}), chunkSizes);
+
+  // monitor is still serving requests
+  thriftReq.cmd = thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA;
+  dealer.sendThriftObj(thriftReq, serializer).value();
+  auto counters =
+      dealer.recvThriftObj<thrift::CounterValuesResponse>(serializer)
+          .value()
+          .counters;
+  EXPECT_EQ(counters, streamed);
+  EXPECT_EQ(thriftReq.counterSetParams.counters, streamed);
+}
+
 int
 main(int argc, char* argv[]) {
   // Parse command line flags
@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <set>
+#include <thread>
+
+#include <folly/Format.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/monitor/ZmqMonitorClient.h>
+#include <fbzmq/service/monitor/ZmqShardedMonitor.h>
+
+using namespace std;
+using namespace fbzmq;
+
+using apache::thrift::CompactSerializer;
+
+namespace {
+
+const int kNumCounters = 100;
+
+} // namespace
+
+TEST(ZmqShardedMonitorTest, ScatterGather) {
+  Context context;
+  CompactSerializer serializer;
+  auto monitor = make_shared<ZmqShardedMonitor>(
+      std::string{"inproc://sharded-monitor-rep"},
+      std::string{"inproc://sharded-monitor-pub"},
+      context,
+      4 /* numShards */);
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  monitor->waitUntilRunning();
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+  EXPECT_EQ(4, monitor->getNumShards());
+
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+  sub.connect(SocketUrl{"inproc://sharded-monitor-pub"}).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+
+  ZmqMonitorClient client(context, "inproc://sharded-monitor-rep");
+  thrift::Counter counter;
+  CounterMap counters;
+  std::set<size_t> shards;
+  for (int i = 0; i < kNumCounters; ++i) {
+    const auto name = folly::sformat("counter.{:03d}", i);
+    counter.value = i;
+    counters[name] = counter;
+    shards.insert(monitor->getShard(name));
+    EXPECT_EQ(monitor->getShard(name), monitor->getShard(name));
+  }
+  EXPECT_LT(1, shards.size());
+  client.setCounters(counters);
+
+  // Updates of a client are applied in order and observed by its reads
+  client.bumpCounter("counter.001");
+  client.bumpCounterBy("counter.002", 40);
+  client.bumpCounter("bumped");
+  EXPECT_EQ(2, client.getCounter("counter.001")->value);
+  EXPECT_EQ(42, client.getCounter("counter.002")->value);
+  EXPECT_EQ(1, client.getCounter("bumped")->value);
+  EXPECT_FALSE(client.getCounter("unknown").hasValue());
+
+  // Dumps gather all shards
+  auto dumped = client.dumpCounters();
+  EXPECT_EQ(kNumCounters + 1, dumped.size());
+  EXPECT_EQ(50, dumped.at("counter.050").value);
+  EXPECT_EQ(kNumCounters + 1, client.dumpCounterNames().size());
+
+  // Pages are merged across shards in sorted order
+  thrift::CounterQueryParams params;
+  params.prefix = "counter.";
+  params.maxCounters = 7;
+  params.namesOnly = true;
+  std::vector<std::string> names;
+  while (true) {
+    auto page = client.queryCounters(params);
+    EXPECT_GE(7, page.counterNames.size());
+    names.insert(
+        names.end(), page.counterNames.begin(), page.counterNames.end());
+    if (not page.hasMore) {
+      break;
+    }
+    params.startAfter = page.lastCounterName;
+  }
+  EXPECT_EQ(kNumCounters, names.size());
+  EXPECT_TRUE(std::is_sorted(names.begin(), names.end()));
+  EXPECT_EQ(10, client.getCountersByPrefix("counter.", "*0").size());
+
+  // Streamed dump in bounded chunks
+  size_t numStreamed = 0;
+  auto stream = client.streamCounters(30);
+  while (auto chunk = stream.next()) {
+    EXPECT_GE(30, chunk->size());
+    numStreamed += chunk->size();
+  }
+  EXPECT_FALSE(stream.hasFailed());
+  EXPECT_EQ(kNumCounters + 1, numStreamed);
+
+  // Publications are sent by front end
+  client.bumpCounter("bumped");
+  while (true) {
+    auto pub = sub.recvThriftObj<thrift::MonitorPub>(
+                      serializer, std::chrono::milliseconds(1000))
+                   .value();
+    EXPECT_EQ(thrift::PubType::COUNTER_PUB, pub.pubType);
+    auto it = pub.counterPub.counters.find("bumped");
+    if (it != pub.counterPub.counters.end() && it->second.value == 2) {
+      break;
+    }
+  }
+}
+
+int
+main(int argc, char* argv[]) {
+  // Parse command line flags
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  // Run the tests
+  return RUN_ALL_TESTS();
+}
@@ -9,6 +9,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 namespace fbzmq {
 
 enum ExportType {
@@ -18,6 +20,16 @@ enum ExportType {
   // MAX        = 0x08,   // Not Available yet
   RATE = 0x10,
   COUNT = 0x20,
-  COUNT_RATE = 0x40
+  COUNT_RATE = 0x40,
+  // Percentiles, look at MultiLevelHistogram
+  P50 = 0x80,
+  P90 = 0x100,
+  P99 = 0x200,
+  P999 = 0x400,
 };
+
+/**
+ * All percentile export types
+ */
+const uint32_t kPercentileExportTypes = P50 | P90 | P99 | P999;
 } // namespace fbzmq
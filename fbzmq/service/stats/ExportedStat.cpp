@@ -9,6 +9,8 @@
 
 #include "ExportedStat.h"
 
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 #include <folly/Format.h>
@@ -41,21 +43,123 @@ getTsInSeconds() {
       std::chrono::steady_clock::now().time_since_epoch());
 }
 
-} // namespace
+/**
+ * Names of export types in counter names, in order of reporting
+ */
+static const std::vector<std::pair<ExportType, const char*>> kTypeNames = {
+    {SUM, "sum"},
+    {AVG, "avg"},
+    {RATE, "rate"},
+    {COUNT, "count"},
+    {COUNT_RATE, "count_rate"},
+    {P50, "p50"},
+    {P90, "p90"},
+    {P99, "p99"},
+    {P999, "p999"},
+};
 
-ExportedStat::ExportedStat(std::string const& key) : key_(key) {
-  multiTs_.reset(new folly::MultiLevelTimeSeries<int64_t>(
-      kTsBuckets, kLevelDurations.size(), &kLevelDurations[0]));
+/**
+ * Longest windowed level, compact samples older than that are only accounted
+ * in all time level
+ */
+static const int64_t kMaxWindow = std::chrono::seconds(3600).count();
+
+/**
+ * Aggregates of a level computed from compact samples, with same accessors
+ * and semantics as folly::BucketedTimeSeries
+ */
+struct CompactLevel {
+  int64_t sum_{0};
+  int64_t count_{0};
+  // seconds covered by level, 0 if empty
+  int64_t elapsed_{0};
+
+  int64_t
+  sum() const {
+    return sum_;
+  }
+  int64_t
+  count() const {
+    return count_;
+  }
+  double
+  avg() const {
+    return count_ ? static_cast<double>(sum_) / count_ : 0;
+  }
+  double
+  rate() const {
+    return elapsed_ ? static_cast<double>(sum_) / elapsed_ : 0;
+  }
+  double
+  countRate() const {
+    return elapsed_ ? static_cast<double>(count_) / elapsed_ : 0;
+  }
+};
+
+/**
+ * Value of non-percentile export type from level of either representation
+ */
+template <typename Level>
+int64_t
+getLevelValue(Level const& level, ExportType type) {
+  switch (type) {
+  case SUM:
+    return level.sum();
+  case AVG:
+    return level.avg();
+  case RATE:
+    return level.rate();
+  case COUNT:
+    return level.count();
+  case COUNT_RATE:
+    return level.countRate();
+  default:
+    return 0;
+  }
+}
+
+double
+getPercentile(ExportType type) {
+  switch (type) {
+  case P50:
+    return 50;
+  case P90:
+    return 90;
+  case P99:
+    return 99;
+  case P999:
+    return 99.9;
+  default:
+    return 0;
+  }
 }
 
+} // namespace
+
+constexpr size_t ExportedStat::kMaxCompactSamples;
+
+ExportedStat::ExportedStat(std::string const& key) : key_(key) {}
+
 void
 ExportedStat::setExportType(ExportType type) {
-  exportTypeBits_ |= type;
+  if ((exportTypeBits_ & type) == 0) {
+    exportTypeBits_ |= type;
+    if ((type & kPercentileExportTypes) && !histogram_) {
+      histogram_.reset(new MultiLevelHistogram(kLevelDurations));
+    }
+    updateExportedCounters();
+  }
 }
 
 void
 ExportedStat::unsetExportType(ExportType type) {
-  exportTypeBits_ &= ~type;
+  if (exportTypeBits_ & type) {
+    exportTypeBits_ &= ~type;
+    if ((exportTypeBits_ & kPercentileExportTypes) == 0) {
+      histogram_.reset();
+    }
+    updateExportedCounters();
+  }
 }
 
 /**
@@ -63,7 +167,23 @@ ExportedStat::unsetExportType(ExportType type) {
  */
 void
 ExportedStat::addValue(int64_t value) {
-  multiTs_->addValue(getTsInSeconds(), value);
+  auto const now = getTsInSeconds();
+  if (histogram_) {
+    histogram_->addValue(now, value);
+  }
+  if (multiTs_) {
+    multiTs_->addValue(now, value);
+    return;
+  }
+
+  if (firstTs_ < 0) {
+    firstTs_ = now.count();
+  }
+  evictSamples(now.count());
+  samples_.push_back(Sample{now.count(), value});
+  if (samples_.size() > kMaxCompactSamples) {
+    promote();
+  }
 }
 
 /**
@@ -72,37 +192,133 @@ ExportedStat::addValue(int64_t value) {
  */
 void
 ExportedStat::getCounters(std::unordered_map<std::string, int64_t>& counters) {
+  visitCounters([&counters](std::string const& name, int64_t value) {
+    counters[name] = value;
+  });
+}
+
+void
+ExportedStat::visitCounters(CounterVisitor visitor) {
+  if (exportedCounters_.empty()) {
+    return;
+  }
+
   // Update timeseries
-  multiTs_->update(getTsInSeconds());
+  auto const now = getTsInSeconds();
+  if (multiTs_) {
+    multiTs_->update(now);
+  } else {
+    evictSamples(now.count());
+  }
 
-  for (size_t i = 0; i < kLevelDurations.size(); i++) {
-    auto const& level = multiTs_->getLevel(i);
-    auto const interval = level.duration().count();
+  // Level being reported of compact samples or histogram, computed once per
+  // level
+  CompactLevel compactLevel;
+  size_t compactLevelIndex = kLevelDurations.size();
+  HistogramBuckets levelHistogram;
+  size_t histogramLevel = kLevelDurations.size();
 
-    if (exportTypeBits_ & SUM) {
-      auto key = folly::sformat("{}.sum.{}", key_, interval);
-      counters[key] = level.sum();
+  for (auto const& counter : exportedCounters_) {
+    int64_t value{0};
+    if (counter.type & kPercentileExportTypes) {
+      if (histogramLevel != counter.level) {
+        levelHistogram = histogram_->getLevel(counter.level, now);
+        histogramLevel = counter.level;
+      }
+      value = levelHistogram.getPercentile(getPercentile(counter.type));
+    } else if (multiTs_) {
+      value = getLevelValue(multiTs_->getLevel(counter.level), counter.type);
+    } else {
+      if (compactLevelIndex != counter.level) {
+        const auto duration = kLevelDurations[counter.level].count();
+        compactLevel = CompactLevel();
+        for (auto const& sample : samples_) {
+          if (duration == 0 || sample.ts > now.count() - duration) {
+            compactLevel.sum_ += sample.value;
+            compactLevel.count_ += 1;
+          }
+        }
+        if (duration == 0) {
+          compactLevel.sum_ += evictedSum_;
+          compactLevel.count_ += evictedCount_;
+        }
+        if (firstTs_ >= 0) {
+          compactLevel.elapsed_ = now.count() - firstTs_ + 1;
+          if (duration) {
+            compactLevel.elapsed_ =
+                std::min<int64_t>(compactLevel.elapsed_, duration);
+          }
+        }
+        compactLevelIndex = counter.level;
+      }
+      value = getLevelValue(compactLevel, counter.type);
     }
+    visitor(counter.name, value);
+  }
+}
 
-    if (exportTypeBits_ & AVG) {
-      auto key = folly::sformat("{}.avg.{}", key_, interval);
-      counters[key] = level.avg();
-    }
+size_t
+ExportedStat::getMemoryUsage() const {
+  size_t usage = sizeof(*this) + key_.capacity();
+  usage += exportedCounters_.capacity() * sizeof(ExportedCounter);
+  for (auto const& counter : exportedCounters_) {
+    usage += counter.name.capacity();
+  }
+  usage += samples_.capacity() * sizeof(Sample);
+  if (multiTs_) {
+    // levels and their buckets of sum and count
+    usage += sizeof(*multiTs_) +
+        kLevelDurations.size() *
+            (sizeof(folly::MultiLevelTimeSeries<int64_t>::Level) +
+             kTsBuckets * 2 * sizeof(int64_t));
+  }
+  if (histogram_) {
+    usage += histogram_->getMemoryUsage();
+  }
+  return usage;
+}
 
-    if (exportTypeBits_ & RATE) {
-      auto key = folly::sformat("{}.rate.{}", key_, interval);
-      counters[key] = level.rate();
+void
+ExportedStat::updateExportedCounters() {
+  exportedCounters_.clear();
+  for (size_t i = 0; i < kLevelDurations.size(); i++) {
+    auto const interval = kLevelDurations[i].count();
+    for (auto const& typeName : kTypeNames) {
+      if (exportTypeBits_ & typeName.first) {
+        exportedCounters_.push_back(ExportedCounter{
+            typeName.first,
+            i,
+            folly::sformat("{}.{}.{}", key_, typeName.second, interval)});
+      }
     }
+  }
+}
 
-    if (exportTypeBits_ & COUNT) {
-      auto key = folly::sformat("{}.count.{}", key_, interval);
-      counters[key] = level.count();
-    }
+void
+ExportedStat::evictSamples(int64_t now) {
+  size_t numEvicted = 0;
+  while (numEvicted < samples_.size() &&
+         samples_[numEvicted].ts <= now - kMaxWindow) {
+    evictedSum_ += samples_[numEvicted].value;
+    evictedCount_ += 1;
+    ++numEvicted;
+  }
+  samples_.erase(samples_.begin(), samples_.begin() + numEvicted);
+}
 
-    if (exportTypeBits_ & COUNT_RATE) {
-      auto key = folly::sformat("{}.count_rate.{}", key_, interval);
-      counters[key] = level.countRate();
-    }
+void
+ExportedStat::promote() {
+  multiTs_.reset(new folly::MultiLevelTimeSeries<int64_t>(
+      kTsBuckets, kLevelDurations.size(), &kLevelDurations[0]));
+
+  // Replay what we have, evicted samples only fall in all time level
+  if (evictedCount_) {
+    multiTs_->addValueAggregated(
+        std::chrono::seconds(firstTs_), evictedSum_, evictedCount_);
+  }
+  for (auto const& sample : samples_) {
+    multiTs_->addValue(std::chrono::seconds(sample.ts), sample.value);
   }
+  std::vector<Sample>().swap(samples_);
 }
 } // namespace fbzmq
@@ -12,12 +12,15 @@
 #include <chrono>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/noncopyable.hpp>
+#include <folly/Function.h>
 #include <folly/String.h>
 #include <folly/stats/MultiLevelTimeSeries.h>
 
 #include "ExportType.h"
+#include "Histogram.h"
 
 namespace fbzmq {
 
@@ -30,17 +33,41 @@ namespace fbzmq {
  * - 10 minutes (.600)
  * - 1 hour (.3600)
  * - all time (.0)
+ *
+ * Percentile export types (e.g. "foo.p99.60") are served from a
+ * MultiLevelHistogram over same levels, which is allocated only once any of
+ * them is set. Values added before that are not accounted in percentiles.
+ *
+ * Stats are materialized lazily to keep large numbers of sparse stats cheap.
+ * Until first write nothing but the key is stored. Low rate stats keep their
+ * raw samples of the last hour (at most kMaxCompactSamples) along with totals
+ * of older ones and compute their counters from those. Stat is promoted to
+ * full MultiLevelTimeSeries once it gets more samples than that within an
+ * hour, and stays promoted.
  */
 class ExportedStat : public boost::noncopyable {
  public:
+  static constexpr size_t kMaxCompactSamples = 8;
+
   explicit ExportedStat(std::string const& key);
 
+  std::string const&
+  getKey() const {
+    return key_;
+  }
+
   /**
    * Set/unset export-type for this statistic.
    */
   void setExportType(ExportType type);
   void unsetExportType(ExportType type);
 
+  /**
+   * Invoked with name and value of each exported counter
+   */
+  using CounterVisitor =
+      folly::FunctionRef<void(std::string const& name, int64_t value)>;
+
   /**
    * Add new value to this stats. We use current timestamp using steady_clock
    */
@@ -52,14 +79,67 @@ class ExportedStat : public boost::noncopyable {
    */
   void getCounters(std::unordered_map<std::string, int64_t>& counters);
 
+  /**
+   * Same as above but streaming counters out to visitor instead of building a
+   * map. Names are formatted once on setExportType/unsetExportType, not on
+   * every call.
+   */
+  void visitCounters(CounterVisitor visitor);
+
+  /**
+   * Whether stat has been promoted to full MultiLevelTimeSeries
+   */
+  bool
+  isPromoted() const {
+    return multiTs_ != nullptr;
+  }
+
+  /**
+   * Estimated heap and inline memory used by this stat in bytes
+   */
+  size_t getMemoryUsage() const;
+
  private:
+  struct ExportedCounter {
+    ExportType type;
+    size_t level;
+    std::string name;
+  };
+
+  struct Sample {
+    int64_t ts;
+    int64_t value;
+  };
+
+  // rebuild exportedCounters_ from exportTypeBits_
+  void updateExportedCounters();
+
+  // fold samples which fell out of all windowed levels into evicted totals
+  void evictSamples(int64_t now);
+
+  // replace compact samples by full MultiLevelTimeSeries
+  void promote();
+
   // The associated key
   std::string key_{""};
 
-  // MultiLevelTimeSeries associated with this statistics
+  // MultiLevelTimeSeries associated with this statistics, once promoted
   std::unique_ptr<folly::MultiLevelTimeSeries<int64_t>> multiTs_;
 
+  // Compact representation until promoted. Samples in order of time, within
+  // longest windowed level, and totals of all samples before them.
+  std::vector<Sample> samples_;
+  int64_t firstTs_{-1};
+  int64_t evictedSum_{0};
+  int64_t evictedCount_{0};
+
+  // Histogram for percentile export types, if any of them is set
+  std::unique_ptr<MultiLevelHistogram> histogram_;
+
   // Masked bitset for export types. #efficiency
   uint32_t exportTypeBits_{0};
+
+  // Exported counters for exportTypeBits_ with their precomputed names
+  std::vector<ExportedCounter> exportedCounters_;
 };
 } // namespace fbzmq
@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "Histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace fbzmq {
+
+constexpr size_t HistogramBuckets::kSubBucketBits;
+constexpr size_t HistogramBuckets::kNumSubBuckets;
+constexpr size_t HistogramBuckets::kNumBuckets;
+constexpr size_t MultiLevelHistogram::kSlotsPerLevel;
+
+size_t
+HistogramBuckets::getBucket(int64_t value) {
+  if (value < static_cast<int64_t>(2 * kNumSubBuckets)) {
+    return value < 0 ? 0 : static_cast<size_t>(value);
+  }
+  const auto v = static_cast<uint64_t>(value);
+  const size_t msb = 63 - __builtin_clzll(v);
+  const size_t shift = msb - kSubBucketBits;
+  return (shift + 1) * kNumSubBuckets + ((v >> shift) & (kNumSubBuckets - 1));
+}
+
+int64_t
+HistogramBuckets::getBucketMin(size_t bucket) {
+  if (bucket < 2 * kNumSubBuckets) {
+    return static_cast<int64_t>(bucket);
+  }
+  const size_t shift = bucket / kNumSubBuckets - 1;
+  const uint64_t sub = bucket % kNumSubBuckets;
+  return static_cast<int64_t>((kNumSubBuckets + sub) << shift);
+}
+
+void
+HistogramBuckets::addValue(int64_t value, uint64_t count) {
+  if (count == 0) {
+    return;
+  }
+  if (counts_.empty()) {
+    counts_.resize(kNumBuckets, 0);
+  }
+  value = std::max<int64_t>(value, 0);
+  counts_[getBucket(value)] += count;
+  min_ = count_ ? std::min(min_, value) : value;
+  max_ = count_ ? std::max(max_, value) : value;
+  count_ += count;
+}
+
+void
+HistogramBuckets::merge(HistogramBuckets const& other) {
+  if (other.count_ == 0) {
+    return;
+  }
+  if (counts_.empty()) {
+    counts_.resize(kNumBuckets, 0);
+  }
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  min_ = count_ ? std::min(min_, other.min_) : other.min_;
+  max_ = count_ ? std::max(max_, other.max_) : other.max_;
+  count_ += other.count_;
+}
+
+void
+HistogramBuckets::clear() {
+  if (count_ == 0) {
+    return;
+  }
+  std::fill(counts_.begin(), counts_.end(), 0);
+  count_ = 0;
+  min_ = 0;
+  max_ = 0;
+}
+
+int64_t
+HistogramBuckets::getPercentile(double pct) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  // rank of requested value among added ones, starting from 1
+  pct = std::min(std::max(pct, 0.0), 100.0);
+  const auto rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(pct / 100.0 * count_)));
+
+  if (rank >= count_) {
+    return max_;
+  }
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    seen += counts_[i];
+    if (seen < rank) {
+      continue;
+    }
+    // report middle of the bucket, narrowed down to range of added values
+    const auto lower = std::max(getBucketMin(i), min_);
+    const auto upper = std::min(
+        i + 1 < kNumBuckets ? getBucketMin(i + 1) - 1
+                            : std::numeric_limits<int64_t>::max(),
+        max_);
+    return lower + (upper - lower) / 2;
+  }
+  return max_;
+}
+
+MultiLevelHistogram::MultiLevelHistogram(
+    std::vector<std::chrono::seconds> const& levelDurations) {
+  for (auto const& duration : levelDurations) {
+    Level level;
+    if (duration.count() > 0) {
+      level.slotDuration = std::max<int64_t>(
+          1, duration.count() / static_cast<int64_t>(kSlotsPerLevel));
+      level.slots.resize(kSlotsPerLevel);
+    } else {
+      level.slots.resize(1);
+    }
+    levels_.push_back(std::move(level));
+  }
+}
+
+void
+MultiLevelHistogram::addValue(std::chrono::seconds now, int64_t value) {
+  for (auto& level : levels_) {
+    if (level.slotDuration == 0) {
+      level.slots[0].buckets.addValue(value);
+      continue;
+    }
+    const int64_t epoch = now.count() / level.slotDuration;
+    auto& slot = level.slots[epoch % kSlotsPerLevel];
+    if (slot.epoch != epoch) {
+      slot.epoch = epoch;
+      slot.buckets.clear();
+    }
+    slot.buckets.addValue(value);
+  }
+}
+
+HistogramBuckets
+MultiLevelHistogram::getLevel(size_t level, std::chrono::seconds now) const {
+  auto const& lvl = levels_.at(level);
+  if (lvl.slotDuration == 0) {
+    return lvl.slots[0].buckets;
+  }
+
+  const int64_t epoch = now.count() / lvl.slotDuration;
+  HistogramBuckets merged;
+  for (auto const& slot : lvl.slots) {
+    if (slot.epoch > epoch - static_cast<int64_t>(kSlotsPerLevel) &&
+        slot.epoch <= epoch) {
+      merged.merge(slot.buckets);
+    }
+  }
+  return merged;
+}
+
+size_t
+MultiLevelHistogram::getMemoryUsage() const {
+  size_t usage = sizeof(*this) + levels_.capacity() * sizeof(Level);
+  for (auto const& level : levels_) {
+    for (auto const& slot : level.slots) {
+      usage += sizeof(slot.epoch) + slot.buckets.getMemoryUsage();
+    }
+  }
+  return usage;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace fbzmq {
+
+/**
+ * Bounded memory, mergeable histogram of int64_t values with log-linear
+ * (HDR style) buckets. Values below 16 get their own bucket, above that every
+ * power of two range is split into 8 equal buckets, hence percentiles are
+ * reported with at most 1/16 relative error. Negative values are accounted as
+ * 0. Insertion is O(1), percentile lookups are O(kNumBuckets).
+ *
+ * Bucket storage (kNumBuckets counters) is allocated on first insertion.
+ */
+class HistogramBuckets {
+ public:
+  static constexpr size_t kSubBucketBits = 3;
+  static constexpr size_t kNumSubBuckets = 1 << kSubBucketBits;
+  static constexpr size_t kNumBuckets = (64 - kSubBucketBits) * kNumSubBuckets;
+
+  void addValue(int64_t value, uint64_t count = 1);
+
+  // add all values of other histogram to this one
+  void merge(HistogramBuckets const& other);
+
+  void clear();
+
+  uint64_t
+  getCount() const {
+    return count_;
+  }
+
+  /**
+   * Estimated value at given percentile in [0, 100], within the range of
+   * added values and exact for 100th. 0 if empty.
+   */
+  int64_t getPercentile(double pct) const;
+
+  // estimated memory used by this histogram in bytes
+  size_t
+  getMemoryUsage() const {
+    return sizeof(*this) + counts_.capacity() * sizeof(uint64_t);
+  }
+
+  // bucket of given value, exposed for testing
+  static size_t getBucket(int64_t value);
+
+  // smallest value of given bucket
+  static int64_t getBucketMin(size_t bucket);
+
+ private:
+  std::vector<uint64_t> counts_;
+  uint64_t count_{0};
+  int64_t min_{0};
+  int64_t max_{0};
+};
+
+/**
+ * Histogram over sliding windows, counterpart of folly::MultiLevelTimeSeries
+ * for percentiles. Each level of non-zero duration is a ring of
+ * kSlotsPerLevel histograms, each covering 1/kSlotsPerLevel of level's
+ * duration, and percentiles of a level are computed on merge of its slots. So
+ * windows roll in steps of slot duration and level estimates cover between
+ * (kSlotsPerLevel - 1) / kSlotsPerLevel and all of its duration. Level of zero
+ * duration covers all time.
+ */
+class MultiLevelHistogram {
+ public:
+  static constexpr size_t kSlotsPerLevel = 4;
+
+  explicit MultiLevelHistogram(
+      std::vector<std::chrono::seconds> const& levelDurations);
+
+  size_t
+  getNumLevels() const {
+    return levels_.size();
+  }
+
+  void addValue(std::chrono::seconds now, int64_t value);
+
+  // merge of histograms in window of given level as of `now`
+  HistogramBuckets getLevel(size_t level, std::chrono::seconds now) const;
+
+  // estimated memory used by all levels in bytes
+  size_t getMemoryUsage() const;
+
+ private:
+  struct Slot {
+    int64_t epoch{-1};
+    HistogramBuckets buckets;
+  };
+
+  struct Level {
+    // 0 for all time level
+    int64_t slotDuration{0};
+    std::vector<Slot> slots;
+  };
+
+  std::vector<Level> levels_;
+};
+
+} // namespace fbzmq
@@ -13,86 +13,155 @@ namespace fbzmq {
 
 void
 ThreadData::resetAllData() {
-  counters_.clear();
-  stats_.clear();
+  // Registrations are kept to keep handles valid
+  for (auto& counter : counters_) {
+    counter = FlatCounter();
+  }
+  for (auto& stat : stats_) {
+    stat = std::make_unique<ExportedStat>(stat->getKey());
+  }
 }
 
-void
-ThreadData::addStatExportType(std::string const& key, ExportType type) {
-  auto it = stats_.find(key);
-  if (it == stats_.end()) {
-    std::tie(it, std::ignore) = stats_.emplace(
-        std::piecewise_construct,
-        std::forward_as_tuple(key),
-        std::forward_as_tuple(key));
+CounterHandle
+ThreadData::registerCounter(std::string const& key) {
+  auto it = counterHandles_.find(key);
+  if (it == counterHandles_.end()) {
+    std::tie(it, std::ignore) =
+        counterHandles_.emplace(key, CounterHandle(counters_.size()));
+    counters_.emplace_back();
+    counterKeys_.emplace_back(key);
   }
+  return it->second;
+}
+
+StatHandle
+ThreadData::registerStat(std::string const& key) {
+  auto it = statHandles_.find(key);
+  if (it == statHandles_.end()) {
+    std::tie(it, std::ignore) =
+        statHandles_.emplace(key, StatHandle(stats_.size()));
+    stats_.emplace_back(std::make_unique<ExportedStat>(key));
+  }
+  return it->second;
+}
 
-  it->second.setExportType(type);
+void
+ThreadData::addStatExportType(std::string const& key, ExportType type) {
+  addStatExportType(registerStat(key), type);
 }
 
 void
 ThreadData::clearStatExportType(std::string const& key, ExportType type) {
-  auto it = stats_.find(key);
-  if (it != stats_.end()) {
-    it->second.unsetExportType(type);
+  auto it = statHandles_.find(key);
+  if (it != statHandles_.end()) {
+    stats_[it->second]->unsetExportType(type);
   }
 }
 
 void
 ThreadData::addStatValue(std::string const& key, int64_t value) {
-  auto it = stats_.find(key);
-  if (it == stats_.end()) {
-    std::tie(it, std::ignore) = stats_.emplace(
-        std::piecewise_construct,
-        std::forward_as_tuple(key),
-        std::forward_as_tuple(key));
-  }
-
-  it->second.addValue(value);
+  addStatValue(registerStat(key), value);
 }
 
 void
 ThreadData::addStatValue(
     const std::string& key, int64_t value, ExportType type) {
-  auto it = stats_.find(key);
-  if (it == stats_.end()) {
-    std::tie(it, std::ignore) = stats_.emplace(
-        std::piecewise_construct,
-        std::forward_as_tuple(key),
-        std::forward_as_tuple(key));
-  }
-
-  it->second.setExportType(type);
-  it->second.addValue(value);
+  const auto handle = registerStat(key);
+  addStatExportType(handle, type);
+  addStatValue(handle, value);
 }
 
 void
 ThreadData::setCounter(std::string const& key, int64_t value) {
-  counters_[key] = value;
+  setCounter(registerCounter(key), value);
 }
 
 void
 ThreadData::clearCounter(std::string const& key) {
-  counters_.erase(key);
+  auto it = counterHandles_.find(key);
+  if (it != counterHandles_.end()) {
+    counters_[it->second] = FlatCounter();
+  }
 }
 
 int64_t
 ThreadData::incrementCounter(std::string const& key, int64_t amount) {
-  return (counters_[key] += amount);
+  return incrementCounter(registerCounter(key), amount);
 }
 
 std::unordered_map<std::string, int64_t>
 ThreadData::getCounters() {
   std::unordered_map<std::string, int64_t> counters;
+  visitCounters([&counters](std::string const& name, int64_t value) {
+    counters[name] = value;
+  });
+  return counters;
+}
 
-  // Add all the flat counters
-  counters.insert(counters_.begin(), counters_.end());
+void
+ThreadData::visitCounters(ExportedStat::CounterVisitor visitor) {
+  // Visit all the flat counters
+  for (size_t i = 0; i < counters_.size(); ++i) {
+    if (counters_[i].isSet) {
+      visitor(counterKeys_[i], counters_[i].value);
+    }
+  }
 
-  // Add all stats
-  for (auto& kv : stats_) {
-    kv.second.getCounters(counters);
+  // Visit all stats
+  for (auto& stat : stats_) {
+    stat->visitCounters(visitor);
   }
 
-  return counters;
+  if (!statsMemoryUsageKey_.empty()) {
+    visitor(statsMemoryUsageKey_, getStatsMemoryUsage());
+  }
+}
+
+size_t
+ThreadData::getStatsMemoryUsage() const {
+  size_t usage = stats_.capacity() * sizeof(stats_[0]);
+  for (auto const& stat : stats_) {
+    usage += stat->getMemoryUsage();
+  }
+  return usage;
+}
+
+void
+ThreadData::exportSocketStats(
+    std::string const& prefix, SocketStats const& stats) {
+  setCounter(prefix + ".sent.msgs", stats.numSentMsgs);
+  setCounter(prefix + ".sent.frames", stats.numSentFrames);
+  setCounter(prefix + ".sent.bytes", stats.numSentBytes);
+  setCounter(prefix + ".sent.eagain", stats.numSendEagain);
+  setCounter(prefix + ".sent.errors", stats.numSendErrors);
+  setCounter(prefix + ".sent.retries", stats.numSendRetries);
+  setCounter(prefix + ".recv.msgs", stats.numRecvMsgs);
+  setCounter(prefix + ".recv.frames", stats.numRecvFrames);
+  setCounter(prefix + ".recv.bytes", stats.numRecvBytes);
+  setCounter(prefix + ".recv.eagain", stats.numRecvEagain);
+  setCounter(prefix + ".recv.errors", stats.numRecvErrors);
+  setCounter(prefix + ".recv.retries", stats.numRecvRetries);
+
+  if (!stats.measureLatency) {
+    return;
+  }
+  // averages are per frame send/receive call
+  const auto numSends =
+      stats.numSentFrames + stats.numSendEagain + stats.numSendErrors;
+  const auto numRecvs =
+      stats.numRecvFrames + stats.numRecvEagain + stats.numRecvErrors;
+  setCounter(
+      prefix + ".sent.latency_us.avg",
+      numSends ? stats.sendLatencyNs / numSends / 1000 : 0);
+  setCounter(prefix + ".sent.latency_us.max", stats.maxSendLatencyNs / 1000);
+  setCounter(
+      prefix + ".recv.latency_us.avg",
+      numRecvs ? stats.recvLatencyNs / numRecvs / 1000 : 0);
+  setCounter(prefix + ".recv.latency_us.max", stats.maxRecvLatencyNs / 1000);
+}
+
+void
+ThreadData::exportStatsMemoryUsage(std::string const& key) {
+  statsMemoryUsageKey_ = key;
 }
 } // namespace fbzmq
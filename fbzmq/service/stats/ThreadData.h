@@ -10,14 +10,26 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/noncopyable.hpp>
+#include <boost/serialization/strong_typedef.hpp>
+
+#include <fbzmq/zmq/SocketStats.h>
 
 #include "ExportedStat.h"
 
 namespace fbzmq {
 
+/**
+ * Handles of flat counters and stats registered with ThreadData, look at
+ * `ThreadData::registerCounter` and `ThreadData::registerStat`
+ */
+BOOST_STRONG_TYPEDEF(size_t, CounterHandle)
+BOOST_STRONG_TYPEDEF(size_t, StatHandle)
+
 /**
  * Thread storage for storing flat counters, timeseries counters and stats. This
  * can be extended to store histograms and string values.
@@ -36,7 +48,7 @@ class ThreadData : public boost::noncopyable {
   /**
    * Clear all counters and exported stats etc. You must call
    * addStatExportType/addStatExports/addHistogram again to
-   * re-add statistics.
+   * re-add statistics. Registered handles remain valid.
    */
   void resetAllData();
 
@@ -48,6 +60,7 @@ class ThreadData : public boost::noncopyable {
    * type SUM: foo.SUM, foo.SUM.60, foo.SUM.600, foo.SUM.3600
    * type COUNT: foo.COUNT, foo.COUNT.60, foo.COUNT.600, foo.COUNT.3600
    * type AVG: foo.avg, foo.avg.60, foo.avg.600, foo.avg.3600
+   * type P99: foo.p99.0, foo.p99.60, foo.p99.600, foo.p99.3600
    * so on for other types
    */
   void addStatExportType(std::string const& key, ExportType type);
@@ -80,16 +93,86 @@ class ThreadData : public boost::noncopyable {
    */
   int64_t incrementCounter(std::string const& key, int64_t amount = 1);
 
+  /**
+   * Register flat counter/stat for updates via handle, for hot code paths.
+   * Registering same key again returns same handle. Handles stay valid for
+   * lifetime of ThreadData, across `clearCounter` and `resetAllData` too.
+   * Updates through them index dense storage, without any string hashing.
+   * Key based API above works on top of same storage, so both can be mixed.
+   */
+  CounterHandle registerCounter(std::string const& key);
+  StatHandle registerStat(std::string const& key);
+
+  /**
+   * Handle based counterparts of key based API
+   */
+  void
+  setCounter(CounterHandle handle, int64_t value) {
+    auto& counter = counters_[handle];
+    counter.value = value;
+    counter.isSet = true;
+  }
+
+  int64_t
+  incrementCounter(CounterHandle handle, int64_t amount = 1) {
+    auto& counter = counters_[handle];
+    counter.isSet = true;
+    return (counter.value += amount);
+  }
+
+  void
+  addStatExportType(StatHandle handle, ExportType type) {
+    stats_[handle]->setExportType(type);
+  }
+
+  void
+  addStatValue(StatHandle handle, int64_t value) {
+    stats_[handle]->addValue(value);
+  }
+
   /**
    * Returns all the counters (flat + exportedStats) as a map of key, vals.
    */
   std::unordered_map<std::string, int64_t> getCounters();
 
- private:
-  // Exported stats
-  std::unordered_map<std::string /* key */, ExportedStat> stats_{};
+  /**
+   * Streams all the counters (flat + exportedStats) to visitor without
+   * building a map, prefer it for exporting large number of stats.
+   */
+  void visitCounters(ExportedStat::CounterVisitor visitor);
+
+  /**
+   * Set flat counters from I/O stats of a socket (look at
+   * `SocketImpl::enableStats`), keyed by given prefix e.g.
+   * `<prefix>.sent.msgs`, `<prefix>.recv.eagain`. Latencies are exported in
+   * microseconds as average and max, only if socket measures them.
+   */
+  void exportSocketStats(std::string const& prefix, SocketStats const& stats);
 
-  // Simple flat counters.
-  std::unordered_map<std::string /* key */, int64_t> counters_{};
+  /**
+   * Estimated memory used by all exported stats in bytes. With
+   * exportStatsMemoryUsage it is also reported as flat counter of given key.
+   */
+  size_t getStatsMemoryUsage() const;
+  void exportStatsMemoryUsage(std::string const& key);
+
+ private:
+  struct FlatCounter {
+    int64_t value{0};
+    // false if counter hasn't been set since registration or clearing
+    bool isSet{false};
+  };
+
+  // Exported stats, indexed by StatHandle
+  std::vector<std::unique_ptr<ExportedStat>> stats_{};
+  std::unordered_map<std::string /* key */, StatHandle> statHandles_{};
+
+  // Simple flat counters, indexed by CounterHandle
+  std::vector<FlatCounter> counters_{};
+  std::vector<std::string> counterKeys_{};
+  std::unordered_map<std::string /* key */, CounterHandle> counterHandles_{};
+
+  // Key of stats memory usage counter, not reported if empty
+  std::string statsMemoryUsageKey_{};
 };
 } // namespace fbzmq
@@ -0,0 +1,221 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ThreadLocalStats.h"
+
+#include <array>
+#include <atomic>
+#include <iterator>
+#include <stdexcept>
+
+#include <folly/Format.h>
+
+namespace fbzmq {
+
+constexpr size_t ThreadLocalStats::kSlotsPerChunk;
+constexpr size_t ThreadLocalStats::kMaxChunks;
+
+namespace detail {
+
+/**
+ * Slots of a single thread. Only that thread writes them, others read.
+ */
+struct ThreadStatsSlots {
+  struct Chunk {
+    // Padding keeps slots of different threads off each other's cache lines
+    char padBefore[64];
+    std::array<std::atomic<int64_t>, ThreadLocalStats::kSlotsPerChunk> slots;
+    char padAfter[64];
+  };
+
+  ThreadStatsSlots() {
+    for (auto& chunk : chunks) {
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~ThreadStatsSlots() {
+    for (auto& chunk : chunks) {
+      delete chunk.load(std::memory_order_relaxed);
+    }
+  }
+
+  int64_t
+  getValue(size_t slot) const {
+    auto chunk = chunks[slot / ThreadLocalStats::kSlotsPerChunk].load(
+        std::memory_order_acquire);
+    return chunk ? chunk->slots[slot % ThreadLocalStats::kSlotsPerChunk].load(
+                       std::memory_order_relaxed)
+                 : 0;
+  }
+
+  std::array<std::atomic<Chunk*>, ThreadLocalStats::kMaxChunks> chunks;
+};
+
+} // namespace detail
+
+namespace {
+
+std::atomic<uint64_t> nextInstanceId{1};
+
+/**
+ * Slots of calling thread per ThreadLocalStats instance, with the last one
+ * used cached for lookup free access
+ */
+struct ThreadSlotsCache {
+  uint64_t lastId{0};
+  detail::ThreadStatsSlots* lastSlots{nullptr};
+  std::unordered_map<uint64_t, std::shared_ptr<detail::ThreadStatsSlots>>
+      slots;
+};
+
+thread_local ThreadSlotsCache threadSlotsCache;
+
+} // namespace
+
+ThreadLocalStats::ThreadLocalStats() : id_(nextInstanceId++) {}
+
+// Threads may still hold their slots, they go away on threads' exit
+ThreadLocalStats::~ThreadLocalStats() = default;
+
+CounterHandle
+ThreadLocalStats::registerCounter(std::string const& key) {
+  return CounterHandle(registerEntry(key, false /* isStat */));
+}
+
+StatHandle
+ThreadLocalStats::registerStat(std::string const& key) {
+  return StatHandle(registerEntry(key, true /* isStat */));
+}
+
+size_t
+ThreadLocalStats::registerEntry(std::string const& key, bool isStat) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    auto const& entry = entries_[it->second];
+    if (entry.isStat != isStat) {
+      throw std::runtime_error(folly::sformat(
+          "ThreadLocalStats: '{}' is already registered as {}",
+          key,
+          entry.isStat ? "stat" : "counter"));
+    }
+    return entry.slot;
+  }
+
+  const size_t numSlots = isStat ? 2 /* sum and count */ : 1;
+  if (numSlots_ + numSlots > kSlotsPerChunk * kMaxChunks) {
+    throw std::runtime_error(folly::sformat(
+        "ThreadLocalStats: no slots left to register '{}'", key));
+  }
+  Entry entry;
+  entry.key = key;
+  entry.isStat = isStat;
+  entry.slot = numSlots_;
+  numSlots_ += numSlots;
+  index_.emplace(key, entries_.size());
+  entries_.emplace_back(std::move(entry));
+  return entries_.back().slot;
+}
+
+void
+ThreadLocalStats::incrementCounter(CounterHandle handle, int64_t amount) {
+  addToSlot(handle, amount);
+}
+
+void
+ThreadLocalStats::incrementCounter(std::string const& key, int64_t amount) {
+  addToSlot(registerCounter(key), amount);
+}
+
+void
+ThreadLocalStats::addStatValue(StatHandle handle, int64_t value) {
+  addToSlot(handle, value);
+  addToSlot(handle + 1, 1);
+}
+
+void
+ThreadLocalStats::addStatValue(std::string const& key, int64_t value) {
+  addStatValue(registerStat(key), value);
+}
+
+detail::ThreadStatsSlots&
+ThreadLocalStats::getThreadSlots() {
+  auto& cache = threadSlotsCache;
+  if (cache.lastId == id_) {
+    return *cache.lastSlots;
+  }
+
+  auto it = cache.slots.find(id_);
+  if (it == cache.slots.end()) {
+    auto slots = std::make_shared<detail::ThreadStatsSlots>();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      threads_.emplace_back(slots);
+    }
+    it = cache.slots.emplace(id_, std::move(slots)).first;
+  }
+  cache.lastId = id_;
+  cache.lastSlots = it->second.get();
+  return *cache.lastSlots;
+}
+
+void
+ThreadLocalStats::addToSlot(size_t slot, int64_t amount) {
+  auto& threadSlots = getThreadSlots();
+  auto& chunkPtr = threadSlots.chunks[slot / kSlotsPerChunk];
+  auto chunk = chunkPtr.load(std::memory_order_relaxed);
+  if (not chunk) {
+    // Value initialization zeroes slots, readers acquire them zeroed
+    chunk = new detail::ThreadStatsSlots::Chunk();
+    chunkPtr.store(chunk, std::memory_order_release);
+  }
+
+  // Sole writer, no need for read-modify-write
+  auto& value = chunk->slots[slot % kSlotsPerChunk];
+  value.store(
+      value.load(std::memory_order_relaxed) + amount,
+      std::memory_order_relaxed);
+}
+
+std::unordered_map<std::string, int64_t>
+ThreadLocalStats::getCounters() {
+  std::unordered_map<std::string, int64_t> counters;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  retired_.resize(numSlots_, 0);
+  std::vector<int64_t> totals(retired_);
+  for (auto it = threads_.begin(); it != threads_.end();) {
+    // Sole owner once thread has exited, no writes can follow
+    const bool hasExited = it->use_count() == 1;
+    for (size_t slot = 0; slot < numSlots_; ++slot) {
+      const auto value = (*it)->getValue(slot);
+      totals[slot] += value;
+      if (hasExited) {
+        retired_[slot] += value;
+      }
+    }
+    it = hasExited ? threads_.erase(it) : std::next(it);
+  }
+
+  for (auto const& entry : entries_) {
+    if (not entry.isStat) {
+      counters[entry.key] = totals[entry.slot];
+      continue;
+    }
+    const auto sum = totals[entry.slot];
+    const auto count = totals[entry.slot + 1];
+    counters[entry.key + ".sum"] = sum;
+    counters[entry.key + ".count"] = count;
+    counters[entry.key + ".avg"] = count ? sum / count : 0;
+  }
+  return counters;
+}
+
+} // namespace fbzmq
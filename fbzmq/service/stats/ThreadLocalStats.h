@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "ThreadData.h"
+
+namespace fbzmq {
+
+namespace detail {
+struct ThreadStatsSlots;
+} // namespace detail
+
+/**
+ * Counters and stats which can be updated from any number of threads without
+ * locks or contention. Unlike ThreadData, a single instance is meant to be
+ * shared by all threads of a process.
+ *
+ * Every thread updates its own slots only (relaxed atomic load and store, no
+ * read-modify-write), kept in cache line padded chunks allocated on first
+ * use. `getCounters` snapshots and sums up slots of all threads while they
+ * keep writing, hence never observes torn values but isn't an atomic
+ * snapshot across counters. Values of exited threads are retained.
+ *
+ * Registration takes a lock, hence should be done upfront with handles used
+ * on hot paths. Key based updates register on every call.
+ */
+class ThreadLocalStats : public boost::noncopyable {
+ public:
+  // Max number of slots, a counter takes one and a stat two
+  static constexpr size_t kSlotsPerChunk = 512;
+  static constexpr size_t kMaxChunks = 256;
+
+  ThreadLocalStats();
+  ~ThreadLocalStats();
+
+  /**
+   * Register counter/stat. Registering same key again returns same handle.
+   * Throws std::runtime_error if key is registered as the other kind or if
+   * slots are exhausted.
+   */
+  CounterHandle registerCounter(std::string const& key);
+  StatHandle registerStat(std::string const& key);
+
+  /**
+   * Add to calling thread's part of counter. Counters are summed up across
+   * threads and reported as "<key>".
+   */
+  void incrementCounter(CounterHandle handle, int64_t amount = 1);
+  void incrementCounter(std::string const& key, int64_t amount = 1);
+
+  /**
+   * Add a value to stat. Stats are reported over lifetime of this object as
+   * "<key>.sum", "<key>.count" and "<key>.avg".
+   */
+  void addStatValue(StatHandle handle, int64_t value);
+  void addStatValue(std::string const& key, int64_t value);
+
+  /**
+   * Thread-safe snapshot of all counters and stats merged over threads
+   */
+  std::unordered_map<std::string, int64_t> getCounters();
+
+ private:
+  struct Entry {
+    std::string key;
+    bool isStat{false};
+    size_t slot{0};
+  };
+
+  size_t registerEntry(std::string const& key, bool isStat);
+
+  // Calling thread's slots, created on first use
+  detail::ThreadStatsSlots& getThreadSlots();
+
+  void addToSlot(size_t slot, int64_t amount);
+
+  // Identifies instance in thread local caches, never reused
+  const uint64_t id_{0};
+
+  // Protects everything below, never taken by updates via handle
+  std::mutex mutex_;
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, size_t /* index in entries_ */> index_;
+  size_t numSlots_{0};
+
+  // Slots of all threads which have updated stats
+  std::vector<std::shared_ptr<detail::ThreadStatsSlots>> threads_;
+
+  // Totals of threads which have exited, indexed by slot
+  std::vector<int64_t> retired_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <limits>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/stats/Histogram.h>
+
+using namespace fbzmq;
+
+TEST(HistogramTest, Buckets) {
+  // Buckets are contiguous and increasing over whole value range
+  for (size_t i = 1; i < HistogramBuckets::kNumBuckets; ++i) {
+    const auto min = HistogramBuckets::getBucketMin(i);
+    EXPECT_LT(HistogramBuckets::getBucketMin(i - 1), min);
+    EXPECT_EQ(i, HistogramBuckets::getBucket(min));
+    EXPECT_EQ(i - 1, HistogramBuckets::getBucket(min - 1));
+  }
+  EXPECT_EQ(0, HistogramBuckets::getBucket(-5));
+  EXPECT_EQ(
+      HistogramBuckets::kNumBuckets - 1,
+      HistogramBuckets::getBucket(std::numeric_limits<int64_t>::max()));
+}
+
+TEST(HistogramTest, Percentiles) {
+  HistogramBuckets hist;
+  EXPECT_EQ(0, hist.getPercentile(50));
+
+  for (int64_t i = 1; i <= 10000; ++i) {
+    hist.addValue(i);
+  }
+  EXPECT_EQ(10000, hist.getCount());
+  EXPECT_EQ(1, hist.getPercentile(0));
+  EXPECT_EQ(10000, hist.getPercentile(100));
+  EXPECT_NEAR(5000, hist.getPercentile(50), 5000 / 16);
+  EXPECT_NEAR(9900, hist.getPercentile(99), 9900 / 16);
+  EXPECT_NEAR(9990, hist.getPercentile(99.9), 9990 / 16);
+
+  // Merge accounts all values of both
+  HistogramBuckets other;
+  other.addValue(1000000, 10000);
+  hist.merge(other);
+  EXPECT_EQ(20000, hist.getCount());
+  EXPECT_NEAR(1000000, hist.getPercentile(75), 1000000 / 16);
+  EXPECT_NEAR(10000, hist.getPercentile(50), 10000 / 16);
+
+  hist.clear();
+  EXPECT_EQ(0, hist.getCount());
+  EXPECT_EQ(0, hist.getPercentile(99));
+}
+
+TEST(HistogramTest, MultiLevel) {
+  MultiLevelHistogram hist(
+      {std::chrono::seconds(60), std::chrono::seconds(600),
+       std::chrono::seconds(0)});
+  EXPECT_EQ(3, hist.getNumLevels());
+
+  hist.addValue(std::chrono::seconds(1000), 10);
+  hist.addValue(std::chrono::seconds(1010), 20);
+  EXPECT_EQ(2, hist.getLevel(0, std::chrono::seconds(1010)).getCount());
+
+  // Old slots fall out of shorter windows first
+  const auto later = std::chrono::seconds(1100);
+  hist.addValue(later, 30);
+  EXPECT_EQ(1, hist.getLevel(0, later).getCount());
+  EXPECT_EQ(30, hist.getLevel(0, later).getPercentile(50));
+  EXPECT_EQ(3, hist.getLevel(1, later).getCount());
+  EXPECT_EQ(20, hist.getLevel(1, later).getPercentile(50));
+  EXPECT_EQ(0, hist.getLevel(1, std::chrono::seconds(5000)).getCount());
+  EXPECT_EQ(3, hist.getLevel(2, std::chrono::seconds(5000)).getCount());
+}
+
+int
+main(int argc, char* argv[]) {
+  // Parse command line flags
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  // Run the tests
+  return RUN_ALL_TESTS();
+}
@@ -74,6 +74,142 @@ TEST(ThreadDataTest, ApiTest) {
   EXPECT_EQ(2, counters["stats_key.count.0"]);
 }
 
+TEST(ThreadDataTest, HandleTest) {
+  fbzmq::ThreadData tData;
+
+  const auto counter = tData.registerCounter("counter_key");
+  const auto stat = tData.registerStat("stats_key");
+  EXPECT_EQ(counter, tData.registerCounter("counter_key"));
+  EXPECT_EQ(stat, tData.registerStat("stats_key"));
+  EXPECT_NE(counter, tData.registerCounter("other_key"));
+
+  // Registered counters are reported only once set
+  EXPECT_EQ(0, tData.getCounters().size());
+
+  // Handle and key based updates apply to same counters
+  tData.setCounter(counter, 10);
+  EXPECT_EQ(12, tData.incrementCounter(counter, 2));
+  EXPECT_EQ(13, tData.incrementCounter("counter_key"));
+  tData.addStatExportType(stat, fbzmq::SUM);
+  tData.addStatValue(stat, 10);
+  tData.addStatValue("stats_key", 20);
+
+  auto counters = tData.getCounters();
+  EXPECT_EQ(5, counters.size());
+  EXPECT_EQ(13, counters["counter_key"]);
+  EXPECT_EQ(30, counters["stats_key.sum.60"]);
+  EXPECT_EQ(30, counters["stats_key.sum.0"]);
+
+  // Handles survive clearing
+  tData.clearCounter("counter_key");
+  EXPECT_EQ(4, tData.getCounters().size());
+  EXPECT_EQ(1, tData.incrementCounter(counter));
+
+  tData.resetAllData();
+  EXPECT_EQ(0, tData.getCounters().size());
+  tData.setCounter(counter, 5);
+  tData.addStatExportType(stat, fbzmq::COUNT);
+  tData.addStatValue(stat, 1);
+  counters = tData.getCounters();
+  EXPECT_EQ(5, counters.size());
+  EXPECT_EQ(5, counters["counter_key"]);
+  EXPECT_EQ(1, counters["stats_key.count.0"]);
+}
+
+TEST(ThreadDataTest, VisitorTest) {
+  fbzmq::ThreadData tData;
+  tData.setCounter("counter_key", 7);
+  tData.addStatExportType("stats_key", fbzmq::SUM);
+  tData.addStatExportType("stats_key", fbzmq::COUNT);
+  tData.addStatValue("stats_key", 10);
+  tData.addStatValue("stats_key", 20);
+
+  // Visitor sees exactly what getCounters reports
+  std::unordered_map<std::string, int64_t> visited;
+  tData.visitCounters([&visited](std::string const& name, int64_t value) {
+    EXPECT_TRUE(visited.emplace(name, value).second);
+  });
+  EXPECT_EQ(tData.getCounters(), visited);
+  EXPECT_EQ(9, visited.size());
+  EXPECT_EQ(7, visited["counter_key"]);
+  EXPECT_EQ(30, visited["stats_key.sum.600"]);
+  EXPECT_EQ(2, visited["stats_key.count.3600"]);
+
+  // Cached names follow export type changes
+  fbzmq::ExportedStat stat("foo");
+  stat.setExportType(fbzmq::AVG);
+  stat.setExportType(fbzmq::AVG);
+  stat.setExportType(fbzmq::COUNT_RATE);
+  stat.unsetExportType(fbzmq::COUNT_RATE);
+  stat.addValue(4);
+  std::vector<std::string> names;
+  stat.visitCounters([&names](std::string const& name, int64_t value) {
+    EXPECT_EQ(4, value);
+    names.push_back(name);
+  });
+  EXPECT_EQ(
+      std::vector<std::string>(
+          {"foo.avg.60", "foo.avg.600", "foo.avg.3600", "foo.avg.0"}),
+      names);
+
+  // Percentiles are exported once their type is set
+  tData.addStatExportType("latency_key", fbzmq::P50);
+  tData.addStatExportType("latency_key", fbzmq::P99);
+  for (int i = 1; i <= 100; ++i) {
+    tData.addStatValue("latency_key", i);
+  }
+  auto counters = tData.getCounters();
+  EXPECT_EQ(17, counters.size());
+  EXPECT_NEAR(50, counters["latency_key.p50.60"], 4);
+  EXPECT_NEAR(99, counters["latency_key.p99.0"], 7);
+  tData.clearStatExportType("latency_key", fbzmq::P99);
+  EXPECT_EQ(13, tData.getCounters().size());
+}
+
+TEST(ThreadDataTest, LazyStatTest) {
+  fbzmq::ThreadData tData;
+  tData.exportStatsMemoryUsage("stats_memory");
+  const auto stat = tData.registerStat("stats_key");
+  tData.addStatExportType(stat, fbzmq::SUM);
+  tData.addStatExportType(stat, fbzmq::COUNT);
+  tData.addStatExportType(stat, fbzmq::AVG);
+  auto counters = tData.getCounters();
+  EXPECT_EQ(13, counters.size());
+  EXPECT_EQ(0, counters["stats_key.sum.0"]);
+  const auto emptyUsage = counters.at("stats_memory");
+  EXPECT_EQ(emptyUsage, static_cast<int64_t>(tData.getStatsMemoryUsage()));
+
+  // Sparse stat is served from its samples
+  fbzmq::ExportedStat sparse("sparse");
+  sparse.setExportType(fbzmq::SUM);
+  for (size_t i = 1; i <= fbzmq::ExportedStat::kMaxCompactSamples; ++i) {
+    tData.addStatValue(stat, 10);
+    sparse.addValue(i);
+  }
+  EXPECT_FALSE(sparse.isPromoted());
+  counters = tData.getCounters();
+  EXPECT_EQ(80, counters["stats_key.sum.60"]);
+  EXPECT_EQ(8, counters["stats_key.count.3600"]);
+  EXPECT_EQ(10, counters["stats_key.avg.0"]);
+  EXPECT_LT(emptyUsage, counters["stats_memory"]);
+
+  // And promoted once it gets busier, keeping what was recorded
+  tData.addStatValue(stat, 20);
+  sparse.addValue(100);
+  EXPECT_TRUE(sparse.isPromoted());
+  counters = tData.getCounters();
+  EXPECT_EQ(100, counters["stats_key.sum.60"]);
+  EXPECT_EQ(9, counters["stats_key.count.0"]);
+  EXPECT_EQ(11, counters["stats_key.avg.600"]);
+  EXPECT_LT(
+      static_cast<int64_t>(sparse.getMemoryUsage()), counters["stats_memory"]);
+
+  std::unordered_map<std::string, int64_t> sparseCounters;
+  sparse.getCounters(sparseCounters);
+  EXPECT_EQ(136, sparseCounters["sparse.sum.60"]);
+  EXPECT_EQ(136, sparseCounters["sparse.sum.0"]);
+}
+
 int
 main(int argc, char** argv) {
   // Basic initialization
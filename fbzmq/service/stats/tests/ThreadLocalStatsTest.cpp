@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/stats/ThreadLocalStats.h>
+
+TEST(ThreadLocalStatsTest, ApiTest) {
+  fbzmq::ThreadLocalStats stats;
+
+  const auto counter = stats.registerCounter("counter_key");
+  const auto stat = stats.registerStat("stats_key");
+  EXPECT_EQ(counter, stats.registerCounter("counter_key"));
+  EXPECT_EQ(stat, stats.registerStat("stats_key"));
+  EXPECT_THROW(stats.registerStat("counter_key"), std::runtime_error);
+  EXPECT_THROW(stats.registerCounter("stats_key"), std::runtime_error);
+
+  // Registered entries are reported with zero values
+  auto counters = stats.getCounters();
+  EXPECT_EQ(4, counters.size());
+  EXPECT_EQ(0, counters.at("counter_key"));
+  EXPECT_EQ(0, counters.at("stats_key.avg"));
+
+  stats.incrementCounter(counter, 5);
+  stats.incrementCounter("counter_key");
+  stats.addStatValue(stat, 10);
+  stats.addStatValue("stats_key", 20);
+  counters = stats.getCounters();
+  EXPECT_EQ(6, counters.at("counter_key"));
+  EXPECT_EQ(30, counters.at("stats_key.sum"));
+  EXPECT_EQ(2, counters.at("stats_key.count"));
+  EXPECT_EQ(15, counters.at("stats_key.avg"));
+}
+
+TEST(ThreadLocalStatsTest, ConcurrentWriters) {
+  fbzmq::ThreadLocalStats stats;
+  const auto counter = stats.registerCounter("counter_key");
+  const auto stat = stats.registerStat("stats_key");
+
+  const int kNumThreads = 8;
+  const int kNumIncrements = 100000;
+  std::atomic<bool> done{false};
+
+  // Aggregate while writers are running, totals never go backwards
+  std::thread reader([&]() {
+    int64_t last = 0;
+    while (not done) {
+      const auto value = stats.getCounters().at("counter_key");
+      EXPECT_LE(last, value);
+      last = value;
+    }
+  });
+
+  std::vector<std::thread> writers;
+  for (int i = 0; i < kNumThreads; ++i) {
+    writers.emplace_back([&]() {
+      for (int j = 0; j < kNumIncrements; ++j) {
+        stats.incrementCounter(counter);
+        stats.addStatValue(stat, 2);
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  done = true;
+  reader.join();
+
+  // Values of exited threads are retained
+  for (int i = 0; i < 2; ++i) {
+    auto counters = stats.getCounters();
+    EXPECT_EQ(kNumThreads * kNumIncrements, counters.at("counter_key"));
+    EXPECT_EQ(kNumThreads * kNumIncrements, counters.at("stats_key.count"));
+    EXPECT_EQ(2 * kNumThreads * kNumIncrements, counters.at("stats_key.sum"));
+    EXPECT_EQ(2, counters.at("stats_key.avg"));
+  }
+}
+
+int
+main(int argc, char** argv) {
+  // Basic initialization
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  // Run the tests
+  return RUN_ALL_TESTS();
+}
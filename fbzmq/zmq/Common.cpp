@@ -26,8 +26,10 @@ operator<<(std::ostream& out, Error const& err) {
   return out;
 }
 
+namespace {
+
 folly::Expected<int, Error>
-poll(zmq_pollitem_t const* items_, int nitems_, long timeout_ = -1) {
+pollImpl(zmq_pollitem_t const* items_, int nitems_, long timeout_) {
   while (true) {
     auto rc = zmq_poll(const_cast<zmq_pollitem_t*>(items_), nitems_, timeout_);
     if (rc >= 0) {
@@ -41,11 +43,21 @@ poll(zmq_pollitem_t const* items_, int nitems_, long timeout_ = -1) {
   }
 }
 
+} // namespace
+
 folly::Expected<int, Error>
 poll(
     std::vector<PollItem> const& items,
     folly::Optional<std::chrono::milliseconds> timeout /* = folly::none */) {
-  return poll(items.data(), items.size(), timeout ? timeout->count() : -1);
+  return pollImpl(items.data(), items.size(), timeout ? timeout->count() : -1);
+}
+
+folly::Expected<int, Error>
+poll(
+    PollItem const* items,
+    size_t numItems,
+    folly::Optional<std::chrono::milliseconds> timeout /* = folly::none */) {
+  return pollImpl(items, numItems, timeout ? timeout->count() : -1);
 }
 
 folly::Expected<folly::Unit, Error> proxy(
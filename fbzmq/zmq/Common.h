@@ -57,10 +57,20 @@ folly::Expected<int, Error> poll(
     std::vector<PollItem> const& items,
     folly::Optional<std::chrono::milliseconds> timeout = folly::none);
 
+/**
+ * Ditto, for items in caller provided storage (e.g. on stack) to avoid
+ * allocating vector on hot paths
+ */
+folly::Expected<int, Error> poll(
+    PollItem const* items,
+    size_t numItems,
+    folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
 /**
  * Proxy connects a frontend socket to a backend socket.
  * Conceptually, data flows from frontend to backend.
  * Depending on the socket types, replies may flow in the opposite direction.
+ * Blocks forever, look at ZmqProxy for a steerable proxy in ZmqEventLoop.
  */
 folly::Expected<folly::Unit, Error> proxy(
     void *frontend, void *backend, void *capture);
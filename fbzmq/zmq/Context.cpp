@@ -11,21 +11,118 @@
 
 namespace fbzmq {
 
+ContextOptions&
+ContextOptions::setNumIoThreads(uint16_t numIoThreads) {
+  numIoThreads_ = numIoThreads;
+  return *this;
+}
+
+ContextOptions&
+ContextOptions::setNumMaxSockets(uint16_t numMaxSockets) {
+  numMaxSockets_ = numMaxSockets;
+  return *this;
+}
+
+ContextOptions&
+ContextOptions::addIoThreadCpu(int cpu) {
+  ioThreadCpus_.push_back(cpu);
+  return *this;
+}
+
+ContextOptions&
+ContextOptions::setIoThreadSchedPolicy(int policy) {
+  ioThreadSchedPolicy_ = policy;
+  return *this;
+}
+
+ContextOptions&
+ContextOptions::setIoThreadPriority(int priority) {
+  ioThreadPriority_ = priority;
+  return *this;
+}
+
+ContextOptions&
+ContextOptions::setIoThreadNamePrefix(int prefix) {
+  ioThreadNamePrefix_ = prefix;
+  return *this;
+}
+
+ContextOptions&
+ContextOptions::setIpv6(bool ipv6) {
+  ipv6_ = ipv6;
+  return *this;
+}
+
+ContextOptions&
+ContextOptions::setBlocky(bool blocky) {
+  blocky_ = blocky;
+  return *this;
+}
+
 Context::Context(
     folly::Optional<uint16_t> numIoThreads,
     folly::Optional<uint16_t> numMaxSockets) noexcept
-    : ptr_(zmq_ctx_new()) {
+    : ptr_(zmq_ctx_new()),
+      keyCache_(std::make_unique<CurveKeyCache>()),
+      localEndpoints_(std::make_unique<LocalEndpoints>()) {
   CHECK(ptr_);
 
   if (numIoThreads) {
-    const int rc = zmq_ctx_set(ptr_, ZMQ_IO_THREADS, numIoThreads.value());
-    CHECK_EQ(0, rc) << zmq_strerror(zmq_errno());
+    setOption(ZMQ_IO_THREADS, numIoThreads.value());
   }
 
   if (numMaxSockets) {
-    const int rc = zmq_ctx_set(ptr_, ZMQ_MAX_SOCKETS, numMaxSockets.value());
-    CHECK_EQ(0, rc) << zmq_strerror(zmq_errno());
+    setOption(ZMQ_MAX_SOCKETS, numMaxSockets.value());
+  }
+}
+
+Context::Context(ContextOptions const& options) noexcept
+    : Context(options.numIoThreads_, options.numMaxSockets_) {
+  if (options.ipv6_) {
+    setOption(ZMQ_IPV6, options.ipv6_.value());
+  }
+  if (options.blocky_) {
+    setOption(ZMQ_BLOCKY, options.blocky_.value());
   }
+
+  // IO thread options must be set before first socket starts IO threads
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+  for (const auto cpu : options.ioThreadCpus_) {
+    setOption(ZMQ_THREAD_AFFINITY_CPU_ADD, cpu);
+  }
+#else
+  LOG_IF(WARNING, !options.ioThreadCpus_.empty())
+      << "IO thread affinity is not supported by libzmq, ignored";
+#endif
+
+#ifdef ZMQ_THREAD_SCHED_POLICY
+  if (options.ioThreadSchedPolicy_) {
+    setOption(ZMQ_THREAD_SCHED_POLICY, options.ioThreadSchedPolicy_.value());
+  }
+  if (options.ioThreadPriority_) {
+    setOption(ZMQ_THREAD_PRIORITY, options.ioThreadPriority_.value());
+  }
+#else
+  LOG_IF(
+      WARNING, options.ioThreadSchedPolicy_ || options.ioThreadPriority_)
+      << "IO thread scheduling is not supported by libzmq, ignored";
+#endif
+
+#ifdef ZMQ_THREAD_NAME_PREFIX
+  if (options.ioThreadNamePrefix_) {
+    setOption(ZMQ_THREAD_NAME_PREFIX, options.ioThreadNamePrefix_.value());
+  }
+#else
+  LOG_IF(WARNING, options.ioThreadNamePrefix_.hasValue())
+      << "IO thread name prefix is not supported by libzmq, ignored";
+#endif
+}
+
+void
+Context::setOption(int option, int value) noexcept {
+  const int rc = zmq_ctx_set(ptr_, option, value);
+  CHECK_EQ(0, rc) << "Failed setting context option " << option << ": "
+                  << zmq_strerror(zmq_errno());
 }
 
 Context::~Context() {
@@ -38,7 +135,10 @@ Context::~Context() {
   CHECK_EQ(0, rc) << zmq_strerror(zmq_errno());
 }
 
-Context::Context(Context&& other) noexcept : ptr_(other.ptr_) {
+Context::Context(Context&& other) noexcept
+    : ptr_(other.ptr_),
+      keyCache_(std::move(other.keyCache_)),
+      localEndpoints_(std::move(other.localEndpoints_)) {
   other.ptr_ = nullptr;
 }
 
@@ -46,6 +146,8 @@ Context&
 Context::operator=(Context&& other) noexcept {
   Context tmp(std::move(other));
   std::swap(ptr_, tmp.ptr_);
+  std::swap(keyCache_, tmp.keyCache_);
+  std::swap(localEndpoints_, tmp.localEndpoints_);
   return *this;
 }
 
@@ -9,7 +9,12 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include <fbzmq/zmq/Common.h>
+#include <fbzmq/zmq/KeyCache.h>
+#include <fbzmq/zmq/LocalEndpoints.h>
 
 namespace fbzmq {
 
@@ -18,6 +23,56 @@ namespace detail {
 class SocketImpl;
 }
 
+/**
+ * Options of zmq context and its IO threads, applied when Context is created
+ * (before IO threads are started), e.g.
+ *
+ *  Context ctx(ContextOptions()
+ *                  .setNumIoThreads(2)
+ *                  .addIoThreadCpu(2)
+ *                  .addIoThreadCpu(3)
+ *                  .setIoThreadSchedPolicy(SCHED_FIFO)
+ *                  .setIoThreadPriority(10));
+ *
+ * IO thread affinity, scheduling and naming need libzmq 4.2 or newer (built
+ * with draft API before 4.3), they are ignored with a warning otherwise.
+ * Unset options keep libzmq defaults.
+ */
+class ContextOptions {
+ public:
+  ContextOptions& setNumIoThreads(uint16_t numIoThreads);
+  ContextOptions& setNumMaxSockets(uint16_t numMaxSockets);
+
+  // pin IO threads to given CPU, can be called for several CPUs
+  ContextOptions& addIoThreadCpu(int cpu);
+
+  // scheduling policy (e.g. SCHED_FIFO) and priority of IO threads
+  ContextOptions& setIoThreadSchedPolicy(int policy);
+  ContextOptions& setIoThreadPriority(int priority);
+
+  // IO threads are named `ZMQbg/<prefix>/<n>`, tells contexts apart in tools
+  ContextOptions& setIoThreadNamePrefix(int prefix);
+
+  // default ZMQ_IPV6 of sockets created by zmq itself
+  ContextOptions& setIpv6(bool ipv6);
+
+  // whether context termination blocks on pending messages of sockets
+  // without ZMQ_LINGER, true by default in libzmq
+  ContextOptions& setBlocky(bool blocky);
+
+ private:
+  friend class Context;
+
+  folly::Optional<uint16_t> numIoThreads_;
+  folly::Optional<uint16_t> numMaxSockets_;
+  std::vector<int> ioThreadCpus_;
+  folly::Optional<int> ioThreadSchedPolicy_;
+  folly::Optional<int> ioThreadPriority_;
+  folly::Optional<int> ioThreadNamePrefix_;
+  folly::Optional<bool> ipv6_;
+  folly::Optional<bool> blocky_;
+};
+
 /**
  * RAII over zmq_context
  */
@@ -35,6 +90,11 @@ class Context {
       folly::Optional<uint16_t> numIoThreads = folly::none,
       folly::Optional<uint16_t> numMaxSockets = folly::none) noexcept;
 
+  /**
+   * Context configured with given options, look at ContextOptions
+   */
+  explicit Context(ContextOptions const& options) noexcept;
+
   // non-copyable
   Context(Context const&) = delete;
   Context& operator=(Context const&) = delete;
@@ -44,11 +104,27 @@ class Context {
   Context& operator=(Context&&) noexcept;
   ~Context();
 
+  /**
+   * Cache of CURVE keys and registry of server keys shared by sockets of
+   * this context, look at CurveKeyCache
+   */
+  CurveKeyCache&
+  getKeyCache() noexcept {
+    return *keyCache_;
+  }
+
  private:
   friend class detail::SocketImpl;
 
+  // set context option, fails hard on error like other context setup
+  void setOption(int option, int value) noexcept;
+
   // pointer to zmq context object
   void* ptr_{nullptr};
+
+  // keep their address when context is moved, sockets refer to them
+  std::unique_ptr<CurveKeyCache> keyCache_;
+  std::unique_ptr<LocalEndpoints> localEndpoints_;
 };
 
 } // namespace fbzmq
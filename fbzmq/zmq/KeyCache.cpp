@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/zmq/KeyCache.h>
+
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+CurveKeyCache::CurveKeyCache(size_t maxCachedKeys)
+    : maxCachedKeys_(maxCachedKeys) {
+  CHECK_LT(0, maxCachedKeys_);
+}
+
+CurveKeyCache::~CurveKeyCache() {
+  for (auto& kv : keyPairs_) {
+    ::sodium_memzero(kv.second.secretKey.data(), kv.second.secretKey.size());
+  }
+}
+
+folly::Expected<CurveKeyCache::CurveKeyPair, Error>
+CurveKeyCache::getKeyPair(KeyPair const& keyPair) {
+  const auto digest = hashSecretKey(keyPair.privateKey);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = keyPairs_.find(digest);
+    if (it != keyPairs_.end()) {
+      return it->second;
+    }
+  }
+
+  // convert without holding the lock, racing conversions yield same keys
+  auto curveKeyPair = convertKeyPair(keyPair);
+  if (curveKeyPair.hasError()) {
+    return curveKeyPair;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++numConversions_;
+  if (not keyPairs_.count(digest) and keyPairs_.size() >= maxCachedKeys_) {
+    eraseKeyPair(keyPairs_.begin());
+  }
+  keyPairs_.emplace(digest, curveKeyPair.value());
+  return curveKeyPair;
+}
+
+folly::Expected<CurveKeyCache::CurveKey, Error>
+CurveKeyCache::getPublicKey(std::string const& publicKey) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = publicKeys_.find(publicKey);
+    if (it != publicKeys_.end()) {
+      return it->second;
+    }
+  }
+
+  auto curveKey = convertPublicKey(publicKey);
+  if (curveKey.hasError()) {
+    return curveKey;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++numConversions_;
+  if (not publicKeys_.count(publicKey) and
+      publicKeys_.size() >= maxCachedKeys_) {
+    publicKeys_.erase(publicKeys_.begin());
+  }
+  publicKeys_.emplace(publicKey, curveKey.value());
+  return curveKey;
+}
+
+void
+CurveKeyCache::delKeyPair(KeyPair const& keyPair) {
+  const auto digest = hashSecretKey(keyPair.privateKey);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = keyPairs_.find(digest);
+  if (it != keyPairs_.end()) {
+    eraseKeyPair(it);
+  }
+}
+
+void
+CurveKeyCache::delPublicKey(std::string const& publicKey) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  publicKeys_.erase(publicKey);
+}
+
+std::string
+CurveKeyCache::hashSecretKey(std::string const& secretKey) {
+  std::string digest(crypto_generichash_BYTES, '\0');
+  ::crypto_generichash(
+      reinterpret_cast<uint8_t*>(&digest[0]),
+      digest.size(),
+      reinterpret_cast<const uint8_t*>(secretKey.data()),
+      secretKey.size(),
+      nullptr /* key */,
+      0);
+  return digest;
+}
+
+void
+CurveKeyCache::eraseKeyPair(
+    std::unordered_map<std::string, CurveKeyPair>::iterator it) {
+  ::sodium_memzero(it->second.secretKey.data(), it->second.secretKey.size());
+  keyPairs_.erase(it);
+}
+
+folly::Expected<folly::Unit, Error>
+CurveKeyCache::addServerKey(
+    std::string const& url, std::string const& publicKey) {
+  auto curveKey = getPublicKey(publicKey);
+  if (curveKey.hasError()) {
+    return folly::makeUnexpected(curveKey.error());
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  serverKeys_[url] = curveKey.value();
+  return folly::Unit();
+}
+
+folly::Expected<folly::Unit, Error>
+CurveKeyCache::addServerKeys(ServerKeys const& serverKeys) {
+  std::vector<CurveKey> curveKeys;
+  curveKeys.reserve(serverKeys.size());
+  for (auto const& kv : serverKeys) {
+    auto curveKey = getPublicKey(kv.second);
+    if (curveKey.hasError()) {
+      return folly::makeUnexpected(curveKey.error());
+    }
+    curveKeys.push_back(curveKey.value());
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < serverKeys.size(); ++i) {
+    serverKeys_[serverKeys[i].first] = curveKeys[i];
+  }
+  return folly::Unit();
+}
+
+void
+CurveKeyCache::delServerKey(std::string const& url) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  serverKeys_.erase(url);
+}
+
+folly::Optional<CurveKeyCache::CurveKey>
+CurveKeyCache::getServerKey(std::string const& url) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = serverKeys_.find(url);
+  if (it == serverKeys_.end()) {
+    return folly::none;
+  }
+  return it->second;
+}
+
+uint64_t
+CurveKeyCache::getNumConversions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return numConversions_;
+}
+
+folly::Expected<CurveKeyCache::CurveKeyPair, Error>
+CurveKeyCache::convertKeyPair(KeyPair const& keyPair) {
+  if (keyPair.publicKey.size() != crypto_sign_ed25519_PUBLICKEYBYTES or
+      keyPair.privateKey.size() != crypto_sign_ed25519_SECRETKEYBYTES) {
+    return folly::makeUnexpected(Error(EINVAL));
+  }
+
+  // convert signature ed25519 keys to encryption curve25519 keys
+  CurveKeyPair curveKeyPair;
+  if (::crypto_sign_ed25519_pk_to_curve25519(
+          curveKeyPair.publicKey.data(),
+          reinterpret_cast<const uint8_t*>(keyPair.publicKey.data())) != 0) {
+    return folly::makeUnexpected(Error(EINVAL));
+  }
+  if (::crypto_sign_ed25519_sk_to_curve25519(
+          curveKeyPair.secretKey.data(),
+          reinterpret_cast<const uint8_t*>(keyPair.privateKey.data())) != 0) {
+    return folly::makeUnexpected(Error(EINVAL));
+  }
+  return curveKeyPair;
+}
+
+folly::Expected<CurveKeyCache::CurveKey, Error>
+CurveKeyCache::convertPublicKey(std::string const& publicKey) {
+  if (publicKey.size() != crypto_sign_ed25519_PUBLICKEYBYTES) {
+    return folly::makeUnexpected(Error(EINVAL));
+  }
+
+  CurveKey curveKey;
+  if (::crypto_sign_ed25519_pk_to_curve25519(
+          curveKey.data(),
+          reinterpret_cast<const uint8_t*>(publicKey.data())) != 0) {
+    return folly::makeUnexpected(Error(EINVAL));
+  }
+  return curveKey;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <fbzmq/zmq/Common.h>
+
+namespace fbzmq {
+
+/**
+ * Cache of CURVE keys of a Context. Sockets are configured with ed25519 keys
+ * (look at `util::genKeyPair`) which zmq needs converted to curve25519 ones.
+ * Cache converts each key only once, no matter how many sockets use it.
+ *
+ * It also serves as a registry of server keys shared by all sockets of the
+ * context. Client sockets fall back to it on `connect` to urls they have no
+ * server key of their own for, so keys of a peer set can be provisioned once
+ * instead of on each socket.
+ *
+ * Converted keys are cached up to `maxCachedKeys` key pairs and as many
+ * public keys, beyond which an arbitrary entry is evicted. Key pairs are
+ * looked up by a hash of their secret key, which isn't kept around, and
+ * cached curve secret keys are wiped once evicted, removed or destroyed.
+ * Server key registry isn't bounded, its keys stay until removed.
+ *
+ * Thread safe, sockets of a context may be created in any thread.
+ */
+class CurveKeyCache : public boost::noncopyable {
+ public:
+  using CurveKey = std::array<uint8_t, crypto_scalarmult_curve25519_BYTES>;
+
+  using ServerKeys =
+      std::vector<std::pair<std::string /* url */, std::string /* key */>>;
+
+  struct CurveKeyPair {
+    CurveKey publicKey;
+    CurveKey secretKey;
+  };
+
+  explicit CurveKeyCache(size_t maxCachedKeys = 4096);
+  ~CurveKeyCache();
+
+  /**
+   * Converted key pair / public key, EINVAL error if conversion fails
+   */
+  folly::Expected<CurveKeyPair, Error> getKeyPair(KeyPair const& keyPair);
+  folly::Expected<CurveKey, Error> getPublicKey(std::string const& publicKey);
+
+  /**
+   * Drop cached conversion of key pair / public key, e.g. once a peer leaves
+   */
+  void delKeyPair(KeyPair const& keyPair);
+  void delPublicKey(std::string const& publicKey);
+
+  /**
+   * Server key registry, keys are converted when added. Bulk version adds
+   * all keys or none if any of them fails to convert.
+   */
+  folly::Expected<folly::Unit, Error> addServerKey(
+      std::string const& url, std::string const& publicKey);
+  folly::Expected<folly::Unit, Error> addServerKeys(
+      ServerKeys const& serverKeys);
+  void delServerKey(std::string const& url);
+  folly::Optional<CurveKey> getServerKey(std::string const& url) const;
+
+  // number of conversions done so far, i.e. cache misses
+  uint64_t getNumConversions() const;
+
+  /**
+   * Uncached conversions
+   */
+  static folly::Expected<CurveKeyPair, Error> convertKeyPair(
+      KeyPair const& keyPair);
+  static folly::Expected<CurveKey, Error> convertPublicKey(
+      std::string const& publicKey);
+
+ private:
+  // digest of ed25519 secret key, key of `keyPairs_`
+  static std::string hashSecretKey(std::string const& secretKey);
+
+  // erase key pair entry, wiping its secret key
+  void eraseKeyPair(
+      std::unordered_map<std::string, CurveKeyPair>::iterator it);
+
+  const size_t maxCachedKeys_{0};
+
+  mutable std::mutex mutex_;
+
+  // converted key pairs by digest of ed25519 secret key (which embeds public
+  // key)
+  std::unordered_map<std::string, CurveKeyPair> keyPairs_;
+
+  // converted public keys by ed25519 public key
+  std::unordered_map<std::string, CurveKey> publicKeys_;
+
+  // converted server keys by url
+  std::unordered_map<std::string, CurveKey> serverKeys_;
+
+  uint64_t numConversions_{0};
+};
+
+} // namespace fbzmq
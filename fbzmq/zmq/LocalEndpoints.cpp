@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/zmq/LocalEndpoints.h>
+
+#include <algorithm>
+#include <cctype>
+
+#include <folly/Range.h>
+
+namespace fbzmq {
+
+namespace {
+
+const folly::StringPiece kTcpPrefix{"tcp://"};
+
+// hosts of wildcard and loopback addresses
+const std::unordered_set<std::string> kLocalHosts = {
+    "*", "0.0.0.0", "127.0.0.1", "localhost", "[::]", "[::1]", "::1"};
+
+} // namespace
+
+folly::Optional<std::string>
+LocalEndpoints::getKey(std::string const& url) {
+  folly::StringPiece address(url);
+  if (not address.removePrefix(kTcpPrefix)) {
+    return folly::none;
+  }
+  const auto colon = address.rfind(':');
+  if (colon == folly::StringPiece::npos) {
+    return folly::none;
+  }
+  const auto host = address.subpiece(0, colon);
+  const auto port = address.subpiece(colon + 1);
+  if (port.empty() or
+      not std::all_of(port.begin(), port.end(), [](char c) {
+        return std::isdigit(static_cast<unsigned char>(c));
+      })) {
+    return folly::none;
+  }
+  if (kLocalHosts.count(host.str())) {
+    return "local:" + port.str();
+  }
+  return address.str();
+}
+
+std::string
+LocalEndpoints::getAlias(std::string const& key) {
+  return "inproc://fbzmq-local/" + key;
+}
+
+void
+LocalEndpoints::add(std::string const& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  keys_.insert(key);
+}
+
+void
+LocalEndpoints::remove(std::string const& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  keys_.erase(key);
+}
+
+bool
+LocalEndpoints::contains(std::string const& key) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return keys_.count(key) != 0;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include <boost/noncopyable.hpp>
+#include <folly/Optional.h>
+
+namespace fbzmq {
+
+/**
+ * Registry of tcp endpoints bound in a Context which are also reachable via
+ * an inproc alias, look at `SecurityPolicy::promoteToInproc`. Endpoints are
+ * identified by a key derived from their url, under which wildcard and
+ * loopback addresses of same port are one and the same, so that e.g. a
+ * connect to `tcp://localhost:5000` finds a bind to `tcp://*:5000`.
+ *
+ * Thread safe.
+ */
+class LocalEndpoints : public boost::noncopyable {
+ public:
+  /**
+   * Key of tcp url, none for other transports and ephemeral ports
+   */
+  static folly::Optional<std::string> getKey(std::string const& url);
+
+  /**
+   * Inproc url standing in for tcp endpoint of given key
+   */
+  static std::string getAlias(std::string const& key);
+
+  void add(std::string const& key);
+  void remove(std::string const& key);
+  bool contains(std::string const& key) const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::unordered_set<std::string> keys_;
+};
+
+} // namespace fbzmq
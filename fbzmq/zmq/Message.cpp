@@ -9,6 +9,8 @@
 
 #include <fbzmq/zmq/Message.h>
 
+#include <fbzmq/zmq/MessagePool.h>
+
 namespace {
 
 /**
@@ -20,6 +22,28 @@ freeIOBuf(void* /* ptr */, void* hint) {
   delete buf;
 }
 
+/**
+* buf points to data in zmq message; userData points to zmq_msg_t object
+*/
+void
+freeZmqMsg(void* /* buf */, void* userData) {
+  auto* msg = reinterpret_cast<zmq_msg_t*>(userData);
+  zmq_msg_close(msg);
+  delete msg;
+}
+
+/**
+* Wrap heap allocated zmq message into an IOBuf which owns it
+*/
+std::unique_ptr<folly::IOBuf>
+wrapZmqMsg(zmq_msg_t* msg) {
+  return folly::IOBuf::takeOwnership(
+      zmq_msg_data(msg),
+      zmq_msg_size(msg),
+      freeZmqMsg,
+      reinterpret_cast<void*>(msg));
+}
+
 } // namespace
 
 namespace fbzmq {
@@ -40,6 +64,20 @@ Message::allocate(size_t size) noexcept {
   return std::move(msg);
 }
 
+folly::Expected<Message, Error>
+Message::allocatePooled(size_t size) noexcept {
+  Message msg;
+  zmq_msg_close(&(msg.msg_));
+  if (MessagePool::initMessage(&(msg.msg_), size)) {
+    return std::move(msg);
+  }
+  const int rc = zmq_msg_init_size(&(msg.msg_), size);
+  if (rc != 0) {
+    return folly::makeUnexpected(Error());
+  }
+  return std::move(msg);
+}
+
 folly::Expected<Message, Error>
 Message::wrapBuffer(std::unique_ptr<folly::IOBuf> buf) noexcept {
   Message msg;
@@ -63,6 +101,30 @@ Message::wrapBuffer(std::unique_ptr<folly::IOBuf> buf) noexcept {
   return std::move(msg);
 }
 
+folly::Expected<std::vector<Message>, Error>
+Message::wrapBufferChain(std::unique_ptr<folly::IOBuf> buf) noexcept {
+  std::vector<Message> msgs;
+  msgs.reserve(buf->countChainElements());
+  while (buf) {
+    // Detach head of the chain and adopt it as a message. Single element
+    // IOBuf never gets coalesced (copied) by `wrapBuffer`.
+    auto rest = buf->pop();
+    if (buf->length() > 0) {
+      auto msg = wrapBuffer(std::move(buf));
+      if (msg.hasError()) {
+        return folly::makeUnexpected(msg.error());
+      }
+      msgs.emplace_back(std::move(msg.value()));
+    }
+    buf = std::move(rest);
+  }
+
+  if (msgs.empty()) {
+    msgs.emplace_back();
+  }
+  return msgs;
+}
+
 Message&
 Message::operator=(Message&& other) noexcept {
   Message tmp(std::move(other));
@@ -124,4 +186,26 @@ Message::empty() const noexcept {
   return (size() == 0);
 }
 
+std::unique_ptr<folly::IOBuf>
+Message::toIOBuf() const& noexcept {
+  // zmq_msg_copy only bumps refcount of heap allocated buffers. Small
+  // messages are stored inline and get copied.
+  auto msg = new zmq_msg_t;
+  zmq_msg_init(msg);
+  const int rc = zmq_msg_copy(msg, const_cast<zmq_msg_t*>(&msg_));
+  CHECK_EQ(0, rc) << zmq_strerror(zmq_errno());
+  return wrapZmqMsg(msg);
+}
+
+std::unique_ptr<folly::IOBuf>
+Message::toIOBuf() && noexcept {
+  // Move zmq message to heap so that its buffer (which can be inline for
+  // small messages) outlives this object
+  auto msg = new zmq_msg_t;
+  zmq_msg_init(msg);
+  const int rc = zmq_msg_move(msg, &msg_);
+  CHECK_EQ(0, rc) << zmq_strerror(zmq_errno());
+  return wrapZmqMsg(msg);
+}
+
 } // namespace fbzmq
@@ -9,6 +9,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include <folly/Expected.h>
 #include <folly/Range.h>
 
@@ -40,10 +42,20 @@ class Message {
    */
 
   /**
-   * Allocate message, content undefined (to be written by user)
+   * Allocate message, content undefined (to be written by user). zmq
+   * allocates message header and data in a single block.
    */
   static folly::Expected<Message, Error> allocate(size_t size) noexcept;
 
+  /**
+   * Same as `allocate` but small messages take their data from the per
+   * thread buffer pool, look at MessagePool. zmq still allocates a header
+   * for every such message, so this doesn't save an allocation over
+   * `allocate`. Meant for callers which want payload memory of a thread
+   * recycled rather than going through the heap.
+   */
+  static folly::Expected<Message, Error> allocatePooled(size_t size) noexcept;
+
   /**
    * Wrap existing IOBuf. Notice that this does not copy buffer, rather adopts
    * its content. The IOBuf pointer will be released when Message destructs.
@@ -51,6 +63,16 @@ class Message {
   static folly::Expected<Message, Error> wrapBuffer(
       std::unique_ptr<folly::IOBuf> buf) noexcept;
 
+  /**
+   * Wrap existing IOBuf chain without coalescing it. Every non-empty link of
+   * the chain is adopted by a separate message (in order), hence no data is
+   * copied. Returns single empty message if chain is empty. Intended to be
+   * sent as consecutive frames of a multipart message, look at
+   * `SocketImpl::sendChain`.
+   */
+  static folly::Expected<std::vector<Message>, Error> wrapBufferChain(
+      std::unique_ptr<folly::IOBuf> buf) noexcept;
+
   /**
    * construct message from Thrift object using supplied serializer
    */
@@ -79,7 +101,10 @@ class Message {
    */
   static folly::Expected<Message, Error>
   from(std::string const& str) noexcept {
-    return Message::wrapBuffer(folly::IOBuf::copyBuffer(str));
+    return allocate(str.size()).then([&str](Message&& msg) {
+      ::memcpy(msg.writeableData().data(), str.data(), str.size());
+      return std::move(msg);
+    });
   }
 
   /**
@@ -171,6 +196,18 @@ class Message {
    */
   bool empty() const noexcept;
 
+  /**
+   * Expose message data as an IOBuf without copying. IOBuf holds its own
+   * reference on zmq buffer (released when IOBuf is freed), so it can outlive
+   * the message and be handed over to other threads.
+   *
+   * Lvalue version shares buffer with this message and its copies, do not
+   * modify it through IOBuf. Rvalue version hands over the buffer and IOBuf
+   * becomes its only owner.
+   */
+  std::unique_ptr<folly::IOBuf> toIOBuf() const& noexcept;
+  std::unique_ptr<folly::IOBuf> toIOBuf() && noexcept;
+
  private:
   friend class detail::SocketImpl;
 
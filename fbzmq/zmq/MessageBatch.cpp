@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/zmq/MessageBatch.h>
+
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+void
+MessageBatch::reserve(size_t numFrames, size_t numMessages) {
+  frames_.reserve(numFrames);
+  ends_.reserve(numMessages);
+}
+
+void
+MessageBatch::add(Message msg) {
+  frames_.emplace_back(std::move(msg));
+  ends_.push_back(frames_.size());
+}
+
+void
+MessageBatch::add(std::vector<Message> frames) {
+  if (frames.empty()) {
+    return;
+  }
+  for (auto& frame : frames) {
+    frames_.emplace_back(std::move(frame));
+  }
+  ends_.push_back(frames_.size());
+}
+
+folly::Range<Message*> MessageBatch::operator[](size_t i) noexcept {
+  DCHECK_LT(i, ends_.size());
+  const size_t begin = i ? ends_[i - 1] : 0;
+  return folly::Range<Message*>(
+      frames_.data() + begin, frames_.data() + ends_[i]);
+}
+
+folly::Range<Message const*> MessageBatch::operator[](size_t i) const
+    noexcept {
+  DCHECK_LT(i, ends_.size());
+  const size_t begin = i ? ends_[i - 1] : 0;
+  return folly::Range<Message const*>(
+      frames_.data() + begin, frames_.data() + ends_[i]);
+}
+
+void
+MessageBatch::clear() noexcept {
+  frames_.clear();
+  ends_.clear();
+}
+
+void
+MessageBatch::erasePrefix(size_t n) {
+  if (n == 0) {
+    return;
+  }
+  if (n >= ends_.size()) {
+    clear();
+    return;
+  }
+
+  const auto numFrames = ends_[n - 1];
+  frames_.erase(frames_.begin(), frames_.begin() + numFrames);
+  ends_.erase(ends_.begin(), ends_.begin() + n);
+  for (auto& end : ends_) {
+    end -= numFrames;
+  }
+}
+
+void
+MessageBatch::truncateIncomplete() noexcept {
+  const size_t end = ends_.empty() ? 0 : ends_.back();
+  while (frames_.size() > end) {
+    frames_.pop_back();
+  }
+}
+
+} // namespace fbzmq
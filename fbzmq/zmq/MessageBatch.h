@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <folly/Range.h>
+
+#include <fbzmq/zmq/Message.h>
+
+namespace fbzmq {
+
+// forward declaration of detail::SocketImpl
+namespace detail {
+class SocketImpl;
+}
+
+/**
+ * Reusable container of whole (possibly multipart) messages used by
+ * `SocketImpl::recvBatch` and `SocketImpl::sendBatch`. Frames of all messages
+ * are kept in a single flat vector, so a batch which is cleared and refilled
+ * over and over does not allocate once it has grown to its working size.
+ */
+class MessageBatch {
+ public:
+  MessageBatch() = default;
+
+  /**
+   * Reserve space for given number of frames and messages
+   */
+  void reserve(size_t numFrames, size_t numMessages);
+
+  /**
+   * Append single frame message
+   */
+  void add(Message msg);
+
+  /**
+   * Append multipart message. Empty vector is ignored.
+   */
+  void add(std::vector<Message> frames);
+
+  /**
+   * Frames of i-th message
+   */
+  folly::Range<Message*> operator[](size_t i) noexcept;
+  folly::Range<Message const*> operator[](size_t i) const noexcept;
+
+  /**
+   * Number of whole messages
+   */
+  size_t
+  size() const noexcept {
+    return ends_.size();
+  }
+
+  bool
+  empty() const noexcept {
+    return ends_.empty();
+  }
+
+  /**
+   * Total number of frames across all messages
+   */
+  size_t
+  getNumFrames() const noexcept {
+    return frames_.size();
+  }
+
+  /**
+   * Release all messages, keeps the allocated space around for reuse
+   */
+  void clear() noexcept;
+
+  /**
+   * Drop first `n` messages, e.g. one which can't be sent
+   */
+  void erasePrefix(size_t n);
+
+ private:
+  friend class detail::SocketImpl;
+
+  // drop frames of incomplete message at the end if any
+  void truncateIncomplete() noexcept;
+
+  std::vector<Message> frames_;
+
+  // index past the last frame of every message
+  std::vector<size_t> ends_;
+};
+
+} // namespace fbzmq
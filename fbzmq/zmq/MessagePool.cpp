@@ -0,0 +1,251 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <fbzmq/zmq/MessagePool.h>
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+namespace fbzmq {
+
+namespace {
+
+constexpr std::array<size_t, 3> kSizeClasses{{64, 128, 256}};
+
+const size_t kBlocksPerSlab = 64;
+
+class Arena;
+
+/**
+ * Header preceding every pooled buffer
+ */
+struct Block {
+  Arena* owner;
+  Block* next;
+  uint32_t sizeClass;
+};
+
+// Keep payloads aligned as malloc would
+const size_t kHeaderSize = 32;
+static_assert(sizeof(Block) <= kHeaderSize, "header too small");
+static_assert(kHeaderSize % alignof(std::max_align_t) == 0, "bad alignment");
+
+uint8_t*
+payload(Block* block) {
+  return reinterpret_cast<uint8_t*>(block) + kHeaderSize;
+}
+
+thread_local Arena* tlsArena{nullptr};
+thread_local MessagePool::Stats tlsStats;
+
+/**
+ * Arena is reference counted by its owning thread and by every buffer handed
+ * out. Whoever drops the last reference destroys it.
+ */
+class Arena {
+ public:
+  Arena() {
+    freeLists_.fill(nullptr);
+  }
+
+  ~Arena() {
+    for (auto slab : slabs_) {
+      ::free(slab);
+    }
+  }
+
+  Block*
+  allocate(uint32_t sizeClass) {
+    auto& head = freeLists_[sizeClass];
+    if (!head) {
+      reclaimRemoteFrees();
+    }
+    if (head) {
+      ++tlsStats.hits;
+    } else {
+      ++tlsStats.misses;
+      if (!carveSlab(sizeClass)) {
+        return nullptr;
+      }
+    }
+
+    auto block = head;
+    head = block->next;
+    refs_.fetch_add(1, std::memory_order_relaxed);
+    return block;
+  }
+
+  // Must be called by owning thread only
+  void
+  freeLocal(Block* block) {
+    block->next = freeLists_[block->sizeClass];
+    freeLists_[block->sizeClass] = block;
+    ++tlsStats.localFrees;
+    // owner holds a reference, can't drop to zero
+    refs_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void
+  freeRemote(Block* block) {
+    auto head = remoteFrees_.load(std::memory_order_relaxed);
+    do {
+      block->next = head;
+    } while (!remoteFrees_.compare_exchange_weak(
+        head, block, std::memory_order_release, std::memory_order_relaxed));
+    numRemoteFrees_.fetch_add(1, std::memory_order_relaxed);
+    unref();
+  }
+
+  // Drop a reference, last one destroys arena
+  void
+  unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  uint64_t
+  getNumRemoteFrees() const {
+    return numRemoteFrees_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t
+  getNumOutstanding() const {
+    // minus reference of owner
+    return refs_.load(std::memory_order_relaxed) - 1;
+  }
+
+ private:
+  // Move buffers freed by other threads back to free lists. Only owner pops
+  // from remote list and it takes the whole list at once, so there is no
+  // ABA problem.
+  void
+  reclaimRemoteFrees() {
+    if (!remoteFrees_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    auto block = remoteFrees_.exchange(nullptr, std::memory_order_acquire);
+    while (block) {
+      auto next = block->next;
+      block->next = freeLists_[block->sizeClass];
+      freeLists_[block->sizeClass] = block;
+      block = next;
+    }
+  }
+
+  bool
+  carveSlab(uint32_t sizeClass) {
+    const auto stride = kHeaderSize + kSizeClasses[sizeClass];
+    auto slab = reinterpret_cast<uint8_t*>(::malloc(stride * kBlocksPerSlab));
+    if (!slab) {
+      return false;
+    }
+    slabs_.push_back(slab);
+
+    auto& head = freeLists_[sizeClass];
+    for (size_t i = 0; i < kBlocksPerSlab; ++i) {
+      auto block = reinterpret_cast<Block*>(slab + i * stride);
+      block->owner = this;
+      block->sizeClass = sizeClass;
+      block->next = head;
+      head = block;
+    }
+    return true;
+  }
+
+  std::array<Block*, kSizeClasses.size()> freeLists_;
+  std::atomic<Block*> remoteFrees_{nullptr};
+  std::atomic<uint64_t> numRemoteFrees_{0};
+  std::atomic<uint64_t> refs_{1};
+  std::vector<uint8_t*> slabs_;
+};
+
+/**
+ * Drops owner's reference on arena when thread exits
+ */
+struct ArenaHolder {
+  ~ArenaHolder() {
+    if (tlsArena) {
+      auto arena = tlsArena;
+      tlsArena = nullptr;
+      arena->unref();
+    }
+  }
+};
+
+thread_local ArenaHolder tlsArenaHolder;
+
+Arena*
+getArena() {
+  if (!tlsArena) {
+    // Touch holder so that it gets constructed (and destructed at exit)
+    (void)&tlsArenaHolder;
+    tlsArena = new Arena();
+  }
+  return tlsArena;
+}
+
+/**
+* data points to payload of block; hint points to block
+*/
+void
+freeBlock(void* /* data */, void* hint) {
+  auto block = reinterpret_cast<Block*>(hint);
+  if (block->owner == tlsArena) {
+    block->owner->freeLocal(block);
+  } else {
+    block->owner->freeRemote(block);
+  }
+}
+
+} // namespace
+
+constexpr size_t MessagePool::kMaxInlineSize;
+constexpr size_t MessagePool::kMaxPooledSize;
+
+bool
+MessagePool::initMessage(zmq_msg_t* msg, size_t size) noexcept {
+  if (size <= kMaxInlineSize || size > kMaxPooledSize) {
+    ++tlsStats.bypassed;
+    return false;
+  }
+
+  uint32_t sizeClass = 0;
+  while (kSizeClasses[sizeClass] < size) {
+    ++sizeClass;
+  }
+
+  auto arena = getArena();
+  auto block = arena->allocate(sizeClass);
+  if (!block) {
+    return false;
+  }
+
+  const int rc = zmq_msg_init_data(
+      msg, reinterpret_cast<void*>(payload(block)), size, freeBlock, block);
+  if (rc != 0) {
+    arena->freeLocal(block);
+    return false;
+  }
+  return true;
+}
+
+MessagePool::Stats
+MessagePool::getStats() noexcept {
+  Stats stats = tlsStats;
+  if (tlsArena) {
+    stats.remoteFrees = tlsArena->getNumRemoteFrees();
+    stats.outstanding = tlsArena->getNumOutstanding();
+  }
+  return stats;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zmq.h>
+
+namespace fbzmq {
+
+/**
+ * Per thread pool of small message buffers used by `Message::allocatePooled`.
+ *
+ * Every thread owns an arena of fixed size-class slabs (64, 128 and 256
+ * bytes). Buffers are handed over to zmq via `zmq_msg_init_data` and given
+ * back to the arena by zmq's free callback, which can be invoked from any
+ * thread (e.g. zmq I/O threads). Buffers freed by the owning thread go
+ * directly to its free lists, others are pushed onto a lock-free list which
+ * the owner reclaims when it runs out of buffers. Slab memory is never
+ * returned to the system while the thread is alive, so the pool holds on to
+ * peak usage of the thread.
+ *
+ * Since `zmq_msg_init_data` allocates a header per message anyway, whereas
+ * `zmq_msg_init_size` allocates header and data together, pooling doesn't
+ * reduce the number of allocations per message. Hence plain
+ * `Message::allocate` (and `Message::from`) don't use the pool.
+ *
+ * Messages of at most `kMaxInlineSize` bytes are not pooled as zmq stores
+ * them inline without any allocation, neither are messages larger than
+ * `kMaxPooledSize`.
+ *
+ * Messages may outlive the thread which allocated them, arena is destroyed
+ * once the thread has exited and all of its buffers have been freed.
+ */
+class MessagePool {
+ public:
+  // zmq keeps messages up to this size inside of zmq_msg_t (on 64-bit)
+  static constexpr size_t kMaxInlineSize = 33;
+
+  // largest size class
+  static constexpr size_t kMaxPooledSize = 256;
+
+  /**
+   * Pool counters of a thread. Allocation counters are only touched by the
+   * owning thread, frees are accounted to the arena which buffer belongs to.
+   */
+  struct Stats {
+    // allocations served from free lists
+    uint64_t hits{0};
+
+    // allocations which had to carve out a new slab
+    uint64_t misses{0};
+
+    // allocations not served by pool because of their size
+    uint64_t bypassed{0};
+
+    // buffers given back by owning thread and by other threads
+    uint64_t localFrees{0};
+    uint64_t remoteFrees{0};
+
+    // number of pooled buffers currently owned by messages
+    uint64_t outstanding{0};
+
+    double
+    hitRate() const {
+      const auto total = hits + misses;
+      return total ? static_cast<double>(hits) / total : 0;
+    }
+  };
+
+  /**
+   * Initialize `msg` with a pooled buffer of `size` bytes. Returns false and
+   * leaves `msg` uninitialized if size is not served by the pool or zmq fails
+   * to adopt the buffer, caller is expected to fall back to
+   * `zmq_msg_init_size`.
+   */
+  static bool initMessage(zmq_msg_t* msg, size_t size) noexcept;
+
+  /**
+   * Pool counters of the calling thread
+   */
+  static Stats getStats() noexcept;
+};
+
+} // namespace fbzmq
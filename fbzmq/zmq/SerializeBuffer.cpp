@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "SerializeBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <folly/Bits.h>
+
+namespace fbzmq {
+
+namespace {
+
+// smallest buffer kept around
+const size_t kMinCapacity{4096};
+
+// recent peak size decays by 1/kPeakDecay of itself per message
+const size_t kPeakDecay{64};
+
+// buffer is shrunk once it exceeds wanted capacity by this factor
+const size_t kMaxOversize{4};
+
+} // namespace
+
+SerializeBuffer&
+SerializeBuffer::get() {
+  static thread_local SerializeBuffer buffer;
+  return buffer;
+}
+
+SerializeBuffer::SerializeBuffer() {
+  reallocate(kMinCapacity);
+}
+
+void
+SerializeBuffer::reallocate(size_t capacity) {
+  queue_.move();
+  queue_.append(folly::IOBuf::create(capacity));
+  stats_.capacity = queue_.front()->capacity();
+  ++stats_.numReallocs;
+}
+
+folly::Expected<Message, Error>
+SerializeBuffer::takeMessage() noexcept {
+  // queue always holds at least the retained buffer
+  auto head = queue_.front();
+  const size_t size = queue_.chainLength();
+  ++stats_.numSerialized;
+
+  // Keep single buffer fitting recent messages with some headroom. Outgrown
+  // buffer is chained by serializer, replace it then.
+  recentPeakSize_ =
+      std::max(size, recentPeakSize_ - recentPeakSize_ / kPeakDecay);
+  const size_t wanted = std::max(
+      kMinCapacity, folly::nextPowTwo(recentPeakSize_ + recentPeakSize_ / 4));
+
+  // Copy into exactly sized message, handing over the retained buffer would
+  // pin all of its capacity for as long as message stays queued
+  auto msg = Message::allocate(size);
+  if (msg.hasValue()) {
+    auto dst = msg.value().writeableData().data();
+    auto buf = head;
+    do {
+      ::memcpy(dst, buf->data(), buf->length());
+      dst += buf->length();
+      buf = buf->next();
+    } while (buf != head);
+  }
+  if (head->isChained() || stats_.capacity > kMaxOversize * wanted) {
+    reallocate(wanted);
+  } else {
+    queue_.clear();
+  }
+  return msg;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/Expected.h>
+#include <folly/io/IOBufQueue.h>
+
+#include <fbzmq/zmq/Common.h>
+#include <fbzmq/zmq/Message.h>
+
+namespace fbzmq {
+
+/**
+ * Per thread scratch buffer which thrift objects are serialized into, used by
+ * `Socket::sendThriftObj`.
+ *
+ * Unlike `Message::fromThriftObj`, which builds a new IOBufQueue (and IOBufs)
+ * for every object, the buffer is retained across serializations and only
+ * reallocated when it gets outgrown or grossly oversized. Its capacity
+ * follows the peak of recent message sizes, decayed over time so that a
+ * single large message doesn't pin memory forever. Serialized data is copied
+ * into an exactly sized message from `Message::allocate`, so queued messages
+ * hold only their payload and the buffer itself never leaves this class.
+ *
+ * Not to be shared across threads, use `get()` to access buffer of calling
+ * thread.
+ */
+class SerializeBuffer {
+ public:
+  struct Stats {
+    // objects serialized through the buffer
+    uint64_t numSerialized{0};
+
+    // times buffer got (re)allocated
+    uint64_t numReallocs{0};
+
+    // capacity of retained buffer
+    size_t capacity{0};
+  };
+
+  /**
+   * Buffer of calling thread
+   */
+  static SerializeBuffer& get();
+
+  /**
+   * Serialize `obj` and copy it into a new message
+   */
+  template <typename ThriftType, typename Serializer>
+  folly::Expected<Message, Error>
+  toMessage(ThriftType const& obj, Serializer& serializer) noexcept {
+    serializer.serialize(obj, &queue_);
+    return takeMessage();
+  }
+
+  Stats
+  getStats() const {
+    return stats_;
+  }
+
+ private:
+  SerializeBuffer();
+
+  SerializeBuffer(SerializeBuffer const&) = delete;
+  SerializeBuffer& operator=(SerializeBuffer const&) = delete;
+
+  // copy serialized data into a message and reset queue for next object
+  folly::Expected<Message, Error> takeMessage() noexcept;
+
+  // replace content of queue by single empty buffer of `capacity` bytes
+  void reallocate(size_t capacity);
+
+  folly::IOBufQueue queue_{folly::IOBufQueue::cacheChainLength()};
+
+  // decaying peak of recent message sizes
+  size_t recentPeakSize_{0};
+
+  Stats stats_;
+};
+
+} // namespace fbzmq
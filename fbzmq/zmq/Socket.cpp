@@ -9,6 +9,8 @@
 
 #include <fbzmq/zmq/Socket.h>
 
+#include <algorithm>
+
 namespace fbzmq {
 namespace detail {
 
@@ -19,13 +21,13 @@ SocketImpl::SocketImpl(
     folly::Optional<IdentityString> identity,
     folly::Optional<KeyPair> keyPair,
     NonblockingFlag isNonblocking)
-    : SocketImpl(
-          type,
-          isServer,
-          ctx.ptr_,
-          std::move(identity),
-          std::move(keyPair),
-          isNonblocking) {}
+    : ptr_(zmq_socket(ctx.ptr_, type)),
+      ctxPtr_{ctx.ptr_},
+      keyCache_{ctx.keyCache_.get()},
+      localEndpoints_{ctx.localEndpoints_.get()},
+      keyPair_(std::move(keyPair)) {
+  init(type, isServer, std::move(identity), isNonblocking);
+}
 
 SocketImpl::SocketImpl(
     int type,
@@ -37,7 +39,16 @@ SocketImpl::SocketImpl(
     : ptr_(zmq_socket(ctxPtr, type)),
       ctxPtr_{ctxPtr},
       keyPair_(std::move(keyPair)) {
-  CHECK(ctxPtr);
+  init(type, isServer, std::move(identity), isNonblocking);
+}
+
+void
+SocketImpl::init(
+    int type,
+    bool isServer,
+    folly::Optional<IdentityString> identity,
+    NonblockingFlag isNonblocking) {
+  CHECK(ctxPtr_);
   CHECK(ptr_) << Error();
 
   if (isNonblocking) {
@@ -67,7 +78,8 @@ SocketImpl::SocketImpl(
 
   // Crypto settings
   if (keyPair_) {
-    applyKeyPair(keyPair_.value());
+    const auto ret = applyKeyPair(keyPair_.value());
+    CHECK(ret.hasValue()) << "Invalid crypto key pair: " << ret.error();
     if (isServer) {
       static const int curveServer = 1;
       setSockOpt(ZMQ_CURVE_SERVER, &curveServer, sizeof(curveServer)).value();
@@ -83,18 +95,32 @@ SocketImpl::~SocketImpl() noexcept {
 
 SocketImpl::SocketImpl(SocketImpl&& other) noexcept
     : baseFlags_(other.baseFlags_),
+      recvTimeout_(other.recvTimeout_),
       ptr_(other.ptr_),
       ctxPtr_(other.ctxPtr_),
-      keyPair_(std::move(other.keyPair_)) {
+      keyCache_(other.keyCache_),
+      localEndpoints_(other.localEndpoints_),
+      keyPair_(std::move(other.keyPair_)),
+      securityPolicy_(other.securityPolicy_),
+      promotedUrls_(std::move(other.promotedUrls_)),
+      serverKeys_(std::move(other.serverKeys_)),
+      stats_(std::move(other.stats_)) {
   other.ptr_ = nullptr;
 }
 
 SocketImpl&
 SocketImpl::operator=(SocketImpl&& other) noexcept {
   baseFlags_ = other.baseFlags_;
+  recvTimeout_ = other.recvTimeout_;
   ptr_ = other.ptr_;
   ctxPtr_ = other.ctxPtr_;
+  keyCache_ = other.keyCache_;
+  localEndpoints_ = other.localEndpoints_;
   keyPair_ = std::move(other.keyPair_);
+  securityPolicy_ = other.securityPolicy_;
+  promotedUrls_ = std::move(other.promotedUrls_);
+  serverKeys_ = std::move(other.serverKeys_);
+  stats_ = std::move(other.stats_);
 
   other.ptr_ = nullptr;
 
@@ -107,9 +133,26 @@ SocketImpl::setSockOpt(int option, const void* optval, size_t len) noexcept {
   if (rc != 0) {
     return folly::makeUnexpected(Error());
   }
+
+  // Keep cached receive timeout in sync
+  if (option == ZMQ_RCVTIMEO and len == sizeof(int)) {
+    const int timeoutMs = *reinterpret_cast<const int*>(optval);
+    if (timeoutMs < 0) {
+      recvTimeout_ = folly::none;
+    } else {
+      recvTimeout_ = std::chrono::milliseconds(timeoutMs);
+    }
+  }
   return folly::Unit();
 }
 
+folly::Expected<folly::Unit, Error>
+SocketImpl::setRecvTimeout(
+    folly::Optional<std::chrono::milliseconds> timeout) noexcept {
+  const int timeoutMs = timeout ? static_cast<int>(timeout->count()) : -1;
+  return setSockOpt(ZMQ_RCVTIMEO, &timeoutMs, sizeof(timeoutMs));
+}
+
 folly::Expected<folly::Unit, Error>
 SocketImpl::setKeepAlive(
     int keepAlive,
@@ -172,6 +215,87 @@ SocketImpl::close() noexcept {
   ptr_ = nullptr;
 }
 
+void
+SocketImpl::enableStats(bool measureLatency) {
+  stats_ = std::make_unique<SocketStats>();
+  stats_->measureLatency = measureLatency;
+}
+
+void
+SocketImpl::disableStats() noexcept {
+  stats_.reset();
+}
+
+folly::Optional<SocketStats>
+SocketImpl::getStats() const noexcept {
+  if (not stats_) {
+    return folly::none;
+  }
+  return *stats_;
+}
+
+void
+SocketImpl::countSend(int n, int flags, StatsClock::time_point start) const
+    noexcept {
+  auto& stats = *stats_;
+  if (n >= 0) {
+    ++stats.numSentFrames;
+    stats.numSentBytes += n;
+    if (not(flags & ZMQ_SNDMORE)) {
+      ++stats.numSentMsgs;
+    }
+  } else {
+    const int err = zmq_errno();
+    if (err == EINTR) {
+      ++stats.numSendRetries;
+    } else if (err == EAGAIN) {
+      ++stats.numSendEagain;
+    } else {
+      ++stats.numSendErrors;
+    }
+  }
+
+  if (stats.measureLatency) {
+    const uint64_t latency =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            StatsClock::now() - start)
+            .count();
+    stats.sendLatencyNs += latency;
+    stats.maxSendLatencyNs = std::max(stats.maxSendLatencyNs, latency);
+  }
+}
+
+void
+SocketImpl::countRecv(int n, zmq_msg_t* msg, StatsClock::time_point start)
+    const noexcept {
+  auto& stats = *stats_;
+  if (n >= 0) {
+    ++stats.numRecvFrames;
+    stats.numRecvBytes += n;
+    if (not zmq_msg_more(msg)) {
+      ++stats.numRecvMsgs;
+    }
+  } else {
+    const int err = zmq_errno();
+    if (err == EINTR) {
+      ++stats.numRecvRetries;
+    } else if (err == EAGAIN) {
+      ++stats.numRecvEagain;
+    } else {
+      ++stats.numRecvErrors;
+    }
+  }
+
+  if (stats.measureLatency) {
+    const uint64_t latency =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            StatsClock::now() - start)
+            .count();
+    stats.recvLatencyNs += latency;
+    stats.maxRecvLatencyNs = std::max(stats.maxRecvLatencyNs, latency);
+  }
+}
+
 folly::Expected<size_t, Error>
 SocketImpl::sendOne(Message msg) const noexcept {
   return send(std::move(msg), baseFlags_);
@@ -212,17 +336,27 @@ SocketImpl::recvOne(folly::Optional<std::chrono::milliseconds>
     return recv(baseFlags_);
   }
 
-  std::vector<fbzmq::PollItem> pollItems = {{ptr_, 0, ZMQ_POLLIN, 0}};
-  auto ret = fbzmq::poll(pollItems, timeout);
+  // Timeout (if any) is enforced by zmq itself
+  if (not timeout or timeout == recvTimeout_) {
+    return recv(baseFlags_);
+  }
+
+  // Try to grab already queued message before paying for poll
+  auto msg = recv(ZMQ_DONTWAIT, true /* isProbe */);
+  if (msg.hasValue() or msg.error().errNum != EAGAIN) {
+    return msg;
+  }
+
+  auto ret = waitReadable(timeout);
   if (ret.hasError()) {
+    // timed out, same as receive with timeout enforced by zmq
+    if (stats_ and ret.error().errNum == EAGAIN) {
+      ++stats_->numRecvEagain;
+    }
     return folly::makeUnexpected(ret.error());
   }
-  //  If we got a reply, process it
-  if (pollItems.front().revents & ZMQ_POLLIN) {
-    // Receive raw message from socket
-    return recv(baseFlags_);
-  }
-  return folly::makeUnexpected(Error());
+  // Receive raw message from socket
+  return recv(baseFlags_);
 }
 
 folly::Expected<std::vector<Message>, Error>
@@ -248,6 +382,137 @@ SocketImpl::recvMultiple(
   return result;
 }
 
+folly::Expected<size_t, Error>
+SocketImpl::recvBatch(
+    MessageBatch& batch,
+    size_t maxMessages,
+    folly::Optional<std::chrono::milliseconds> timeout) const noexcept {
+  if (maxMessages == 0) {
+    return 0;
+  }
+
+  // Wait for the first message, rest of them are drained without blocking
+  if (not(baseFlags_ & ZMQ_DONTWAIT)) {
+    auto ret = waitReadable(timeout ? timeout : recvTimeout_);
+    if (ret.hasError()) {
+      return folly::makeUnexpected(ret.error());
+    }
+  }
+
+  size_t count = 0;
+  while (count < maxMessages) {
+    batch.frames_.emplace_back();
+    auto& msg = batch.frames_.back().msg_;
+    int n;
+    do {
+      const auto start = getStatsStart();
+      n = zmq_msg_recv(&msg, ptr_, ZMQ_DONTWAIT);
+      if (stats_) {
+        countRecv(n, &msg, start);
+      }
+    } while (n < 0 and zmq_errno() == EINTR);
+
+    if (n < 0) {
+      const int err = zmq_errno();
+      batch.truncateIncomplete();
+      if (count == 0) {
+        return folly::makeUnexpected(Error(err));
+      }
+      break;
+    }
+
+    if (not zmq_msg_more(&msg)) {
+      batch.ends_.push_back(batch.frames_.size());
+      ++count;
+    }
+  }
+  return count;
+}
+
+folly::Expected<size_t, Error>
+SocketImpl::sendBatch(MessageBatch& batch) const noexcept {
+  size_t count = 0;
+  size_t frame = 0;
+  folly::Optional<Error> error;
+  bool partial = false;
+  while (count < batch.size() and not error) {
+    const auto end = batch.ends_[count];
+    while (frame < end) {
+      const int flags = baseFlags_ | (frame + 1 < end ? ZMQ_SNDMORE : 0);
+      // zmq takes over content of message on success and leaves it empty
+      const auto start = getStatsStart();
+      const int n = zmq_msg_send(&(batch.frames_[frame].msg_), ptr_, flags);
+      if (stats_) {
+        countSend(n, flags, start);
+      }
+      if (n >= 0) {
+        ++frame;
+        continue;
+      }
+      const int err = zmq_errno();
+      if (err != EINTR) {
+        error = Error(err);
+        partial = frame > (count ? batch.ends_[count - 1] : 0);
+        break;
+      }
+    }
+    if (not error) {
+      ++count;
+    }
+  }
+
+  // zmq accepts all parts of multipart message once it has accepted the
+  // first one, hence messages are never sent partially on EAGAIN. Other
+  // errors can hit in the middle of one though, and its frames handed over
+  // already are gone, so it can't be retried.
+  batch.erasePrefix(count + (partial ? 1 : 0));
+  if (error and count == 0) {
+    return folly::makeUnexpected(error.value());
+  }
+  return count;
+}
+
+folly::Expected<size_t, Error>
+SocketImpl::sendChain(std::unique_ptr<folly::IOBuf> buf, bool hasMore) const {
+  auto msgs = Message::wrapBufferChain(std::move(buf));
+  if (msgs.hasError()) {
+    return folly::makeUnexpected(msgs.error());
+  }
+  return sendMultiple(msgs.value(), hasMore);
+}
+
+folly::Expected<std::unique_ptr<folly::IOBuf>, Error>
+SocketImpl::recvIOBuf(folly::Optional<std::chrono::milliseconds>
+                          timeout /* = folly::none */) const noexcept {
+  auto msg = recvOne(timeout);
+  if (msg.hasError()) {
+    return folly::makeUnexpected(msg.error());
+  }
+  return std::move(msg.value()).toIOBuf();
+}
+
+folly::Expected<std::unique_ptr<folly::IOBuf>, Error>
+SocketImpl::recvChain(folly::Optional<std::chrono::milliseconds>
+                          timeout /* = folly::none */) const noexcept {
+  auto msg = recvOne(timeout);
+  if (msg.hasError()) {
+    return folly::makeUnexpected(msg.error());
+  }
+
+  // if the first frame arrives, the rest shall have arrived
+  bool more = not msg.value().isLast();
+  auto head = std::move(msg.value()).toIOBuf();
+  while (more) {
+    auto next = recv(ZMQ_DONTWAIT);
+    if (next.hasError()) {
+      return folly::makeUnexpected(next.error());
+    }
+    more = not next.value().isLast();
+    head->prependChain(std::move(next.value()).toIOBuf());
+  }
+  return std::move(head);
+}
+
 bool
 SocketImpl::hasMore() noexcept {
   int more;
@@ -268,11 +533,26 @@ SocketImpl::hasMore() noexcept {
 
 folly::Expected<folly::Unit, Error>
 SocketImpl::bind(SocketUrl addr) noexcept {
-  const int rc = zmq_bind(ptr_, static_cast<std::string>(addr).c_str());
-  if (rc != 0) {
-    return folly::makeUnexpected(Error());
+  auto ret = bindUrl(addr);
+  if (ret.hasError() or not securityPolicy_.promoteToInproc or
+      not localEndpoints_) {
+    return ret;
   }
-  return folly::Unit();
+
+  // bind inproc alias of tcp endpoint for clients in same context
+  const auto key = LocalEndpoints::getKey(addr);
+  if (not key) {
+    return ret;
+  }
+  const auto alias = LocalEndpoints::getAlias(*key);
+  if (bindUrl(alias).hasError()) {
+    LOG(WARNING) << "Could not bind inproc alias of " << std::string(addr)
+                 << ": " << Error();
+    return ret;
+  }
+  localEndpoints_->add(*key);
+  promotedUrls_[addr] = alias;
+  return ret;
 }
 
 folly::Expected<folly::Unit, Error>
@@ -281,30 +561,105 @@ SocketImpl::unbind(SocketUrl addr) noexcept {
   if (rc != 0) {
     return folly::makeUnexpected(Error());
   }
+
+  auto it = promotedUrls_.find(addr);
+  if (it != promotedUrls_.end()) {
+    localEndpoints_->remove(LocalEndpoints::getKey(addr).value());
+    zmq_unbind(ptr_, it->second.c_str());
+    promotedUrls_.erase(it);
+  }
   return folly::Unit();
 }
 
 folly::Expected<folly::Unit, Error>
 SocketImpl::connect(SocketUrl addr) noexcept {
-  if (keyPair_) {
-    try {
-      auto const serverKey = serverKeys_.at(addr);
-      setCurveServerSocketKey(serverKey);
-    } catch (std::out_of_range const& err) {
-      VLOG(2) << "Crypto key for " << std::string(addr) << " not found";
-      return folly::makeUnexpected(Error(EINVAL));
+  // connect to inproc alias if server is in same context
+  if (securityPolicy_.promoteToInproc and localEndpoints_) {
+    const auto key = LocalEndpoints::getKey(addr);
+    if (key and localEndpoints_->contains(*key)) {
+      const auto alias = LocalEndpoints::getAlias(*key);
+      auto ret = connectUrl(alias, addr);
+      if (ret.hasValue()) {
+        promotedUrls_[addr] = alias;
+      }
+      return ret;
     }
   }
-  const int rc = zmq_connect(ptr_, static_cast<std::string>(addr).c_str());
+  return connectUrl(addr, addr);
+}
+
+folly::Expected<folly::Unit, Error>
+SocketImpl::disconnect(SocketUrl addr) noexcept {
+  std::string url = addr;
+  auto it = promotedUrls_.find(addr);
+  if (it != promotedUrls_.end()) {
+    url = it->second;
+  }
+  const int rc = zmq_disconnect(ptr_, url.c_str());
   if (rc != 0) {
     return folly::makeUnexpected(Error());
   }
+  if (it != promotedUrls_.end()) {
+    promotedUrls_.erase(it);
+  }
   return folly::Unit();
 }
 
+bool
+SocketImpl::selectSecurity(std::string const& url, bool isBind) noexcept {
+  if (not keyPair_) {
+    return false;
+  }
+
+  const folly::StringPiece transport(url);
+  const bool plain =
+      (securityPolicy_.plainInproc and transport.startsWith("inproc://")) or
+      (securityPolicy_.plainIpc and transport.startsWith("ipc://"));
+  if (plain) {
+    // resets security mechanism to NULL
+    const int plainServer = 0;
+    setSockOpt(ZMQ_PLAIN_SERVER, &plainServer, sizeof(plainServer)).value();
+    return false;
+  }
+  if (isBind) {
+    // restore CURVE after a plain endpoint, setting server key does so for
+    // connects
+    const int curveServer = 1;
+    setSockOpt(ZMQ_CURVE_SERVER, &curveServer, sizeof(curveServer)).value();
+  }
+  return true;
+}
+
 folly::Expected<folly::Unit, Error>
-SocketImpl::disconnect(SocketUrl addr) noexcept {
-  const int rc = zmq_disconnect(ptr_, static_cast<std::string>(addr).c_str());
+SocketImpl::bindUrl(std::string const& url) noexcept {
+  selectSecurity(url, true /* isBind */);
+  const int rc = zmq_bind(ptr_, url.c_str());
+  if (rc != 0) {
+    return folly::makeUnexpected(Error());
+  }
+  return folly::Unit();
+}
+
+folly::Expected<folly::Unit, Error>
+SocketImpl::connectUrl(
+    std::string const& url, std::string const& serverKeyUrl) noexcept {
+  if (selectSecurity(url, false /* isBind */)) {
+    // socket's own server key takes precedence over context's registry
+    folly::Optional<CurveKeyCache::CurveKey> serverKey;
+    auto it = serverKeys_.find(serverKeyUrl);
+    if (it != serverKeys_.end()) {
+      serverKey = it->second;
+    } else if (keyCache_) {
+      serverKey = keyCache_->getServerKey(serverKeyUrl);
+    }
+    if (not serverKey) {
+      VLOG(2) << "Crypto key for " << serverKeyUrl << " not found";
+      return folly::makeUnexpected(Error(EINVAL));
+    }
+    setSockOpt(ZMQ_CURVE_SERVERKEY, serverKey->data(), serverKey->size())
+        .value();
+  }
+  const int rc = zmq_connect(ptr_, url.c_str());
   if (rc != 0) {
     return folly::makeUnexpected(Error());
   }
@@ -314,7 +669,11 @@ SocketImpl::disconnect(SocketUrl addr) noexcept {
 folly::Expected<size_t, Error>
 SocketImpl::send(Message msg, int flags) const noexcept {
   while (true) {
+    const auto start = getStatsStart();
     const int n = zmq_msg_send(&(msg.msg_), ptr_, flags);
+    if (stats_) {
+      countSend(n, flags, start);
+    }
     if (n >= 0) {
       return n;
     }
@@ -328,9 +687,96 @@ SocketImpl::send(Message msg, int flags) const noexcept {
   }
 }
 
+folly::Expected<folly::Unit, Error>
+SocketImpl::waitReadable(
+    folly::Optional<std::chrono::milliseconds> timeout) const noexcept {
+  PollItem pollItem{ptr_, 0, ZMQ_POLLIN, 0};
+  auto ret = fbzmq::poll(&pollItem, 1, timeout);
+  if (ret.hasError()) {
+    return folly::makeUnexpected(ret.error());
+  }
+  if (not(pollItem.revents & ZMQ_POLLIN)) {
+    return folly::makeUnexpected(Error(EAGAIN));
+  }
+  return folly::Unit();
+}
+
+folly::Expected<size_t, Error>
+SocketImpl::sendFrameArray(Message* frames, size_t numFrames) const noexcept {
+  size_t size{0};
+  for (size_t i = 0; i < numFrames; ++i) {
+    const int flags = baseFlags_ | (i + 1 < numFrames ? ZMQ_SNDMORE : 0);
+    int n;
+    do {
+      const auto start = getStatsStart();
+      n = zmq_msg_send(&(frames[i].msg_), ptr_, flags);
+      if (stats_) {
+        countSend(n, flags, start);
+      }
+    } while (n < 0 and zmq_errno() == EINTR);
+    if (n < 0) {
+      return folly::makeUnexpected(Error());
+    }
+    size += n;
+  }
+  return size;
+}
+
+folly::Expected<folly::Unit, Error>
+SocketImpl::recvFrameArray(
+    Message* frames,
+    size_t numFrames,
+    folly::Optional<std::chrono::milliseconds> timeout) const noexcept {
+  auto first = recvOne(timeout);
+  if (first.hasError()) {
+    return folly::makeUnexpected(first.error());
+  }
+  frames[0] = std::move(first.value());
+
+  // if the first frame arrives, the rest shall have arrived
+  size_t numReceived = 1;
+  bool more = not frames[0].isLast();
+  for (; numReceived < numFrames and more; ++numReceived) {
+    auto msg = recv(ZMQ_DONTWAIT);
+    if (msg.hasError()) {
+      return folly::makeUnexpected(msg.error());
+    }
+    frames[numReceived] = std::move(msg.value());
+    more = not frames[numReceived].isLast();
+  }
+
+  if (numReceived < numFrames) {
+    return folly::makeUnexpected(Error(EPROTO));
+  }
+  if (more) {
+    // Drain unexpected frames so that next receive starts on a fresh message
+    while (more) {
+      auto msg = recv(ZMQ_DONTWAIT);
+      more = msg.hasValue() and not msg.value().isLast();
+    }
+    return folly::makeUnexpected(Error(EPROTO));
+  }
+  return folly::Unit();
+}
+
+bool
+SocketImpl::initFrame(Message& frame, size_t size) noexcept {
+  zmq_msg_close(&(frame.msg_));
+  if (zmq_msg_init_size(&(frame.msg_), size) != 0) {
+    zmq_msg_init(&(frame.msg_));
+    return false;
+  }
+  return true;
+}
+
 folly::Expected<folly::Unit, Error>
 SocketImpl::addServerKey(SocketUrl server, PublicKey serverPubKey) noexcept {
-  serverKeys_[server] = serverPubKey;
+  auto serverKey = keyCache_ ? keyCache_->getPublicKey(serverPubKey)
+                             : CurveKeyCache::convertPublicKey(serverPubKey);
+  if (serverKey.hasError()) {
+    return folly::makeUnexpected(serverKey.error());
+  }
+  serverKeys_[server] = serverKey.value();
   return folly::Unit();
 }
 
@@ -341,10 +787,14 @@ SocketImpl::delServerKey(SocketUrl server) noexcept {
 }
 
 folly::Expected<Message, Error>
-SocketImpl::recv(int flags) const noexcept {
+SocketImpl::recv(int flags, bool isProbe) const noexcept {
   Message msg;
   while (true) {
+    const auto start = getStatsStart();
     const int n = zmq_msg_recv(&(msg.msg_), ptr_, flags);
+    if (stats_ and not(isProbe and n < 0 and zmq_errno() == EAGAIN)) {
+      countRecv(n, &(msg.msg_), start);
+    }
     if (n >= 0) {
       return std::move(msg);
     }
@@ -360,60 +810,24 @@ SocketImpl::recv(int flags) const noexcept {
 
 folly::Expected<folly::Unit, Error>
 SocketImpl::applyKeyPair(const KeyPair& keyPair) noexcept {
-  CHECK_EQ(crypto_sign_ed25519_PUBLICKEYBYTES, keyPair.publicKey.length());
-  CHECK_EQ(crypto_sign_ed25519_SECRETKEYBYTES, keyPair.privateKey.length());
-
-  // 1) string -> byte
-  std::array<uint8_t, crypto_sign_ed25519_PUBLICKEYBYTES> ed25519Pk;
-  std::array<uint8_t, crypto_sign_ed25519_SECRETKEYBYTES> ed25519Sk;
-  ::memcpy(
-      ed25519Pk.data(), keyPair.publicKey.data(), keyPair.publicKey.length());
-  ::memcpy(
-      ed25519Sk.data(), keyPair.privateKey.data(), keyPair.privateKey.length());
-
-  // 2) convert signature ed25519 key to encryption curve25519 key
-  std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> curve25519Pk;
-  std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> curve25519Sk;
-  if (::crypto_sign_ed25519_pk_to_curve25519(
-          curve25519Pk.data(), ed25519Pk.data()) != 0) {
-    return folly::makeUnexpected(Error());
-  }
-  if (::crypto_sign_ed25519_sk_to_curve25519(
-          curve25519Sk.data(), ed25519Sk.data()) != 0) {
-    return folly::makeUnexpected(Error());
+  // converted once per key pair if socket has context's key cache
+  auto curveKeyPair = keyCache_ ? keyCache_->getKeyPair(keyPair)
+                                : CurveKeyCache::convertKeyPair(keyPair);
+  if (curveKeyPair.hasError()) {
+    return folly::makeUnexpected(curveKeyPair.error());
   }
+  auto const& keys = curveKeyPair.value();
 
   // Apply secrete-key on the socket
-  setSockOpt(ZMQ_CURVE_SECRETKEY, curve25519Sk.data(), curve25519Sk.size())
+  setSockOpt(ZMQ_CURVE_SECRETKEY, keys.secretKey.data(), keys.secretKey.size())
       .value();
 
   // Apply public-key on the socket
-  setSockOpt(ZMQ_CURVE_PUBLICKEY, curve25519Pk.data(), curve25519Pk.size())
+  setSockOpt(ZMQ_CURVE_PUBLICKEY, keys.publicKey.data(), keys.publicKey.size())
       .value();
 
   return folly::Unit();
 }
 
-void
-SocketImpl::setCurveServerSocketKey(const std::string& publicKey) noexcept {
-  CHECK_EQ(crypto_sign_ed25519_PUBLICKEYBYTES, publicKey.length());
-  // first convert signature ed25519 key to encoded encryption curve25519 key
-
-  // 1) string -> byte
-  std::array<uint8_t, crypto_sign_ed25519_PUBLICKEYBYTES> ed25519Pk;
-  ::memcpy(ed25519Pk.data(), publicKey.data(), publicKey.length());
-
-  // 2) convert signature ed25519 key to encryption curve25519 key
-  std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> curve25519Pk;
-  if (::crypto_sign_ed25519_pk_to_curve25519(
-          curve25519Pk.data(), ed25519Pk.data()) != 0) {
-    return;
-  }
-
-  // 3) set server's public key
-  setSockOpt(ZMQ_CURVE_SERVERKEY, curve25519Pk.data(), curve25519Pk.size())
-      .value();
-}
-
 } // namespace detail
 } // namespace fbzmq
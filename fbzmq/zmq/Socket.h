@@ -9,13 +9,20 @@
 
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <memory>
+#include <tuple>
+#include <utility>
 
 #include <boost/serialization/strong_typedef.hpp>
 
 #include <fbzmq/zmq/Common.h>
 #include <fbzmq/zmq/Context.h>
 #include <fbzmq/zmq/Message.h>
+#include <fbzmq/zmq/MessageBatch.h>
+#include <fbzmq/zmq/SerializeBuffer.h>
+#include <fbzmq/zmq/SocketStats.h>
 
 namespace fbzmq {
 
@@ -30,6 +37,28 @@ BOOST_STRONG_TYPEDEF(std::string, IdentityString)
 BOOST_STRONG_TYPEDEF(std::string, PublicKey)
 BOOST_STRONG_TYPEDEF(bool, NonblockingFlag)
 
+/**
+ * Security of socket's endpoints on the same host, for sockets with key pair.
+ * By default every endpoint uses CURVE. Peers must use the same policy, as
+ * both sides of a connection have to agree on its security mechanism.
+ */
+struct SecurityPolicy {
+  // use no encryption for inproc:// endpoints, peers can't be in another
+  // process anyway
+  bool plainInproc{false};
+
+  // use no encryption for ipc:// endpoints, access is controlled by file
+  // permissions of socket's path instead
+  bool plainIpc{false};
+
+  // Servers also bind their tcp endpoints to an inproc alias registered
+  // with the context, and clients connect to the alias instead of the tcp
+  // url when their server is in the same context. Transparent to user,
+  // traffic between sockets of a process then bypasses TCP (and CURVE if
+  // plainInproc is set too).
+  bool promoteToInproc{false};
+};
+
 /**
  * Used to specify socket mode as part of type signature
  */
@@ -102,6 +131,21 @@ class SocketImpl {
   folly::Expected<folly::Unit, Error> getSockOpt(
       int option, void* optval, size_t* len) noexcept;
 
+  /**
+   * Set ZMQ_RCVTIMEO of socket (none means block indefinitely). Timeout is
+   * cached, `recvOne` calls without timeout or with the same timeout then
+   * leave waiting to zmq's blocking receive instead of polling the socket on
+   * every call. Intended for request/response clients using same timeout
+   * for every receive. Setting ZMQ_RCVTIMEO via `setSockOpt` has same effect.
+   */
+  folly::Expected<folly::Unit, Error> setRecvTimeout(
+      folly::Optional<std::chrono::milliseconds> timeout) noexcept;
+
+  folly::Optional<std::chrono::milliseconds>
+  getRecvTimeout() const noexcept {
+    return recvTimeout_;
+  }
+
   /**
    * Convenient API to set TCP keep alive settings on a socket. We often need
    * to set multiple socket options to turn keep alive settings.
@@ -117,13 +161,46 @@ class SocketImpl {
    */
   void close() noexcept;
 
+  /**
+   * Security of local endpoints, look at SecurityPolicy. Applies to binds and
+   * connects made afterwards.
+   */
+  void
+  setSecurityPolicy(SecurityPolicy policy) noexcept {
+    securityPolicy_ = policy;
+  }
+
+  SecurityPolicy
+  getSecurityPolicy() const noexcept {
+    return securityPolicy_;
+  }
+
+  /**
+   * Start counting I/O of this socket, look at SocketStats. Counters live in
+   * a block of their own allocated here, touched only by the thread using the
+   * socket, so they don't share cache lines with other sockets' state.
+   * Sockets without stats only pay for a branch per frame. Enabling again
+   * resets counters.
+   */
+  void enableStats(bool measureLatency = false);
+
+  void disableStats() noexcept;
+
+  /**
+   * Counters since stats got enabled, none if they are not
+   */
+  folly::Optional<SocketStats> getStats() const noexcept;
+
   /**
    * Send/receive methods
    */
 
   /**
    * Receive single message, atomically. Will or will not block depending on
-   * socket operations mode. default timeout is indefinite
+   * socket operations mode. default timeout is indefinite (or receive timeout
+   * of socket if set, look at `setRecvTimeout`).
+   *
+   * Queued message is received right away without polling the socket.
    */
   folly::Expected<Message, Error> recvOne(
       folly::Optional<std::chrono::milliseconds> timeout = folly::none) const
@@ -241,6 +318,117 @@ class SocketImpl {
   folly::Expected<size_t, Error> sendMultiple(
       std::vector<Message> const& msgs, bool hasMore = false) const;
 
+  /**
+   * Receive up to `maxMessages` whole (multipart) messages in one call and
+   * append them to `batch`. Only the first message is waited for (honoring
+   * timeout, like `recvOne`), the rest of them are drained without blocking
+   * from what is already queued on the socket. End of message is detected
+   * with `zmq_msg_more` instead of extra ZMQ_RCVMORE lookups.
+   *
+   * Returns number of messages received. Error is returned only if no
+   * message could be received at all.
+   */
+  folly::Expected<size_t, Error> recvBatch(
+      MessageBatch& batch,
+      size_t maxMessages,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none) const
+      noexcept;
+
+  /**
+   * Send all messages of `batch` in order. Frames are handed over to zmq
+   * without copying. Sent messages are removed from the batch, on error the
+   * unsent ones are left in it so that caller can retry them later (e.g. on
+   * EAGAIN for non-blocking socket). Multipart message which failed after
+   * some of its frames had been sent is dropped, as it can't be retried.
+   *
+   * Returns number of whole messages sent. Error is returned if not even the
+   * first message could be sent.
+   */
+  folly::Expected<size_t, Error> sendBatch(MessageBatch& batch) const noexcept;
+
+  /**
+   * Typed multipart send. Every argument becomes a frame of the message, in
+   * order. Supported frame types are fundamentals (encoded as raw bytes),
+   * std::string and Message (moved if passed as rvalue, shared otherwise),
+   * e.g.
+   *
+   *  socket.sendFrames(uint32_t(1), std::string("foo"), std::move(msg));
+   *
+   * Frames are built in place in a stack allocated array and handed over to
+   * zmq directly, there are no intermediate copies of messages. Fundamentals
+   * fit into zmq's inline (VSM) storage and need no allocation at all.
+   */
+  template <typename... Ts>
+  folly::Expected<size_t, Error>
+  sendFrames(Ts&&... args) const noexcept {
+    static_assert(sizeof...(Ts) > 0, "at least one frame is required");
+    std::array<Message, sizeof...(Ts)> frames;
+    if (not encodeFrames(
+            frames,
+            std::index_sequence_for<Ts...>{},
+            std::forward<Ts>(args)...)) {
+      return folly::makeUnexpected(Error(ENOMEM));
+    }
+    return sendFrameArray(frames.data(), frames.size());
+  }
+
+  /**
+   * Typed multipart receive, counterpart of `sendFrames`. Receives message of
+   * exactly sizeof...(Ts) frames and decodes them into a tuple, e.g.
+   *
+   *  auto ret = socket.recvFrames<uint32_t, std::string, Message>();
+   *
+   * Returns EPROTO error if number of frames does not match (the whole
+   * message is consumed nonetheless) or fundamental frame is of wrong size.
+   */
+  template <typename... Ts>
+  folly::Expected<std::tuple<Ts...>, Error>
+  recvFrames(folly::Optional<std::chrono::milliseconds> timeout =
+                 folly::none) const noexcept {
+    static_assert(sizeof...(Ts) > 0, "at least one frame is required");
+    std::array<Message, sizeof...(Ts)> frames;
+    auto ret = recvFrameArray(frames.data(), frames.size(), timeout);
+    if (ret.hasError()) {
+      return folly::makeUnexpected(ret.error());
+    }
+    std::tuple<Ts...> result;
+    if (not decodeFrames(frames, result, std::index_sequence_for<Ts...>{})) {
+      return folly::makeUnexpected(Error(EPROTO));
+    }
+    return std::move(result);
+  }
+
+  /**
+   * Zero-copy scatter-gather send of an IOBuf chain. Every link of the chain
+   * is sent as a separate frame of multipart message without coalescing, e.g.
+   *
+   *  socket.sendChain(util::writeThriftObj(obj, serializer));
+   *
+   * Use `recvChain` on receiving side to stitch frames back together. If
+   * `hasMore` is set then more frames are expected to follow the chain.
+   */
+  folly::Expected<size_t, Error> sendChain(
+      std::unique_ptr<folly::IOBuf> buf, bool hasMore = false) const;
+
+  /**
+   * Receive single message and expose it as an IOBuf. Received zmq buffer is
+   * adopted by the IOBuf, no data is copied. IOBuf is the only owner of the
+   * buffer and can be passed to other threads.
+   */
+  folly::Expected<std::unique_ptr<folly::IOBuf>, Error> recvIOBuf(
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none) const
+      noexcept;
+
+  /**
+   * Receive all remaining frames of a multipart message and stitch them into
+   * an IOBuf chain, one link per frame. Received zmq buffers are adopted by
+   * the IOBufs, no data is copied. Chain can be passed to other threads and
+   * buffers are released when IOBufs are destroyed.
+   */
+  folly::Expected<std::unique_ptr<folly::IOBuf>, Error> recvChain(
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none) const
+      noexcept;
+
   /**
    * Convenience methods to recv/send thrift objects as messages
    */
@@ -261,7 +449,7 @@ class SocketImpl {
   template <typename ThriftType, typename Serializer>
   folly::Expected<size_t, Error>
   sendThriftObj(const ThriftType& obj, Serializer& serializer) const noexcept {
-    auto msg = Message::fromThriftObj(obj, serializer);
+    auto msg = SerializeBuffer::get().toMessage(obj, serializer);
     return msg.hasError() ? folly::makeUnexpected(msg.error())
                           : sendOne(msg.value());
   }
@@ -322,9 +510,138 @@ class SocketImpl {
   folly::Expected<size_t, Error> send(Message msg, int flags) const noexcept;
 
   /**
-   * low-level recv method
+   * low-level recv method. EAGAIN of a probe for already queued message
+   * isn't counted in stats, it doesn't mean that socket is backpressured.
    */
-  folly::Expected<Message, Error> recv(int flags) const noexcept;
+  folly::Expected<Message, Error> recv(
+      int flags, bool isProbe = false) const noexcept;
+
+  /**
+   * Stats accounting of a zmq send/receive call, given its return value.
+   * Must only be called if stats are enabled and before zmq_errno() could
+   * change. Start time is only taken if latency is measured.
+   */
+  using StatsClock = std::chrono::steady_clock;
+
+  StatsClock::time_point
+  getStatsStart() const noexcept {
+    return stats_ and stats_->measureLatency ? StatsClock::now()
+                                             : StatsClock::time_point();
+  }
+
+  void countSend(int n, int flags, StatsClock::time_point start) const
+      noexcept;
+  void countRecv(int n, zmq_msg_t* msg, StatsClock::time_point start) const
+      noexcept;
+
+  /**
+   * Wait for socket to become readable. Returns EAGAIN error on timeout.
+   */
+  folly::Expected<folly::Unit, Error> waitReadable(
+      folly::Optional<std::chrono::milliseconds> timeout) const noexcept;
+
+  /**
+   * Array based multipart send/recv backing `sendFrames` and `recvFrames`
+   */
+  folly::Expected<size_t, Error> sendFrameArray(
+      Message* frames, size_t numFrames) const noexcept;
+  folly::Expected<folly::Unit, Error> recvFrameArray(
+      Message* frames,
+      size_t numFrames,
+      folly::Optional<std::chrono::milliseconds> timeout) const noexcept;
+
+  /**
+   * Frame encoding/decoding for typed multipart API
+   */
+
+  // Re-initialize frame with buffer of given size
+  static bool initFrame(Message& frame, size_t size) noexcept;
+
+  template <
+      typename T,
+      std::enable_if_t<std::is_fundamental<std::decay_t<T>>::value>* = nullptr>
+  static bool
+  encodeFrame(Message& frame, T value) noexcept {
+    if (not initFrame(frame, sizeof(T))) {
+      return false;
+    }
+    ::memcpy(frame.writeableData().data(), &value, sizeof(T));
+    return true;
+  }
+
+  static bool
+  encodeFrame(Message& frame, std::string const& str) noexcept {
+    if (not initFrame(frame, str.size())) {
+      return false;
+    }
+    ::memcpy(frame.writeableData().data(), str.data(), str.size());
+    return true;
+  }
+
+  static bool
+  encodeFrame(Message& frame, Message const& msg) noexcept {
+    frame = msg;
+    return true;
+  }
+
+  static bool
+  encodeFrame(Message& frame, Message&& msg) noexcept {
+    frame = std::move(msg);
+    return true;
+  }
+
+  template <
+      typename T,
+      std::enable_if_t<std::is_fundamental<T>::value>* = nullptr>
+  static bool
+  decodeFrame(Message& frame, T& value) noexcept {
+    if (frame.size() != sizeof(T)) {
+      return false;
+    }
+    ::memcpy(&value, frame.data().data(), sizeof(T));
+    return true;
+  }
+
+  static bool
+  decodeFrame(Message& frame, std::string& str) noexcept {
+    str.assign(
+        reinterpret_cast<const char*>(frame.data().data()), frame.size());
+    return true;
+  }
+
+  static bool
+  decodeFrame(Message& frame, Message& msg) noexcept {
+    msg = std::move(frame);
+    return true;
+  }
+
+  template <size_t N, size_t... Is, typename... Ts>
+  static bool
+  encodeFrames(
+      std::array<Message, N>& frames,
+      std::index_sequence<Is...>,
+      Ts&&... args) noexcept {
+    bool ok = true;
+    // braced initializer list guarantees left to right evaluation and stops
+    // at first failure
+    const int expand[] = {
+        (ok = ok && encodeFrame(frames[Is], std::forward<Ts>(args)), 0)...};
+    (void)expand;
+    return ok;
+  }
+
+  template <size_t N, typename Tuple, size_t... Is>
+  static bool
+  decodeFrames(
+      std::array<Message, N>& frames,
+      Tuple& result,
+      std::index_sequence<Is...>) noexcept {
+    bool ok = true;
+    const int expand[] = {
+        (ok = ok && decodeFrame(frames[Is], std::get<Is>(result)), 0)...};
+    (void)expand;
+    return ok;
+  }
 
   /**
    * Crypto stuff
@@ -337,13 +654,29 @@ class SocketImpl {
       const KeyPair& keyPair) noexcept;
 
   /**
-   * attach server key to the socket
+   * Select security mechanism for next bind/connect to `url` according to
+   * security policy, returns whether it uses CURVE
    */
-  void setCurveServerSocketKey(const std::string& publicKey) noexcept;
+  bool selectSecurity(std::string const& url, bool isBind) noexcept;
+
+  // bind/connect to url as is
+  folly::Expected<folly::Unit, Error> bindUrl(std::string const& url) noexcept;
+  folly::Expected<folly::Unit, Error> connectUrl(
+      std::string const& url, std::string const& serverKeyUrl) noexcept;
+
+  // socket setup common to constructors
+  void init(
+      int type,
+      bool isServer,
+      folly::Optional<IdentityString> identity,
+      NonblockingFlag isNonblocking);
 
   // used to store ZMQ_DONTWAIT
   int baseFlags_{0};
 
+  // cached value of ZMQ_RCVTIMEO, none if it is indefinite
+  folly::Optional<std::chrono::milliseconds> recvTimeout_;
+
   // pointer to socket object. alas, this can not be const
   // since we update it in move constructor
   void* ptr_{nullptr};
@@ -352,12 +685,30 @@ class SocketImpl {
   // SocketMonitor object
   void* ctxPtr_{nullptr};
 
+  // key cache and server key registry of the context, null for sockets
+  // created from raw context pointer
+  CurveKeyCache* keyCache_{nullptr};
+
+  // inproc aliases of tcp endpoints of the context, null for sockets
+  // created from raw context pointer
+  LocalEndpoints* localEndpoints_{nullptr};
+
   // the crypto key pair.
   folly::Optional<KeyPair> keyPair_;
 
-  // public keys for use with servers
-  std::unordered_map<std::string /* server url */, std::string /* pub key */>
+  SecurityPolicy securityPolicy_;
+
+  // inproc aliases of endpoints bound/connected by this socket
+  std::unordered_map<std::string /* url */, std::string /* alias */>
+      promotedUrls_;
+
+  // converted public keys for use with servers, take precedence over keys
+  // registered with context
+  std::unordered_map<std::string /* server url */, CurveKeyCache::CurveKey>
       serverKeys_;
+
+  // I/O counters, null unless enabled
+  std::unique_ptr<SocketStats> stats_;
 };
 
 /**
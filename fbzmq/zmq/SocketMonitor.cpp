@@ -9,8 +9,29 @@
 
 #include <fbzmq/zmq/SocketMonitor.h>
 
+#include <algorithm>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+
 namespace fbzmq {
 
+namespace {
+
+// events tracked in health stats along with their names
+const std::vector<std::pair<SocketMonitorMessage, const char*>>
+    kHealthEvents = {
+        {SocketMonitorMessage::CONNECTED, "connected"},
+        {SocketMonitorMessage::CONNECT_RETRIED, "connect_retried"},
+        {SocketMonitorMessage::ACCEPTED, "accepted"},
+        {SocketMonitorMessage::DISCONNECTED, "disconnected"},
+        {SocketMonitorMessage::CLOSED, "closed"},
+        {SocketMonitorMessage::BIND_FAILED, "bind_failed"},
+        {SocketMonitorMessage::ACCEPT_FAILED, "accept_failed"},
+        {SocketMonitorMessage::HANDSHAKE_FAILED, "handshake_failed"},
+};
+
+} // namespace
+
 SocketMonitor::SocketMonitor(
     detail::SocketImpl const& sock, SocketUrl monitorUrl, CallbackT cb) noexcept
     : pairSock_{const_cast<void*>(sock.ctxPtr_)}, cb_{std::move(cb)} {
@@ -23,7 +44,61 @@ SocketMonitor::SocketMonitor(
   cb_(SocketMonitorMessage::STARTED, SocketUrl{});
 }
 
+SocketMonitor::~SocketMonitor() {
+  detach();
+}
+
 // public
+void
+SocketMonitor::attachTo(ZmqEventLoop& evl) {
+  CHECK(!evl_) << "SocketMonitor is already attached to a loop";
+  evl_ = &evl;
+  evl.addSocket(RawZmqSocketPtr{**this}, ZMQ_POLLIN, [this](int) noexcept {
+    // consume all queued events, edge triggered pollers notify only once
+    while (evl_) {
+      const auto ret = processEvent(std::chrono::milliseconds(0));
+      if (ret.hasError()) {
+        if (ret.error().errNum == EAGAIN) {
+          break;
+        }
+        LOG(ERROR) << "Failed receiving monitor event: " << ret.error();
+        detach();
+      } else if (not ret.value()) {
+        detach();
+      }
+    }
+  });
+}
+
+void
+SocketMonitor::detach() {
+  if (not evl_) {
+    return;
+  }
+  evl_->removeSocket(RawZmqSocketPtr{**this});
+  evl_ = nullptr;
+}
+
+void
+SocketMonitor::exportHealthStats(
+    ThreadData& tData, std::string const& prefix) {
+  health_ = std::make_unique<HealthStats>();
+  health_->tData = &tData;
+  for (auto const& kv : kHealthEvents) {
+    const auto handle = tData.registerStat(prefix + "." + kv.second);
+    tData.addStatExportType(handle, SUM);
+    tData.addStatExportType(handle, COUNT_RATE);
+    health_->eventStats.emplace(kv.first, handle);
+  }
+  health_->connectLatency = tData.registerStat(prefix + ".connect_latency_ms");
+  tData.addStatExportType(health_->connectLatency, AVG);
+  tData.addStatExportType(health_->connectLatency, P50);
+  tData.addStatExportType(health_->connectLatency, P99);
+  tData.addStatExportType(health_->connectLatency, P999);
+  health_->connections = tData.registerCounter(prefix + ".connections");
+  tData.setCounter(health_->connections, 0);
+}
+
 folly::Expected<folly::Unit, Error>
 SocketMonitor::runForever() noexcept {
   std::vector<fbzmq::PollItem> pollItems = {
@@ -48,11 +123,18 @@ SocketMonitor::runForever() noexcept {
 
 folly::Expected<bool, Error>
 SocketMonitor::runOnce() noexcept {
+  return processEvent(folly::none);
+}
+
+// private
+folly::Expected<bool, Error>
+SocketMonitor::processEvent(
+    folly::Optional<std::chrono::milliseconds> timeout) noexcept {
   EventT event;
   std::string address;
 
   {
-    auto maybeMsg = pairSock_.recvOne();
+    auto maybeMsg = pairSock_.recvOne(timeout);
     if (maybeMsg.hasError()) {
       return folly::makeUnexpected(maybeMsg.error());
     }
@@ -74,45 +156,101 @@ SocketMonitor::runOnce() noexcept {
     return false;
   }
 
-  const auto url = SocketUrl{address};
-
+  folly::Optional<SocketMonitorMessage> msg;
   switch (event.event) {
   case ZMQ_EVENT_CONNECTED:
-    cb_(SocketMonitorMessage::CONNECTED, url);
+    msg = SocketMonitorMessage::CONNECTED;
     break;
   case ZMQ_EVENT_CONNECT_DELAYED:
-    cb_(SocketMonitorMessage::CONNECT_DELAYED, url);
+    msg = SocketMonitorMessage::CONNECT_DELAYED;
     break;
   case ZMQ_EVENT_CONNECT_RETRIED:
-    cb_(SocketMonitorMessage::CONNECT_RETRIED, url);
+    msg = SocketMonitorMessage::CONNECT_RETRIED;
     break;
   case ZMQ_EVENT_LISTENING:
-    cb_(SocketMonitorMessage::LISTENING, url);
+    msg = SocketMonitorMessage::LISTENING;
     break;
   case ZMQ_EVENT_BIND_FAILED:
-    cb_(SocketMonitorMessage::BIND_FAILED, url);
+    msg = SocketMonitorMessage::BIND_FAILED;
     break;
   case ZMQ_EVENT_ACCEPTED:
-    cb_(SocketMonitorMessage::ACCEPTED, url);
+    msg = SocketMonitorMessage::ACCEPTED;
     break;
   case ZMQ_EVENT_ACCEPT_FAILED:
-    cb_(SocketMonitorMessage::ACCEPT_FAILED, url);
+    msg = SocketMonitorMessage::ACCEPT_FAILED;
     break;
   case ZMQ_EVENT_CLOSED:
-    cb_(SocketMonitorMessage::CLOSED, url);
+    msg = SocketMonitorMessage::CLOSED;
     break;
   case ZMQ_EVENT_CLOSE_FAILED:
-    cb_(SocketMonitorMessage::CLOSE_FAILED, url);
+    msg = SocketMonitorMessage::CLOSE_FAILED;
     break;
   case ZMQ_EVENT_DISCONNECTED:
-    cb_(SocketMonitorMessage::DISCONNECTED, url);
+    msg = SocketMonitorMessage::DISCONNECTED;
+    break;
+#ifdef ZMQ_EVENT_HANDSHAKE_FAILED_NO_DETAIL
+  case ZMQ_EVENT_HANDSHAKE_FAILED_NO_DETAIL:
+  case ZMQ_EVENT_HANDSHAKE_FAILED_PROTOCOL:
+  case ZMQ_EVENT_HANDSHAKE_FAILED_AUTH:
+    msg = SocketMonitorMessage::HANDSHAKE_FAILED;
     break;
+  case ZMQ_EVENT_HANDSHAKE_SUCCEEDED:
+    // nothing to report, connection has been reported already
+    return true;
+#endif
   default:
     LOG(ERROR) << "Unknown event: " << event.event;
-    break;
+    return true;
   } // switch
 
+  if (health_) {
+    updateHealthStats(*msg, address);
+  }
+  cb_(*msg, SocketUrl{address});
+
   return true;
 }
 
+void
+SocketMonitor::updateHealthStats(
+    SocketMonitorMessage msg, std::string const& address) noexcept {
+  auto& health = *health_;
+  auto& tData = *health.tData;
+
+  auto it = health.eventStats.find(msg);
+  if (it != health.eventStats.end()) {
+    tData.addStatValue(it->second, 1);
+  }
+
+  switch (msg) {
+  case SocketMonitorMessage::CONNECT_DELAYED:
+  case SocketMonitorMessage::CONNECT_RETRIED:
+    // keeps the time of first attempt if already connecting
+    health.connectStarts.emplace(address, std::chrono::steady_clock::now());
+    break;
+  case SocketMonitorMessage::CONNECTED: {
+    auto start = health.connectStarts.find(address);
+    if (start != health.connectStarts.end()) {
+      tData.addStatValue(
+          health.connectLatency,
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - start->second)
+              .count());
+      health.connectStarts.erase(start);
+    }
+    tData.setCounter(health.connections, ++health.numConnections);
+    break;
+  }
+  case SocketMonitorMessage::ACCEPTED:
+    tData.setCounter(health.connections, ++health.numConnections);
+    break;
+  case SocketMonitorMessage::DISCONNECTED:
+    health.numConnections = std::max<int64_t>(0, health.numConnections - 1);
+    tData.setCounter(health.connections, health.numConnections);
+    break;
+  default:
+    break;
+  }
+}
+
 } // namespace fbzmq
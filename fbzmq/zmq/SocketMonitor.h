@@ -9,12 +9,21 @@
 
 #pragma once
 
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
 #include <folly/Function.h>
 
+#include <fbzmq/service/stats/ThreadData.h>
 #include <fbzmq/zmq/Socket.h>
 
 namespace fbzmq {
 
+class ZmqEventLoop;
+
 enum class SocketMonitorMessage {
   STARTED,
   CONNECTED,
@@ -27,12 +36,19 @@ enum class SocketMonitorMessage {
   CLOSED,
   CLOSE_FAILED,
   DISCONNECTED,
+  // handshake (e.g. CURVE authentication) with peer failed, reported only by
+  // libzmq versions supporting handshake events
+  HANDSHAKE_FAILED,
 };
 
 /**
  * Socket monitor creates new PAIR socket that observes even on monitored
  * socket and reports it down. It runs synchronous loop and invokes the
- * callback
+ * callback, or consumes events in an existing ZmqEventLoop (`attachTo`) so
+ * that any number of sockets can be monitored without a thread each.
+ *
+ * Optionally it keeps connection health metrics of the monitored socket in a
+ * ThreadData, look at `exportHealthStats`.
  */
 class SocketMonitor {
  public:
@@ -61,6 +77,11 @@ class SocketMonitor {
   SocketMonitor(SocketMonitor const&) = delete;
   SocketMonitor& operator=(SocketMonitor const&) = delete;
 
+  /**
+   * Detaches from event loop if attached, look at `attachTo`
+   */
+  ~SocketMonitor();
+
   /**
    * Starts the monitoring loop, until the monitored socket closes. this
    * should run in a new thread to avoid blocking
@@ -74,6 +95,38 @@ class SocketMonitor {
    */
   folly::Expected<bool, Error> runOnce() noexcept;
 
+  /**
+   * Consume events in given loop as they arrive, instead of `runForever` or
+   * `runOnce`. Monitor removes itself from the loop once monitored socket
+   * closes (or on error). Callback is invoked in loop's thread. Must be
+   * called from loop's thread (or before loop runs), and so must be the
+   * destruction of the monitor.
+   */
+  void attachTo(ZmqEventLoop& evl);
+
+  /**
+   * Stop consuming events in the loop, no-op if not attached
+   */
+  void detach();
+
+  bool
+  isAttached() const {
+    return evl_ != nullptr;
+  }
+
+  /**
+   * Maintain connection health metrics of monitored socket in `tData`, under
+   * keys prefixed by `prefix`, updated in the thread consuming the events:
+   *
+   *  <prefix>.<event> - stat per event type (connected, connect_retried,
+   *    accepted, disconnected, closed, bind_failed, accept_failed,
+   *    handshake_failed), exported as SUM and COUNT_RATE (events/sec)
+   *  <prefix>.connect_latency_ms - stat of time from first delayed or retried
+   *    connect to an url until connected, exported as AVG and percentiles
+   *  <prefix>.connections - flat counter of established connections
+   */
+  void exportHealthStats(ThreadData& tData, std::string const& prefix);
+
   /**
    * return raw pointer to the pair socket so it could be added to event loops
    */
@@ -90,11 +143,35 @@ class SocketMonitor {
     int32_t data;
   };
 
+  struct HealthStats {
+    ThreadData* tData{nullptr};
+    std::map<SocketMonitorMessage, StatHandle> eventStats;
+    StatHandle connectLatency;
+    CounterHandle connections;
+    int64_t numConnections{0};
+    // start of connect attempts by url, until connected
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point>
+        connectStarts;
+  };
+
+  // consume single event, waiting for it up to `timeout`
+  folly::Expected<bool, Error> processEvent(
+      folly::Optional<std::chrono::milliseconds> timeout) noexcept;
+
+  void updateHealthStats(
+      SocketMonitorMessage msg, std::string const& address) noexcept;
+
   // this socket will be used to report monitored socket events
   Socket<ZMQ_PAIR, ZMQ_CLIENT> pairSock_;
 
   // we'll call this method on any event
   CallbackT cb_;
+
+  // loop consuming events, if attached
+  ZmqEventLoop* evl_{nullptr};
+
+  // connection health metrics, if exported
+  std::unique_ptr<HealthStats> health_;
 };
 
 } // namespace fbzmq
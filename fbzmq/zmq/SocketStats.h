@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace fbzmq {
+
+/**
+ * I/O counters of a single socket, look at `SocketImpl::enableStats`. Frames
+ * are counted by zmq send/receive calls, messages by their last frame.
+ * EINTR retries are not errors, EAGAIN (no message to receive, or HWM reached
+ * on non-blocking send) is counted apart from other errors.
+ *
+ * Latencies are nanoseconds spent in zmq send/receive calls (excluding
+ * polling for readability) and only measured if enabled, as it costs two
+ * clock reads per frame.
+ *
+ * Counters are plain integers as a socket is only used by one thread at a
+ * time. Every socket owns a separate heap allocated instance, which isn't
+ * cache line aligned: C++14 `new` doesn't honour over-aligned types, and
+ * sharing a line with a neighbouring allocation only costs on the edges of
+ * a 136 byte struct which is written by the socket's thread alone.
+ */
+struct SocketStats {
+  uint64_t numSentMsgs{0};
+  uint64_t numSentFrames{0};
+  uint64_t numSentBytes{0};
+  uint64_t numSendEagain{0};
+  uint64_t numSendErrors{0};
+  uint64_t numSendRetries{0};
+
+  uint64_t numRecvMsgs{0};
+  uint64_t numRecvFrames{0};
+  uint64_t numRecvBytes{0};
+  uint64_t numRecvEagain{0};
+  uint64_t numRecvErrors{0};
+  uint64_t numRecvRetries{0};
+
+  bool measureLatency{false};
+  uint64_t sendLatencyNs{0};
+  uint64_t maxSendLatencyNs{0};
+  uint64_t recvLatencyNs{0};
+  uint64_t maxRecvLatencyNs{0};
+
+  double
+  getFramesPerSentMsg() const {
+    return numSentMsgs ? static_cast<double>(numSentFrames) / numSentMsgs : 0;
+  }
+
+  double
+  getFramesPerRecvMsg() const {
+    return numRecvMsgs ? static_cast<double>(numRecvFrames) / numRecvMsgs : 0;
+  }
+};
+
+} // namespace fbzmq
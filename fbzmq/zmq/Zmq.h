@@ -11,9 +11,15 @@
 
 #include <fbzmq/zmq/Common.h>
 #include <fbzmq/zmq/Context.h>
+#include <fbzmq/zmq/KeyCache.h>
+#include <fbzmq/zmq/LocalEndpoints.h>
 #include <fbzmq/zmq/Message.h>
+#include <fbzmq/zmq/MessageBatch.h>
+#include <fbzmq/zmq/MessagePool.h>
+#include <fbzmq/zmq/SerializeBuffer.h>
 #include <fbzmq/zmq/Socket.h>
 #include <fbzmq/zmq/SocketMonitor.h>
+#include <fbzmq/zmq/SocketStats.h>
 
 /**
  * Umbrella to hold all of fbzmq headers
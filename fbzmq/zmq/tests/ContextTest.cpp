@@ -11,6 +11,7 @@
 #include <gtest/gtest.h>
 
 #include <fbzmq/zmq/Context.h>
+#include <fbzmq/zmq/Socket.h>
 
 namespace fbzmq {
 
@@ -22,6 +23,32 @@ TEST(Context, Move) {
   ctx3 = std::move(ctx2);
 }
 
+TEST(Context, Options) {
+  fbzmq::Context ctx(fbzmq::ContextOptions()
+                         .setNumIoThreads(2)
+                         .setNumMaxSockets(64)
+                         .addIoThreadCpu(0)
+                         .setIoThreadNamePrefix(7)
+                         .setIpv6(true)
+                         .setBlocky(false));
+
+  // IO threads start with first socket, sockets work as usual
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(ctx);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  server.bind(fbzmq::SocketUrl{"tcp://127.0.0.1:*"}).value();
+  char endpoint[256];
+  size_t size = sizeof(endpoint);
+  server.getSockOpt(ZMQ_LAST_ENDPOINT, endpoint, &size).value();
+  client.connect(fbzmq::SocketUrl{endpoint}).value();
+  client.sendOne(fbzmq::Message::from(std::string("hello")).value()).value();
+  EXPECT_EQ(
+      "hello",
+      server.recvOne(std::chrono::seconds(5))
+          .value()
+          .read<std::string>()
+          .value());
+}
+
 } // namespace fbzmq
 
 int
@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <cstring>
+#include <thread>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/zmq/Message.h>
+#include <fbzmq/zmq/MessagePool.h>
+
+namespace fbzmq {
+
+TEST(MessagePoolTest, ReuseBuffers) {
+  const auto before = MessagePool::getStats();
+
+  // Tiny and large messages are not pooled
+  Message::allocatePooled(MessagePool::kMaxInlineSize).value();
+  Message::allocatePooled(MessagePool::kMaxPooledSize + 1).value();
+  auto stats = MessagePool::getStats();
+  EXPECT_EQ(before.bypassed + 2, stats.bypassed);
+  EXPECT_EQ(before.hits + before.misses, stats.hits + stats.misses);
+
+  // Freed buffer is handed out again
+  const uint8_t* ptr{nullptr};
+  {
+    auto msg = Message::allocatePooled(100).value();
+    ptr = msg.data().data();
+    EXPECT_EQ(before.outstanding + 1, MessagePool::getStats().outstanding);
+  }
+  {
+    auto msg = Message::allocatePooled(128).value();
+    EXPECT_EQ(ptr, msg.data().data());
+  }
+
+  stats = MessagePool::getStats();
+  EXPECT_EQ(before.outstanding, stats.outstanding);
+  EXPECT_EQ(before.localFrees + 2, stats.localFrees);
+  EXPECT_EQ(before.hits + before.misses + 2, stats.hits + stats.misses);
+  EXPECT_LT(before.hits, stats.hits);
+  EXPECT_LT(0, stats.hitRate());
+}
+
+TEST(MessagePoolTest, PlainAllocateBypassesPool) {
+  const auto before = MessagePool::getStats();
+  Message::allocate(100).value();
+  Message::from(std::string(200, 'a')).value();
+  const auto stats = MessagePool::getStats();
+  EXPECT_EQ(before.hits + before.misses, stats.hits + stats.misses);
+  EXPECT_EQ(before.bypassed, stats.bypassed);
+}
+
+TEST(MessagePoolTest, RemoteFree) {
+  const auto before = MessagePool::getStats();
+
+  // Messages allocated here and destroyed on another thread
+  std::vector<Message> msgs;
+  for (int i = 0; i < 100; ++i) {
+    msgs.emplace_back(Message::allocatePooled(64).value());
+  }
+  EXPECT_EQ(before.outstanding + 100, MessagePool::getStats().outstanding);
+
+  std::thread thread([msgs = std::move(msgs)]() mutable { msgs.clear(); });
+  msgs.clear();
+  thread.join();
+
+  auto stats = MessagePool::getStats();
+  EXPECT_EQ(before.remoteFrees + 100, stats.remoteFrees);
+  EXPECT_EQ(before.outstanding, stats.outstanding);
+
+  // Remotely freed buffers are reclaimed instead of growing the pool
+  for (int i = 0; i < 100; ++i) {
+    msgs.emplace_back(Message::allocatePooled(64).value());
+  }
+  EXPECT_EQ(stats.misses, MessagePool::getStats().misses);
+}
+
+TEST(MessagePoolTest, MessageOutlivesThread) {
+  const std::string str(200, 'z');
+  std::vector<Message> msgs;
+  std::thread thread([&msgs, &str]() {
+    for (int i = 0; i < 10; ++i) {
+      auto msg = Message::allocatePooled(str.size()).value();
+      ::memcpy(msg.writeableData().data(), str.data(), str.size());
+      msgs.emplace_back(std::move(msg));
+    }
+  });
+  thread.join();
+
+  // Arena of exited thread is kept alive by outstanding messages
+  for (auto& msg : msgs) {
+    EXPECT_EQ(str, msg.read<std::string>().value());
+  }
+  msgs.clear();
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
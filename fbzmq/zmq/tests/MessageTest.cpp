@@ -91,6 +91,64 @@ TEST(Message, WrapBuffer) {
   EXPECT_FALSE(buf->isShared());
 }
 
+TEST(Message, WrapBufferChain) {
+  const auto str1 = genRandomStr(64);
+  const auto str2 = genRandomStr(128);
+  const auto str3 = genRandomStr(256);
+  auto chain = folly::IOBuf::copyBuffer(str1);
+  chain->prependChain(folly::IOBuf::create(0)); // empty links are skipped
+  chain->prependChain(folly::IOBuf::copyBuffer(str2));
+  chain->prependChain(folly::IOBuf::copyBuffer(str3));
+  EXPECT_EQ(4, chain->countChainElements());
+
+  // Remember data pointers of links
+  std::vector<const uint8_t*> ptrs;
+  for (auto const& range : *chain) {
+    if (!range.empty()) {
+      ptrs.push_back(range.data());
+    }
+  }
+
+  auto msgs = fbzmq::Message::wrapBufferChain(std::move(chain)).value();
+  ASSERT_EQ(3, msgs.size());
+  std::string data;
+  for (size_t i = 0; i < msgs.size(); ++i) {
+    // Data must not have been copied
+    EXPECT_EQ(ptrs[i], msgs[i].data().data());
+    data.append(
+        reinterpret_cast<const char*>(msgs[i].data().data()), msgs[i].size());
+  }
+  EXPECT_EQ(str1 + str2 + str3, data);
+
+  // Empty chain results in single empty message
+  auto emptyMsgs =
+      fbzmq::Message::wrapBufferChain(folly::IOBuf::create(0)).value();
+  ASSERT_EQ(1, emptyMsgs.size());
+  EXPECT_TRUE(emptyMsgs[0].empty());
+}
+
+TEST(Message, ToIOBuf) {
+  const auto str = genRandomStr(1024);
+  auto msg = fbzmq::Message::from(str).value();
+  const auto ptr = msg.data().data();
+
+  // Shared buffer, data is not copied and outlives message
+  auto shared = msg.toIOBuf();
+  EXPECT_EQ(ptr, shared->data());
+  EXPECT_EQ(str, shared->cloneAsValue().moveToFbString().toStdString());
+
+  // Moved buffer, message is left empty
+  auto moved = std::move(msg).toIOBuf();
+  EXPECT_EQ(ptr, moved->data());
+  EXPECT_TRUE(msg.empty());
+  moved.reset();
+  EXPECT_EQ(str, shared->moveToFbString().toStdString());
+
+  // Small messages are stored inline and must survive message as well
+  auto buf = fbzmq::Message::from(std::string("hello")).value().toIOBuf();
+  EXPECT_EQ("hello", buf->moveToFbString().toStdString());
+}
+
 } // namespace fbzmq
 
 int
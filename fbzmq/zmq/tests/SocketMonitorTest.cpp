@@ -7,12 +7,14 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <atomic>
 #include <thread>
 
 #include <folly/Format.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include <fbzmq/async/ZmqEventLoop.h>
 #include <fbzmq/zmq/SocketMonitor.h>
 
 namespace fbzmq {
@@ -203,6 +205,78 @@ TEST(SocketMonitor, ConnectAsync) {
   EXPECT_FALSE(ret);
 }
 
+//
+// Validate that monitors attached to an event loop consume events in it and
+// maintain health stats
+//
+TEST(SocketMonitor, AttachToLoop) {
+  fbzmq::Context ctx;
+  fbzmq::ZmqEventLoop evl;
+  // only used by loop thread while it runs
+  fbzmq::ThreadData tData;
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_SERVER> server(ctx);
+  const std::string kServerUrl{getSocketUrl("test_attach_to_loop")};
+
+  std::atomic<bool> connected{false};
+  std::atomic<bool> accepted{false};
+  std::atomic<bool> disconnected{false};
+  fbzmq::SocketMonitor serverMonitor(
+      server,
+      fbzmq::SocketUrl{"inproc://server_monitor"},
+      [&](fbzmq::SocketMonitorMessage msg, fbzmq::SocketUrl) {
+        EXPECT_TRUE(evl.isInEventLoop());
+        if (msg == fbzmq::SocketMonitorMessage::ACCEPTED) {
+          accepted = true;
+        } else if (msg == fbzmq::SocketMonitorMessage::DISCONNECTED) {
+          disconnected = true;
+        }
+      });
+  fbzmq::SocketMonitor clientMonitor(
+      client,
+      fbzmq::SocketUrl{"inproc://client_monitor"},
+      [&](fbzmq::SocketMonitorMessage msg, fbzmq::SocketUrl) {
+        if (msg == fbzmq::SocketMonitorMessage::CONNECTED) {
+          connected = true;
+        }
+      });
+  serverMonitor.exportHealthStats(tData, "server");
+  clientMonitor.exportHealthStats(tData, "client");
+  serverMonitor.attachTo(evl);
+  clientMonitor.attachTo(evl);
+  EXPECT_TRUE(serverMonitor.isAttached());
+
+  std::thread evlThread([&evl]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  server.bind(fbzmq::SocketUrl{kServerUrl}).value();
+  client.connect(fbzmq::SocketUrl{kServerUrl}).value();
+  while (not accepted or not connected) {
+    std::this_thread::yield();
+  }
+
+  client.close();
+  while (not disconnected) {
+    std::this_thread::yield();
+  }
+
+  evl.stop();
+  evl.waitUntilStopped();
+  evlThread.join();
+
+  auto counters = tData.getCounters();
+  EXPECT_EQ(1, counters.at("server.accepted.sum.0"));
+  EXPECT_EQ(1, counters.at("server.disconnected.sum.0"));
+  EXPECT_EQ(0, counters.at("server.connections"));
+  EXPECT_EQ(0, counters.at("server.handshake_failed.sum.0"));
+  EXPECT_EQ(1, counters.at("client.connected.sum.0"));
+
+  // server is still monitored, monitor detaches on destruction
+  EXPECT_TRUE(serverMonitor.isAttached());
+  serverMonitor.detach();
+  EXPECT_FALSE(serverMonitor.isAttached());
+}
+
 } // namespace fbzmq
 
 int
@@ -7,6 +7,7 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <set>
 #include <thread>
 
 #include <folly/Random.h>
@@ -14,6 +15,7 @@
 #include <gtest/gtest.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
+#include <fbzmq/service/stats/ThreadData.h>
 #include <fbzmq/zmq/Socket.h>
 #include <fbzmq/zmq/tests/gen-cpp2/Test_types.h>
 
@@ -211,6 +213,44 @@ TEST(Socket, MessageRecvTimeout) {
   }
 }
 
+TEST(Socket, CachedRecvTimeout) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(
+      ctx, folly::none, folly::none, fbzmq::NonblockingFlag{false});
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(
+      ctx, folly::none, folly::none, fbzmq::NonblockingFlag{false});
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  EXPECT_FALSE(server.getRecvTimeout().hasValue());
+  server.setRecvTimeout(100ms).value();
+  EXPECT_EQ(100ms, server.getRecvTimeout().value());
+  int timeoutMs{0};
+  size_t len = sizeof(timeoutMs);
+  server.getSockOpt(ZMQ_RCVTIMEO, &timeoutMs, &len).value();
+  EXPECT_EQ(100, timeoutMs);
+
+  // Default timeout of socket is used
+  auto start = std::chrono::steady_clock::now();
+  auto rcvd = server.recvOne();
+  EXPECT_TRUE(rcvd.hasError());
+  EXPECT_EQ(EAGAIN, rcvd.error().errNum);
+  EXPECT_LE(100ms, std::chrono::steady_clock::now() - start);
+
+  // Queued messages are received right away, with or without timeout
+  client.sendOne(fbzmq::Message::from(std::string("hello")).value()).value();
+  client.sendOne(fbzmq::Message::from(std::string("world")).value()).value();
+  EXPECT_EQ("hello", server.recvOne().value().read<std::string>().value());
+  EXPECT_EQ("world", server.recvOne(10ms).value().read<std::string>().value());
+  EXPECT_TRUE(server.recvOne(10ms).hasError());
+
+  // Option set directly is cached as well
+  const int indefinite = -1;
+  server.setSockOpt(ZMQ_RCVTIMEO, &indefinite, sizeof(indefinite)).value();
+  EXPECT_FALSE(server.getRecvTimeout().hasValue());
+}
+
 //
 // Bounce random messages b/w req/rep sockets
 //
@@ -389,6 +429,70 @@ TEST(Socket, SendRecvString) {
   });
 }
 
+//
+// Test thrift objects sent via retained serialize buffer
+//
+TEST(Socket, SerializeBuffer) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(ctx);
+  CompactSerializer serializer;
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  auto& buffer = fbzmq::SerializeBuffer::get();
+  fbzmq::test::TestValue testValue;
+  auto sendRecv = [&](size_t size) {
+    testValue.value = genRandomStr(size);
+    client.sendThriftObj(testValue, serializer).value();
+    auto rcvd =
+        server.recvThriftObj<fbzmq::test::TestValue>(serializer).value();
+    EXPECT_EQ(testValue.value, rcvd.value);
+  };
+
+  // Steady state of small messages sticks to the same buffer, once buffer
+  // settled after what earlier tests of this thread sent
+  for (int i = 0; i < 300; ++i) {
+    sendRecv(100);
+  }
+  auto stats = buffer.getStats();
+  for (int i = 0; i < 100; ++i) {
+    sendRecv(50 + i);
+  }
+  EXPECT_EQ(stats.numReallocs, buffer.getStats().numReallocs);
+  EXPECT_EQ(stats.numSerialized + 100, buffer.getStats().numSerialized);
+
+  // Queued messages hold only their payload, whatever their size. Buffer
+  // stays with serializer and isn't reallocated for them.
+  stats = buffer.getStats();
+  std::vector<fbzmq::Message> queued;
+  for (size_t size : {300, 1000}) {
+    testValue.value = genRandomStr(size);
+    const auto expected =
+        fbzmq::Message::fromThriftObj(testValue, serializer).value().size();
+    for (int i = 0; i < 1024; ++i) {
+      queued.emplace_back(buffer.toMessage(testValue, serializer).value());
+      EXPECT_EQ(expected, queued.back().size());
+    }
+  }
+  EXPECT_EQ(stats.numReallocs, buffer.getStats().numReallocs);
+  EXPECT_EQ(stats.capacity, buffer.getStats().capacity);
+  queued.clear();
+
+  // Outgrown buffer is replaced by larger one
+  stats = buffer.getStats();
+  sendRecv(100000);
+  EXPECT_EQ(stats.numReallocs + 1, buffer.getStats().numReallocs);
+  EXPECT_LE(100000, buffer.getStats().capacity);
+
+  // and shrunk back once large messages become rare
+  for (int i = 0; i < 1000; ++i) {
+    sendRecv(100);
+  }
+  EXPECT_GT(100000, buffer.getStats().capacity);
+}
+
 //
 // Test reading/writing thrift object via sockets
 //
@@ -751,6 +855,228 @@ TEST(Socket, SendMultipleDynamic) {
   }
 }
 
+//
+// Zero-copy send and receive of IOBuf chain
+//
+TEST(Socket, SendRecvChain) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_ROUTER, fbzmq::ZMQ_SERVER> server(ctx);
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  const auto str1 = genRandomStr(1024);
+  const auto str2 = genRandomStr(4096);
+  auto chain = folly::IOBuf::copyBuffer(str1);
+  chain->prependChain(folly::IOBuf::copyBuffer(str2));
+  EXPECT_EQ(
+      str1.size() + str2.size(), client.sendChain(std::move(chain)).value());
+
+  // Router receives identity frame followed by the frames of chain
+  auto identity = server.recvOne().value();
+  EXPECT_TRUE(server.hasMore());
+  auto buf = server.recvChain(1000ms).value();
+  EXPECT_EQ(2, buf->countChainElements());
+  EXPECT_EQ(str1.size() + str2.size(), buf->computeChainDataLength());
+  EXPECT_EQ(str1 + str2, buf->moveToFbString().toStdString());
+
+  // Chain goes back to client right after identity frame
+  const auto payload = genRandomStr(100);
+  server.sendMore(identity).value();
+  server.sendChain(folly::IOBuf::copyBuffer(payload)).value();
+  auto reply = client.recvChain(1000ms).value();
+  EXPECT_FALSE(reply->isChained());
+  EXPECT_EQ(payload, reply->moveToFbString().toStdString());
+}
+
+TEST(Socket, SendRecvBatch) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(ctx);
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  fbzmq::MessageBatch batch;
+  batch.add(fbzmq::Message::from(std::string("one")).value());
+  batch.add(std::vector<fbzmq::Message>{
+      fbzmq::Message::from(std::string("two")).value(),
+      fbzmq::Message::from(std::string("three")).value(),
+      fbzmq::Message::from(genRandomStr(1024)).value()});
+  batch.add(fbzmq::Message::from(std::string("four")).value());
+  EXPECT_EQ(3, batch.size());
+  EXPECT_EQ(5, batch.getNumFrames());
+  EXPECT_EQ(3, client.sendBatch(batch).value());
+  EXPECT_TRUE(batch.empty());
+
+  // Receive in two rounds, messages are appended to the batch
+  EXPECT_EQ(2, server.recvBatch(batch, 2, 1000ms).value());
+  EXPECT_EQ(1, server.recvBatch(batch, 10, 1000ms).value());
+  ASSERT_EQ(3, batch.size());
+  EXPECT_EQ(1, batch[0].size());
+  EXPECT_EQ("one", batch[0][0].read<std::string>().value());
+  ASSERT_EQ(3, batch[1].size());
+  EXPECT_EQ("three", batch[1][1].read<std::string>().value());
+  EXPECT_EQ(1024, batch[1][2].size());
+  EXPECT_EQ("four", batch[2][0].read<std::string>().value());
+
+  // Nothing left on the wire
+  EXPECT_FALSE(server.recvBatch(batch, 10, 0ms).hasValue());
+  EXPECT_EQ(3, batch.size());
+
+  // Echo batch back as is
+  EXPECT_EQ(3, server.sendBatch(batch).value());
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(3, client.recvBatch(batch, 10, 1000ms).value());
+  EXPECT_EQ(5, batch.getNumFrames());
+  EXPECT_EQ("two", batch[1][0].read<std::string>().value());
+
+  batch.clear();
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(0, batch.getNumFrames());
+}
+
+TEST(Socket, Stats) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(
+      ctx, folly::none, folly::none, NonblockingFlag{true});
+  EXPECT_FALSE(client.getStats().hasValue());
+  client.enableStats();
+  server.enableStats(true /* measureLatency */);
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  // nothing to receive yet
+  EXPECT_TRUE(server.recvOne().hasError());
+
+  client.sendOne(fbzmq::Message::from(std::string("one")).value()).value();
+  client
+      .sendMultiple(
+          fbzmq::Message::from(std::string("two")).value(),
+          fbzmq::Message::from(uint32_t(3)).value())
+      .value();
+  fbzmq::MessageBatch batch;
+  batch.add(fbzmq::Message::from(std::string("four")).value());
+  client.sendBatch(batch).value();
+
+  // moved socket keeps its stats
+  auto client2 = std::move(client);
+  const auto clientStats = client2.getStats().value();
+  EXPECT_EQ(3, clientStats.numSentMsgs);
+  EXPECT_EQ(4, clientStats.numSentFrames);
+  EXPECT_EQ(14, clientStats.numSentBytes);
+  EXPECT_EQ(0, clientStats.numSendErrors);
+  EXPECT_DOUBLE_EQ(4.0 / 3, clientStats.getFramesPerSentMsg());
+  EXPECT_FALSE(clientStats.measureLatency);
+  EXPECT_EQ(0, clientStats.sendLatencyNs);
+
+  EXPECT_EQ(3, server.recvBatch(batch, 10).value());
+  auto serverStats = server.getStats().value();
+  EXPECT_EQ(3, serverStats.numRecvMsgs);
+  EXPECT_EQ(4, serverStats.numRecvFrames);
+  EXPECT_EQ(14, serverStats.numRecvBytes);
+  // one for empty socket at start and one ending the batch
+  EXPECT_EQ(2, serverStats.numRecvEagain);
+  EXPECT_EQ(0, serverStats.numRecvErrors);
+  EXPECT_TRUE(serverStats.measureLatency);
+  EXPECT_LE(serverStats.maxRecvLatencyNs, serverStats.recvLatencyNs);
+
+  fbzmq::ThreadData tData;
+  tData.exportSocketStats("server", serverStats);
+  auto counters = tData.getCounters();
+  EXPECT_EQ(16, counters.size());
+  EXPECT_EQ(4, counters["server.recv.frames"]);
+  EXPECT_EQ(2, counters["server.recv.eagain"]);
+  EXPECT_EQ(1, counters.count("server.recv.latency_us.max"));
+
+  // receive with timeout counts EAGAIN once it times out, not for checking
+  // whether message is queued already
+  EXPECT_TRUE(client2.recvOne(10ms).hasError());
+  server.sendOne(fbzmq::Message::from(std::string("five")).value()).value();
+  EXPECT_TRUE(client2.recvOne(1000ms).hasValue());
+  EXPECT_EQ(1, client2.getStats().value().numRecvEagain);
+  EXPECT_EQ(1, client2.getStats().value().numRecvMsgs);
+
+  server.disableStats();
+  EXPECT_FALSE(server.getStats().hasValue());
+}
+
+TEST(Socket, SendRecvFrames) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(ctx);
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  const auto str = genRandomStr(512);
+  auto msg = fbzmq::Message::from(str).value();
+  const std::string hello("hello");
+  EXPECT_EQ(
+      sizeof(uint32_t) + hello.size() + str.size() + sizeof(double),
+      client.sendFrames(uint32_t(42), hello, std::move(msg), 3.5).value());
+
+  auto frames =
+      server.recvFrames<uint32_t, std::string, fbzmq::Message, double>(1000ms)
+          .value();
+  EXPECT_EQ(42, std::get<0>(frames));
+  EXPECT_EQ(hello, std::get<1>(frames));
+  EXPECT_EQ(str, std::get<2>(frames).read<std::string>().value());
+  EXPECT_EQ(3.5, std::get<3>(frames));
+
+  // Lvalue message is shared, not consumed
+  auto reply = fbzmq::Message::from(str).value();
+  server.sendFrames(reply, true).value();
+  EXPECT_EQ(str.size(), reply.size());
+  auto replyFrames = client.recvFrames<std::string, bool>(1000ms).value();
+  EXPECT_EQ(str, std::get<0>(replyFrames));
+  EXPECT_TRUE(std::get<1>(replyFrames));
+
+  // Mismatching number of frames or size of frame
+  client.sendFrames(uint32_t(1), uint32_t(2), uint32_t(3)).value();
+  auto tooMany = server.recvFrames<uint32_t, uint32_t>(1000ms);
+  ASSERT_TRUE(tooMany.hasError());
+  EXPECT_EQ(EPROTO, tooMany.error().errNum);
+  client.sendFrames(uint32_t(1)).value();
+  auto tooFew = server.recvFrames<uint32_t, uint32_t>(1000ms);
+  ASSERT_TRUE(tooFew.hasError());
+  EXPECT_EQ(EPROTO, tooFew.error().errNum);
+  client.sendFrames(uint64_t(1)).value();
+  auto badSize = server.recvFrames<uint32_t>(1000ms);
+  ASSERT_TRUE(badSize.hasError());
+  EXPECT_EQ(EPROTO, badSize.error().errNum);
+
+  // Socket is still in sync with message boundaries
+  client.sendFrames(std::string("done")).value();
+  EXPECT_EQ(
+      "done", std::get<0>(server.recvFrames<std::string>(1000ms).value()));
+}
+
+TEST(Socket, RecvIOBuf) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(ctx);
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  // Timeout without any message
+  EXPECT_FALSE(server.recvIOBuf(0ms).hasValue());
+
+  const auto payload = genRandomStr(4096);
+  client.sendOne(fbzmq::Message::from(payload).value()).value();
+  auto buf = server.recvIOBuf(1000ms).value();
+  EXPECT_FALSE(buf->isChained());
+
+  // IOBuf is sole owner of the buffer and is free to modify it
+  EXPECT_FALSE(buf->isShared());
+  buf->writableData()[0] = 'x';
+  EXPECT_EQ("x" + payload.substr(1), buf->moveToFbString().toStdString());
+}
+
 //
 // Send multiple messages in a row, dynamic version, more flag set
 //
@@ -948,6 +1274,176 @@ TEST(CryptoSocket, Dealer2Dealer) {
   client.delServerKey(fbzmq::SocketUrl{"inproc://server"});
 }
 
+//
+// Cached conversions are bounded and can be dropped
+//
+TEST(CryptoSocket, KeyCacheEviction) {
+  fbzmq::CurveKeyCache keyCache(2 /* maxCachedKeys */);
+  std::vector<fbzmq::KeyPair> keyPairs;
+  for (int i = 0; i < 3; ++i) {
+    keyPairs.emplace_back(fbzmq::util::genKeyPair());
+  }
+
+  const auto curveKeyPair = keyCache.getKeyPair(keyPairs[0]).value();
+  keyCache.getKeyPair(keyPairs[0]).value();
+  EXPECT_EQ(1, keyCache.getNumConversions());
+  EXPECT_EQ(
+      fbzmq::CurveKeyCache::convertKeyPair(keyPairs[0]).value().secretKey,
+      curveKeyPair.secretKey);
+
+  // removed key pair is converted again
+  keyCache.delKeyPair(keyPairs[0]);
+  keyCache.getKeyPair(keyPairs[0]).value();
+  EXPECT_EQ(2, keyCache.getNumConversions());
+
+  // cache never holds more than its capacity, one of the first two is gone
+  keyCache.getKeyPair(keyPairs[1]).value();
+  keyCache.getKeyPair(keyPairs[2]).value();
+  EXPECT_EQ(4, keyCache.getNumConversions());
+  keyCache.getKeyPair(keyPairs[0]).value();
+  keyCache.getKeyPair(keyPairs[1]).value();
+  EXPECT_LE(5, keyCache.getNumConversions());
+
+  // same for public keys
+  keyCache.getPublicKey(keyPairs[0].publicKey).value();
+  keyCache.delPublicKey(keyPairs[0].publicKey);
+  const auto numConversions = keyCache.getNumConversions();
+  keyCache.getPublicKey(keyPairs[0].publicKey).value();
+  EXPECT_EQ(numConversions + 1, keyCache.getNumConversions());
+}
+
+//
+// Server keys provisioned in context, keys converted once per context
+//
+TEST(CryptoSocket, ContextKeyRegistry) {
+  fbzmq::Context ctx;
+  auto& keyCache = ctx.getKeyCache();
+
+  auto kpClient = fbzmq::util::genKeyPair();
+  auto kpServer = fbzmq::util::genKeyPair();
+
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_SERVER> server{
+      ctx, fbzmq::IdentityString{"server"}, kpServer};
+  server.bind(fbzmq::SocketUrl{"inproc://server"}).value();
+  EXPECT_EQ(1, keyCache.getNumConversions());
+
+  // all keys are rejected if any is invalid
+  EXPECT_TRUE(keyCache
+                  .addServerKeys({{"inproc://server", kpServer.publicKey},
+                                  {"inproc://other", "bad-key"}})
+                  .hasError());
+  EXPECT_FALSE(keyCache.getServerKey("inproc://server").hasValue());
+  keyCache.addServerKeys({{"inproc://server", kpServer.publicKey}}).value();
+  EXPECT_TRUE(keyCache.getServerKey("inproc://server").hasValue());
+
+  // sockets share converted keys, without server keys of their own
+  std::vector<std::unique_ptr<fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT>>>
+      clients;
+  for (int i = 0; i < 3; ++i) {
+    clients.emplace_back(
+        std::make_unique<fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT>>(
+            ctx, folly::none, kpClient));
+    clients.back()->connect(fbzmq::SocketUrl{"inproc://server"}).value();
+    clients.back()
+        ->sendOne(fbzmq::Message::from(std::string("hello")).value())
+        .value();
+  }
+  // server key pair, server public key and client key pair
+  EXPECT_EQ(3, keyCache.getNumConversions());
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(
+        "hello",
+        server.recvOne(std::chrono::seconds(5))
+            .value()
+            .read<std::string>()
+            .value());
+  }
+
+  // unknown server
+  EXPECT_TRUE(
+      clients[0]->connect(fbzmq::SocketUrl{"inproc://other"}).hasError());
+  keyCache.delServerKey("inproc://server");
+  EXPECT_TRUE(
+      clients[0]->connect(fbzmq::SocketUrl{"inproc://server"}).hasError());
+
+  // invalid key of socket's own
+  EXPECT_TRUE(clients[0]
+                  ->addServerKey(
+                      fbzmq::SocketUrl{"inproc://server"},
+                      fbzmq::PublicKey{"bad-key"})
+                  .hasError());
+}
+
+//
+// CURVE is skipped for local endpoints and tcp is promoted to inproc
+//
+TEST(CryptoSocket, LocalSecurityPolicy) {
+  fbzmq::Context ctx;
+  fbzmq::SecurityPolicy policy;
+  policy.plainInproc = true;
+  policy.promoteToInproc = true;
+
+  auto kpClient = fbzmq::util::genKeyPair();
+  auto kpServer = fbzmq::util::genKeyPair();
+
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_SERVER> server{
+      ctx, folly::none, kpServer};
+  server.setSecurityPolicy(policy);
+  server.bind(fbzmq::SocketUrl{"inproc://server"}).value();
+  server.bind(fbzmq::SocketUrl{"tcp://*:55581"}).value();
+
+  // no server key needed for inproc
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> inprocClient{
+      ctx, folly::none, kpClient};
+  inprocClient.setSecurityPolicy(policy);
+  inprocClient.connect(fbzmq::SocketUrl{"inproc://server"}).value();
+
+  // tcp url is transparently promoted to inproc alias, without key as well
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> tcpClient{
+      ctx, folly::none, kpClient};
+  tcpClient.setSecurityPolicy(policy);
+  tcpClient.connect(fbzmq::SocketUrl{"tcp://localhost:55581"}).value();
+  char endpoint[256];
+  size_t size = sizeof(endpoint);
+  tcpClient.getSockOpt(ZMQ_LAST_ENDPOINT, endpoint, &size).value();
+  EXPECT_EQ("inproc://fbzmq-local/local:55581", std::string(endpoint));
+
+  inprocClient.sendOne(fbzmq::Message::from(std::string("one")).value())
+      .value();
+  tcpClient.sendOne(fbzmq::Message::from(std::string("two")).value())
+      .value();
+  std::set<std::string> received;
+  for (int i = 0; i < 2; ++i) {
+    received.insert(server.recvOne(std::chrono::seconds(5))
+                        .value()
+                        .read<std::string>()
+                        .value());
+  }
+  EXPECT_EQ((std::set<std::string>{"one", "two"}), received);
+  tcpClient.disconnect(fbzmq::SocketUrl{"tcp://localhost:55581"}).value();
+
+  // without promotion tcp needs server key
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> remoteClient{
+      ctx, folly::none, kpClient};
+  EXPECT_TRUE(remoteClient.connect(fbzmq::SocketUrl{"tcp://localhost:55581"})
+                  .hasError());
+
+  // alias goes away with tcp endpoint
+  server.unbind(fbzmq::SocketUrl{"tcp://*:55581"}).value();
+  EXPECT_TRUE(tcpClient.connect(fbzmq::SocketUrl{"tcp://localhost:55581"})
+                  .hasError());
+
+  EXPECT_EQ(
+      std::string("local:5000"),
+      fbzmq::LocalEndpoints::getKey("tcp://127.0.0.1:5000").value());
+  EXPECT_EQ(
+      std::string("10.0.0.1:5000"),
+      fbzmq::LocalEndpoints::getKey("tcp://10.0.0.1:5000").value());
+  EXPECT_FALSE(fbzmq::LocalEndpoints::getKey("tcp://*:*").hasValue());
+  EXPECT_FALSE(fbzmq::LocalEndpoints::getKey("ipc://foo").hasValue());
+}
+
 //
 // Publisher sends encrypted messages
 //